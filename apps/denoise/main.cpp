@@ -14,6 +14,7 @@
 #include <media/reader.h>
 #include <media/writer.h>
 #include <media/sample.h>
+#include <media/frame_cache.h>
 #include <image/plane.h>
 #include <image/plane_ops.h>
 #include <image/media_io.h>
@@ -146,6 +147,10 @@ int safemain( int argc, char *argv[] )
 			'T', std::string( "threads" ),
 			"<int>", base::cmd_line::arg<1>,
 			"Number of threads to use for processing", false ),
+		base::cmd_line::option(
+			0, std::string( "cache-size" ),
+			"<int>", base::cmd_line::arg<1>,
+			"Size in MB of the cache of decoded frames, so each frame of the temporal window is read once (default 2048)", false ),
 		base::cmd_line::option(
 			0, std::string( "output-settings" ),
 			"<string>", base::cmd_line::arg<1>,
@@ -176,6 +181,10 @@ int safemain( int argc, char *argv[] )
 		threading::init( tCount );
 	}
 
+	auto &cacheSize = options["cache-size"];
+	if ( cacheSize )
+		media::frame_cache::global().set_budget( static_cast<size_t>( std::max( 0, atoi( cacheSize.value() ) ) ) * 1024 * 1024 );
+
 	std::cout << "CPU features:\n";
 	base::cpu::output( std::cout );
 	std::cout << std::endl;
@@ -380,7 +389,11 @@ int safemain( int argc, char *argv[] )
 		media::container oc = media::writer::open( outputU, tds, outputOptions );
 		for ( size_t ci = 0; ci != c.video_tracks().size(); ++ci )
 		{
-			auto &vt = c.video_tracks()[ci];
+			// the frames of the temporal window are read once for
+			// each output frame they contribute to, so keep them
+			// decoded
+			auto cachedVT = std::make_shared<media::cached_track>( c.video_tracks()[ci], inputU );
+			std::shared_ptr<media::video_track> vt = cachedVT;
 			int64_t fs = vt->begin();
 			int64_t fe = vt->end();
 			if ( frameStart != std::numeric_limits<int64_t>::min() )
@@ -391,9 +404,14 @@ int safemain( int argc, char *argv[] )
 			std::cout << "Processing track '" << vt->name() << "' of '" << inputU.pretty() << "': frames " << fs << " - " << fe << " of " << vt->begin() << " - " << vt->end() << " @ rate " << vt->rate() << std::endl;
 
 
+			// flows between the frame pairs, used to warm start the
+			// solves of the neighbouring pairs of the next frames
+			flow_cache flows;
 			for ( int64_t f = fs; f <= fe; ++f )
 			{
 				std::cout << "Processing frame: " << f << std::endl;
+				flows.prune( f - temporalRadius - 1, f + temporalRadius );
+				cachedVT->pin( f - temporalRadius, f + temporalRadius );
 				image_buf centerImg;
 				image_buf weight;
 				plane cenAlpha;
@@ -573,6 +591,7 @@ int safemain( int argc, char *argv[] )
 						}
 
 						vector_field vf, vb;
+						plane vecConf;
 						if ( temporalmethod == "patchmatch" )
 							vf = patch_match( tmpCen, tmpImg, plane(), f, curF, matchRadius, patch_style::SSD, tempIters );
 						else if ( temporalmethod == "hierpatch" )
@@ -592,9 +611,17 @@ int safemain( int argc, char *argv[] )
 
 							plane lumA = tmpCen[0] * 0.3F + tmpCen[1] * 0.6F + tmpCen[2] * 0.1F;
 							plane lumB = tmpImg[0] * 0.3F + tmpImg[1] * 0.6F + tmpImg[2] * 0.1F;
-							vf = oflow_ahtvl1( lumA, lumB, plane(), plane(), vector_field(), lambda, theta, epsilon, edgePower, edgeAlpha, edgeBorder, tvl1Iters, warpIters, eta );
 							if ( confThresh > 0.F )
-								vb = oflow_ahtvl1( lumB, lumA, plane(), plane(), vector_field(), lambda, theta, epsilon, edgePower, edgeAlpha, edgeBorder, tvl1Iters, warpIters, eta );
+							{
+								flow_pair fp = oflow_ahtvl1_bidir( lumA, lumB, plane(), plane(), flows.predict( f, curF ), flows.predict( curF, f ), lambda, theta, epsilon, edgePower, edgeAlpha, edgeBorder, tvl1Iters, warpIters, true, eta, conservativeness );
+								vf = fp.forward;
+								vb = fp.backward;
+								vecConf = fp.consistency;
+								flows.store( curF, f, vb );
+							}
+							else
+								vf = oflow_ahtvl1( lumA, lumB, plane(), plane(), flows.predict( f, curF ), lambda, theta, epsilon, edgePower, edgeAlpha, edgeBorder, tvl1Iters, warpIters, true, eta );
+							flows.store( f, curF, vf );
 						}
 						else if ( temporalmethod == "pdtncc" )
 						{
@@ -621,6 +648,9 @@ int safemain( int argc, char *argv[] )
 //							vf.v() = cross_bilateral( vf.v(), lumA, engine::make_constant( spatX ), engine::make_constant( spatY ), engine::make_constant( 10.F ), engine::make_constant( vecFilter ) );
 							vf.u() = guided_filter_mono( lumA, vf.u(), 8, vecFilter );
 							vf.v() = guided_filter_mono( lumA, vf.v(), 8, vecFilter );
+							// the consistency from the solve no longer
+							// describes the filtered forward field
+							vecConf = plane();
 							if ( vb.valid() )
 							{
 //								plane lumB = tmpImg[0] * 0.3F + tmpImg[1] * 0.6F + tmpImg[2] * 0.1F;
@@ -642,10 +672,10 @@ int safemain( int argc, char *argv[] )
 							alpPlane = 1.F - erode( warpA * cenAlpha, 1 );
 						}
 
-						plane vecConf;
 						if ( vb.valid() )
 						{
-							vecConf = confidence( vf, vb, conservativeness );
+							if ( ! vecConf.valid() )
+								vecConf = confidence( vf, vb, conservativeness );
 							vecConf = erode( threshold( vecConf, confThresh ), 1 );
 //							image_buf tmp;
 //							tmp.add_plane( vecConf );
@@ -756,7 +786,14 @@ int safemain( int argc, char *argv[] )
 				}
 				std::cout << "Finished frame: " << f << std::endl;
 			}
+			cachedVT->unpin();
+			// frames are compressed and written in the background
+			oc.video_tracks()[ci]->flush();
 		}
+
+		media::frame_cache::statistics cs = media::frame_cache::global().stats();
+		std::cout << "Frame cache: " << cs.hits << " hits, " << cs.misses << " misses, "
+				  << cs.evictions << " evictions, " << ( cs.bytes / ( 1024 * 1024 ) ) << "MB in use" << std::endl;
 	}
 	image::allocator::get().report( std::cout );
 
@@ -0,0 +1,243 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include <base/uri.h>
+#include <base/scope_guard.h>
+#include <base/contract.h>
+#include <base/cmd_line.h>
+#include <base/string_split.h>
+#include <base/timer.h>
+#include <media/reader.h>
+#include <media/sample.h>
+#include <image/media_io.h>
+#include <image/image_metrics.h>
+#include <image/threading.h>
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+using namespace image;
+
+struct frame_pair
+{
+	image_buf test;
+	image_buf ref;
+};
+
+base::uri
+to_uri( const std::string &fn )
+{
+	base::uri ret( fn );
+	if ( ! ret )
+		ret.set_scheme( "file" );
+	return ret;
+}
+
+void
+print_worst_tiles( const frame_metrics &m, size_t count )
+{
+	std::vector<size_t> order( m.tile_ssim.size() );
+	std::iota( order.begin(), order.end(), size_t(0) );
+	count = std::min( count, order.size() );
+	std::partial_sort( order.begin(), order.begin() + static_cast<std::ptrdiff_t>( count ), order.end(),
+					   [&]( size_t a, size_t b ) { return m.tile_ssim[a] < m.tile_ssim[b]; } );
+	for ( size_t i = 0; i != count; ++i )
+	{
+		size_t t = order[i];
+		int tx = static_cast<int>( t ) % m.tiles_x;
+		int ty = static_cast<int>( t ) / m.tiles_x;
+		std::cout << "    tile " << std::setw( 5 ) << tx * m.tile_size << ',' << std::setw( 5 ) << ty * m.tile_size
+				  << " ssim " << std::setw( 9 ) << m.tile_ssim[t]
+				  << " mse " << std::setw( 12 ) << m.tile_mse[t];
+		if ( ! m.tile_flicker.empty() )
+			std::cout << " flicker " << std::setw( 12 ) << m.tile_flicker[t];
+		std::cout << '\n';
+	}
+}
+
+int safemain( int argc, char *argv[] )
+{
+	base::cmd_line options(
+		argv[0],
+		base::cmd_line::option(
+			0, std::string( "channels" ),
+			"<string>", base::cmd_line::arg<1>,
+			"Comma separated list of channels to compare (default all)", false ),
+		base::cmd_line::option(
+			0, std::string( "peak" ),
+			"<float>", base::cmd_line::arg<1>,
+			"Peak signal value, used for PSNR and the SSIM constants (default 1)", false ),
+		base::cmd_line::option(
+			0, std::string( "ssim-radius" ),
+			"<int>", base::cmd_line::arg<1>,
+			"Radius of the SSIM window (default 3, a 7x7 window)", false ),
+		base::cmd_line::option(
+			0, std::string( "tile-size" ),
+			"<int>", base::cmd_line::arg<1>,
+			"Size of the tiles of the error maps (default 64)", false ),
+		base::cmd_line::option(
+			0, std::string( "worst-tiles" ),
+			"<int>", base::cmd_line::arg<1>,
+			"Print the given number of tiles with the lowest SSIM for each frame", false ),
+		base::cmd_line::option(
+			'f', std::string( "frames" ),
+			"[<frame>|<start end>]", base::cmd_line::arg<1,2>,
+			"Frame range to compare", false ),
+		base::cmd_line::option(
+			'T', std::string( "threads" ),
+			"<int>", base::cmd_line::arg<1>,
+			"Number of threads to use for processing", false ),
+		base::cmd_line::option(
+			0, std::string(),
+			"<test_file>", base::cmd_line::arg<1>,
+			"File pattern of the sequence to score", true ),
+		base::cmd_line::option(
+			0, std::string(),
+			"<reference_file>", base::cmd_line::arg<1>,
+			"File pattern of the reference sequence", true )
+	);
+
+	auto errhandler = base::make_guard( [&]() { std::cerr << options << std::endl; } );
+	options.parse( argc, argv );
+	errhandler.dismiss();
+
+	auto &threads = options["threads"];
+	if ( threads )
+		threading::init( atoi( threads.value() ) );
+
+	std::vector<std::string> chans;
+	auto &chanP = options["channels"];
+	if ( chanP )
+		base::split( std::string( chanP.value() ), ',', std::back_inserter( chans ), true );
+
+	float peak = 1.F;
+	int radius = 3;
+	int tileSize = 64;
+	size_t worstTiles = 0;
+	if ( options["peak"] )
+		peak = static_cast<float>( atof( options["peak"].value() ) );
+	if ( options["ssim-radius"] )
+		radius = atoi( options["ssim-radius"].value() );
+	if ( options["tile-size"] )
+		tileSize = atoi( options["tile-size"].value() );
+	if ( options["worst-tiles"] )
+		worstTiles = static_cast<size_t>( std::max( 0, atoi( options["worst-tiles"].value() ) ) );
+
+	auto &testP = options["<test_file>"];
+	auto &refP = options["<reference_file>"];
+	if ( ! testP || ! refP )
+		return -1;
+
+	media::container tc = media::reader::open( to_uri( testP.value() ) );
+	media::container rc = media::reader::open( to_uri( refP.value() ) );
+	if ( tc.video_tracks().empty() || rc.video_tracks().empty() )
+		throw_runtime( "Both sequences need a video track to compare" );
+	auto tvt = tc.video_tracks().front();
+	auto rvt = rc.video_tracks().front();
+
+	int64_t frameStart = std::max( tvt->begin(), rvt->begin() );
+	int64_t frameEnd = std::min( tvt->end(), rvt->end() );
+	auto &frames = options["frames"];
+	if ( frames )
+	{
+		if ( frames.values().size() == 1 )
+			frameStart = frameEnd = atoll( frames.value() );
+		else
+		{
+			frameStart = atoll( frames.values()[0] );
+			frameEnd = atoll( frames.values()[1] );
+		}
+		if ( frameStart < std::max( tvt->begin(), rvt->begin() ) || frameEnd > std::min( tvt->end(), rvt->end() ) )
+			throw_runtime( "Frame range {0} - {1} is not in both sequences", frameStart, frameEnd );
+	}
+	if ( frameStart > frameEnd )
+		throw_runtime( "No frames to compare in range {0} - {1}", frameStart, frameEnd );
+
+	// reading and decoding is serial, so the next pair is read while
+	// the metrics of the current one are computed by the thread pool
+	auto load = [&]( int64_t f )
+	{
+		frame_pair r;
+		media::sample ts( f, tvt->rate() );
+		media::sample rs( f, rvt->rate() );
+		r.test = extract_frame( *ts( tvt ), std::string(), std::string(), chans );
+		r.ref = extract_frame( *rs( rvt ), std::string(), std::string(), chans );
+		if ( r.test.size() != r.ref.size() )
+			throw_runtime( "Frame {0} has {1} channels in the test sequence, {2} in the reference", f, r.test.size(), r.ref.size() );
+		return r;
+	};
+
+	std::cout << "  frame      psnr      ssim   ms_ssim       flicker\n"
+			  << std::fixed;
+
+	base::timer total( true );
+	sequence_metrics seq;
+	frame_pair prev;
+	std::future<frame_pair> next = std::async( std::launch::async, load, frameStart );
+	for ( int64_t f = frameStart; f <= frameEnd; ++f )
+	{
+		frame_pair cur = next.get();
+		if ( f < frameEnd )
+			next = std::async( std::launch::async, load, f + 1 );
+
+		bool temporal = ! prev.test.empty();
+		frame_metrics m;
+		if ( temporal )
+			m = static_cast<frame_metrics>( compare_frames( cur.test, cur.ref, prev.test, prev.ref, peak, radius, tileSize ) );
+		else
+			m = static_cast<frame_metrics>( compare_frames( cur.test, cur.ref, peak, radius, tileSize ) );
+		seq.add( m, temporal, peak );
+
+		std::cout << std::setw( 7 ) << f
+				  << std::setprecision( 4 ) << std::setw( 10 ) << m.psnr
+				  << std::setprecision( 6 ) << std::setw( 10 ) << m.ssim
+				  << std::setw( 10 ) << m.ms_ssim;
+		if ( temporal )
+			std::cout << std::setprecision( 8 ) << std::setw( 14 ) << m.flicker;
+		else
+			std::cout << std::setw( 14 ) << '-';
+		std::cout << '\n';
+		if ( worstTiles > 0 )
+			print_worst_tiles( m, worstTiles );
+
+		prev = std::move( cur );
+	}
+
+	std::cout << "\n" << seq.frames << " frames in " << std::setprecision( 3 ) << total.seconds().count() << "s\n"
+			  << std::setprecision( 4 )
+			  << "  psnr    " << std::setw( 10 ) << seq.psnr << " (min " << seq.min_psnr << ")\n"
+			  << std::setprecision( 6 )
+			  << "  ssim    " << std::setw( 10 ) << seq.ssim << " (min " << seq.min_ssim << ")\n"
+			  << "  ms_ssim " << std::setw( 10 ) << seq.ms_ssim << " (min " << seq.min_ms_ssim << ")\n";
+	if ( seq.temporal_frames > 0 )
+		std::cout << std::setprecision( 8 )
+				  << "  flicker " << std::setw( 10 ) << seq.flicker << " (max " << seq.max_flicker << ")\n";
+	std::cout << std::flush;
+
+	return 0;
+}
+
+}
+
+int main( int argc, char *argv[] )
+{
+	try
+	{
+		return safemain( argc, argv );
+	}
+	catch ( const std::exception &e )
+	{
+		base::print_exception( std::cerr, e );
+	}
+	return -1;
+}
@@ -0,0 +1,93 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include <base/contract.h>
+#include <base/timer.h>
+#include <base/thread_util.h>
+#include <base/uri.h>
+#include <media/reader.h>
+#include <image/media_io.h>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+
+// reads every frame of the PNG sequence, converting it to float
+// planes, returning the frames per second
+double measure( const base::uri &u, const std::string &decode, int64_t frameThreads )
+{
+	media::parameter_set ps;
+	ps["decode"] = media::parameter_value( decode );
+	ps["frame_threads"] = media::parameter_value( frameThreads );
+
+	media::container c = media::reader::open( u, ps );
+	if ( c.video_tracks().empty() )
+		throw_runtime( "No video tracks in {0}", u );
+	auto vt = c.video_tracks().front();
+
+	base::timer t( true );
+	int64_t n = 0;
+	for ( int64_t f = vt->begin(); f <= vt->end(); ++f, ++n )
+	{
+		auto frm = vt->at( f );
+		image::image_buf img = image::extract_frame( *frm );
+		if ( img.empty() )
+			throw_runtime( "Frame {0} has no planes", f );
+	}
+	return static_cast<double>( n ) / t.seconds().count();
+}
+
+int safemain( int argc, char *argv[] )
+{
+	if ( argc < 2 )
+	{
+		std::cerr << "Usage: " << argv[0] << " <file_pattern> ... [frame_threads]\n"
+				  << "  e.g. " << argv[0] << " /tmp/rgba8.#.png /tmp/rgba16.#.png 4" << std::endl;
+		return -1;
+	}
+
+	int last = argc;
+	int64_t threads = base::thread::core_count();
+	if ( argc > 2 && atoi( argv[argc - 1] ) > 0 )
+		threads = atoi( argv[--last] );
+
+	std::cout << "decode   frame_threads        fps" << std::endl;
+	for ( int a = 1; a < last; ++a )
+	{
+		base::uri u( argv[a] );
+		if ( ! u )
+			u.set_scheme( "file" );
+
+		std::cout << u << '\n' << std::fixed << std::setprecision( 2 );
+		// native is the 8 / 16 bit decode, converted in extract_frame
+		std::cout << std::setw( 6 ) << "native" << std::setw( 16 ) << 0
+				  << std::setw( 11 ) << measure( u, "native", 0 ) << std::endl;
+		std::cout << std::setw( 6 ) << "float" << std::setw( 16 ) << 0
+				  << std::setw( 11 ) << measure( u, "float", 0 ) << std::endl;
+		std::cout << std::setw( 6 ) << "float" << std::setw( 16 ) << threads
+				  << std::setw( 11 ) << measure( u, "float", threads ) << std::endl;
+	}
+
+	return 0;
+}
+
+}
+
+int main( int argc, char *argv[] )
+{
+	try
+	{
+		return safemain( argc, argv );
+	}
+	catch ( const std::exception &e )
+	{
+		base::print_exception( std::cerr, e );
+	}
+	return -1;
+}
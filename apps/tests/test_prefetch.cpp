@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include <base/contract.h>
+#include <base/timer.h>
+#include <base/uri.h>
+#include <media/reader.h>
+#include <media/prefetch_track.h>
+#include <media/preloaded_image.h>
+#include <image/media_io.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+
+// reads (and converts) every frame of the track, with an optional
+// sleep standing in for the processing of the frame, returning the
+// frames per second
+double measure( const std::shared_ptr<media::video_track> &vt, int processMs )
+{
+	base::timer t( true );
+	int64_t n = 0;
+	for ( int64_t f = vt->begin(); f <= vt->end(); ++f, ++n )
+	{
+		auto frm = vt->at( f );
+		image::image_buf img = image::extract_frame( *frm );
+		if ( img.empty() )
+			throw_runtime( "Frame {0} has no planes", f );
+		if ( processMs > 0 )
+			std::this_thread::sleep_for( std::chrono::milliseconds( processMs ) );
+	}
+	return static_cast<double>( n ) / t.seconds().count();
+}
+
+int safemain( int argc, char *argv[] )
+{
+	if ( argc < 2 )
+	{
+		std::cerr << "Usage: " << argv[0] << " <file_pattern> [process_ms] [threads]\n"
+				  << "  e.g. " << argv[0] << " /tmp/shot.#.exr 20" << std::endl;
+		return -1;
+	}
+
+	base::uri u( argv[1] );
+	if ( ! u )
+		u.set_scheme( "file" );
+	int processMs = argc > 2 ? atoi( argv[2] ) : 0;
+	size_t threads = argc > 3 ? static_cast<size_t>( atoi( argv[3] ) ) : 2;
+
+	media::container c = media::reader::open( u );
+	if ( c.video_tracks().empty() )
+		throw_runtime( "No video tracks in {0}", u );
+	auto vt = c.video_tracks().front();
+
+	std::cout << "frames " << vt->begin() << " - " << vt->end() << ", " << processMs << "ms processing per frame\n"
+			  << "window   decode        fps" << std::endl;
+	std::cout << std::setw( 6 ) << 0 << std::setw( 9 ) << '-'
+			  << std::fixed << std::setprecision( 2 ) << std::setw( 11 ) << measure( vt, processMs ) << std::endl;
+	for ( size_t window: { 1, 2, 4, 8 } )
+	{
+		for ( bool decode: { false, true } )
+		{
+			media::prefetch_options opts;
+			opts.window = window;
+			opts.threads = threads;
+			opts.decode = decode;
+			auto pf = std::make_shared<media::prefetch_track>( vt, opts );
+			std::cout << std::setw( 6 ) << window << std::setw( 9 ) << ( decode ? "yes" : "no" )
+					  << std::setw( 11 ) << measure( pf, processMs ) << std::endl;
+		}
+	}
+
+	// every other frame: the frames skipped over must not pile up
+	{
+		media::prefetch_options opts;
+		opts.window = 4;
+		opts.threads = threads;
+		auto pf = std::make_shared<media::prefetch_track>( vt, opts );
+		size_t frameBytes = 0;
+		size_t maxReady = 0, maxBytes = 0;
+		for ( int64_t f = vt->begin(); f <= vt->end(); f += 2 )
+		{
+			auto frm = pf->at( f );
+			if ( frameBytes == 0 )
+			{
+				if ( auto img = frm->find_image( std::string(), std::string() ) )
+					frameBytes = media::preloaded_image::decoded_size( *img );
+			}
+			maxReady = std::max( maxReady, pf->ready() );
+			maxBytes = std::max( maxBytes, pf->bytes_ahead() );
+		}
+		std::cout << "stride 2: at most " << maxReady << " frames, " << maxBytes << " bytes ahead" << std::endl;
+		if ( maxReady > opts.window || ( frameBytes > 0 && maxBytes > opts.window * frameBytes ) )
+			throw_runtime( "Frames read ahead not bounded by the window ({0} frames, {1} bytes)", maxReady, maxBytes );
+	}
+
+	return 0;
+}
+
+}
+
+int main( int argc, char *argv[] )
+{
+	try
+	{
+		return safemain( argc, argv );
+	}
+	catch ( const std::exception &e )
+	{
+		base::print_exception( std::cerr, e );
+	}
+	return -1;
+}
@@ -0,0 +1,83 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include <base/contract.h>
+#include <base/timer.h>
+#include <color/transfer_kernel.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+// compares the throughput of the per value switch of
+// color::linearize / encode against the transfer kernels
+double measure( const std::function<void(float *, size_t)> &f, const std::vector<float> &src )
+{
+	std::vector<float> tmp( src.size() );
+	double best = 0.0;
+	for ( int i = 0; i < 5; ++i )
+	{
+		std::copy( src.begin(), src.end(), tmp.begin() );
+		base::timer t( true );
+		f( tmp.data(), tmp.size() );
+		double s = t.seconds().count();
+		best = std::max( best, static_cast<double>( src.size() ) / s / 1e6 );
+	}
+	return best;
+}
+
+template <color::transfer T>
+void compare( const char *name, const std::vector<float> &src )
+{
+	auto swLin = []( float *v, size_t n ) { for ( size_t i = 0; i != n; ++i ) v[i] = color::linearize( v[i], T ); };
+	auto swEnc = []( float *v, size_t n ) { for ( size_t i = 0; i != n; ++i ) v[i] = color::encode( v[i], T ); };
+	auto kLin = []( float *v, size_t n ) { color::linearize_line<T>( v, n ); };
+	auto kEnc = []( float *v, size_t n ) { color::encode_line<T>( v, n ); };
+
+	std::cout << std::setw( 14 ) << name << std::fixed << std::setprecision( 1 )
+			  << std::setw( 10 ) << measure( swLin, src )
+			  << std::setw( 10 ) << measure( kLin, src )
+			  << std::setw( 10 ) << measure( swEnc, src )
+			  << std::setw( 10 ) << measure( kEnc, src )
+			  << std::endl;
+}
+
+int safemain( void )
+{
+	const size_t n = 3840 * 2160;
+	std::vector<float> src( n );
+	for ( size_t i = 0; i != n; ++i )
+		src[i] = static_cast<float>( i % 4096 ) / 4095.F;
+
+	std::cout << "curve         lin_switch lin_kernel enc_switch enc_kernel (Mvalues/s)" << std::endl;
+	compare<color::transfer::GAMMA_sRGB>( "srgb", src );
+	compare<color::transfer::GAMMA_BT709>( "bt709", src );
+	compare<color::transfer::GAMMA_DCI>( "gamma_dci", src );
+	compare<color::transfer::PQ>( "pq", src );
+	compare<color::transfer::HLG_OETF>( "hlg", src );
+	compare<color::transfer::MID_GRAY_LOG>( "mid_gray_log", src );
+
+	return 0;
+}
+
+}
+
+int main( void )
+{
+	try
+	{
+		return safemain();
+	}
+	catch ( const std::exception &e )
+	{
+		base::print_exception( std::cerr, e );
+	}
+	return -1;
+}
@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include <base/contract.h>
+#include <base/timer.h>
+#include <image/plane_ops.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+
+// compares the bandwidth of the vertical passes against a plain
+// copy of the plane for a range of widths
+double measure( const std::function<image::plane(const image::plane &)> &f, int w, int h, double bytes )
+{
+	double best = 0.0;
+	for ( int i = 0; i < 5; ++i )
+	{
+		// results are shared through the graph of the source, so
+		// each run needs a fresh source to actually compute anything
+		image::plane p = image::create_random_plane( 0, 0, w - 1, h - 1, static_cast<uint32_t>( 42 + i ), 0.F, 1.F );
+		p.cdata();
+
+		base::timer t( true );
+		image::plane r = f( p );
+		r.cdata();
+		double s = t.seconds().count();
+		double bw = bytes / s / ( 1024.0 * 1024.0 * 1024.0 );
+		best = std::max( best, bw );
+	}
+	return best;
+}
+
+int safemain( void )
+{
+	const int h = 1024;
+	const std::vector<float> k7 = { 0.05F, 0.1F, 0.2F, 0.3F, 0.2F, 0.1F, 0.05F };
+
+	std::cout << "width     copy   conv7_v  cgrad_v ngrad5_v bilin_v/2 bicub_v/2 (GiB/s)" << std::endl;
+	for ( int w = 1024; w <= 16384; w *= 2 )
+	{
+		const double full = 2.0 * static_cast<double>( w ) * static_cast<double>( h ) * sizeof(float);
+		const double half = 1.5 * static_cast<double>( w ) * static_cast<double>( h ) * sizeof(float);
+
+		std::cout << std::setw( 5 ) << w << std::fixed << std::setprecision( 2 )
+				  << std::setw( 9 ) << measure( [&]( const image::plane &p ) { return p.copy(); }, w, h, full )
+				  << std::setw( 9 ) << measure( [&]( const image::plane &p ) { return image::convolve_vert( p, k7 ); }, w, h, full )
+				  << std::setw( 9 ) << measure( [&]( const image::plane &p ) { return image::central_gradient_vert( p ); }, w, h, full )
+				  << std::setw( 9 ) << measure( [&]( const image::plane &p ) { return image::noise_gradient_vert5( p ); }, w, h, full )
+				  << std::setw( 10 ) << measure( [&]( const image::plane &p ) { return image::resize_vert_bilinear( p, h / 2 ); }, w, h, half )
+				  << std::setw( 10 ) << measure( [&]( const image::plane &p ) { return image::resize_vert_bicubic( p, h / 2 ); }, w, h, half )
+				  << std::endl;
+	}
+
+	return 0;
+}
+
+}
+
+int main( void )
+{
+	try
+	{
+		return safemain();
+	}
+	catch ( const std::exception &e )
+	{
+		base::print_exception( std::cerr, e );
+	}
+	return -1;
+}
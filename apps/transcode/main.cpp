@@ -13,9 +13,12 @@
 #include <media/reader.h>
 #include <media/writer.h>
 #include <media/sample.h>
+#include <media/prefetch_track.h>
 #include <image/plane_ops.h>
 #include <image/media_io.h>
 #include <image/threading.h>
+#include <algorithm>
+#include <cstdlib>
 #include <sstream>
 #include <iostream>
 #include <typeindex>
@@ -31,6 +34,10 @@ int safemain( int argc, char *argv[] )
 			0, std::string( "output-settings" ),
 			"<string>", base::cmd_line::arg<1>,
 			"Comma separated name=value setting for output file format options", false ),
+		base::cmd_line::option(
+			0, std::string( "prefetch" ),
+			"<int>", base::cmd_line::arg<1>,
+			"Number of frames to read ahead while processing (default 4, 0 to disable)", false ),
 		base::cmd_line::option(
 			0, std::string(),
 			"<input_file>", base::cmd_line::arg<1>,
@@ -76,10 +83,29 @@ int safemain( int argc, char *argv[] )
 			outOpts = outParams.value();
 		media::parameter_set outputOptions = media::writer::parameters_by_ext( outputU, outOpts );
 
+		// the resolution levels written have to be computed
+		media::image::level_mode levels = media::image::level_mode::SINGLE;
+		auto lvlP = outputOptions.find( "levels" );
+		if ( lvlP != outputOptions.end() && lvlP->second.valid() )
+		{
+			if ( lvlP->second.as_string() == "mipmap" )
+				levels = media::image::level_mode::MIPMAP;
+			else if ( lvlP->second.as_string() == "ripmap" )
+				levels = media::image::level_mode::RIPMAP;
+		}
+
+		media::prefetch_options prefetch;
+		auto &prefetchP = options["prefetch"];
+		if ( prefetchP )
+			prefetch.window = static_cast<size_t>( std::max( 0, atoi( prefetchP.value() ) ) );
+
 		media::container oc = media::writer::open( outputU, tds, outputOptions );
 		size_t ovt = 0;
-		for ( auto &vt: c.video_tracks() )
+		for ( auto &srcvt: c.video_tracks() )
 		{
+			std::shared_ptr<media::video_track> vt = srcvt;
+			if ( prefetch.window > 0 )
+				vt = std::make_shared<media::prefetch_track>( srcvt, prefetch );
 			for ( int64_t f = vt->begin(); f <= vt->end(); ++f )
 			{
 				media::sample s( f, vt->rate() );
@@ -108,9 +134,11 @@ int safemain( int argc, char *argv[] )
 				}
 				
 
-				oc.video_tracks()[ovt]->store( f, to_frame( img, { "R", "G", "B" }, "f16" )  );
+				oc.video_tracks()[ovt]->store( f, to_frame_with_levels( img, { "R", "G", "B" }, "f16", levels )  );
 //				oc.video_tracks()[ovt]->store( f, curFrm );
 			}
+			// frames are compressed and written in the background
+			oc.video_tracks()[ovt]->flush();
 			++ovt;
 		}
 	}
@@ -0,0 +1,314 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include "color.h"
+#include "lut3d.h"
+#include "transfer_kernel.h"
+#include <vector>
+
+////////////////////////////////////////
+
+namespace color
+{
+
+///
+/// @brief Class compiled_transform holds the conversion between two
+/// color states, resolved once so it can be applied to many values.
+///
+/// This follows the same chain as @sa convert, but the RGB to XYZ,
+/// adaptation and XYZ to RGB matrices are fused into a single matrix
+/// (computed in double precision), and the range scales and transfer
+/// curves are resolved up front. The values are processed in blocks,
+/// one stage at a time, so each stage is a simple loop over the block.
+///
+/// States with color opponency are not (yet) compiled, and fall back
+/// to calling convert for each value.
+///
+class compiled_transform
+{
+public:
+	compiled_transform( const state &from, const state &to, cone_response cr = cone_response::NONE )
+		: _from( from ), _to( to ), _cr( cr )
+	{
+		_generic = has_opponency( from.current_space() ) || has_opponency( to.current_space() );
+		_in_scale = range_scale( from.signal(), true );
+		_out_scale = range_scale( to.signal(), false );
+		_lin = from.curve();
+		_enc = to.curve();
+		_xform = from.curve() != to.curve() || ! to.is_same_matrix( from );
+		if ( _xform )
+		{
+			matrix<double> m = to.get_from_xyz_mat() * to.adaptation( from, cr ) * from.get_to_xyz_mat();
+			for ( size_t r = 0; r != 3; ++r )
+				for ( size_t c = 0; c != 3; ++c )
+					_m[r*3+c] = static_cast<float>( m[r][c] );
+		}
+	}
+
+	/// true if the transform does not change the values
+	inline bool is_identity( void ) const
+	{
+		return ! _generic && ! _xform && _in_scale * _out_scale == 1.F;
+	}
+
+	/// Replaces the transfer curves with linearly interpolated tables
+	/// of size + 1 entries over [0, 1]. Values outside that range are
+	/// still computed exactly. With 4096 entries, the error of the sRGB
+	/// curves is below 2e-5.
+	void use_curve_luts( int size )
+	{
+		_lut_size = size;
+		_lin_lut.clear();
+		_enc_lut.clear();
+		_lin_kernel = _enc_kernel = false;
+		if ( size <= 0 )
+			return;
+		if ( _lin != transfer::LINEAR )
+			_lin_lut = make_curve_lut( _lin, true, size );
+		if ( _enc != transfer::LINEAR )
+			_enc_lut = make_curve_lut( _enc, false, size );
+	}
+
+	/// Uses the vectorized approximations of @sa transfer_kernel for
+	/// the transfer curves that have one, which are within about 1e-6
+	/// of the exact curves for all values, and tables of lutSize
+	/// entries (@sa use_curve_luts) for the others.
+	void use_curve_kernels( int lutSize )
+	{
+		use_curve_luts( lutSize );
+		_lin_kernel = has_kernel( _lin );
+		_enc_kernel = has_kernel( _enc );
+		if ( _lin_kernel )
+			_lin_lut.clear();
+		if ( _enc_kernel )
+			_enc_lut.clear();
+	}
+
+	/// Replaces the whole transform with a size^3 3D LUT with
+	/// tetrahedral interpolation for values inside [0, 1], as long as
+	/// the transform is not the identity. Values outside are computed
+	/// exactly. This is only appropriate for (non-linearly) encoded
+	/// source states.
+	void use_lut_3d( int size )
+	{
+		_lut_3d = lut3d();
+		if ( size <= 0 || is_identity() )
+			return;
+		lut3d l( size );
+		l.bake( [this]( float &a, float &b, float &c ) { convert_exact( a, b, c ); } );
+		_lut_3d = std::move( l );
+	}
+
+	inline const lut3d &lut_3d( void ) const { return _lut_3d; }
+
+	/// converts a single value without using any of the LUTs
+	inline void convert_exact( float &a, float &b, float &c ) const
+	{
+		if ( _generic )
+		{
+			convert( a, b, c, _from, _to, 32, _cr );
+			return;
+		}
+		a *= _in_scale; b *= _in_scale; c *= _in_scale;
+		if ( _xform )
+		{
+			a = linearize( a, _lin );
+			b = linearize( b, _lin );
+			c = linearize( c, _lin );
+			float x = _m[0] * a + _m[1] * b + _m[2] * c;
+			float y = _m[3] * a + _m[4] * b + _m[5] * c;
+			float z = _m[6] * a + _m[7] * b + _m[8] * c;
+			a = encode( x, _enc );
+			b = encode( y, _enc );
+			c = encode( z, _enc );
+		}
+		a *= _out_scale; b *= _out_scale; c *= _out_scale;
+	}
+
+	/// converts n values in place, stored as separate channels (i.e.
+	/// the scanlines of the planes of an image)
+	void apply( float *a, float *b, float *c, size_t n ) const
+	{
+		if ( is_identity() )
+			return;
+
+		if ( _generic )
+		{
+			for ( size_t i = 0; i != n; ++i )
+				convert( a[i], b[i], c[i], _from, _to, 32, _cr );
+			return;
+		}
+
+		if ( _lut_3d.valid() )
+		{
+			for ( size_t i = 0; i != n; ++i )
+			{
+				if ( lut3d::in_domain( a[i], b[i], c[i] ) )
+					_lut_3d.apply( a[i], b[i], c[i] );
+				else
+					convert_exact( a[i], b[i], c[i] );
+			}
+			return;
+		}
+
+		const size_t block = kBlock;
+		for ( size_t s = 0; s < n; s += block )
+		{
+			size_t bn = std::min( block, n - s );
+			apply_block( a + s, b + s, c + s, bn );
+		}
+	}
+
+private:
+	static constexpr size_t kBlock = 256;
+
+	static float range_scale( range r, bool toFull )
+	{
+		switch ( r )
+		{
+			case range::FULL:
+			case range::SDI_RP2077:
+				return 1.F;
+			case range::ITU_FULL:
+				return toFull ? static_cast<float>( 1023.0 / 1024.0 ) : static_cast<float>( 1024.0 / 1023.0 );
+			case range::SMPTE:
+			case range::SDI:
+			case range::SDI_ST2084:
+			case range::SMPTE_PLUS:
+				throw_not_yet();
+		}
+		return 1.F;
+	}
+
+	static std::vector<float> make_curve_lut( transfer t, bool lin, int size )
+	{
+		std::vector<float> ret( static_cast<size_t>( size ) + 2 );
+		for ( int i = 0; i <= size; ++i )
+		{
+			double v = static_cast<double>( i ) / static_cast<double>( size );
+			ret[static_cast<size_t>( i )] = static_cast<float>( lin ? linearize( v, t ) : encode( v, t ) );
+		}
+		// padding so the interpolation at 1.0 can read past the end
+		ret.back() = ret[static_cast<size_t>( size )];
+		return ret;
+	}
+
+	static void scale( float *v, size_t n, float s )
+	{
+		if ( s == 1.F )
+			return;
+		for ( size_t i = 0; i != n; ++i )
+			v[i] *= s;
+	}
+
+	void curve( float *v, size_t n, transfer t, const std::vector<float> &lut, bool kernel, bool lin ) const
+	{
+		if ( t == transfer::LINEAR )
+			return;
+
+		if ( kernel )
+		{
+			if ( lin )
+				linearize_line( v, n, t );
+			else
+				encode_line( v, n, t );
+			return;
+		}
+
+		if ( lut.empty() )
+		{
+			if ( lin )
+			{
+				for ( size_t i = 0; i != n; ++i )
+					v[i] = linearize( v[i], t );
+			}
+			else
+			{
+				for ( size_t i = 0; i != n; ++i )
+					v[i] = encode( v[i], t );
+			}
+			return;
+		}
+
+		const float *l = lut.data();
+		const float lsize = static_cast<float>( _lut_size );
+		for ( size_t i = 0; i != n; ++i )
+		{
+			float x = v[i];
+			if ( x >= 0.F && x <= 1.F )
+			{
+				x *= lsize;
+				int idx = static_cast<int>( x );
+				float f = x - static_cast<float>( idx );
+				v[i] = l[idx] + f * ( l[idx + 1] - l[idx] );
+			}
+			else
+				v[i] = lin ? linearize( x, t ) : encode( x, t );
+		}
+	}
+
+	void apply_block( float *a, float *b, float *c, size_t n ) const
+	{
+		if ( ! _xform )
+		{
+			float s = _in_scale * _out_scale;
+			scale( a, n, s );
+			scale( b, n, s );
+			scale( c, n, s );
+			return;
+		}
+
+		scale( a, n, _in_scale );
+		scale( b, n, _in_scale );
+		scale( c, n, _in_scale );
+		curve( a, n, _lin, _lin_lut, _lin_kernel, true );
+		curve( b, n, _lin, _lin_lut, _lin_kernel, true );
+		curve( c, n, _lin, _lin_lut, _lin_kernel, true );
+
+		const float m0 = _m[0], m1 = _m[1], m2 = _m[2];
+		const float m3 = _m[3], m4 = _m[4], m5 = _m[5];
+		const float m6 = _m[6], m7 = _m[7], m8 = _m[8];
+		for ( size_t i = 0; i != n; ++i )
+		{
+			float x = a[i], y = b[i], z = c[i];
+			a[i] = m0 * x + m1 * y + m2 * z;
+			b[i] = m3 * x + m4 * y + m5 * z;
+			c[i] = m6 * x + m7 * y + m8 * z;
+		}
+
+		curve( a, n, _enc, _enc_lut, _enc_kernel, false );
+		curve( b, n, _enc, _enc_lut, _enc_kernel, false );
+		curve( c, n, _enc, _enc_lut, _enc_kernel, false );
+		scale( a, n, _out_scale );
+		scale( b, n, _out_scale );
+		scale( c, n, _out_scale );
+	}
+
+	state _from;
+	state _to;
+	cone_response _cr;
+	bool _generic = false;
+	bool _xform = false;
+	float _in_scale = 1.F;
+	float _out_scale = 1.F;
+	transfer _lin = transfer::LINEAR;
+	transfer _enc = transfer::LINEAR;
+	float _m[9] = { 1.F, 0.F, 0.F, 0.F, 1.F, 0.F, 0.F, 0.F, 1.F };
+	int _lut_size = 0;
+	std::vector<float> _lin_lut;
+	std::vector<float> _enc_lut;
+	bool _lin_kernel = false;
+	bool _enc_kernel = false;
+	lut3d _lut_3d;
+};
+
+} // namespace color
+
+
+
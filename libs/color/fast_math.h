@@ -0,0 +1,193 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#ifdef __SSE__
+# if defined(LINUX) || defined(__linux__)
+#  include <x86intrin.h>
+# else
+#  include <xmmintrin.h>
+#  include <immintrin.h>
+# endif
+#endif
+
+////////////////////////////////////////
+
+namespace color
+{
+
+///
+/// @brief Approximations of the math functions needed by the transfer
+/// curves, with matching scalar and SSE versions.
+///
+/// The same formula is written for float and float4 so the curves can
+/// be written once (@sa transfer_kernel), and the scalar tail of a
+/// scanline gives the same result as the vector body. log2 uses the
+/// atanh series on the mantissa, and exp2 a polynomial on the
+/// fraction, both with a relative error of about 1e-7, so the error
+/// of pow is dominated by the rounding of y * log2( x ).
+///
+namespace fast
+{
+
+// 2 / ( k * ln(2) ) for the odd terms of the atanh series
+static constexpr float kLog2C1 = 2.8853900817779268F;
+static constexpr float kLog2C3 = 0.9617966939259756F;
+static constexpr float kLog2C5 = 0.5770780163555854F;
+static constexpr float kLog2C7 = 0.4121985831111324F;
+// ln(2)^k / k!
+static constexpr float kExp2C1 = 0.6931471805599453F;
+static constexpr float kExp2C2 = 0.2402265069591007F;
+static constexpr float kExp2C3 = 0.0555041086648216F;
+static constexpr float kExp2C4 = 0.0096181291076285F;
+static constexpr float kExp2C5 = 0.0013333558146428F;
+static constexpr float kExp2C6 = 0.0001540353039338F;
+static constexpr float kSqrt2 = 1.4142135623730951F;
+static constexpr float kLog2_10 = 3.3219280948873623F;
+static constexpr float kLog10_2 = 0.3010299956639812F;
+static constexpr float kLn2 = 0.6931471805599453F;
+
+////////////////////////////////////////
+
+inline float select( bool m, float a, float b ) { return m ? a : b; }
+inline float abs( float v ) { return std::abs( v ); }
+inline float copysign( float mag, float sgn ) { return std::copysign( mag, sgn ); }
+inline float min( float a, float b ) { return std::min( a, b ); }
+inline float max( float a, float b ) { return std::max( a, b ); }
+inline float sqrt( float v ) { return std::sqrt( v ); }
+
+/// log2 for positive, normal values
+inline float log2( float x )
+{
+	uint32_t bits;
+	std::memcpy( &bits, &x, sizeof(float) );
+	float e = static_cast<float>( static_cast<int>( bits >> 23 ) - 127 );
+	bits = ( bits & 0x007FFFFF ) | 0x3F800000;
+	float m;
+	std::memcpy( &m, &bits, sizeof(float) );
+	// center the mantissa on 1 so the series converges quickly
+	if ( m > kSqrt2 )
+	{
+		m *= 0.5F;
+		e += 1.F;
+	}
+	float t = ( m - 1.F ) / ( m + 1.F );
+	float t2 = t * t;
+	return e + t * ( kLog2C1 + t2 * ( kLog2C3 + t2 * ( kLog2C5 + t2 * kLog2C7 ) ) );
+}
+
+/// exp2, clamped to the range of normal values
+inline float exp2( float x )
+{
+	x = std::min( std::max( x, -126.F ), 127.F );
+	float n = std::nearbyint( x );
+	float f = x - n;
+	float p = 1.F + f * ( kExp2C1 + f * ( kExp2C2 + f * ( kExp2C3 + f * ( kExp2C4 + f * ( kExp2C5 + f * kExp2C6 ) ) ) ) );
+	uint32_t bits = static_cast<uint32_t>( static_cast<int>( n ) + 127 ) << 23;
+	float s;
+	std::memcpy( &s, &bits, sizeof(float) );
+	return p * s;
+}
+
+/// x^y for non-negative x, values below the smallest normal are 0
+inline float pow( float x, float y )
+{
+	return x >= 1.17549435e-38F ? exp2( y * log2( x ) ) : 0.F;
+}
+
+inline float log10( float x ) { return log2( x ) * kLog10_2; }
+inline float log( float x ) { return log2( x ) * kLn2; }
+inline float pow10( float x ) { return exp2( x * kLog2_10 ); }
+inline float exp( float x ) { return exp2( x * ( 1.F / kLn2 ) ); }
+
+////////////////////////////////////////
+
+#if defined(__SSE__)
+
+/// 4 floats, with just enough operators to write the curves once for
+/// both scalar and vector values
+struct float4
+{
+	float4( void ) = default;
+	float4( __m128 x ) : v( x ) {}
+	float4( float x ) : v( _mm_set1_ps( x ) ) {}
+
+	__m128 v;
+};
+
+inline float4 operator+( float4 a, float4 b ) { return _mm_add_ps( a.v, b.v ); }
+inline float4 operator-( float4 a, float4 b ) { return _mm_sub_ps( a.v, b.v ); }
+inline float4 operator*( float4 a, float4 b ) { return _mm_mul_ps( a.v, b.v ); }
+inline float4 operator/( float4 a, float4 b ) { return _mm_div_ps( a.v, b.v ); }
+// comparisons return masks for select
+inline float4 operator<( float4 a, float4 b ) { return _mm_cmplt_ps( a.v, b.v ); }
+inline float4 operator<=( float4 a, float4 b ) { return _mm_cmple_ps( a.v, b.v ); }
+inline float4 operator>( float4 a, float4 b ) { return _mm_cmpgt_ps( a.v, b.v ); }
+inline float4 operator>=( float4 a, float4 b ) { return _mm_cmpge_ps( a.v, b.v ); }
+
+inline float4 select( float4 m, float4 a, float4 b )
+{
+	return _mm_or_ps( _mm_and_ps( m.v, a.v ), _mm_andnot_ps( m.v, b.v ) );
+}
+inline float4 abs( float4 v ) { return _mm_andnot_ps( _mm_set1_ps( -0.F ), v.v ); }
+inline float4 copysign( float4 mag, float4 sgn )
+{
+	const __m128 s = _mm_set1_ps( -0.F );
+	return _mm_or_ps( _mm_and_ps( s, sgn.v ), _mm_andnot_ps( s, mag.v ) );
+}
+inline float4 min( float4 a, float4 b ) { return _mm_min_ps( a.v, b.v ); }
+inline float4 max( float4 a, float4 b ) { return _mm_max_ps( a.v, b.v ); }
+inline float4 sqrt( float4 v ) { return _mm_sqrt_ps( v.v ); }
+
+inline float4 log2( float4 x )
+{
+	__m128i bits = _mm_castps_si128( x.v );
+	__m128 e = _mm_cvtepi32_ps( _mm_sub_epi32( _mm_srli_epi32( bits, 23 ), _mm_set1_epi32( 127 ) ) );
+	__m128 m = _mm_castsi128_ps( _mm_or_si128( _mm_and_si128( bits, _mm_set1_epi32( 0x007FFFFF ) ), _mm_set1_epi32( 0x3F800000 ) ) );
+	__m128 big = _mm_cmpgt_ps( m, _mm_set1_ps( kSqrt2 ) );
+	m = select( big, _mm_mul_ps( m, _mm_set1_ps( 0.5F ) ), m ).v;
+	e = _mm_add_ps( e, _mm_and_ps( big, _mm_set1_ps( 1.F ) ) );
+	float4 t = float4( _mm_sub_ps( m, _mm_set1_ps( 1.F ) ) ) / float4( _mm_add_ps( m, _mm_set1_ps( 1.F ) ) );
+	float4 t2 = t * t;
+	return float4( e ) + t * ( kLog2C1 + t2 * ( kLog2C3 + t2 * ( kLog2C5 + t2 * kLog2C7 ) ) );
+}
+
+inline float4 exp2( float4 x )
+{
+	x = min( max( x, -126.F ), 127.F );
+	// round to nearest, as nearbyint
+	__m128i ni = _mm_cvtps_epi32( x.v );
+	float4 f = x - float4( _mm_cvtepi32_ps( ni ) );
+	float4 p = 1.F + f * ( kExp2C1 + f * ( kExp2C2 + f * ( kExp2C3 + f * ( kExp2C4 + f * ( kExp2C5 + f * kExp2C6 ) ) ) ) );
+	__m128 s = _mm_castsi128_ps( _mm_slli_epi32( _mm_add_epi32( ni, _mm_set1_epi32( 127 ) ), 23 ) );
+	return p * float4( s );
+}
+
+inline float4 pow( float4 x, float y )
+{
+	return _mm_and_ps( _mm_cmpge_ps( x.v, _mm_set1_ps( 1.17549435e-38F ) ), exp2( float4( y ) * log2( x ) ).v );
+}
+
+inline float4 log10( float4 x ) { return log2( x ) * kLog10_2; }
+inline float4 log( float4 x ) { return log2( x ) * kLn2; }
+inline float4 pow10( float4 x ) { return exp2( x * kLog2_10 ); }
+inline float4 exp( float4 x ) { return exp2( x * ( 1.F / kLn2 ) ); }
+
+#endif
+
+} // namespace fast
+
+} // namespace color
+
+
+
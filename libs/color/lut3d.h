@@ -0,0 +1,212 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <limits>
+
+////////////////////////////////////////
+
+namespace color
+{
+
+///
+/// @brief Class lut3d provides a cube of RGB values sampled over
+/// [0, 1] in each dimension, with tetrahedral interpolation.
+///
+/// The values are stored interleaved, with red varying fastest, which
+/// is the same order as the .cube file format.
+///
+/// An optional shaper 1D table, applied to each channel prior to the
+/// cube, maps an arbitrary input range (i.e. scene linear values) onto
+/// the domain of the cube, so the lattice points can be spent where
+/// the transform needs them.
+///
+class lut3d
+{
+public:
+	lut3d( void ) = default;
+	explicit lut3d( int size )
+		: _size( size ), _data( static_cast<size_t>( size ) * static_cast<size_t>( size ) * static_cast<size_t>( size ) * 3 )
+	{
+		if ( size < 2 )
+			throw std::logic_error( "3D LUT must have at least 2 entries per dimension" );
+	}
+
+	inline bool valid( void ) const { return _size > 1; }
+	inline int size( void ) const { return _size; }
+
+	inline float *entry( int r, int g, int b )
+	{
+		return _data.data() + ( ( static_cast<size_t>( b ) * static_cast<size_t>( _size ) + static_cast<size_t>( g ) ) * static_cast<size_t>( _size ) + static_cast<size_t>( r ) ) * 3;
+	}
+	inline const float *entry( int r, int g, int b ) const
+	{
+		return _data.data() + ( ( static_cast<size_t>( b ) * static_cast<size_t>( _size ) + static_cast<size_t>( g ) ) * static_cast<size_t>( _size ) + static_cast<size_t>( r ) ) * 3;
+	}
+	inline const std::vector<float> &data( void ) const { return _data; }
+
+	/// Sets the shaper, a table sampled evenly over [minV, maxV] of
+	/// the input, producing values in [0, 1]
+	void set_shaper( std::vector<float> table, float minV, float maxV )
+	{
+		if ( table.size() < 2 || ! ( maxV > minV ) )
+			throw std::logic_error( "Invalid shaper for 3D LUT" );
+		_shaper = std::move( table );
+		_shaper_min = minV;
+		_shaper_max = maxV;
+	}
+	inline bool has_shaper( void ) const { return ! _shaper.empty(); }
+	inline const std::vector<float> &shaper( void ) const { return _shaper; }
+	inline float shaper_min( void ) const { return _shaper_min; }
+	inline float shaper_max( void ) const { return _shaper_max; }
+
+	/// maps an input value to the domain of the cube, clamping values
+	/// outside the range of the shaper
+	inline float shape( float v ) const
+	{
+		if ( _shaper.empty() )
+			return std::min( std::max( v, 0.F ), 1.F );
+		const int last = static_cast<int>( _shaper.size() ) - 1;
+		float x = ( v - _shaper_min ) * ( static_cast<float>( last ) / ( _shaper_max - _shaper_min ) );
+		x = std::min( std::max( x, 0.F ), static_cast<float>( last ) );
+		int i = std::min( static_cast<int>( x ), last - 1 );
+		float f = x - static_cast<float>( i );
+		return _shaper[static_cast<size_t>( i )] + f * ( _shaper[static_cast<size_t>( i + 1 )] - _shaper[static_cast<size_t>( i )] );
+	}
+
+	/// fills the cube by evaluating func( float &r, float &g, float &b )
+	/// in place at each of the grid points
+	template <typename Func>
+	void bake( Func &&func )
+	{
+		const float scale = 1.F / static_cast<float>( _size - 1 );
+		for ( int b = 0; b < _size; ++b )
+		{
+			for ( int g = 0; g < _size; ++g )
+			{
+				for ( int r = 0; r < _size; ++r )
+				{
+					float v[3] = { static_cast<float>( r ) * scale, static_cast<float>( g ) * scale, static_cast<float>( b ) * scale };
+					func( v[0], v[1], v[2] );
+					std::copy( v, v + 3, entry( r, g, b ) );
+				}
+			}
+		}
+	}
+
+	/// true if the value is inside the domain of the cube
+	static inline bool in_domain( float r, float g, float b )
+	{
+		return r >= 0.F && r <= 1.F && g >= 0.F && g <= 1.F && b >= 0.F && b <= 1.F;
+	}
+
+	/// tetrahedral interpolation of a value inside the domain
+	inline void apply( float &r, float &g, float &b ) const
+	{
+		const int last = _size - 2;
+		const float scale = static_cast<float>( _size - 1 );
+		float fr = r * scale, fg = g * scale, fb = b * scale;
+		int ir = std::min( static_cast<int>( fr ), last );
+		int ig = std::min( static_cast<int>( fg ), last );
+		int ib = std::min( static_cast<int>( fb ), last );
+		fr -= static_cast<float>( ir );
+		fg -= static_cast<float>( ig );
+		fb -= static_cast<float>( ib );
+
+		const size_t sr = 3;
+		const size_t sg = 3 * static_cast<size_t>( _size );
+		const size_t sb = sg * static_cast<size_t>( _size );
+		const float *c000 = entry( ir, ig, ib );
+		const float *c111 = c000 + sr + sg + sb;
+		// the tetrahedron is chosen by the order of the fractions,
+		// walking from c000 to c111 along the largest first
+		const float *c1, *c2;
+		float w0, w1, w2;
+		if ( fr > fg )
+		{
+			if ( fg > fb )
+			{ c1 = c000 + sr; c2 = c1 + sg; w0 = fr; w1 = fg; w2 = fb; }
+			else if ( fr > fb )
+			{ c1 = c000 + sr; c2 = c1 + sb; w0 = fr; w1 = fb; w2 = fg; }
+			else
+			{ c1 = c000 + sb; c2 = c1 + sr; w0 = fb; w1 = fr; w2 = fg; }
+		}
+		else
+		{
+			if ( fb > fg )
+			{ c1 = c000 + sb; c2 = c1 + sg; w0 = fb; w1 = fg; w2 = fr; }
+			else if ( fb > fr )
+			{ c1 = c000 + sg; c2 = c1 + sb; w0 = fg; w1 = fb; w2 = fr; }
+			else
+			{ c1 = c000 + sg; c2 = c1 + sr; w0 = fg; w1 = fr; w2 = fb; }
+		}
+
+		r = c000[0] + w0 * ( c1[0] - c000[0] ) + w1 * ( c2[0] - c1[0] ) + w2 * ( c111[0] - c2[0] );
+		g = c000[1] + w0 * ( c1[1] - c000[1] ) + w1 * ( c2[1] - c1[1] ) + w2 * ( c111[1] - c2[1] );
+		b = c000[2] + w0 * ( c1[2] - c000[2] ) + w1 * ( c2[2] - c1[2] ) + w2 * ( c111[2] - c2[2] );
+	}
+
+	/// applies the shaper (if any) and the cube to any value, values
+	/// outside the domain are clamped to the edge of the cube
+	inline void lookup( float &r, float &g, float &b ) const
+	{
+		r = shape( r );
+		g = shape( g );
+		b = shape( b );
+		apply( r, g, b );
+	}
+
+	/// Writes the LUT as a .cube file. With a shaper, this uses the
+	/// LUT_1D_SIZE / LUT_1D_INPUT_RANGE extension understood by
+	/// Resolve, where the 1D table precedes the cube.
+	void write_cube( std::ostream &os, const std::string &title = std::string() ) const
+	{
+		if ( ! valid() )
+			throw std::logic_error( "Attempt to write an empty 3D LUT" );
+
+		std::ios::fmtflags oldFlags = os.flags();
+		std::streamsize oldPrec = os.precision();
+		os << std::setprecision( std::numeric_limits<float>::max_digits10 );
+		if ( ! title.empty() )
+			os << "TITLE \"" << title << "\"\n";
+		if ( has_shaper() )
+		{
+			os << "LUT_1D_SIZE " << _shaper.size() << '\n';
+			os << "LUT_1D_INPUT_RANGE " << _shaper_min << ' ' << _shaper_max << '\n';
+		}
+		os << "LUT_3D_SIZE " << _size << '\n';
+		if ( has_shaper() )
+		{
+			os << "LUT_3D_INPUT_RANGE 0 1\n";
+			for ( float v: _shaper )
+				os << v << ' ' << v << ' ' << v << '\n';
+		}
+		for ( size_t i = 0; i < _data.size(); i += 3 )
+			os << _data[i] << ' ' << _data[i + 1] << ' ' << _data[i + 2] << '\n';
+		os.flags( oldFlags );
+		os.precision( oldPrec );
+	}
+
+private:
+	int _size = 0;
+	std::vector<float> _data;
+	std::vector<float> _shaper;
+	float _shaper_min = 0.F;
+	float _shaper_max = 1.F;
+};
+
+} // namespace color
+
+
+
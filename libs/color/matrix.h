@@ -49,8 +49,8 @@ public:
 	template <typename U>
 	inline constexpr matrix( const matrix<U> &o ) noexcept : _m{{
 			static_cast<value_type>(o[0][0]), static_cast<value_type>(o[0][1]), static_cast<value_type>(o[0][2]),
-			static_cast<value_type>(o[1][3]), static_cast<value_type>(o[1][4]), static_cast<value_type>(o[1][5]),
-			static_cast<value_type>(o[2][6]), static_cast<value_type>(o[2][7]), static_cast<value_type>(o[2][8]) }} {}
+			static_cast<value_type>(o[1][0]), static_cast<value_type>(o[1][1]), static_cast<value_type>(o[1][2]),
+			static_cast<value_type>(o[2][0]), static_cast<value_type>(o[2][1]), static_cast<value_type>(o[2][2]) }} {}
 			
 	inline constexpr matrix( const matrix & ) = default;
 	inline constexpr matrix( matrix && ) = default;
@@ -0,0 +1,256 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include "spectral_density.h"
+#include "spectral_sensitivity.h"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __SSE__
+# if defined(LINUX) || defined(__linux__)
+#  include <x86intrin.h>
+# else
+#  include <xmmintrin.h>
+#  include <immintrin.h>
+# endif
+#endif
+
+////////////////////////////////////////
+
+namespace color
+{
+
+///
+/// @brief Class spectral_grid describes a set of evenly spaced
+/// wavelengths, shared by a batch of spectral distributions so they
+/// can be stored as plain arrays of samples.
+///
+class spectral_grid
+{
+public:
+	spectral_grid( void ) = default;
+	spectral_grid( float start, float delta, size_t n )
+		: _start( start ), _delta( delta ), _size( n )
+	{
+		if ( ! ( delta > 0.F ) || n == 0 )
+			throw std::logic_error( "Invalid spectral grid" );
+	}
+
+	inline bool valid( void ) const { return _size > 0; }
+	inline size_t size( void ) const { return _size; }
+	inline float start_wavelength( void ) const { return _start; }
+	inline float delta( void ) const { return _delta; }
+	inline float wavelength( size_t i ) const { return _start + _delta * static_cast<float>( i ); }
+
+	/// resamples the distribution to the grid, writing size() values
+	template <typename T>
+	void resample( const spectral_density<T> &d, float *out ) const
+	{
+		for ( size_t i = 0; i != _size; ++i )
+			out[i] = static_cast<float>( d.sample( static_cast<T>( wavelength( i ) ), static_cast<T>( _delta ) ) );
+	}
+
+	template <typename T>
+	std::vector<float> resample( const spectral_density<T> &d ) const
+	{
+		std::vector<float> ret( _size );
+		resample( d, ret.data() );
+		return ret;
+	}
+
+private:
+	float _start = 0.F;
+	float _delta = 0.F;
+	size_t _size = 0;
+};
+
+inline bool operator==( const spectral_grid &a, const spectral_grid &b )
+{
+	return a.size() == b.size() && a.start_wavelength() == b.start_wavelength() && a.delta() == b.delta();
+}
+
+inline bool operator!=( const spectral_grid &a, const spectral_grid &b )
+{
+	return !( a == b );
+}
+
+///
+/// @brief Class spectral_integrator integrates batches of spectral
+/// distributions sampled on a spectral_grid against a spectral
+/// sensitivity (color matching functions, or the sensitivities of a
+/// camera).
+///
+/// The sensitivity is resampled to the grid once, and premultiplied
+/// by the wavelength delta (and the illuminant, if any), so each
+/// integration is just 3 dot products. Distributions stored one after
+/// another are integrated with SIMD dot products along the samples,
+/// and spectral planes (one plane per sample) with SIMD accumulation
+/// across the pixels.
+///
+class spectral_integrator
+{
+public:
+	spectral_integrator( void ) = default;
+
+	/// integrates emissive distributions
+	template <typename T>
+	spectral_integrator( const spectral_sensitivity<T> &s, const spectral_grid &g )
+		: _grid( g )
+	{
+		init( s, nullptr );
+	}
+
+	/// Integrates reflectance (or transmittance) distributions lit by
+	/// the illuminant, normalized such that a perfect reflector has a
+	/// second (Y) value of 1
+	template <typename T, typename U>
+	spectral_integrator( const spectral_sensitivity<T> &s, const spectral_density<U> &illum, const spectral_grid &g )
+		: _grid( g )
+	{
+		std::vector<float> il = g.resample( illum );
+		init( s, il.data() );
+		float y = 0.F;
+		for ( size_t i = 0; i != size(); ++i )
+			y += _weights[1][i];
+		if ( ! ( y > 0.F ) )
+			throw std::logic_error( "Illuminant has no luminance over the spectral grid" );
+		for ( auto &w: _weights )
+			for ( float &v: w )
+				v /= y;
+	}
+
+	inline bool valid( void ) const { return _grid.valid(); }
+	inline const spectral_grid &grid( void ) const { return _grid; }
+	inline size_t size( void ) const { return _grid.size(); }
+	/// the per-sample weights for output channel c (0 - 2)
+	inline const std::vector<float> &weights( size_t c ) const { return _weights[c]; }
+
+	/// integrates one distribution of size() samples
+	inline void integrate( const float *spd, float &x, float &y, float &z ) const
+	{
+		const float *wx = _weights[0].data();
+		const float *wy = _weights[1].data();
+		const float *wz = _weights[2].data();
+		const size_t n = size();
+		size_t i = 0;
+		x = y = z = 0.F;
+#if defined(__SSE__)
+		__m128 ax = _mm_setzero_ps();
+		__m128 ay = _mm_setzero_ps();
+		__m128 az = _mm_setzero_ps();
+		for ( ; i + 3 < n; i += 4 )
+		{
+			__m128 s = _mm_loadu_ps( spd + i );
+			ax = _mm_add_ps( ax, _mm_mul_ps( s, _mm_loadu_ps( wx + i ) ) );
+			ay = _mm_add_ps( ay, _mm_mul_ps( s, _mm_loadu_ps( wy + i ) ) );
+			az = _mm_add_ps( az, _mm_mul_ps( s, _mm_loadu_ps( wz + i ) ) );
+		}
+		x = hsum( ax );
+		y = hsum( ay );
+		z = hsum( az );
+#endif
+		for ( ; i < n; ++i )
+		{
+			x += spd[i] * wx[i];
+			y += spd[i] * wy[i];
+			z += spd[i] * wz[i];
+		}
+	}
+
+	/// integrates count distributions of size() samples, each stride
+	/// values after the previous, writing count (x, y, z) triples
+	void integrate( const float *spd, size_t count, size_t stride, float *out ) const
+	{
+		if ( stride < size() )
+			throw std::logic_error( "Spectral distributions overlap" );
+		for ( size_t d = 0; d != count; ++d, spd += stride, out += 3 )
+			integrate( spd, out[0], out[1], out[2] );
+	}
+
+	/// Integrates n pixels of spectral planes, where bands[i] points
+	/// to the values of sample i of the grid (i.e. the scanline of the
+	/// plane from a multispectral layer), writing the 3 channels to x,
+	/// y and z. Works on blocks of pixels so the accumulators stay in
+	/// cache while the bands are streamed through.
+	void integrate_planes( const float * const *bands, size_t n, float *x, float *y, float *z ) const
+	{
+		const size_t block = kPlaneBlock;
+		for ( size_t s = 0; s < n; s += block )
+		{
+			size_t bn = std::min( block, n - s );
+			std::fill( x + s, x + s + bn, 0.F );
+			std::fill( y + s, y + s + bn, 0.F );
+			std::fill( z + s, z + s + bn, 0.F );
+			for ( size_t b = 0; b != size(); ++b )
+				accumulate( bands[b] + s, bn, _weights[0][b], _weights[1][b], _weights[2][b], x + s, y + s, z + s );
+		}
+	}
+
+private:
+	static constexpr size_t kPlaneBlock = 1024;
+
+	template <typename T>
+	void init( const spectral_sensitivity<T> &s, const float *illum )
+	{
+		const size_t n = size();
+		const float d = _grid.delta();
+		for ( auto &w: _weights )
+			w.resize( n );
+		for ( size_t i = 0; i != n; ++i )
+		{
+			T l = static_cast<T>( _grid.wavelength( i ) );
+			T ld = static_cast<T>( d );
+			float scale = illum ? illum[i] * d : d;
+			_weights[0][i] = static_cast<float>( s.sample_x( l, ld ) ) * scale;
+			_weights[1][i] = static_cast<float>( s.sample_y( l, ld ) ) * scale;
+			_weights[2][i] = static_cast<float>( s.sample_z( l, ld ) ) * scale;
+		}
+	}
+
+	static inline void accumulate( const float *b, size_t n, float kx, float ky, float kz, float *x, float *y, float *z )
+	{
+		size_t i = 0;
+#if defined(__SSE__)
+		const __m128 vx = _mm_set1_ps( kx );
+		const __m128 vy = _mm_set1_ps( ky );
+		const __m128 vz = _mm_set1_ps( kz );
+		for ( ; i + 3 < n; i += 4 )
+		{
+			__m128 v = _mm_loadu_ps( b + i );
+			_mm_storeu_ps( x + i, _mm_add_ps( _mm_loadu_ps( x + i ), _mm_mul_ps( v, vx ) ) );
+			_mm_storeu_ps( y + i, _mm_add_ps( _mm_loadu_ps( y + i ), _mm_mul_ps( v, vy ) ) );
+			_mm_storeu_ps( z + i, _mm_add_ps( _mm_loadu_ps( z + i ), _mm_mul_ps( v, vz ) ) );
+		}
+#endif
+		for ( ; i < n; ++i )
+		{
+			x[i] += b[i] * kx;
+			y[i] += b[i] * ky;
+			z[i] += b[i] * kz;
+		}
+	}
+
+#if defined(__SSE__)
+	static inline float hsum( __m128 v )
+	{
+		__m128 s = _mm_add_ps( v, _mm_movehl_ps( v, v ) );
+		s = _mm_add_ss( s, _mm_shuffle_ps( s, s, 1 ) );
+		return _mm_cvtss_f32( s );
+	}
+#endif
+
+	spectral_grid _grid;
+	std::vector<float> _weights[3];
+};
+
+} // namespace color
+
+
+
@@ -116,7 +116,7 @@ public:
 		value_type radius = static_cast<value_type>( nSamples ) / value_type(2);
 
 		value_type ret = value_type(0);
-		for ( long i = 0; i < nSamples; ++i, curL += delta() )
+		for ( long i = 0; i < nSamples; ++i )
 		{
 			value_type x = ( static_cast<value_type>( i ) - radius + value_type(0.5) );
 			ret += sample( l + x * delta() );
@@ -140,11 +140,12 @@ public:
 	}
 
 	template <typename OT>
-	typename std::common_type<value_type, typename OT::value_type>::type
-	dot( const spectral_density<OT> &o )
+	typename std::common_type<value_type, OT>::type
+	dot( const spectral_density<OT> &o ) const
 	{
-		using rettype = typename std::common_type<value_type, typename OT::value_type>::type;
+		using rettype = typename std::common_type<value_type, OT>::type;
 		rettype ret = rettype(0);
+		value_type curL = start_wavelength();
 		for ( size_t i = 0; i != size(); ++i, curL += delta() )
 			ret += _table[i] * o.sample( curL, delta() );
 		return ret;
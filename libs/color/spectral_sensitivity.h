@@ -9,7 +9,7 @@
 
 #include "spectral_density.h"
 #include <vector>
-#include "triple.h"
+#include "triplet.h"
 
 ////////////////////////////////////////
 
@@ -49,11 +49,11 @@ public:
 	value_type sample_z( value_type l, value_type d ) const { return _z_bar.sample( l, d ); }
 
 	template <typename OT>
-	triple<typename std::common_type<value_type, typename OT::value_type>::type>
-	integrate( const spectral_density<OT> &d )
+	triplet<typename std::common_type<value_type, OT>::type>
+	integrate( const spectral_density<OT> &d ) const
 	{
-		using rettype = typename std::common_type<value_type, typename OT::value_type>::type;
-		return triple<rettype>{ _x_bar.dot( d ), _y_bar.dot( d ), _z_bar.dot( d ) };
+		using rettype = typename std::common_type<value_type, OT>::type;
+		return triplet<rettype>{ _x_bar.dot( d ), _y_bar.dot( d ), _z_bar.dot( d ) };
 	}
 
 	const table &x_bar( void ) const { return _x_bar; }
@@ -23,6 +23,10 @@
 // when just carrying the state???
 #include "transfer_curves/mid_gray_log.h"
 #include "transfer_curves/gamma_srgb.h"
+#include "transfer_curves/gamma_bt709.h"
+#include "transfer_curves/gamma_power.h"
+#include "transfer_curves/pq.h"
+#include "transfer_curves/hlg.h"
 #include "transfer_curves/cie_Lab_76.h"
 
 ////////////////////////////////////////
@@ -125,11 +129,11 @@ inline T linearize( const T v, transfer t )
 	{
 		case transfer::LINEAR: return v;
 		case transfer::GAMMA_sRGB: return gamma_srgb<T>::linearize( v );
-		case transfer::GAMMA_BT601: return gamma_srgb<T>::linearize( v );
-		case transfer::GAMMA_BT709: return gamma_srgb<T>::linearize( v );
-		case transfer::GAMMA_BT2020: return gamma_srgb<T>::linearize( v );
+		case transfer::GAMMA_BT601: return gamma_bt709<T>::linearize( v );
+		case transfer::GAMMA_BT709: return gamma_bt709<T>::linearize( v );
+		case transfer::GAMMA_BT2020: return gamma_bt709<T>::linearize( v );
 		case transfer::GAMMA_BT1886: return gamma_srgb<T>::linearize( v );
-		case transfer::GAMMA_DCI: return gamma_srgb<T>::linearize( v );
+		case transfer::GAMMA_DCI: return gamma_power<T>::linearize( v );
 		case transfer::GAMMA_CUSTOM: return gamma_srgb<T>::linearize( v );
 		case transfer::FOUR_PT_GAMMA_CUSTOM: return gamma_srgb<T>::linearize( v );
 		case transfer::SONY_SLOG1: return gamma_srgb<T>::linearize( v );
@@ -142,8 +146,8 @@ inline T linearize( const T v, transfer t )
 		case transfer::CINEON: return gamma_srgb<T>::linearize( v );
 		case transfer::CINEON_SOFTCLIP: return gamma_srgb<T>::linearize( v );
 		case transfer::MID_GRAY_LOG: return mid_gray_log<T>::linearize( v );
-		case transfer::PQ: return gamma_srgb<T>::linearize( v );
-		case transfer::HLG_OETF: return gamma_srgb<T>::linearize( v );
+		case transfer::PQ: return pq<T>::linearize( v );
+		case transfer::HLG_OETF: return hlg<T>::linearize( v );
 		case transfer::HLG_EOTF: return gamma_srgb<T>::linearize( v );
 		case transfer::ACES_cc: return gamma_srgb<T>::linearize( v );
 		case transfer::ACES_cct: return gamma_srgb<T>::linearize( v );
@@ -160,11 +164,11 @@ inline T encode( const T v, transfer t )
 	{
 		case transfer::LINEAR: return v;
 		case transfer::GAMMA_sRGB: return gamma_srgb<T>::encode( v );
-		case transfer::GAMMA_BT601: return gamma_srgb<T>::encode( v );
-		case transfer::GAMMA_BT709: return gamma_srgb<T>::encode( v );
-		case transfer::GAMMA_BT2020: return gamma_srgb<T>::encode( v );
+		case transfer::GAMMA_BT601: return gamma_bt709<T>::encode( v );
+		case transfer::GAMMA_BT709: return gamma_bt709<T>::encode( v );
+		case transfer::GAMMA_BT2020: return gamma_bt709<T>::encode( v );
 		case transfer::GAMMA_BT1886: return gamma_srgb<T>::encode( v );
-		case transfer::GAMMA_DCI: return gamma_srgb<T>::encode( v );
+		case transfer::GAMMA_DCI: return gamma_power<T>::encode( v );
 		case transfer::GAMMA_CUSTOM: return gamma_srgb<T>::encode( v );
 		case transfer::FOUR_PT_GAMMA_CUSTOM: return gamma_srgb<T>::encode( v );
 		case transfer::SONY_SLOG1: return gamma_srgb<T>::encode( v );
@@ -177,8 +181,8 @@ inline T encode( const T v, transfer t )
 		case transfer::CINEON: return gamma_srgb<T>::encode( v );
 		case transfer::CINEON_SOFTCLIP: return gamma_srgb<T>::encode( v );
 		case transfer::MID_GRAY_LOG: return mid_gray_log<T>::encode( v );
-		case transfer::PQ: return gamma_srgb<T>::encode( v );
-		case transfer::HLG_OETF: return gamma_srgb<T>::encode( v );
+		case transfer::PQ: return pq<T>::encode( v );
+		case transfer::HLG_OETF: return hlg<T>::encode( v );
 		case transfer::HLG_EOTF: return gamma_srgb<T>::encode( v );
 		case transfer::ACES_cc: return gamma_srgb<T>::encode( v );
 		case transfer::ACES_cct: return gamma_srgb<T>::encode( v );
@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+////////////////////////////////////////
+
+namespace color
+{
+
+// BT.709 OETF, also used by BT.601, and BT.2020 for 10 bit signals
+// (the 12 bit variant of BT.2020 only refines the precision of the
+// constants). Negative values are reflected, as with sRGB
+template <typename T>
+struct gamma_bt709
+{
+	static_assert( std::is_floating_point<T>::value, "Expecting a floating point type" );
+
+	inline std::string to_linear_glsl( const std::string &funcName )
+	{
+		std::stringstream func;
+		func <<
+			"float " << funcName << "(float v)\n"
+			"{\n"
+			"    float x = fabs( v );\n"
+			"    x = x < 0.081f ? x / 4.5f : pow( ( x + 0.099f ) / 1.099f, 1.f / 0.45f );\n"
+			"    return copysign( x, v );\n"
+			"}\n";
+		return func.str();
+	}		
+
+	inline std::string from_linear_glsl( const std::string &funcName )
+	{
+		std::stringstream func;
+		func <<
+			"float " << funcName << "(float v)\n"
+			"{\n"
+			"    float x = fabs( v );\n"
+			"    x = x < 0.018f ? 4.5f * x : 1.099f * pow( x, 0.45f ) - 0.099f;\n"
+			"    return copysign( x, v );\n"
+			"}\n";
+		return func.str();
+	}		
+
+	constexpr inline T to_linear( const T v ) const
+	{
+		return std::abs( v ) < T(0.081) ? v / T(4.5) : std::copysign( std::pow( ( std::abs( v ) + T(0.099) ) / T(1.099), T(1.0/0.45) ), v );
+	}
+
+	constexpr inline T from_linear( const T v ) const
+	{
+		return std::abs( v ) < T(0.018) ? v * T(4.5) : std::copysign( T(1.099) * std::pow( std::abs( v ), T(0.45) ) - T(0.099), v );
+	}
+
+	static constexpr inline T linearize( const T v )
+	{
+		return gamma_bt709().to_linear( v );
+	}
+
+	static constexpr inline T encode( const T v )
+	{
+		return gamma_bt709().from_linear( v );
+	}
+};
+
+} // namespace color
+
+
+
@@ -0,0 +1,78 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+////////////////////////////////////////
+
+namespace color
+{
+
+// pure power function, no linear segment (i.e. gamma 2.6 for digital
+// cinema). Negative values are reflected
+template <typename T>
+struct gamma_power
+{
+	static_assert( std::is_floating_point<T>::value, "Expecting a floating point type" );
+
+	constexpr gamma_power( const T g = T(2.6) ) noexcept
+		: _gamma( g )
+	{}
+
+	inline std::string to_linear_glsl( const std::string &funcName )
+	{
+		std::stringstream func;
+		func <<
+			"float " << funcName << "(float v)\n"
+			"{\n"
+			"    return copysign( pow( fabs( v ), " << _gamma << " ), v );\n"
+			"}\n";
+		return func.str();
+	}		
+
+	inline std::string from_linear_glsl( const std::string &funcName )
+	{
+		std::stringstream func;
+		func <<
+			"float " << funcName << "(float v)\n"
+			"{\n"
+			"    return copysign( pow( fabs( v ), 1.f / " << _gamma << " ), v );\n"
+			"}\n";
+		return func.str();
+	}		
+
+	constexpr inline T to_linear( const T v ) const
+	{
+		return std::copysign( std::pow( std::abs( v ), _gamma ), v );
+	}
+
+	constexpr inline T from_linear( const T v ) const
+	{
+		return std::copysign( std::pow( std::abs( v ), T(1) / _gamma ), v );
+	}
+
+	const T _gamma;
+
+	static constexpr inline T linearize( const T v, const T g = T(2.6) )
+	{
+		return gamma_power( g ).to_linear( v );
+	}
+
+	static constexpr inline T encode( const T v, const T g = T(2.6) )
+	{
+		return gamma_power( g ).from_linear( v );
+	}
+};
+
+} // namespace color
+
+
+
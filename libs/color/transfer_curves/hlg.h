@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+////////////////////////////////////////
+
+namespace color
+{
+
+// BT.2100 hybrid log gamma OETF, scene linear values normalized to
+// [0, 1]. Negative values are reflected
+template <typename T>
+struct hlg
+{
+	static_assert( std::is_floating_point<T>::value, "Expecting a floating point type" );
+
+	static constexpr T a = T(0.17883277);
+	static constexpr T b = T(0.28466892);
+	static constexpr T c = T(0.55991073);
+
+	inline std::string to_linear_glsl( const std::string &funcName )
+	{
+		std::stringstream func;
+		func <<
+			"float " << funcName << "(float v)\n"
+			"{\n"
+			"    float x = fabs( v );\n"
+			"    x = x <= 0.5f ? x * x / 3.f : ( exp( ( x - 0.55991073f ) / 0.17883277f ) + 0.28466892f ) / 12.f;\n"
+			"    return copysign( x, v );\n"
+			"}\n";
+		return func.str();
+	}		
+
+	inline std::string from_linear_glsl( const std::string &funcName )
+	{
+		std::stringstream func;
+		func <<
+			"float " << funcName << "(float v)\n"
+			"{\n"
+			"    float x = fabs( v );\n"
+			"    x = x <= 1.f / 12.f ? sqrt( 3.f * x ) : 0.17883277f * log( 12.f * x - 0.28466892f ) + 0.55991073f;\n"
+			"    return copysign( x, v );\n"
+			"}\n";
+		return func.str();
+	}		
+
+	constexpr inline T to_linear( const T v ) const
+	{
+		return std::copysign( std::abs( v ) <= T(0.5) ? v * v / T(3) : ( std::exp( ( std::abs( v ) - c ) / a ) + b ) / T(12), v );
+	}
+
+	constexpr inline T from_linear( const T v ) const
+	{
+		return std::copysign( std::abs( v ) <= T(1.0/12.0) ? std::sqrt( T(3) * std::abs( v ) ) : a * std::log( T(12) * std::abs( v ) - b ) + c, v );
+	}
+
+	static constexpr inline T linearize( const T v )
+	{
+		return hlg().to_linear( v );
+	}
+
+	static constexpr inline T encode( const T v )
+	{
+		return hlg().from_linear( v );
+	}
+};
+
+} // namespace color
+
+
+
@@ -0,0 +1,82 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <cmath>
+#include <sstream>
+#include <string>
+
+////////////////////////////////////////
+
+namespace color
+{
+
+// SMPTE ST.2084 perceptual quantizer, with linear values normalized
+// such that 1.0 is 10000 cd/m^2. Negative values are reflected
+template <typename T>
+struct pq
+{
+	static_assert( std::is_floating_point<T>::value, "Expecting a floating point type" );
+
+	static constexpr T m1 = T(2610.0/16384.0);
+	static constexpr T m2 = T(2523.0/4096.0*128.0);
+	static constexpr T c1 = T(3424.0/4096.0);
+	static constexpr T c2 = T(2413.0/4096.0*32.0);
+	static constexpr T c3 = T(2392.0/4096.0*32.0);
+
+	inline std::string to_linear_glsl( const std::string &funcName )
+	{
+		std::stringstream func;
+		func <<
+			"float " << funcName << "(float v)\n"
+			"{\n"
+			"    float x = pow( fabs( v ), 1.f / 78.84375f );\n"
+			"    x = pow( max( x - 0.8359375f, 0.f ) / ( 18.8515625f - 18.6875f * x ), 1.f / 0.1593017578125f );\n"
+			"    return copysign( x, v );\n"
+			"}\n";
+		return func.str();
+	}		
+
+	inline std::string from_linear_glsl( const std::string &funcName )
+	{
+		std::stringstream func;
+		func <<
+			"float " << funcName << "(float v)\n"
+			"{\n"
+			"    float x = pow( fabs( v ), 0.1593017578125f );\n"
+			"    x = pow( ( 0.8359375f + 18.8515625f * x ) / ( 1.f + 18.6875f * x ), 78.84375f );\n"
+			"    return copysign( x, v );\n"
+			"}\n";
+		return func.str();
+	}		
+
+	constexpr inline T to_linear( const T v ) const
+	{
+		return std::copysign( std::pow( std::max( std::pow( std::abs( v ), T(1) / m2 ) - c1, T(0) ) / ( c2 - c3 * std::pow( std::abs( v ), T(1) / m2 ) ), T(1) / m1 ), v );
+	}
+
+	constexpr inline T from_linear( const T v ) const
+	{
+		return std::copysign( std::pow( ( c1 + c2 * std::pow( std::abs( v ), m1 ) ) / ( T(1) + c3 * std::pow( std::abs( v ), m1 ) ), m2 ), v );
+	}
+
+	static constexpr inline T linearize( const T v )
+	{
+		return pq().to_linear( v );
+	}
+
+	static constexpr inline T encode( const T v )
+	{
+		return pq().from_linear( v );
+	}
+};
+
+} // namespace color
+
+
+
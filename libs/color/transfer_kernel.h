@@ -0,0 +1,261 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licenced under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include "transfer_curve.h"
+#include "fast_math.h"
+#include <cstddef>
+
+////////////////////////////////////////
+
+namespace color
+{
+
+///
+/// @brief transfer_kernel provides a compile time specialization of
+/// a transfer curve.
+///
+/// Each specialization provides linearize / encode templated on the
+/// value type (float, or fast::float4 when SSE is available) using the
+/// approximations in @sa fast, along with linearize_exact /
+/// encode_exact, which are the reference implementations used by
+/// @sa color::linearize and @sa color::encode. The curve is chosen
+/// once for a scanline (@sa linearize_line) rather than per value, and
+/// the kernels select between the segments of the curve rather than
+/// branching, so they vectorize.
+///
+/// Only the curves with a complete reference implementation have a
+/// kernel, @sa has_kernel.
+///
+template <transfer T> struct transfer_kernel;
+
+template <>
+struct transfer_kernel<transfer::LINEAR>
+{
+	template <typename V> static inline V linearize( V v ) { return v; }
+	template <typename V> static inline V encode( V v ) { return v; }
+	static inline double linearize_exact( double v ) { return v; }
+	static inline double encode_exact( double v ) { return v; }
+};
+
+template <>
+struct transfer_kernel<transfer::GAMMA_sRGB>
+{
+	template <typename V> static inline V linearize( V v )
+	{
+		V x = fast::abs( v );
+		V r = fast::select( x <= V(0.04045F), x * V(1.F / 12.92F), fast::pow( ( x + V(0.055F) ) * V(1.F / 1.055F), 2.4F ) );
+		return fast::copysign( r, v );
+	}
+	template <typename V> static inline V encode( V v )
+	{
+		V x = fast::abs( v );
+		V r = fast::select( x <= V(0.0031308F), x * V(12.92F), V(1.055F) * fast::pow( x, 1.F / 2.4F ) - V(0.055F) );
+		return fast::copysign( r, v );
+	}
+	static inline double linearize_exact( double v ) { return gamma_srgb<double>::linearize( v ); }
+	static inline double encode_exact( double v ) { return gamma_srgb<double>::encode( v ); }
+};
+
+template <>
+struct transfer_kernel<transfer::GAMMA_BT709>
+{
+	template <typename V> static inline V linearize( V v )
+	{
+		V x = fast::abs( v );
+		V r = fast::select( x < V(0.081F), x * V(1.F / 4.5F), fast::pow( ( x + V(0.099F) ) * V(1.F / 1.099F), 1.F / 0.45F ) );
+		return fast::copysign( r, v );
+	}
+	template <typename V> static inline V encode( V v )
+	{
+		V x = fast::abs( v );
+		V r = fast::select( x < V(0.018F), x * V(4.5F), V(1.099F) * fast::pow( x, 0.45F ) - V(0.099F) );
+		return fast::copysign( r, v );
+	}
+	static inline double linearize_exact( double v ) { return gamma_bt709<double>::linearize( v ); }
+	static inline double encode_exact( double v ) { return gamma_bt709<double>::encode( v ); }
+};
+
+template <> struct transfer_kernel<transfer::GAMMA_BT601> : public transfer_kernel<transfer::GAMMA_BT709> {};
+template <> struct transfer_kernel<transfer::GAMMA_BT2020> : public transfer_kernel<transfer::GAMMA_BT709> {};
+
+template <>
+struct transfer_kernel<transfer::GAMMA_DCI>
+{
+	template <typename V> static inline V linearize( V v )
+	{
+		return fast::copysign( fast::pow( fast::abs( v ), 2.6F ), v );
+	}
+	template <typename V> static inline V encode( V v )
+	{
+		return fast::copysign( fast::pow( fast::abs( v ), 1.F / 2.6F ), v );
+	}
+	static inline double linearize_exact( double v ) { return gamma_power<double>::linearize( v, 2.6 ); }
+	static inline double encode_exact( double v ) { return gamma_power<double>::encode( v, 2.6 ); }
+};
+
+template <>
+struct transfer_kernel<transfer::PQ>
+{
+	template <typename V> static inline V linearize( V v )
+	{
+		const float m1 = static_cast<float>( pq<double>::m1 );
+		const float m2 = static_cast<float>( pq<double>::m2 );
+		const float c1 = static_cast<float>( pq<double>::c1 );
+		const float c2 = static_cast<float>( pq<double>::c2 );
+		const float c3 = static_cast<float>( pq<double>::c3 );
+		V x = fast::pow( fast::abs( v ), 1.F / m2 );
+		V r = fast::pow( fast::max( x - V(c1), V(0.F) ) / ( V(c2) - V(c3) * x ), 1.F / m1 );
+		return fast::copysign( r, v );
+	}
+	template <typename V> static inline V encode( V v )
+	{
+		const float m1 = static_cast<float>( pq<double>::m1 );
+		const float m2 = static_cast<float>( pq<double>::m2 );
+		const float c1 = static_cast<float>( pq<double>::c1 );
+		const float c2 = static_cast<float>( pq<double>::c2 );
+		const float c3 = static_cast<float>( pq<double>::c3 );
+		V x = fast::pow( fast::abs( v ), m1 );
+		V r = fast::pow( ( V(c1) + V(c2) * x ) / ( V(1.F) + V(c3) * x ), m2 );
+		return fast::copysign( r, v );
+	}
+	static inline double linearize_exact( double v ) { return pq<double>::linearize( v ); }
+	static inline double encode_exact( double v ) { return pq<double>::encode( v ); }
+};
+
+template <>
+struct transfer_kernel<transfer::HLG_OETF>
+{
+	template <typename V> static inline V linearize( V v )
+	{
+		const float a = static_cast<float>( hlg<double>::a );
+		const float b = static_cast<float>( hlg<double>::b );
+		const float c = static_cast<float>( hlg<double>::c );
+		V x = fast::abs( v );
+		V r = fast::select( x <= V(0.5F), x * x * V(1.F / 3.F), ( fast::exp( ( x - V(c) ) * V(1.F / a) ) + V(b) ) * V(1.F / 12.F) );
+		return fast::copysign( r, v );
+	}
+	template <typename V> static inline V encode( V v )
+	{
+		const float a = static_cast<float>( hlg<double>::a );
+		const float b = static_cast<float>( hlg<double>::b );
+		const float c = static_cast<float>( hlg<double>::c );
+		V x = fast::abs( v );
+		// keep the log argument positive in the unused segment
+		V l = fast::log( fast::max( V(12.F) * x - V(b), V(1e-6F) ) );
+		V r = fast::select( x <= V(1.F / 12.F), fast::sqrt( V(3.F) * x ), V(a) * l + V(c) );
+		return fast::copysign( r, v );
+	}
+	static inline double linearize_exact( double v ) { return hlg<double>::linearize( v ); }
+	static inline double encode_exact( double v ) { return hlg<double>::encode( v ); }
+};
+
+template <>
+struct transfer_kernel<transfer::MID_GRAY_LOG>
+{
+	// default controls of mid_gray_log
+	template <typename V> static inline V linearize( V v )
+	{
+		V x = fast::min( fast::max( V(0.F), v * V(1023.F) ), V(1023.F) );
+		return V(0.18F) * fast::pow10( ( x - V(445.F) ) * V(0.002F / 0.6F) );
+	}
+	template <typename V> static inline V encode( V v )
+	{
+		V l = fast::log10( fast::max( v, V(1e-10F) ) * V(1.F / 0.18F) );
+		return fast::min( V(1023.F), V(445.F) + l * V(0.6F / 0.002F) ) * V(1.F / 1023.F);
+	}
+	static inline double linearize_exact( double v ) { return mid_gray_log<double>::linearize( v ); }
+	static inline double encode_exact( double v ) { return mid_gray_log<double>::encode( v ); }
+};
+
+////////////////////////////////////////
+
+/// true if there is a transfer_kernel for the curve
+inline constexpr bool has_kernel( transfer t )
+{
+	return ( t == transfer::LINEAR || t == transfer::GAMMA_sRGB ||
+			 t == transfer::GAMMA_BT601 || t == transfer::GAMMA_BT709 ||
+			 t == transfer::GAMMA_BT2020 || t == transfer::GAMMA_DCI ||
+			 t == transfer::PQ || t == transfer::HLG_OETF ||
+			 t == transfer::MID_GRAY_LOG );
+}
+
+/// linearizes n values in place with the kernel for the curve
+template <transfer T>
+inline void linearize_line( float *v, size_t n )
+{
+	size_t i = 0;
+#if defined(__SSE__)
+	for ( ; i + 3 < n; i += 4 )
+		_mm_storeu_ps( v + i, transfer_kernel<T>::linearize( fast::float4( _mm_loadu_ps( v + i ) ) ).v );
+#endif
+	for ( ; i < n; ++i )
+		v[i] = transfer_kernel<T>::linearize( v[i] );
+}
+
+/// encodes n values in place with the kernel for the curve
+template <transfer T>
+inline void encode_line( float *v, size_t n )
+{
+	size_t i = 0;
+#if defined(__SSE__)
+	for ( ; i + 3 < n; i += 4 )
+		_mm_storeu_ps( v + i, transfer_kernel<T>::encode( fast::float4( _mm_loadu_ps( v + i ) ) ).v );
+#endif
+	for ( ; i < n; ++i )
+		v[i] = transfer_kernel<T>::encode( v[i] );
+}
+
+/// linearizes n values in place, choosing the kernel once, or falling
+/// back to @sa linearize per value for curves without one
+inline void linearize_line( float *v, size_t n, transfer t )
+{
+	switch ( t )
+	{
+		case transfer::LINEAR: return;
+		case transfer::GAMMA_sRGB: linearize_line<transfer::GAMMA_sRGB>( v, n ); return;
+		case transfer::GAMMA_BT601:
+		case transfer::GAMMA_BT709:
+		case transfer::GAMMA_BT2020: linearize_line<transfer::GAMMA_BT709>( v, n ); return;
+		case transfer::GAMMA_DCI: linearize_line<transfer::GAMMA_DCI>( v, n ); return;
+		case transfer::PQ: linearize_line<transfer::PQ>( v, n ); return;
+		case transfer::HLG_OETF: linearize_line<transfer::HLG_OETF>( v, n ); return;
+		case transfer::MID_GRAY_LOG: linearize_line<transfer::MID_GRAY_LOG>( v, n ); return;
+		default:
+			for ( size_t i = 0; i != n; ++i )
+				v[i] = linearize( v[i], t );
+			return;
+	}
+}
+
+/// encodes n values in place, choosing the kernel once, or falling
+/// back to @sa encode per value for curves without one
+inline void encode_line( float *v, size_t n, transfer t )
+{
+	switch ( t )
+	{
+		case transfer::LINEAR: return;
+		case transfer::GAMMA_sRGB: encode_line<transfer::GAMMA_sRGB>( v, n ); return;
+		case transfer::GAMMA_BT601:
+		case transfer::GAMMA_BT709:
+		case transfer::GAMMA_BT2020: encode_line<transfer::GAMMA_BT709>( v, n ); return;
+		case transfer::GAMMA_DCI: encode_line<transfer::GAMMA_DCI>( v, n ); return;
+		case transfer::PQ: encode_line<transfer::PQ>( v, n ); return;
+		case transfer::HLG_OETF: encode_line<transfer::HLG_OETF>( v, n ); return;
+		case transfer::MID_GRAY_LOG: encode_line<transfer::MID_GRAY_LOG>( v, n ); return;
+		default:
+			for ( size_t i = 0; i != n; ++i )
+				v[i] = encode( v[i], t );
+			return;
+	}
+}
+
+} // namespace color
+
+
+
@@ -49,25 +49,25 @@ inline constexpr bool operator!=( const triplet<V> &a, const triplet<V> &b ) noe
 template <typename V>
 inline constexpr triplet<V> operator+( const triplet<V> &a, const triplet<V> &b ) noexcept
 {
-	return triplet<V>( a.x + b.x, a.y + b.y, a.z + a.z );
+	return triplet<V>( a.x + b.x, a.y + b.y, a.z + b.z );
 }
 
 template <typename V>
 inline constexpr triplet<V> operator-( const triplet<V> &a, const triplet<V> &b ) noexcept
 {
-	return triplet<V>( a.x - b.x, a.y - b.y, a.z - a.z );
+	return triplet<V>( a.x - b.x, a.y - b.y, a.z - b.z );
 }
 
 template <typename V>
 inline constexpr triplet<V> operator*( const triplet<V> &a, const triplet<V> &b ) noexcept
 {
-	return triplet<V>( a.x * b.x, a.y * b.y, a.z * a.z );
+	return triplet<V>( a.x * b.x, a.y * b.y, a.z * b.z );
 }
 
 template <typename V>
 inline constexpr triplet<V> operator/( const triplet<V> &a, const triplet<V> &b ) noexcept
 {
-	return triplet<V>( a.x / b.x, a.y / b.y, a.z / a.z );
+	return triplet<V>( a.x / b.x, a.y / b.y, a.z / b.z );
 }
 
 } // namespace color
@@ -9,9 +9,26 @@
 
 #include "threading.h"
 
+#include <base/contract.h>
 #include <color/color.h>
+#include <color/compiled_transform.h>
+#include <color/lut3d.h>
+#include <color/spectral_batch.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 
+#ifdef __SSE__
+# if defined(LINUX) || defined(__linux__)
+#  include <x86intrin.h>
+# else
+#  include <xmmintrin.h>
+#  include <immintrin.h>
+# endif
+#endif
+
 ////////////////////////////////////////
 
 namespace color
@@ -26,6 +43,22 @@ engine::hash &operator<<( engine::hash &h, const state &p )
 	return h;
 }
 
+engine::hash &operator<<( engine::hash &h, const lut3d &l )
+{
+    h << l.size() << l.shaper_min() << l.shaper_max();
+    h.add( l.shaper().data(), l.shaper().size() * sizeof(float) );
+    h.add( l.data().data(), l.data().size() * sizeof(float) );
+    return h;
+}
+
+engine::hash &operator<<( engine::hash &h, const spectral_integrator &s )
+{
+    h << s.grid().start_wavelength() << s.grid().delta() << s.size();
+    for ( size_t c = 0; c != 3; ++c )
+        h.add( s.weights( c ).data(), s.weights( c ).size() * sizeof(float) );
+    return h;
+}
+
 }
 
 ////////////////////////////////////////
@@ -35,66 +68,361 @@ namespace image
 
 ////////////////////////////////////////
 
-static void colorspace_line( size_t, int s, int e, image_buf &ret, const image_buf &src, const color::state &from, const color::state &to )
+/// transfer curve table size used unless an exact conversion is requested
+static const int kColorCurveLUTSize = 4096;
+
+static std::mutex theTransformMutex;
+static std::map<engine::hash::value, std::shared_ptr<const color::compiled_transform>> theTransforms;
+
+/// returns the shared compiled transform for the pair of states, so
+/// the matrices and tables are only computed once for all the frames
+static std::shared_ptr<const color::compiled_transform> get_transform( const color::state &from, const color::state &to, bool exact )
 {
-    plane &xOut = ret[0];
-    plane &yOut = ret[1];
-    plane &zOut = ret[2];
-    const plane &xIn = src[0];
-    const plane &yIn = src[1];
-    const plane &zIn = src[2];
+    engine::hash h;
+    h << from << to << exact;
+    engine::hash::value hv = h.finish();
 
+    std::lock_guard<std::mutex> lk( theTransformMutex );
+    auto i = theTransforms.find( hv );
+    if ( i != theTransforms.end() )
+        return i->second;
+
+    auto xf = std::make_shared<color::compiled_transform>( from, to );
+    if ( ! exact )
+        xf->use_curve_kernels( kColorCurveLUTSize );
+    theTransforms[hv] = xf;
+    return xf;
+}
+
+////////////////////////////////////////
+
+static void colorspace_line( size_t, int s, int e, image_buf &ret, const image_buf &src, const color::compiled_transform &xf )
+{
     int w = ret.width();
     for ( int y = s; y < e; ++y )
     {
-        float *xLine = xOut.line( y );
-        float *yLine = yOut.line( y );
-        float *zLine = zOut.line( y );
-        const float *xInLine = xIn.line( y );
-        const float *yInLine = yIn.line( y );
-        const float *zInLine = zIn.line( y );
-
-        for ( int x = 0; x < w; ++x )
+        for ( size_t i = 0; i < ret.size(); ++i )
+            std::copy( src[i].line( y ), src[i].line( y ) + w, ret[i].line( y ) );
+
+        xf.apply( ret[0].line( y ), ret[1].line( y ), ret[2].line( y ), static_cast<size_t>( w ) );
+    }
+}
+
+////////////////////////////////////////
+
+static image_buf compute_colorspace( const image_buf &a, color::state from, color::state to, bool exact )
+{
+    image_buf ret;
+    for ( size_t i = 0; i != a.size(); ++i )
+        ret.add_plane( plane( a.x1(), a.y1(), a.x2(), a.y2() ) );
+
+    std::shared_ptr<const color::compiled_transform> xf = get_transform( from, to, exact );
+    threading::get().dispatch( std::bind( colorspace_line, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( ret ), std::cref( a ), std::cref( *xf ) ), a.y1(), a.height() );
+    return ret;
+}
+
+////////////////////////////////////////
+
+image_buf colorspace( const image_buf &a, const color::state &from, const color::state &to, bool exact )
+{
+    if ( a.size() < 3 )
+        throw std::logic_error( "Attempt to convert color space on an image with fewer than 3 planes" );
+
+    engine::dimensions d = a.dims();
+    d.planes = a.size();
+    d.images = 1;
+    return image_buf( "i.colorspace", d, a, from, to, exact );
+}
+
+////////////////////////////////////////
+
+/// shaper table size used when baking 3D LUTs
+static const int kLUTShaperSize = 4096;
+
+static std::mutex theLUTMutex;
+static std::map<engine::hash::value, std::shared_ptr<const color::lut3d>> theLUTs;
+
+////////////////////////////////////////
+
+static void lattice_line( size_t, int s, int e, image_buf &ret, const std::vector<float> &vals )
+{
+    int size = static_cast<int>( vals.size() );
+    for ( int y = s; y < e; ++y )
+    {
+        float *r = ret[0].line( y );
+        float *g = ret[1].line( y );
+        float *b = ret[2].line( y );
+        std::copy( vals.begin(), vals.end(), r );
+        std::fill( g, g + size, vals[static_cast<size_t>( y % size )] );
+        std::fill( b, b + size, vals[static_cast<size_t>( y / size )] );
+    }
+}
+
+////////////////////////////////////////
+
+/// creates the image of the lattice points of a 3D LUT, red varies
+/// along the scanline, with green then blue varying down the image
+static image_buf compute_lut3d_lattice( int size, int shaper, float minV, float maxV )
+{
+    color::transfer t = static_cast<color::transfer>( shaper );
+    std::vector<float> vals( static_cast<size_t>( size ) );
+    for ( int i = 0; i < size; ++i )
+    {
+        double u = static_cast<double>( i ) / static_cast<double>( size - 1 );
+        vals[static_cast<size_t>( i )] = static_cast<float>( minV + ( maxV - minV ) * color::linearize( u, t ) );
+    }
+
+    image_buf ret;
+    for ( int i = 0; i != 3; ++i )
+        ret.add_plane( plane( 0, 0, size - 1, size * size - 1 ) );
+
+    threading::get().dispatch( std::bind( lattice_line, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( ret ), std::cref( vals ) ), 0, size * size );
+    return ret;
+}
+
+////////////////////////////////////////
+
+#if defined(__SSE__)
+static inline __m128 lut_select( __m128 m, __m128 a, __m128 b )
+{
+    return _mm_or_ps( _mm_and_ps( m, a ), _mm_andnot_ps( m, b ) );
+}
+#endif
+
+/// Tetrahedral interpolation of a scanline. Rather than branching on
+/// the order of the fractions, the first step is along the axis of the
+/// largest fraction, and the last along the axis of the smallest,
+/// so 4 values can be processed at once, leaving only the gather of
+/// the corners as scalar loads.
+static void lut3d_line( float *r, float *g, float *b, int n, const color::lut3d &lut )
+{
+    if ( lut.has_shaper() )
+    {
+        for ( int x = 0; x < n; ++x )
         {
-            float xV = xInLine[x];
-            float yV = yInLine[x];
-            float zV = zInLine[x];
+            r[x] = lut.shape( r[x] );
+            g[x] = lut.shape( g[x] );
+            b[x] = lut.shape( b[x] );
+        }
+    }
 
-            /// \todo { extract the logic inside here out to a higher level... }
-            color::convert( xV, yV, zV, from, to, 32 );
+    int x = 0;
+#if defined(__SSE__)
+    const float *d = lut.data().data();
+    const float scale = static_cast<float>( lut.size() - 1 );
+    const float sr = 3.F;
+    const float sg = 3.F * static_cast<float>( lut.size() );
+    const float sb = sg * static_cast<float>( lut.size() );
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.F );
+    const __m128 vScale = _mm_set1_ps( scale );
+    const __m128 vLast = _mm_set1_ps( scale - 1.F );
+    const __m128 vSR = _mm_set1_ps( sr );
+    const __m128 vSG = _mm_set1_ps( sg );
+    const __m128 vSB = _mm_set1_ps( sb );
+    const __m128 vSum = _mm_set1_ps( sr + sg + sb );
+    alignas(16) int i0[4], i1[4], i2[4];
+    for ( ; x + 3 < n; x += 4 )
+    {
+        __m128 fr = _mm_mul_ps( _mm_min_ps( _mm_max_ps( _mm_loadu_ps( r + x ), zero ), one ), vScale );
+        __m128 fg = _mm_mul_ps( _mm_min_ps( _mm_max_ps( _mm_loadu_ps( g + x ), zero ), one ), vScale );
+        __m128 fb = _mm_mul_ps( _mm_min_ps( _mm_max_ps( _mm_loadu_ps( b + x ), zero ), one ), vScale );
+        // non-negative, so truncation is floor
+        __m128 ir = _mm_min_ps( _mm_cvtepi32_ps( _mm_cvttps_epi32( fr ) ), vLast );
+        __m128 ig = _mm_min_ps( _mm_cvtepi32_ps( _mm_cvttps_epi32( fg ) ), vLast );
+        __m128 ib = _mm_min_ps( _mm_cvtepi32_ps( _mm_cvttps_epi32( fb ) ), vLast );
+        fr = _mm_sub_ps( fr, ir );
+        fg = _mm_sub_ps( fg, ig );
+        fb = _mm_sub_ps( fb, ib );
 
-            xLine[x] = xV;
-            yLine[x] = yV;
-            zLine[x] = zV;
+        // ties are broken in opposite orders for the largest and
+        // smallest, so they are only on the same axis when all the
+        // fractions are equal, at which point the path doesn't matter
+        __m128 maxIsR = _mm_and_ps( _mm_cmpge_ps( fr, fg ), _mm_cmpge_ps( fr, fb ) );
+        __m128 maxIsG = _mm_cmpge_ps( fg, fb );
+        __m128 minIsB = _mm_and_ps( _mm_cmple_ps( fb, fr ), _mm_cmple_ps( fb, fg ) );
+        __m128 minIsG = _mm_cmple_ps( fg, fr );
+        __m128 off1 = lut_select( maxIsR, vSR, lut_select( maxIsG, vSG, vSB ) );
+        __m128 off2 = _mm_sub_ps( vSum, lut_select( minIsB, vSB, lut_select( minIsG, vSG, vSR ) ) );
+
+        __m128 wMax = _mm_max_ps( fr, _mm_max_ps( fg, fb ) );
+        __m128 wMin = _mm_min_ps( fr, _mm_min_ps( fg, fb ) );
+        __m128 wMid = _mm_sub_ps( _mm_sub_ps( _mm_add_ps( fr, _mm_add_ps( fg, fb ) ), wMax ), wMin );
+        __m128 w0 = _mm_sub_ps( one, wMax );
+        __m128 w1 = _mm_sub_ps( wMax, wMid );
+        __m128 w2 = _mm_sub_ps( wMid, wMin );
+
+        // exact in float for any reasonable cube size
+        __m128 base = _mm_add_ps( _mm_mul_ps( ir, vSR ), _mm_add_ps( _mm_mul_ps( ig, vSG ), _mm_mul_ps( ib, vSB ) ) );
+        _mm_store_si128( reinterpret_cast<__m128i *>( i0 ), _mm_cvttps_epi32( base ) );
+        _mm_store_si128( reinterpret_cast<__m128i *>( i1 ), _mm_cvttps_epi32( _mm_add_ps( base, off1 ) ) );
+        _mm_store_si128( reinterpret_cast<__m128i *>( i2 ), _mm_cvttps_epi32( _mm_add_ps( base, off2 ) ) );
+        const int s3 = static_cast<int>( sr + sg + sb );
+
+        float *outs[3] = { r + x, g + x, b + x };
+        for ( int c = 0; c < 3; ++c )
+        {
+            __m128 c0 = _mm_setr_ps( d[i0[0] + c], d[i0[1] + c], d[i0[2] + c], d[i0[3] + c] );
+            __m128 c1 = _mm_setr_ps( d[i1[0] + c], d[i1[1] + c], d[i1[2] + c], d[i1[3] + c] );
+            __m128 c2 = _mm_setr_ps( d[i2[0] + c], d[i2[1] + c], d[i2[2] + c], d[i2[3] + c] );
+            __m128 c3 = _mm_setr_ps( d[i0[0] + s3 + c], d[i0[1] + s3 + c], d[i0[2] + s3 + c], d[i0[3] + s3 + c] );
+            __m128 v = _mm_add_ps( _mm_add_ps( _mm_mul_ps( c0, w0 ), _mm_mul_ps( c1, w1 ) ),
+                                   _mm_add_ps( _mm_mul_ps( c2, w2 ), _mm_mul_ps( c3, wMin ) ) );
+            _mm_storeu_ps( outs[c], v );
         }
-        for ( size_t i = 3; i < ret.size(); ++i )
+    }
+#endif
+    for ( ; x < n; ++x )
+    {
+        r[x] = std::min( std::max( r[x], 0.F ), 1.F );
+        g[x] = std::min( std::max( g[x], 0.F ), 1.F );
+        b[x] = std::min( std::max( b[x], 0.F ), 1.F );
+        lut.apply( r[x], g[x], b[x] );
+    }
+}
+
+////////////////////////////////////////
+
+static void apply_lut3d_line( size_t, int s, int e, image_buf &ret, const image_buf &src, const color::lut3d &lut )
+{
+    int w = ret.width();
+    for ( int y = s; y < e; ++y )
+    {
+        for ( size_t i = 0; i < ret.size(); ++i )
             std::copy( src[i].line( y ), src[i].line( y ) + w, ret[i].line( y ) );
+
+        lut3d_line( ret[0].line( y ), ret[1].line( y ), ret[2].line( y ), w, lut );
     }
 }
 
 ////////////////////////////////////////
 
-static image_buf compute_colorspace( const image_buf &a, color::state from, color::state to )
+static image_buf compute_apply_lut3d( const image_buf &a, std::shared_ptr<const color::lut3d> lut )
 {
     image_buf ret;
     for ( size_t i = 0; i != a.size(); ++i )
         ret.add_plane( plane( a.x1(), a.y1(), a.x2(), a.y2() ) );
 
-    threading::get().dispatch( std::bind( colorspace_line, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( ret ), std::cref( a ), std::cref( from ), std::cref( to ) ), a.y1(), a.height() );
+    threading::get().dispatch( std::bind( apply_lut3d_line, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( ret ), std::cref( a ), std::cref( *lut ) ), a.y1(), a.height() );
     return ret;
 }
 
 ////////////////////////////////////////
 
-image_buf colorspace( const image_buf &a, const color::state &from, const color::state &to )
+std::shared_ptr<const color::lut3d> bake_lut3d(
+    const std::function<image_buf( const image_buf & )> &chain, int size,
+    color::transfer shaper, float shaperMin, float shaperMax )
+{
+    precondition( size >= 2 && size * size <= std::numeric_limits<engine::dimensions::value_type>::max(), "Invalid 3D LUT size {0}", size );
+    precondition( shaperMax > shaperMin, "Invalid 3D LUT shaper range [{0}, {1}]", shaperMin, shaperMax );
+
+    engine::dimensions d;
+    d.x2 = static_cast<engine::dimensions::value_type>( size - 1 );
+    d.y2 = static_cast<engine::dimensions::value_type>( size * size - 1 );
+    d.planes = 3;
+    d.images = 1;
+    image_buf lattice( "i.lut3d_lattice", d, size, static_cast<int>( shaper ), shaperMin, shaperMax );
+    image_buf out = chain( lattice );
+    precondition( out.size() >= 3 && out.width() == size && out.height() == size * size, "3D LUT chain must be per-pixel operations on 3 planes" );
+
+    // the lattice is fully described by the arguments, so the hash of
+    // the result identifies the chain
+    engine::hash h;
+    h << out;
+    engine::hash::value hv = h.finish();
+    {
+        std::lock_guard<std::mutex> lk( theLUTMutex );
+        auto i = theLUTs.find( hv );
+        if ( i != theLUTs.end() )
+            return i->second;
+    }
+
+    auto lut = std::make_shared<color::lut3d>( size );
+    for ( int b = 0; b < size; ++b )
+    {
+        for ( int g = 0; g < size; ++g )
+        {
+            int y = b * size + g;
+            const float *rl = out[0].line( y );
+            const float *gl = out[1].line( y );
+            const float *bl = out[2].line( y );
+            for ( int r = 0; r < size; ++r )
+            {
+                float *e = lut->entry( r, g, b );
+                e[0] = rl[r];
+                e[1] = gl[r];
+                e[2] = bl[r];
+            }
+        }
+    }
+
+    if ( shaper != color::transfer::LINEAR || shaperMin != 0.F || shaperMax != 1.F )
+    {
+        std::vector<float> table( static_cast<size_t>( kLUTShaperSize ) );
+        for ( int i = 0; i < kLUTShaperSize; ++i )
+        {
+            double v = static_cast<double>( i ) / static_cast<double>( kLUTShaperSize - 1 );
+            table[static_cast<size_t>( i )] = static_cast<float>( color::encode( v, shaper ) );
+        }
+        lut->set_shaper( std::move( table ), shaperMin, shaperMax );
+    }
+
+    std::lock_guard<std::mutex> lk( theLUTMutex );
+    theLUTs[hv] = lut;
+    return lut;
+}
+
+////////////////////////////////////////
+
+image_buf apply_lut3d( const image_buf &a, const std::shared_ptr<const color::lut3d> &lut )
 {
     if ( a.size() < 3 )
-        throw std::logic_error( "Attempt to convert color space on an image with fewer than 3 planes" );
+        throw std::logic_error( "Attempt to apply a 3D LUT to an image with fewer than 3 planes" );
+    precondition( lut && lut->valid(), "Attempt to apply an invalid 3D LUT" );
 
     engine::dimensions d = a.dims();
     d.planes = a.size();
     d.images = 1;
-    return image_buf( "i.colorspace", d, a, from, to );
+    return image_buf( "i.apply_lut3d", d, a, lut );
+}
+
+////////////////////////////////////////
+
+static void spectral_line( size_t, int s, int e, image_buf &ret, const image_buf &bands, const color::spectral_integrator &integ )
+{
+    std::vector<const float *> lines( bands.size() );
+    size_t w = static_cast<size_t>( ret.width() );
+    for ( int y = s; y < e; ++y )
+    {
+        for ( size_t i = 0; i != bands.size(); ++i )
+            lines[i] = bands[i].line( y );
+        integ.integrate_planes( lines.data(), w, ret[0].line( y ), ret[1].line( y ), ret[2].line( y ) );
+    }
+}
+
+////////////////////////////////////////
+
+static image_buf compute_integrate_spectral( const image_buf &bands, std::shared_ptr<const color::spectral_integrator> integ )
+{
+    image_buf ret;
+    for ( size_t i = 0; i != 3; ++i )
+        ret.add_plane( plane( bands.x1(), bands.y1(), bands.x2(), bands.y2() ) );
+
+    threading::get().dispatch( std::bind( spectral_line, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( ret ), std::cref( bands ), std::cref( *integ ) ), bands.y1(), bands.height() );
+    return ret;
+}
+
+////////////////////////////////////////
+
+image_buf integrate_spectral( const image_buf &bands, const std::shared_ptr<const color::spectral_integrator> &integ )
+{
+    precondition( integ && integ->valid(), "Attempt to integrate spectral planes with an invalid integrator" );
+    precondition( bands.size() == integ->size(), "Image has {0} spectral planes, integrator expects {1}", bands.size(), integ->size() );
+
+    engine::dimensions d = bands.dims();
+    d.planes = 3;
+    d.images = 1;
+    return image_buf( "i.integrate_spectral", d, bands, integ );
 }
 
 ////////////////////////////////////////
@@ -106,6 +434,13 @@ void add_color_ops( engine::registry &r )
     r.register_constant<color::state>();
     // we will just do a threaded op so we can optimize the from / to operations applied once
     r.add( op( "i.colorspace", compute_colorspace, op::threaded ) );
+
+    r.register_constant<std::shared_ptr<const color::lut3d>>();
+    r.add( op( "i.lut3d_lattice", compute_lut3d_lattice, op::threaded ) );
+    r.add( op( "i.apply_lut3d", compute_apply_lut3d, op::threaded ) );
+
+    r.register_constant<std::shared_ptr<const color::spectral_integrator>>();
+    r.add( op( "i.integrate_spectral", compute_integrate_spectral, op::threaded ) );
 }
 
 } // image
@@ -8,15 +8,52 @@
 #pragma once
 
 #include "image.h"
+#include <color/transfer_curve.h>
+#include <functional>
+#include <memory>
 
-namespace color { class state; }
+namespace color { class state; class lut3d; class spectral_integrator; }
 
 ////////////////////////////////////////
 
 namespace image
 {
 
-image_buf colorspace( const image_buf &a, const color::state &from, const color::state &to );
+/// Converts the first 3 planes of the image from one color state to
+/// another, any other planes are passed through. The conversion is
+/// compiled once per pair of states (@sa color::compiled_transform).
+/// Unless exact is set, the transfer curves are applied with the
+/// vectorized approximations (@sa color::transfer_kernel), or tables
+/// for curves without one, which are within 2e-5 of the exact curves
+image_buf colorspace( const image_buf &a, const color::state &from, const color::state &to, bool exact = false );
+
+/// Bakes a chain of per-pixel operations on the first 3 planes (i.e.
+/// a colorspace, then some math, then a transfer curve) into a 3D LUT
+/// of size^3 entries. The chain is called once with an image holding
+/// the lattice points, and must not do anything spatial.
+///
+/// The shaper maps [shaperMin, shaperMax] of the input onto the cube
+/// by normalizing and then encoding with the transfer curve, which is
+/// needed for scene linear input. It is omitted for the default of
+/// a linear curve over [0, 1].
+///
+/// The LUTs are cached by the graph hash of the chain, so baking the
+/// same chain for each frame only evaluates it once.
+std::shared_ptr<const color::lut3d> bake_lut3d(
+	const std::function<image_buf( const image_buf & )> &chain, int size,
+	color::transfer shaper = color::transfer::LINEAR,
+	float shaperMin = 0.F, float shaperMax = 1.F );
+
+/// Applies the 3D LUT (and shaper) to the first 3 planes with
+/// tetrahedral interpolation, any other planes are passed through.
+/// Values outside the domain of the LUT are clamped
+image_buf apply_lut3d( const image_buf &a, const std::shared_ptr<const color::lut3d> &lut );
+
+/// Integrates an image of spectral planes, one plane per sample of
+/// the grid of the integrator (i.e. the channels of a multispectral
+/// EXR layer, in wavelength order), producing 3 planes of tristimulus
+/// values (or camera RGB, depending on the sensitivity)
+image_buf integrate_spectral( const image_buf &bands, const std::shared_ptr<const color::spectral_integrator> &integ );
 
 void add_color_ops( engine::registry &r );
 
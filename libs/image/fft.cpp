@@ -0,0 +1,239 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "fft.h"
+#include <base/contract.h>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+////////////////////////////////////////
+
+namespace
+{
+
+std::mutex thePlanMutex;
+std::map<size_t, std::shared_ptr<const image::fft_plan>> thePlans;
+
+inline void
+cmul( float &outR, float &outI, float aR, float aI, float bR, float bI )
+{
+	outR = aR * bR - aI * bI;
+	outI = aR * bI + aI * bR;
+}
+
+}
+
+////////////////////////////////////////
+
+namespace image
+{
+
+////////////////////////////////////////
+
+fft_plan::fft_plan( size_t n, bool realSupport )
+	: _n( n )
+{
+	precondition( n > 0 && ( n & ( n - 1 ) ) == 0, "fft size {0} must be a power of two", n );
+
+	size_t bits = 0;
+	while ( ( size_t(1) << bits ) < n )
+		++bits;
+
+	_bitrev.resize( n );
+	for ( size_t i = 0; i < n; ++i )
+	{
+		size_t r = 0;
+		for ( size_t b = 0; b < bits; ++b )
+			r |= ( ( i >> b ) & 1 ) << ( bits - 1 - b );
+		_bitrev[i] = static_cast<uint32_t>( r );
+	}
+
+	size_t nTwid = std::max( size_t(1), n / 2 );
+	_fwd_twiddle.resize( nTwid );
+	_inv_twiddle.resize( nTwid );
+	for ( size_t i = 0; i < nTwid; ++i )
+	{
+		double a = -2.0 * M_PI * static_cast<double>( i ) / static_cast<double>( n );
+		_fwd_twiddle[i] = complex_type( static_cast<float>( cos( a ) ), static_cast<float>( sin( a ) ) );
+		_inv_twiddle[i] = std::conj( _fwd_twiddle[i] );
+	}
+
+	if ( realSupport && n >= 2 )
+	{
+		size_t m = n / 2;
+		_half.reset( new fft_plan( m, false ) );
+		_real_twiddle.resize( m + 1 );
+		for ( size_t k = 0; k <= m; ++k )
+		{
+			double a = -2.0 * M_PI * static_cast<double>( k ) / static_cast<double>( n );
+			_real_twiddle[k] = complex_type( static_cast<float>( cos( a ) ), static_cast<float>( sin( a ) ) );
+		}
+	}
+}
+
+////////////////////////////////////////
+
+fft_plan::~fft_plan( void )
+{
+}
+
+////////////////////////////////////////
+
+void
+fft_plan::forward( complex_type *data ) const
+{
+	transform( data, _fwd_twiddle );
+}
+
+////////////////////////////////////////
+
+void
+fft_plan::inverse( complex_type *data ) const
+{
+	transform( data, _inv_twiddle );
+}
+
+////////////////////////////////////////
+
+void
+fft_plan::forward_real( const float *in, complex_type *out, complex_type *scratch ) const
+{
+	precondition( _half, "fft plan of size {0} not created with real transform support", _n );
+
+	// pack the even / odd samples as a half size complex signal
+	const size_t m = _n / 2;
+	for ( size_t i = 0; i < m; ++i )
+		scratch[i] = complex_type( in[2*i], in[2*i+1] );
+
+	_half->forward( scratch );
+
+	// split the interleaved result back out
+	for ( size_t k = 0; k <= m; ++k )
+	{
+		const complex_type &zk = scratch[k == m ? 0 : k];
+		const complex_type &zmk = scratch[k == 0 ? 0 : m - k];
+		float eR = 0.5F * ( zk.real() + zmk.real() );
+		float eI = 0.5F * ( zk.imag() - zmk.imag() );
+		// -i * ( zk - conj( zmk ) ) / 2
+		float oR = 0.5F * ( zk.imag() + zmk.imag() );
+		float oI = -0.5F * ( zk.real() - zmk.real() );
+		float tR, tI;
+		cmul( tR, tI, oR, oI, _real_twiddle[k].real(), _real_twiddle[k].imag() );
+		out[k] = complex_type( eR + tR, eI + tI );
+	}
+}
+
+////////////////////////////////////////
+
+void
+fft_plan::inverse_real( const complex_type *in, float *out, complex_type *scratch ) const
+{
+	precondition( _half, "fft plan of size {0} not created with real transform support", _n );
+
+	// inverse of the split in forward_real, leaving the scale at n
+	// to match the unnormalized complex transforms
+	const size_t m = _n / 2;
+	for ( size_t k = 0; k < m; ++k )
+	{
+		const complex_type &xk = in[k];
+		const complex_type &xmk = in[m - k];
+		float eR = xk.real() + xmk.real();
+		float eI = xk.imag() - xmk.imag();
+		float dR = xk.real() - xmk.real();
+		float dI = xk.imag() + xmk.imag();
+		float oR, oI;
+		cmul( oR, oI, dR, dI, _real_twiddle[k].real(), -_real_twiddle[k].imag() );
+		// e + i * o
+		scratch[k] = complex_type( eR - oI, eI + oR );
+	}
+
+	_half->inverse( scratch );
+
+	for ( size_t i = 0; i < m; ++i )
+	{
+		out[2*i] = scratch[i].real();
+		out[2*i+1] = scratch[i].imag();
+	}
+}
+
+////////////////////////////////////////
+
+size_t
+fft_plan::next_size( size_t n )
+{
+	size_t r = 1;
+	while ( r < n )
+		r <<= 1;
+	return r;
+}
+
+////////////////////////////////////////
+
+std::shared_ptr<const fft_plan>
+fft_plan::get( size_t n )
+{
+	std::lock_guard<std::mutex> lk( thePlanMutex );
+	auto i = thePlans.find( n );
+	if ( i != thePlans.end() )
+		return i->second;
+
+	std::shared_ptr<const fft_plan> r = std::make_shared<fft_plan>( n );
+	thePlans[n] = r;
+	return r;
+}
+
+////////////////////////////////////////
+
+void
+fft_plan::transform( complex_type *data, const std::vector<complex_type> &twiddle ) const
+{
+	const size_t n = _n;
+	if ( n < 2 )
+		return;
+
+	for ( size_t i = 0; i < n; ++i )
+	{
+		size_t r = _bitrev[i];
+		if ( r > i )
+			std::swap( data[i], data[r] );
+	}
+
+	// std::complex allows access as an array of float pairs, which
+	// avoids the nan / inf checks in the complex multiply
+	float *d = reinterpret_cast<float *>( data );
+	const float *tw = reinterpret_cast<const float *>( twiddle.data() );
+	for ( size_t len = 2; len <= n; len <<= 1 )
+	{
+		const size_t half = len / 2;
+		const size_t tstep = n / len;
+		for ( size_t i = 0; i < n; i += len )
+		{
+			float *a = d + i * 2;
+			float *b = a + half * 2;
+			for ( size_t j = 0; j < half; ++j )
+			{
+				const float *w = tw + j * tstep * 2;
+				float vR, vI;
+				cmul( vR, vI, b[j*2], b[j*2+1], w[0], w[1] );
+				float uR = a[j*2];
+				float uI = a[j*2+1];
+				a[j*2] = uR + vR;
+				a[j*2+1] = uI + vI;
+				b[j*2] = uR - vR;
+				b[j*2+1] = uI - vI;
+			}
+		}
+	}
+}
+
+////////////////////////////////////////
+
+} // image
+
+
+
@@ -0,0 +1,79 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <cstdint>
+#include <complex>
+#include <memory>
+#include <vector>
+
+////////////////////////////////////////
+
+namespace image
+{
+
+///
+/// @brief Class fft_plan provides precomputed tables for a power of
+/// two fast fourier transform.
+///
+/// A plan is immutable once constructed, so the same plan may be
+/// shared between threads, each of which provides its own working
+/// buffers. The transforms are unnormalized, so a forward followed by
+/// an inverse transform scales the values by size().
+///
+class fft_plan
+{
+public:
+	typedef std::complex<float> complex_type;
+
+	/// n must be a power of two. When realSupport is true (and n is
+	/// at least 2), the tables for the real transforms are also built
+	explicit fft_plan( size_t n, bool realSupport = true );
+	~fft_plan( void );
+
+	inline size_t size( void ) const { return _n; }
+	/// number of (non-redundant) complex values resulting from a real
+	/// transform
+	inline size_t real_bins( void ) const { return _n / 2 + 1; }
+
+	/// in-place complex transform of size() elements
+	void forward( complex_type *data ) const;
+	/// in-place complex inverse transform of size() elements (unnormalized)
+	void inverse( complex_type *data ) const;
+
+	/// real to complex transform, out must hold real_bins() values,
+	/// scratch must hold size() / 2 values
+	void forward_real( const float *in, complex_type *out, complex_type *scratch ) const;
+	/// complex (hermitian) to real transform, in is real_bins() values,
+	/// scratch must hold size() / 2 values (unnormalized)
+	void inverse_real( const complex_type *in, float *out, complex_type *scratch ) const;
+
+	/// returns the smallest power of two >= n
+	static size_t next_size( size_t n );
+
+	/// returns a shared plan for the provided size, creating if needed
+	static std::shared_ptr<const fft_plan> get( size_t n );
+
+private:
+	void transform( complex_type *data, const std::vector<complex_type> &twiddle ) const;
+
+	size_t _n;
+	std::vector<uint32_t> _bitrev;
+	std::vector<complex_type> _fwd_twiddle;
+	std::vector<complex_type> _inv_twiddle;
+
+	// real transforms are done as a half-size complex transform
+	// followed by a split pass
+	std::unique_ptr<fft_plan> _half;
+	std::vector<complex_type> _real_twiddle;
+};
+
+} // namespace image
+
+
+
@@ -0,0 +1,145 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "flow_cache.h"
+#include "vector_ops.h"
+#include "plane_ops.h"
+#include <base/contract.h>
+#include <set>
+
+////////////////////////////////////////
+
+namespace
+{
+using namespace image;
+
+vector_field scale_vectors( const vector_field &v, float scale )
+{
+	if ( scale == 1.F )
+		return v;
+	return modify_vectors( v.u() * scale, v.v() * scale, false );
+}
+
+int64_t frame_dist( int64_t a, int64_t b )
+{
+	return a < b ? b - a : a - b;
+}
+
+}
+
+////////////////////////////////////////
+
+namespace image
+{
+
+////////////////////////////////////////
+
+vector_field
+flow_cache::find( int64_t a, int64_t b ) const
+{
+	auto i = _fields.find( std::make_pair( a, b ) );
+	if ( i != _fields.end() )
+		return i->second;
+	return vector_field();
+}
+
+////////////////////////////////////////
+
+void
+flow_cache::store( int64_t a, int64_t b, const vector_field &v )
+{
+	precondition( v.valid(), "Attempt to store an invalid flow from frame {0} to {1}", a, b );
+	_fields[std::make_pair( a, b )] = v.is_absolute() ? convert_to_relative( v ) : v;
+}
+
+////////////////////////////////////////
+
+vector_field
+flow_cache::predict( int64_t a, int64_t b ) const
+{
+	vector_field r = lookup( a, b );
+	if ( r.valid() || a == b )
+		return r;
+
+	std::set<int64_t> frames;
+	for ( auto &f: _fields )
+	{
+		frames.insert( f.first.first );
+		frames.insert( f.first.second );
+	}
+	frames.erase( a );
+	frames.erase( b );
+
+	int64_t bestChain = 0, bestProj = 0;
+	vector_field ac, cb, proj;
+	for ( int64_t c: frames )
+	{
+		vector_field toC = lookup( a, c );
+		if ( ! toC.valid() )
+			continue;
+
+		if ( ! ac.valid() || frame_dist( c, b ) < bestChain )
+		{
+			vector_field fromC = lookup( c, b );
+			if ( fromC.valid() )
+			{
+				ac = toC;
+				cb = fromC;
+				bestChain = frame_dist( c, b );
+			}
+		}
+
+		if ( ! proj.valid() || frame_dist( c, b ) < bestProj )
+		{
+			proj = scale_vectors( toC, static_cast<float>( b - a ) / static_cast<float>( c - a ) );
+			bestProj = frame_dist( c, b );
+		}
+	}
+
+	if ( ac.valid() )
+		return concatenate( ac, cb );
+	return proj;
+}
+
+////////////////////////////////////////
+
+void
+flow_cache::prune( int64_t first, int64_t last )
+{
+	for ( auto i = _fields.begin(); i != _fields.end(); )
+	{
+		if ( i->first.first < first || i->first.first > last ||
+			 i->first.second < first || i->first.second > last )
+			i = _fields.erase( i );
+		else
+			++i;
+	}
+}
+
+////////////////////////////////////////
+
+vector_field
+flow_cache::lookup( int64_t a, int64_t b ) const
+{
+	vector_field r = find( a, b );
+	if ( ! r.valid() )
+	{
+		// splatting the reverse flow forward to where it lands gives
+		// the flow in the other direction
+		r = find( b, a );
+		if ( r.valid() )
+			r = project( r, -1.F );
+	}
+	return r;
+}
+
+////////////////////////////////////////
+
+} // image
+
+
+
@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include "vector_field.h"
+
+////////////////////////////////////////
+
+namespace image
+{
+
+///
+/// @brief Class flow_cache stores the flow fields computed between
+/// pairs of frames, so they can be re-used across the temporal radius
+/// of a filter and used to warm start the solve of nearby pairs.
+///
+/// The fields are stored relative, keyed by the (from, to) frame
+/// numbers. The fields are lazily evaluated values, so storing one
+/// does not force it to be computed.
+///
+class flow_cache
+{
+public:
+	/// returns the flow from frame a to frame b, or an invalid field
+	/// if it has not been stored
+	vector_field find( int64_t a, int64_t b ) const;
+
+	/// stores the flow from frame a to frame b
+	void store( int64_t a, int64_t b, const vector_field &v );
+
+	/// Returns an estimate of the flow from frame a to frame b derived
+	/// from the stored fields, suitable for the initUV of the flow
+	/// solvers, or an invalid field if there is nothing usable. In
+	/// order of preference this is:
+	///   - the stored field
+	///   - the stored b -> a field, reversed
+	///   - a -> c concatenated with c -> b, with c closest to b
+	///   - a -> c projected out to b assuming constant motion, with c
+	///     closest to b
+	/// where the a -> c and c -> b fields may themselves be reversed
+	/// from stored fields.
+	vector_field predict( int64_t a, int64_t b ) const;
+
+	/// removes any fields with a frame outside [first, last]
+	void prune( int64_t first, int64_t last );
+
+	inline void clear( void ) { _fields.clear(); }
+	inline size_t size( void ) const { return _fields.size(); }
+
+private:
+	vector_field lookup( int64_t a, int64_t b ) const;
+
+	std::map<std::pair<int64_t, int64_t>, vector_field> _fields;
+};
+
+} // namespace image
+
+
+
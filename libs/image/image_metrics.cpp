@@ -0,0 +1,604 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "image_metrics.h"
+#include "threading.h"
+#include "plane_reduce.h"
+#include <base/contract.h>
+
+#ifdef __SSE__
+# if defined(LINUX) || defined(__linux__)
+#  include <x86intrin.h>
+# else
+#  include <xmmintrin.h>
+#  include <immintrin.h>
+# endif
+#endif
+
+////////////////////////////////////////
+
+namespace
+{
+using namespace image;
+
+// weights of the scales of ms-ssim, finest first (Wang et al. 2003)
+static const double kScaleWeights[] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+static const int kMaxScales = 5;
+
+// the planes of one scale, plus the previous frame at full resolution
+struct scale_planes
+{
+	std::vector<const plane *> test;
+	std::vector<const plane *> ref;
+	std::vector<const plane *> prevTest;
+	std::vector<const plane *> prevRef;
+	// the next (half resolution) scale to fill in, empty for the last
+	std::vector<plane> *downTest = nullptr;
+	std::vector<plane> *downRef = nullptr;
+	int width = 0;
+	int height = 0;
+	// 0 for the coarser scales, where no tile maps are made
+	int tileSize = 0;
+	int tilesX = 0;
+	int tilesY = 0;
+};
+
+// sums of one pass, per plane for the structural terms, and over all
+// planes for the error and the tiles
+struct pass_sums
+{
+	std::vector<double> ssim;
+	std::vector<double> cs;
+	double sq = 0.0;
+	double flicker = 0.0;
+	std::vector<double> tileSq;
+	std::vector<double> tileSsim;
+	std::vector<double> tileFlicker;
+};
+
+static void
+merge_sums( pass_sums &a, const pass_sums &b )
+{
+	for ( size_t i = 0; i != a.ssim.size(); ++i )
+	{
+		a.ssim[i] += b.ssim[i];
+		a.cs[i] += b.cs[i];
+	}
+	a.sq += b.sq;
+	a.flicker += b.flicker;
+	for ( size_t i = 0; i != a.tileSq.size(); ++i )
+	{
+		a.tileSq[i] += b.tileSq[i];
+		a.tileSsim[i] += b.tileSsim[i];
+		a.tileFlicker[i] += b.tileFlicker[i];
+	}
+}
+
+////////////////////////////////////////
+
+static inline float
+span_sum( const float *v, int n )
+{
+	int x = 0;
+	float r = 0.F;
+#if defined(__SSE__)
+	__m128 acc = _mm_setzero_ps();
+	for ( ; x + 3 < n; x += 4 )
+		acc = _mm_add_ps( acc, _mm_loadu_ps( v + x ) );
+	acc = _mm_add_ps( acc, _mm_movehl_ps( acc, acc ) );
+	acc = _mm_add_ss( acc, _mm_shuffle_ps( acc, acc, 1 ) );
+	r = _mm_cvtss_f32( acc );
+#endif
+	for ( ; x < n; ++x )
+		r += v[x];
+	return r;
+}
+
+////////////////////////////////////////
+
+// evaluates the ssim and contrast-structure terms for a scanline from
+// the window sums of x, y, x^2, y^2 and xy
+static inline void
+ssim_row( float *ss, float *cs, const float * const *m, const float *invNX, float invNY, int w, float c1, float c2 )
+{
+	const float *sx = m[0];
+	const float *sy = m[1];
+	const float *sxx = m[2];
+	const float *syy = m[3];
+	const float *sxy = m[4];
+	int x = 0;
+#if defined(__SSE__)
+	const __m128 vNY = _mm_set1_ps( invNY );
+	const __m128 vC1 = _mm_set1_ps( c1 );
+	const __m128 vC2 = _mm_set1_ps( c2 );
+	const __m128 vZero = _mm_setzero_ps();
+	for ( ; x + 3 < w; x += 4 )
+	{
+		__m128 n = _mm_mul_ps( _mm_loadu_ps( invNX + x ), vNY );
+		__m128 mx = _mm_mul_ps( _mm_loadu_ps( sx + x ), n );
+		__m128 my = _mm_mul_ps( _mm_loadu_ps( sy + x ), n );
+		__m128 mxy = _mm_mul_ps( mx, my );
+		__m128 mx2 = _mm_mul_ps( mx, mx );
+		__m128 my2 = _mm_mul_ps( my, my );
+		__m128 vx = _mm_max_ps( vZero, _mm_sub_ps( _mm_mul_ps( _mm_loadu_ps( sxx + x ), n ), mx2 ) );
+		__m128 vy = _mm_max_ps( vZero, _mm_sub_ps( _mm_mul_ps( _mm_loadu_ps( syy + x ), n ), my2 ) );
+		__m128 cov = _mm_sub_ps( _mm_mul_ps( _mm_loadu_ps( sxy + x ), n ), mxy );
+		__m128 c = _mm_div_ps( _mm_add_ps( _mm_add_ps( cov, cov ), vC2 ), _mm_add_ps( _mm_add_ps( vx, vy ), vC2 ) );
+		__m128 l = _mm_div_ps( _mm_add_ps( _mm_add_ps( mxy, mxy ), vC1 ), _mm_add_ps( _mm_add_ps( mx2, my2 ), vC1 ) );
+		_mm_storeu_ps( cs + x, c );
+		_mm_storeu_ps( ss + x, _mm_mul_ps( l, c ) );
+	}
+#endif
+	for ( ; x < w; ++x )
+	{
+		float n = invNX[x] * invNY;
+		float mx = sx[x] * n;
+		float my = sy[x] * n;
+		float mxy = mx * my;
+		float mx2 = mx * mx;
+		float my2 = my * my;
+		float vx = std::max( 0.F, sxx[x] * n - mx2 );
+		float vy = std::max( 0.F, syy[x] * n - my2 );
+		float cov = sxy[x] * n - mxy;
+		float c = ( 2.F * cov + c2 ) / ( vx + vy + c2 );
+		float l = ( 2.F * mxy + c1 ) / ( mx2 + my2 + c1 );
+		cs[x] = c;
+		ss[x] = l * c;
+	}
+}
+
+////////////////////////////////////////
+
+// per thread storage for the sliding window: a ring of the horizontal
+// window sums of the 5 moments for the 2 * radius + 1 scanlines under
+// the window, which are then summed vertically for each output line
+class window_rows
+{
+public:
+	window_rows( int w, int radius )
+		: _w( w ), _r( radius ), _n( 2 * radius + 1 ),
+		  _ring( static_cast<size_t>( _n * 5 * w ) ),
+		  _prefix( static_cast<size_t>( 5 * ( w + 1 ) ) ),
+		  _vert( static_cast<size_t>( 5 * w ) ),
+		  _invNX( static_cast<size_t>( w ) )
+	{
+		for ( int x = 0; x < w; ++x )
+		{
+			int nX = std::min( w - 1, x + radius ) - std::max( 0, x - radius ) + 1;
+			_invNX[static_cast<size_t>( x )] = 1.F / static_cast<float>( nX );
+		}
+	}
+
+	inline const float *inv_nx( void ) const { return _invNX.data(); }
+
+	/// computes the horizontal sums for line y of the plane pair
+	void fill( int y, const float *a, const float *b )
+	{
+		const int w = _w;
+		double *p[5];
+		for ( int m = 0; m < 5; ++m )
+		{
+			p[m] = _prefix.data() + m * ( w + 1 );
+			p[m][0] = 0.0;
+		}
+		double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0, s4 = 0.0;
+		for ( int x = 0; x < w; ++x )
+		{
+			double va = static_cast<double>( a[x] );
+			double vb = static_cast<double>( b[x] );
+			s0 += va;
+			s1 += vb;
+			s2 += va * va;
+			s3 += vb * vb;
+			s4 += va * vb;
+			p[0][x + 1] = s0;
+			p[1][x + 1] = s1;
+			p[2][x + 1] = s2;
+			p[3][x + 1] = s3;
+			p[4][x + 1] = s4;
+		}
+		for ( int m = 0; m < 5; ++m )
+		{
+			float *out = ring( y, m );
+			const double *pm = p[m];
+			for ( int x = 0; x < w; ++x )
+			{
+				int lo = std::max( 0, x - _r );
+				int hi = std::min( w, x + _r + 1 );
+				out[x] = static_cast<float>( pm[hi] - pm[lo] );
+			}
+		}
+	}
+
+	/// sums the horizontal sums of lines lo - hi (which must all be
+	/// filled and still in the ring), returning the 5 window sums
+	const float * const *vertical( int lo, int hi )
+	{
+		const int w = _w;
+		for ( int m = 0; m < 5; ++m )
+		{
+			float *out = _vert.data() + m * w;
+			_cur[m] = out;
+			const float *src = ring( lo, m );
+			std::copy( src, src + w, out );
+			for ( int y = lo + 1; y <= hi; ++y )
+			{
+				src = ring( y, m );
+				for ( int x = 0; x < w; ++x )
+					out[x] += src[x];
+			}
+		}
+		return _cur;
+	}
+
+private:
+	inline float *ring( int y, int m )
+	{
+		return _ring.data() + ( ( y % _n ) * 5 + m ) * _w;
+	}
+
+	int _w, _r, _n;
+	std::vector<float> _ring;
+	std::vector<double> _prefix;
+	std::vector<float> _vert;
+	std::vector<float> _invNX;
+	const float *_cur[5];
+};
+
+////////////////////////////////////////
+
+// one pass over a scale, handling pairs of scanlines [s, e) so each
+// line of the half resolution scale is written by a single thread
+static void
+scale_pass( pass_sums &sums, int s, int e, const scale_planes &sp, int radius, float c1, float c2 )
+{
+	const int w = sp.width;
+	const int h = sp.height;
+	const int y0 = 2 * s;
+	const int y1 = std::min( 2 * e, h );
+	const bool temporal = ! sp.prevTest.empty();
+	const int tileSize = sp.tileSize > 0 ? sp.tileSize : w;
+	const int tilesX = sp.tileSize > 0 ? sp.tilesX : 1;
+
+	window_rows win( w, radius );
+	std::vector<float> ssRow( static_cast<size_t>( w ) );
+	std::vector<float> csRow( static_cast<size_t>( w ) );
+	std::vector<float> errRow( static_cast<size_t>( w ) );
+	std::vector<float> flickRow( static_cast<size_t>( w ) );
+
+	for ( size_t p = 0; p != sp.test.size(); ++p )
+	{
+		const plane &a = *(sp.test[p]);
+		const plane &b = *(sp.ref[p]);
+		plane *downA = sp.downTest ? &( (*sp.downTest)[p] ) : nullptr;
+		plane *downB = sp.downRef ? &( (*sp.downRef)[p] ) : nullptr;
+		double ssimSum = 0.0, csSum = 0.0;
+
+		int next = std::max( 0, y0 - radius );
+		for ( int y = y0; y < y1; ++y )
+		{
+			const int lo = std::max( 0, y - radius );
+			const int hi = std::min( h - 1, y + radius );
+			for ( ; next <= hi; ++next )
+				win.fill( next, a.line( a.y1() + next ), b.line( b.y1() + next ) );
+
+			ssim_row( ssRow.data(), csRow.data(), win.vertical( lo, hi ), win.inv_nx(), 1.F / static_cast<float>( hi - lo + 1 ), w, c1, c2 );
+
+			const float *la = a.line( a.y1() + y );
+			const float *lb = b.line( b.y1() + y );
+			if ( sp.tileSize > 0 )
+			{
+				for ( int x = 0; x < w; ++x )
+				{
+					float d = la[x] - lb[x];
+					errRow[static_cast<size_t>( x )] = d * d;
+				}
+				if ( temporal )
+				{
+					const plane &pa = *(sp.prevTest[p]);
+					const plane &pb = *(sp.prevRef[p]);
+					const float *lpa = pa.line( pa.y1() + y );
+					const float *lpb = pb.line( pb.y1() + y );
+					for ( int x = 0; x < w; ++x )
+						flickRow[static_cast<size_t>( x )] = std::abs( ( la[x] - lpa[x] ) - ( lb[x] - lpb[x] ) );
+				}
+			}
+
+			const size_t tileRow = static_cast<size_t>( y / tileSize ) * static_cast<size_t>( tilesX );
+			for ( int tx = 0; tx < tilesX; ++tx )
+			{
+				const int x0 = tx * tileSize;
+				const int n = std::min( w, x0 + tileSize ) - x0;
+				double ts = static_cast<double>( span_sum( ssRow.data() + x0, n ) );
+				ssimSum += ts;
+				csSum += static_cast<double>( span_sum( csRow.data() + x0, n ) );
+				if ( sp.tileSize > 0 )
+				{
+					const size_t t = tileRow + static_cast<size_t>( tx );
+					double te = static_cast<double>( span_sum( errRow.data() + x0, n ) );
+					sums.sq += te;
+					sums.tileSq[t] += te;
+					sums.tileSsim[t] += ts;
+					if ( temporal )
+					{
+						double tf = static_cast<double>( span_sum( flickRow.data() + x0, n ) );
+						sums.flicker += tf;
+						sums.tileFlicker[t] += tf;
+					}
+				}
+			}
+
+			// 2x2 box filter and decimate for the next scale
+			if ( downA && ( y & 1 ) && ( y >> 1 ) <= downA->y2() )
+			{
+				const float *pa0 = a.line( a.y1() + y - 1 );
+				const float *pb0 = b.line( b.y1() + y - 1 );
+				float *oa = downA->line( y >> 1 );
+				float *ob = downB->line( y >> 1 );
+				const int dw = downA->width();
+				for ( int x = 0; x < dw; ++x )
+				{
+					oa[x] = ( pa0[2 * x] + pa0[2 * x + 1] + la[2 * x] + la[2 * x + 1] ) * 0.25F;
+					ob[x] = ( pb0[2 * x] + pb0[2 * x + 1] + lb[2 * x] + lb[2 * x + 1] ) * 0.25F;
+				}
+			}
+		}
+		sums.ssim[p] += ssimSum;
+		sums.cs[p] += csSum;
+	}
+}
+
+static pass_sums
+run_pass( const scale_planes &sp, int radius, float c1, float c2 )
+{
+	pass_sums init;
+	init.ssim.resize( sp.test.size(), 0.0 );
+	init.cs.resize( sp.test.size(), 0.0 );
+	if ( sp.tileSize > 0 )
+	{
+		size_t nT = static_cast<size_t>( sp.tilesX ) * static_cast<size_t>( sp.tilesY );
+		init.tileSq.resize( nT, 0.0 );
+		init.tileSsim.resize( nT, 0.0 );
+		init.tileFlicker.resize( nT, 0.0 );
+	}
+
+	const size_t nThreads = threading::get().size();
+	std::vector<padded_partial<pass_sums>> parts( nThreads, padded_partial<pass_sums>{ init, {} } );
+	threading::get().dispatch(
+		[&]( size_t tIdx, int s, int e )
+		{
+			pass_sums local = init;
+			scale_pass( local, s, e, sp, radius, c1, c2 );
+			merge_sums( parts[tIdx].value, local );
+		}, 0, ( sp.height + 1 ) / 2 );
+
+	for ( size_t step = 1; step < nThreads; step *= 2 )
+	{
+		for ( size_t i = 0; ( i + step ) < nThreads; i += 2 * step )
+			merge_sums( parts[i].value, parts[i + step].value );
+	}
+	return parts[0].value;
+}
+
+////////////////////////////////////////
+
+static frame_metrics
+compute_metrics( const image_buf &test, const image_buf &ref, const image_buf *prevTest, const image_buf *prevRef, float peak, int radius, int tileSize )
+{
+	frame_metrics ret;
+	const size_t nP = test.size();
+	const int w = test.width();
+	const int h = test.height();
+	const float c1 = ( 0.01F * peak ) * ( 0.01F * peak );
+	const float c2 = ( 0.03F * peak ) * ( 0.03F * peak );
+
+	int scales = 1;
+	for ( int sw = w, sh = h; scales < kMaxScales && std::min( sw, sh ) / 2 >= 2 * radius + 1; ++scales )
+	{
+		sw /= 2;
+		sh /= 2;
+	}
+	ret.scales = scales;
+	ret.tile_size = tileSize;
+	ret.tiles_x = ( w + tileSize - 1 ) / tileSize;
+	ret.tiles_y = ( h + tileSize - 1 ) / tileSize;
+
+	std::vector<plane> levels[2][2];
+	scale_planes sp;
+	sp.width = w;
+	sp.height = h;
+	sp.tileSize = tileSize;
+	sp.tilesX = ret.tiles_x;
+	sp.tilesY = ret.tiles_y;
+	for ( size_t p = 0; p != nP; ++p )
+	{
+		// make sure any pending planes are computed here rather than
+		// by the first worker thread to touch them
+		test[p].cdata();
+		ref[p].cdata();
+		if ( prevTest )
+		{
+			(*prevTest)[p].cdata();
+			(*prevRef)[p].cdata();
+		}
+		sp.test.push_back( &( test[p] ) );
+		sp.ref.push_back( &( ref[p] ) );
+		if ( prevTest )
+		{
+			sp.prevTest.push_back( &( (*prevTest)[p] ) );
+			sp.prevRef.push_back( &( (*prevRef)[p] ) );
+		}
+	}
+
+	std::vector<double> msssim( nP, 1.0 );
+	double weightSum = 0.0;
+	for ( int s = 0; s < scales; ++s )
+		weightSum += kScaleWeights[s];
+
+	for ( int s = 0; s < scales; ++s )
+	{
+		const bool last = ( s + 1 ) == scales;
+		std::vector<plane> &nextTest = levels[s & 1][0];
+		std::vector<plane> &nextRef = levels[s & 1][1];
+		if ( ! last )
+		{
+			nextTest.clear();
+			nextRef.clear();
+			for ( size_t p = 0; p != nP; ++p )
+			{
+				nextTest.push_back( plane( 0, 0, sp.width / 2 - 1, sp.height / 2 - 1 ) );
+				nextRef.push_back( plane( 0, 0, sp.width / 2 - 1, sp.height / 2 - 1 ) );
+			}
+			sp.downTest = &nextTest;
+			sp.downRef = &nextRef;
+		}
+		else
+		{
+			sp.downTest = nullptr;
+			sp.downRef = nullptr;
+		}
+
+		pass_sums sums = run_pass( sp, radius, c1, c2 );
+
+		const double count = static_cast<double>( sp.width ) * static_cast<double>( sp.height );
+		const double weight = kScaleWeights[s] / weightSum;
+		for ( size_t p = 0; p != nP; ++p )
+		{
+			// the luminance term is only included at the coarsest scale
+			double v = ( last ? sums.ssim[p] : sums.cs[p] ) / count;
+			msssim[p] *= std::pow( std::max( 0.0, v ), weight );
+		}
+
+		if ( s == 0 )
+		{
+			const double n = count * static_cast<double>( nP );
+			double ssimSum = 0.0;
+			for ( size_t p = 0; p != nP; ++p )
+				ssimSum += sums.ssim[p];
+			ret.mse = sums.sq / n;
+			ret.ssim = ssimSum / n;
+			ret.flicker = prevTest ? sums.flicker / n : 0.0;
+
+			const size_t nT = sums.tileSq.size();
+			ret.tile_mse.resize( nT );
+			ret.tile_ssim.resize( nT );
+			if ( prevTest )
+				ret.tile_flicker.resize( nT );
+			for ( int ty = 0; ty < ret.tiles_y; ++ty )
+			{
+				int th = std::min( h, ( ty + 1 ) * tileSize ) - ty * tileSize;
+				for ( int tx = 0; tx < ret.tiles_x; ++tx )
+				{
+					int tw = std::min( w, ( tx + 1 ) * tileSize ) - tx * tileSize;
+					size_t t = static_cast<size_t>( ty * ret.tiles_x + tx );
+					double tn = static_cast<double>( tw ) * static_cast<double>( th ) * static_cast<double>( nP );
+					ret.tile_mse[t] = static_cast<float>( sums.tileSq[t] / tn );
+					ret.tile_ssim[t] = static_cast<float>( sums.tileSsim[t] / tn );
+					if ( prevTest )
+						ret.tile_flicker[t] = static_cast<float>( sums.tileFlicker[t] / tn );
+				}
+			}
+		}
+
+		if ( ! last )
+		{
+			sp.test.clear();
+			sp.ref.clear();
+			for ( size_t p = 0; p != nP; ++p )
+			{
+				sp.test.push_back( &( nextTest[p] ) );
+				sp.ref.push_back( &( nextRef[p] ) );
+			}
+			sp.prevTest.clear();
+			sp.prevRef.clear();
+			sp.width /= 2;
+			sp.height /= 2;
+			sp.tileSize = 0;
+		}
+	}
+
+	double ms = 0.0;
+	for ( double v: msssim )
+		ms += v;
+	ret.ms_ssim = ms / static_cast<double>( nP );
+
+	double pk = static_cast<double>( peak );
+	ret.psnr = ret.mse > 0.0 ? 10.0 * std::log10( pk * pk / ret.mse ) : std::numeric_limits<double>::infinity();
+	return ret;
+}
+
+static frame_metrics
+compute_compare( const image_buf &test, const image_buf &ref, float peak, int radius, int tileSize )
+{
+	return compute_metrics( test, ref, nullptr, nullptr, peak, radius, tileSize );
+}
+
+static frame_metrics
+compute_compare_temporal( const image_buf &test, const image_buf &ref, const image_buf &prevTest, const image_buf &prevRef, float peak, int radius, int tileSize )
+{
+	return compute_metrics( test, ref, &prevTest, &prevRef, peak, radius, tileSize );
+}
+
+static void
+check_frames( const image_buf &a, const image_buf &b )
+{
+	precondition( a.size() == b.size(), "unable to compare images with {0} and {1} planes", a.size(), b.size() );
+	precondition( a.width() == b.width() && a.height() == b.height(), "unable to compare images of different sizes ({0}x{1} vs {2}x{3})", a.width(), a.height(), b.width(), b.height() );
+}
+
+} // empty namespace
+
+////////////////////////////////////////
+
+namespace image
+{
+
+////////////////////////////////////////
+
+engine::computed_value<frame_metrics>
+compare_frames( const image_buf &test, const image_buf &ref, float peak, int radius, int tileSize )
+{
+	check_frames( test, ref );
+	precondition( test.size() > 0, "unable to compare empty images" );
+	precondition( peak > 0.F && radius >= 0 && tileSize > 0, "invalid metric settings peak {0} radius {1} tile size {2}", peak, radius, tileSize );
+
+	engine::dimensions d;
+	d.bytes_per_item = static_cast<engine::dimensions::value_type>( sizeof(frame_metrics) );
+	return engine::computed_value<frame_metrics>( op_registry(), "i.compare_frames", d, test, ref, peak, radius, tileSize );
+}
+
+////////////////////////////////////////
+
+engine::computed_value<frame_metrics>
+compare_frames( const image_buf &test, const image_buf &ref, const image_buf &prevTest, const image_buf &prevRef, float peak, int radius, int tileSize )
+{
+	check_frames( test, ref );
+	check_frames( test, prevTest );
+	check_frames( test, prevRef );
+	precondition( test.size() > 0, "unable to compare empty images" );
+	precondition( peak > 0.F && radius >= 0 && tileSize > 0, "invalid metric settings peak {0} radius {1} tile size {2}", peak, radius, tileSize );
+
+	engine::dimensions d;
+	d.bytes_per_item = static_cast<engine::dimensions::value_type>( sizeof(frame_metrics) );
+	return engine::computed_value<frame_metrics>( op_registry(), "i.compare_frames_temporal", d, test, ref, prevTest, prevRef, peak, radius, tileSize );
+}
+
+////////////////////////////////////////
+
+void
+add_image_metrics( engine::registry &r )
+{
+	using namespace engine;
+
+	r.add( op( "i.compare_frames", compute_compare, op::threaded ) );
+	r.add( op( "i.compare_frames_temporal", compute_compare_temporal, op::threaded ) );
+}
+
+} // namespace image
+
+
+
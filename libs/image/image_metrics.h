@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include "image.h"
+#include "op_registry.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+////////////////////////////////////////
+
+namespace image
+{
+
+/// Quality scores of a test frame against a reference frame
+///
+/// The structural similarity terms use a box window of (2 * radius +
+/// 1)^2 pixels, clipped at the edges of the image, so ssim matches the
+/// mean of ssim( a, b, radius, peak, 0.01, 0.03, 0 ) over the planes.
+struct frame_metrics
+{
+	/// mean squared error over all the planes
+	double mse = 0.0;
+	/// peak signal to noise ratio in dB, infinite for identical frames
+	double psnr = 0.0;
+	/// mean structural similarity, averaged over the planes
+	double ssim = 0.0;
+	/// multi-scale structural similarity (Wang et al. 2003), averaged
+	/// over the planes
+	double ms_ssim = 0.0;
+	/// mean absolute difference between the frame to frame change of
+	/// the test and of the reference, i.e. the temporal noise added
+	/// (or removed), 0 when there are no previous frames
+	double flicker = 0.0;
+	/// number of scales used for ms_ssim, fewer than 5 when the frame
+	/// is too small to be halved that many times
+	int scales = 0;
+
+	/// Per tile error maps, tiles_x * tiles_y values in scanline
+	/// order, of tile_size square tiles (the last row / column may be
+	/// partial)
+	int tile_size = 0;
+	int tiles_x = 0;
+	int tiles_y = 0;
+	std::vector<float> tile_mse;
+	std::vector<float> tile_ssim;
+	std::vector<float> tile_flicker;
+};
+
+/// Computes the spatial metrics of test against ref, in one fused
+/// parallel pass over the full resolution frames, plus the (much
+/// smaller) passes for the coarser scales of ms_ssim
+engine::computed_value<frame_metrics> compare_frames( const image_buf &test, const image_buf &ref, float peak = 1.F, int radius = 3, int tileSize = 64 );
+
+/// Computes the metrics including the temporal flicker, given the
+/// previous test and reference frames
+engine::computed_value<frame_metrics> compare_frames( const image_buf &test, const image_buf &ref, const image_buf &prevTest, const image_buf &prevRef, float peak = 1.F, int radius = 3, int tileSize = 64 );
+
+/// Aggregates frame_metrics over a sequence
+struct sequence_metrics
+{
+	size_t frames = 0;
+	/// number of frames with a flicker value (all but the first)
+	size_t temporal_frames = 0;
+	/// mean of the per frame values
+	double mse = 0.0;
+	double ssim = 0.0;
+	double ms_ssim = 0.0;
+	double flicker = 0.0;
+	/// PSNR of the mean squared error of the sequence
+	double psnr = 0.0;
+	double min_psnr = std::numeric_limits<double>::infinity();
+	double min_ssim = std::numeric_limits<double>::infinity();
+	double min_ms_ssim = std::numeric_limits<double>::infinity();
+	double max_flicker = 0.0;
+
+	inline void add( const frame_metrics &m, bool temporal, float peak = 1.F )
+	{
+		double n = static_cast<double>( frames );
+		mse = ( mse * n + m.mse ) / ( n + 1.0 );
+		ssim = ( ssim * n + m.ssim ) / ( n + 1.0 );
+		ms_ssim = ( ms_ssim * n + m.ms_ssim ) / ( n + 1.0 );
+		++frames;
+		if ( temporal )
+		{
+			double nt = static_cast<double>( temporal_frames );
+			flicker = ( flicker * nt + m.flicker ) / ( nt + 1.0 );
+			max_flicker = std::max( max_flicker, m.flicker );
+			++temporal_frames;
+		}
+		double p = static_cast<double>( peak );
+		psnr = mse > 0.0 ? 10.0 * std::log10( p * p / mse ) : std::numeric_limits<double>::infinity();
+		min_psnr = std::min( min_psnr, m.psnr );
+		min_ssim = std::min( min_ssim, m.ssim );
+		min_ms_ssim = std::min( min_ms_ssim, m.ms_ssim );
+	}
+};
+
+void add_image_metrics( engine::registry &r );
+
+} // namespace image
+
+
+
@@ -11,6 +11,10 @@
 #include <media/frame.h>
 #include <media/image.h>
 #include <media/image_buffer.h>
+#include <media/preloaded_image.h>
+#include "plane_resize.h"
+#include <algorithm>
+#include <map>
 
 ////////////////////////////////////////
 
@@ -44,6 +48,43 @@ void update_image_buffer(
 										   pl._floating, pl._unsigned );
 }
 
+media::image_buffer to_buffer( const image::plane &p, const std::string &type )
+{
+	media::image_buffer ib;
+	if ( type == "f16" )
+		ib = media::image_buffer::simple_buffer<base::half>( p.x1(), p.y1(), p.x2(), p.y2() );
+	else if ( type == "f32" )
+		ib = media::image_buffer::simple_buffer<float>( p.x1(), p.y1(), p.x2(), p.y2() );
+	else if ( type == "u16" )
+		ib = media::image_buffer::simple_buffer<uint16_t>( p.x1(), p.y1(), p.x2(), p.y2() );
+	else
+		throw_runtime( "Unknown/unhandled data type tag" );
+
+	for ( int64_t y = p.y1(), ly = p.y2(); y <= ly; ++y )
+	{
+		const float *pL = p.line( static_cast<int>( y ) );
+		ib.set_scanline( y, pL, 1 );
+	}
+	return ib;
+}
+
+// levels are rounded down, as OpenEXR does by default
+int level_count( int size )
+{
+	int n = 1;
+	while ( size > 1 )
+	{
+		size >>= 1;
+		++n;
+	}
+	return n;
+}
+
+int level_size( int size, int l )
+{
+	return std::max( 1, size >> l );
+}
+
 } // empty namespace
 
 ////////////////////////////////////////
@@ -57,13 +98,21 @@ image_buf extract_frame(
 	const media::frame &f,
 	const std::string &layer,
 	const std::string &view,
-	const std::vector<std::string> &planes )
+	const std::vector<std::string> &planes,
+	const media::area_rect &area )
 {
 	image_buf r;
 	std::shared_ptr<media::image> img = f.find_image( layer, view );
 	if ( img )
 	{
-		const media::area_rect active = img->active_area();
+		media::area_rect active = img->active_area();
+		if ( ! area.empty() )
+		{
+			active.clip( area );
+			if ( active.empty() )
+				throw_runtime( "Requested area does not overlap the active area of layer '{0}', view '{1}' in frame {2}",
+							   layer, view, f.number() );
+		}
 		int64_t dx1 = active.x1(), dx2 = active.x2();
 		int64_t dy1 = active.y1(), dy2 = active.y2();
 
@@ -73,24 +122,10 @@ image_buf extract_frame(
 			// TODO: how do we handle 4:2:2 interleaved?
 			throw_not_yet();
 		}
-		else if ( planes.empty() )
-		{
-			media::image_buffer tmp;
-			for ( size_t p = 0, nP = img->size(); p != nP; ++p )
-			{
-				update_image_buffer( tmp, img->layout( p ), active );
-				img->retrieve( p, tmp );
-				plane pl( dx1, dy1, dx2, dy2 );
-				for ( int64_t y = dy1; y <= dy2; ++y )
-					tmp.get_scanline( y, pl.line( static_cast<int>( y ) ), 1 );
-				r.add_plane( std::move( pl ) );
-			}
-		}
 		else
 		{
 			std::vector<size_t> pMapping;
 			pMapping.reserve( planes.size() );
-			throw_not_yet();
 			media::image_buffer tmp;
 			for ( auto &plane: planes )
 			{
@@ -108,15 +143,33 @@ image_buf extract_frame(
 					throw_runtime( "Request for channel '{0}' in layer '{0}', view '{1}' does not exist in frame {2}",
 								   plane, layer, view, f.number() );
 			}
+			if ( planes.empty() )
+			{
+				for ( size_t p = 0, nP = img->size(); p != nP; ++p )
+					pMapping.push_back( p );
+			}
 
 			for ( size_t idx: pMapping )
 			{
-				update_image_buffer( tmp, img->layout( idx ), active );
-				img->retrieve( idx, tmp );
-				plane pl( dx1, dy1, dx2, dy2 );
+				// when the image can hand out its stored pixels (i.e. an
+				// uncompressed file mapped in memory), convert straight
+				// from them rather than copying them to tmp first
+				media::plane_layout pl = img->layout( idx );
+				media::image_buffer src;
+				if ( pl._xsubsample_shift == 0 && pl._ysubsample_shift == 0 )
+					src = img->direct_plane( idx );
+				if ( src.valid() && src.x1() <= dx1 && src.y1() <= dy1 && src.x2() >= dx2 && src.y2() >= dy2 )
+					src = src.sub_buffer( dx1, dy1, dx2, dy2 );
+				else
+				{
+					update_image_buffer( tmp, pl, active );
+					img->retrieve( idx, tmp );
+					src = tmp;
+				}
+				plane dst( dx1, dy1, dx2, dy2 );
 				for ( int64_t y = dy1; y <= dy2; ++y )
-					tmp.get_scanline( y, pl.line( static_cast<int>( y ) ), 1 );
-				r.add_plane( std::move( pl ) );
+					src.get_scanline( y, dst.line( static_cast<int>( y ) ), 1 );
+				r.add_plane( std::move( dst ) );
 			}
 		}
 	}
@@ -137,35 +190,76 @@ to_frame( const image_buf &i, const std::vector<std::string> &chans, const std::
 	if ( i.size() < chans.size() )
 		throw_runtime( "image does not have enough channels ({0}) for requested channel list size ({1})", i.size(), chans.size() );
 
-	throw_not_yet();
-#if 0
 	engine::dimensions d = i.dims();
-	std::shared_ptr<media::image_frame> r = std::make_shared<media::image_frame>( d.x1, d.y1, d.x2, d.y2 );
+	media::area_rect area = media::area_rect::from_points( d.x1, d.y1, d.x2, d.y2 );
+	std::vector<media::image_buffer> bufs;
 	for ( size_t c = 0, nC = chans.size(); c != nC; ++c )
+		bufs.emplace_back( to_buffer( i[c], type ) );
+
+	auto img = std::make_shared<media::preloaded_image>( area, chans, std::move( bufs ) );
+	for ( auto &m: meta )
+		img->set_meta( m.first, m.second );
+
+	std::shared_ptr<media::frame> r = std::make_shared<media::frame>();
+	r->register_layer( std::string() ).add_view( std::string() ).store( std::static_pointer_cast<media::image>( img ) );
+	return r;
+}
+
+////////////////////////////////////////
+
+std::shared_ptr<media::frame>
+to_frame_with_levels( const image_buf &i, const std::vector<std::string> &chans, const std::string &type, media::image::level_mode levels, const std::string &filter, const media::metadata &meta )
+{
+	std::shared_ptr<media::frame> r = to_frame( i, chans, type, meta );
+	if ( levels == media::image::level_mode::SINGLE )
+		return r;
+
+	auto img = std::static_pointer_cast<media::preloaded_image>( r->find_image( std::string(), std::string() ) );
+	const int w = i.width();
+	const int h = i.height();
+	int nx = level_count( w ), ny = level_count( h );
+	if ( levels == media::image::level_mode::MIPMAP )
 	{
-		const plane &p = i[c];
-		media::image_buffer ib;
-		if ( type == "f16" )
-		{
-			ib = media::image_buffer::simple_buffer<base::half>( p.x1(), p.y1(), p.x2(), p.y2() );
-		}
-		else if ( type == "u16" )
-		{
-			ib = media::image_buffer::simple_buffer<uint16_t>( p.x1(), p.y1(), p.x2(), p.y2() );
-		}
-		else
-			throw_runtime( "Unknown/unhandled data type tag" );
+		nx = std::max( nx, ny );
+		ny = nx;
+	}
 
-		for ( int64_t y = p.y1(), ly = p.y2(); y <= ly; ++y )
+	// build the resizes for every level before computing any, so the
+	// graph is complete when the engine evaluates it. Each level is
+	// reduced from the previous one (in x and / or y), keeping the
+	// filter small. The first level of a row of a ripmap comes from
+	// the previous row.
+	std::map<std::pair<int, int>, image_buf> lev;
+	lev[std::make_pair( 0, 0 )] = i;
+	for ( int ly = 0; ly != ny; ++ly )
+	{
+		for ( int lx = 0; lx != nx; ++lx )
 		{
-			const float *pL = p.line( static_cast<int>( y ) );
-			ib.set_scanline( y, pL, 1 );
+			if ( lx == 0 && ly == 0 )
+				continue;
+			if ( levels == media::image::level_mode::MIPMAP && lx != ly )
+				continue;
+
+			std::pair<int, int> prev = ( levels == media::image::level_mode::MIPMAP ) ? std::make_pair( lx - 1, ly - 1 ) :
+				( lx == 0 ? std::make_pair( 0, ly - 1 ) : std::make_pair( lx - 1, ly ) );
+			image_buf tmp = lev[prev];
+			for ( size_t p = 0; p != chans.size(); ++p )
+				tmp[p] = resize( tmp[p], filter, level_size( w, lx ), level_size( h, ly ) );
+			lev[std::make_pair( lx, ly )] = std::move( tmp );
 		}
-		r->add_channel( chans[c], ib );
 	}
-	r->copy_meta( meta );
+
+	img->set_levels( levels, nx, ny );
+	for ( auto &l: lev )
+	{
+		if ( l.first.first == 0 && l.first.second == 0 )
+			continue;
+		std::vector<media::image_buffer> bufs;
+		for ( size_t c = 0, nC = chans.size(); c != nC; ++c )
+			bufs.emplace_back( to_buffer( l.second[c], type ) );
+		img->add_level( l.first.first, l.first.second, std::move( bufs ) );
+	}
 	return r;
-#endif
 }
 
 ////////////////////////////////////////
@@ -10,6 +10,7 @@
 #include "image.h"
 #include <media/container.h>
 #include <media/frame.h>
+#include <media/image.h>
 #include <vector>
 #include <string>
 
@@ -20,15 +21,31 @@ namespace engine { class registry; }
 namespace image
 {
 
+/// Reads the planes of a layer / view of the frame. If area is not
+/// empty, only the part of the active area inside it is read (and
+/// decoded, for formats that can read a sub-region)
 image_buf extract_frame(
 	const media::frame &f,
 	const std::string &layer = std::string(),
 	const std::string &view = std::string(),
-	const std::vector<std::string> &planes = std::vector<std::string>() );
+	const std::vector<std::string> &planes = std::vector<std::string>(),
+	const media::area_rect &area = media::area_rect() );
 
 /// Simple image to a frame with a single default / unnamed (well, empty string) layer and one view
 std::shared_ptr<media::frame> to_frame( const image_buf &i, const std::vector<std::string> &chans, const std::string &type, const media::metadata &meta = media::metadata() );
 
+/// Same as to_frame, but also stores the resolution levels of the
+/// image (mipmaps or ripmaps, rounding down, as OpenEXR does), reduced
+/// with the named resize filter, for writing to tiled multi-resolution
+/// files
+std::shared_ptr<media::frame> to_frame_with_levels(
+	const image_buf &i,
+	const std::vector<std::string> &chans,
+	const std::string &type,
+	media::image::level_mode levels,
+	const std::string &filter = "box",
+	const media::metadata &meta = media::metadata() );
+
 void debug_save_image( const image_buf &i, const std::string &fn, int64_t sampNum, const std::vector<std::string> &chans, const std::string &type, const media::parameter_set &params = media::parameter_set(), const media::metadata &meta = media::metadata() );
 
 std::shared_ptr<media::frame> load_frame( const std::shared_ptr<media::container> &c, size_t videoTrackIdx, int64_t sampNum );
@@ -12,6 +12,8 @@
 #include "plane_ops.h"
 #include "plane_math.h"
 #include "plane_stats.h"
+#include "color_ops.h"
+#include "image_metrics.h"
 #include "scanline_process.h"
 
 #include <mutex>
@@ -114,6 +116,8 @@ void initOps( void )
 	registerImageOps( r );
 	image::add_spatial( r );
 	image::add_vector_ops( r );
+	image::add_color_ops( r );
+	image::add_image_metrics( r );
 }
 
 }
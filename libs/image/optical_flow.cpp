@@ -7,12 +7,15 @@
 
 #include "optical_flow.h"
 #include "plane_ops.h"
+#include "vector_ops.h"
 #include "threading.h"
+#include "plane_reduce.h"
 #include "debug_util.h"
 #include "media_io.h"
 #include <iomanip>
 #include <cmath>
 #include <algorithm>
+#include <array>
 #include <vector>
 #include <math.h>
 
@@ -553,234 +556,6 @@ ahtvl1_gradAve( plane &gxAve, const plane &bx, const plane &ax, const plane &u,
 
 ////////////////////////////////////////
 
-static void
-ahtvl1_updateU_thread( size_t, int s, int e,
-					   plane_buffer &u, plane_buffer &v,
-					   const const_plane_buffer &puu,
-					   const const_plane_buffer &puv,
-					   const const_plane_buffer &pvu,
-					   const const_plane_buffer &pvv,
-					   const const_plane_buffer &u0,
-					   const const_plane_buffer &v0,
-					   const const_plane_buffer &t,
-					   const const_plane_buffer &gx,
-					   const const_plane_buffer &gy,
-					   float lamTheta, float theta )
-{
-	int w = u.width();
-
-	for ( int y = s; y < e; ++y )
-	{
-		float * __restrict__ uLine = u.line( y );
-		float * __restrict__ vLine = v.line( y );
-		const float * __restrict__ tLine = t.line( y );
-		const float * __restrict__ gxLine = gx.line( y );
-		const float * __restrict__ gyLine = gy.line( y );
-		const float * __restrict__ u0Line = u0.line( y );
-		const float * __restrict__ v0Line = v0.line( y );
-
-		const float * __restrict__ puuLine = puu.line( y );
-		const float * __restrict__ puvLine = puv.line( y );
-		const float * __restrict__ pvuLine = pvu.line( y );
-		const float * __restrict__ pvvLine = pvv.line( y );
-		if ( y == u.y1() )
-		{
-			for ( int x = 0; x < w; ++x )
-			{
-				float rho = tLine[x];
-				float gXAve = gxLine[x];
-				float gYAve = gyLine[x];
-				float initU = uLine[x];
-				float initV = vLine[x];
-
-				rho += ( initU - u0Line[x] ) * gXAve;
-				rho += ( initV - v0Line[x] ) * gYAve;
-				float magSq = gXAve * gXAve + gYAve * gYAve;
-
-				float u_ = initU, v_ = initV;
-
-				if ( rho < ( magSq * ( - lamTheta ) ) )
-				{
-					u_ += gXAve * lamTheta;
-					v_ += gYAve * lamTheta;
-				}
-				else if ( rho > ( magSq * lamTheta ) )
-				{
-					u_ -= gXAve * lamTheta;
-					v_ -= gYAve * lamTheta;
-				}
-				else if ( magSq > 0.F )
-				{
-					u_ -= rho * gXAve / magSq;
-					v_ -= rho * gYAve / magSq;
-				}
-
-				float p0 = 0.F;
-				if ( x > 0 )
-					p0 = puuLine[x] - puuLine[x - 1];
-
-				uLine[x] = u_ + p0 * theta;
-
-				// else will still be 0 from above
-				if ( x > 0 )
-					p0 = pvuLine[x] - pvuLine[x - 1];
-
-				vLine[x] = v_ + p0 * theta;
-			}
-			continue;
-		}
-
-		const float * __restrict__ puvm1L = puv.line( y - 1 );
-		const float * __restrict__ pvvm1L = pvv.line( y - 1 );
-
-#if defined(__SSSE3__)
-		int sseChunks = (w+3)/4;
-		sseChunks = sseChunks * 4;
-		const __m128 lamThetaV = _mm_set1_ps( lamTheta );
-		const __m128 thetaV = _mm_set1_ps( theta );
-		const __m128 negZeroV = _mm_set1_ps( -0.F );
-
-		__m128i puuPrev = _mm_set1_epi32( *(reinterpret_cast<const int *>(puuLine)) );
-		__m128i pvuPrev = _mm_set1_epi32( *(reinterpret_cast<const int *>(pvuLine)) );
-		for ( int x = 0; x < sseChunks; x += 4 )
-		{
-			__m128 rho = _mm_load_ps( tLine + x );
-			__m128 u_ = _mm_load_ps( uLine + x );
-			__m128 u0 = _mm_load_ps( u0Line + x );
-			__m128 gXAve = _mm_load_ps( gxLine + x );
-			__m128 v_ = _mm_load_ps( vLine + x );
-			__m128 v0 = _mm_load_ps( v0Line + x );
-			__m128 gYAve = _mm_load_ps( gyLine + x );
-
-			__m128i tmppuu = _mm_load_si128( reinterpret_cast<const __m128i *>( puuLine + x ) );
-			__m128 puv_v = _mm_load_ps( puvLine + x );
-			__m128 puvm1_v = _mm_load_ps( puvm1L + x );
-
-			rho = _mm_add_ps( rho, _mm_mul_ps( gXAve, _mm_sub_ps( u_, u0 ) ) );
-			rho = _mm_add_ps( rho, _mm_mul_ps( gYAve, _mm_sub_ps( v_, v0 ) ) );
-
-			__m128 magSq = _mm_add_ps(
-				_mm_mul_ps( gXAve, gXAve ),
-				_mm_mul_ps( gYAve, gYAve ) );
-
-			__m128 testVal = _mm_mul_ps( magSq, lamThetaV );
-			__m128 rhoLT = _mm_cmplt_ps( rho, _mm_xor_ps( testVal, negZeroV ) );
-			__m128 rhoGT = _mm_cmpgt_ps( rho, testVal );
-			// avoid divide by zero when magSq == 0 AND rho == 0
-			__m128 rhoMagSq = _mm_cmpgt_ps( magSq, _mm_setzero_ps() );
-			rhoMagSq = _mm_andnot_ps( _mm_or_ps( rhoLT, rhoGT ), rhoMagSq );
-
-			__m128 gxScale = _mm_mul_ps( gXAve, lamThetaV );
-			__m128 gxScaleRho = _mm_min_ps( thetaV, _mm_mul_ps( rho, _mm_div_ps( gXAve, magSq ) ) );
-
-			u_ = _mm_add_ps( u_, _mm_and_ps( rhoLT, gxScale ) );
-			u_ = _mm_sub_ps( u_, _mm_and_ps( rhoGT, gxScale ) );
-			u_ = _mm_sub_ps( u_, _mm_and_ps( rhoMagSq, gxScaleRho ) );
-
-			__m128 puu_v = _mm_castsi128_ps( tmppuu );
-			__m128 puu_v_m1 = _mm_castsi128_ps( _mm_alignr_epi8( tmppuu, puuPrev, 12 ) );
-			puuPrev = tmppuu;
-
-			__m128 p0 = _mm_sub_ps( puu_v, puu_v_m1 );
-			__m128 p1 = _mm_sub_ps( puv_v, puvm1_v );
-
-			__m128i tmppvu = _mm_load_si128( reinterpret_cast<const __m128i *>( pvuLine + x ) );
-			__m128 pvv_v = _mm_load_ps( pvvLine + x );
-			__m128 pvvm1_v = _mm_load_ps( pvvm1L + x );
-
-			u_ = _mm_add_ps( u_, _mm_mul_ps( thetaV, _mm_add_ps( p0, p1 ) ) );
-			_mm_store_ps( uLine + x, u_ );
-
-			__m128 gyScale = _mm_mul_ps( gYAve, lamThetaV );
-			__m128 gyScaleRho = _mm_min_ps( thetaV, _mm_mul_ps( rho, _mm_div_ps( gYAve, magSq ) ) );
-
-			v_ = _mm_add_ps( v_, _mm_and_ps( rhoLT, gyScale ) );
-			v_ = _mm_sub_ps( v_, _mm_and_ps( rhoGT, gyScale ) );
-			v_ = _mm_sub_ps( v_, _mm_and_ps( rhoMagSq, gyScaleRho ) );
-
-			__m128 pvu_v = _mm_castsi128_ps( tmppvu );
-			__m128 pvu_v_m1 = _mm_castsi128_ps( _mm_alignr_epi8( tmppvu, pvuPrev, 12 ) );
-			pvuPrev = tmppvu;
-
-			p0 = _mm_sub_ps( pvu_v, pvu_v_m1 );
-			p1 = _mm_sub_ps( pvv_v, pvvm1_v );
-
-			v_ = _mm_add_ps( v_, _mm_mul_ps( thetaV, _mm_add_ps( p0, p1 ) ) );
-			_mm_store_ps( vLine + x, v_ );
-		}
-#else
-		for ( int x = 0; x < w; ++x )
-		{
-			float rho = tLine[x];
-			float gXAve = gxLine[x];
-			float gYAve = gyLine[x];
-			float initU = uLine[x];
-			float initV = vLine[x];
-
-			rho += ( initU - u0Line[x] ) * gXAve;
-			rho += ( initV - v0Line[x] ) * gYAve;
-			float magSq = gXAve * gXAve + gYAve * gYAve;
-
-			float u_ = initU, v_ = initV;
-
-			if ( rho < ( magSq * ( - lamTheta ) ) )
-			{
-				u_ += gXAve * lamTheta;
-				v_ += gYAve * lamTheta;
-			}
-			else if ( rho > ( magSq * lamTheta ) )
-			{
-				u_ -= gXAve * lamTheta;
-				v_ -= gYAve * lamTheta;
-			}
-			else
-			{
-				u_ -= rho * gXAve / magSq;
-				v_ -= rho * gYAve / magSq;
-			}
-
-			float p0 = 0.F;
-			if ( x > 0 )
-				p0 = puuLine[x] - puuLine[x - 1];
-			float p1 = puvLine[x] - puvm1L[x];
-
-			uLine[x] = u_ + ( p0 + p1 ) * theta;
-
-			// else will still be 0 from above
-			if ( x > 0 )
-				p0 = pvuLine[x] - pvuLine[x - 1];
-			p1 = pvvLine[x] - pvvm1L[x];
-
-			vLine[x] = v_ + ( p0 + p1 ) * theta;
-		}
-#endif
-	}
-}
-
-static void
-ahtvl1_updateU( plane &u, plane &v,
-				const plane &puu, const plane &puv,
-				const plane &pvu, const plane &pvv,
-				const plane &u0, const plane &v0,
-				const plane &t,
-				const plane &gxAve, const plane &gyAve,
-				float lamTheta, float theta )
-{
-	plane_buffer ub = u;
-	plane_buffer vb = v;
-	const_plane_buffer puub = puu;
-	const_plane_buffer puvb = puv;
-	const_plane_buffer pvub = pvu;
-	const_plane_buffer pvvb = pvv;
-	const_plane_buffer u0b = u0;
-	const_plane_buffer v0b = v0;
-	const_plane_buffer tb = t;
-	const_plane_buffer gxb = gxAve;
-	const_plane_buffer gyb = gyAve;
-
-	threading::get().dispatch( std::bind( ahtvl1_updateU_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( ub ), std::ref( vb ), std::cref( puub ), std::cref( puvb ), std::cref( pvub ), std::cref( pvvb ), std::cref( u0b ), std::cref( v0b ), std::cref( tb ), std::cref( gxb ), std::cref( gyb ), lamTheta, theta ), u.y1(), u.height() );
-}
-
 #if defined(__SSE__)
 GK_FORCE_INLINE __m128 rsqrtSafe( __m128 x )
 {
@@ -819,217 +594,334 @@ GK_FORCE_INLINE __m128 rsqrtSafe( __m128 x )
 }
 #endif
 
+
 ////////////////////////////////////////
 
-static void
-ahtvl1_updatePnoedge_thread( size_t, int s, int e, plane_buffer &pu, plane_buffer &pv, const const_plane_buffer &u, float tau, float epsilon )
+// The fused solver runs a block of iterations of the U and P updates
+// on one tile at a time, so the state of the tile stays in cache
+// instead of streaming all the planes through memory 3 times per
+// iteration. Each update only reads the immediate neighbours, so a
+// tile loaded with a halo of N pixels has a valid interior after N
+// iterations. Only the interior is written back, to a second set of
+// buffers, as the neighbouring tiles are reading the halo.
+constexpr int kTVL1Tile = 64;
+constexpr int kTVL1Block = 4;
+// stop iterating once the mean change in the flow per iteration is
+// below this (in pixels at the current level)
+constexpr float kTVL1Converge = 0.0001F;
+
+enum tvl1_plane
 {
-	int w = pu.width();
-#if defined(__SSSE3__)
-	const __m128 tauV = _mm_set1_ps( tau );
-	const __m128 epsV = _mm_set1_ps( epsilon );
-	const __m128 oneV = _mm_set1_ps( 1.F );
-#endif
-	for ( int y = s; y < e; ++y )
+	TVL1_U = 0, TVL1_V, TVL1_PUU, TVL1_PUV, TVL1_PVU, TVL1_PVV,
+	TVL1_STATE_COUNT,
+	TVL1_RHO = TVL1_STATE_COUNT, TVL1_GX, TVL1_GY, TVL1_EDGE,
+	TVL1_LOCAL_COUNT
+};
+
+struct tvl1_fused_job
+{
+	std::array<const_plane_buffer, TVL1_STATE_COUNT> src;
+	std::array<plane_buffer, TVL1_STATE_COUNT> dst;
+	const_plane_buffer u0, v0, t, gx, gy, edgeW;
+	float lamTheta, theta, tau, epsilon;
+	int iters;
+	int tilesX;
+	std::vector<padded_partial<double>> change;
+};
+
+GK_FORCE_INLINE void
+tvl1_updateU_pixel( int x, size_t up, bool hasLeft,
+					float * __restrict__ uL, float * __restrict__ vL,
+					const float * __restrict__ puuL, const float * __restrict__ puvL,
+					const float * __restrict__ pvuL, const float * __restrict__ pvvL,
+					const float * __restrict__ rhoL, const float * __restrict__ gxL,
+					const float * __restrict__ gyL, float lamTheta, float theta )
+{
+	float gX = gxL[x];
+	float gY = gyL[x];
+	float u_ = uL[x];
+	float v_ = vL[x];
+	float rho = rhoL[x] + u_ * gX + v_ * gY;
+	float magSq = gX * gX + gY * gY;
+	float step = magSq > 0.F ? myminf( lamTheta, mymaxf( -lamTheta, rho / magSq ) ) : 0.F;
+
+	// divergence of p, with the neighbours outside the plane
+	// (or the tile) treated as 0
+	float divU = puvL[x] - puvL[x - up];
+	float divV = pvvL[x] - pvvL[x - up];
+	if ( hasLeft )
 	{
-		float * __restrict__ puLine = pu.line( y );
-		float * __restrict__ pvLine = pv.line( y );
-		const float * __restrict__ uLine = u.line( y );
+		divU += puuL[x] - puuL[x - 1];
+		divV += pvuL[x] - pvuL[x - 1];
+	}
+	uL[x] = u_ - step * gX + divU * theta;
+	vL[x] = v_ - step * gY + divV * theta;
+}
 
-		if ( y < pu.y2() )
+static void
+tvl1_local_updateU( float *local, int lw, int lh, float lamTheta, float theta )
+{
+	const size_t planeSize = static_cast<size_t>( lw ) * static_cast<size_t>( lh );
+	for ( int y = 0; y < lh; ++y )
+	{
+		const size_t off = static_cast<size_t>( y ) * static_cast<size_t>( lw );
+		float * __restrict__ uL = local + TVL1_U * planeSize + off;
+		float * __restrict__ vL = local + TVL1_V * planeSize + off;
+		const float * __restrict__ puuL = local + TVL1_PUU * planeSize + off;
+		const float * __restrict__ puvL = local + TVL1_PUV * planeSize + off;
+		const float * __restrict__ pvuL = local + TVL1_PVU * planeSize + off;
+		const float * __restrict__ pvvL = local + TVL1_PVV * planeSize + off;
+		const float * __restrict__ rhoL = local + TVL1_RHO * planeSize + off;
+		const float * __restrict__ gxL = local + TVL1_GX * planeSize + off;
+		const float * __restrict__ gyL = local + TVL1_GY * planeSize + off;
+		// the first row has no row above, point at itself so the
+		// vertical divergence term is 0
+		const size_t up = y > 0 ? static_cast<size_t>( lw ) : 0;
+
+		tvl1_updateU_pixel( 0, up, false, uL, vL, puuL, puvL, pvuL, pvvL, rhoL, gxL, gyL, lamTheta, theta );
+		int x = 1;
+#if defined(__SSE__)
+		const __m128 ltV = _mm_set1_ps( lamTheta );
+		const __m128 nltV = _mm_set1_ps( -lamTheta );
+		const __m128 thetaV = _mm_set1_ps( theta );
+		const __m128 zeroV = _mm_setzero_ps();
+		const __m128 minV = _mm_set1_ps( std::numeric_limits<float>::min() );
+		for ( ; ( x + 4 ) <= lw; x += 4 )
 		{
-			const float * __restrict__ up1Line = u.line( y + 1 );
-#if defined(__SSSE3__)
-			int sseChunks = ( w + 3 ) / 4 - 1;
-			sseChunks *= 4;
-			int startOffset = sseChunks;
-
-			__m128i curUx = _mm_load_si128( reinterpret_cast<const __m128i *>( uLine ) );
-			for ( int x = 0; x < sseChunks; x += 4 )
-			{
-				__m128i nextUx = _mm_load_si128( reinterpret_cast<const __m128i *>( uLine + x + 4 ) );
-				__m128 uX = _mm_castsi128_ps( curUx );
-
-				__m128 outU = _mm_load_ps( puLine + x );
-				__m128 outV = _mm_load_ps( pvLine + x );
-				__m128 uY = _mm_load_ps( up1Line + x );
-
-				__m128i rot = _mm_alignr_epi8( nextUx, curUx, 4 );
-				__m128 uXp1 = _mm_castsi128_ps( rot );
-				curUx = nextUx;
-
-				uY = _mm_sub_ps( uY, uX );
-				uX = _mm_sub_ps( uXp1, uX );
-
-				outU = _mm_add_ps(
-					outU,
-					_mm_mul_ps( tauV,
-								_mm_sub_ps(
-									uX, _mm_mul_ps( epsV, outU ) ) ) );
-				outV = _mm_add_ps(
-					outV,
-					_mm_mul_ps( tauV,
-								_mm_sub_ps(
-									uY, _mm_mul_ps( epsV, outV ) ) ) );
-
-				__m128 scale = rsqrtSafe(
-						_mm_add_ps( _mm_mul_ps( outU, outU ),
-									_mm_mul_ps( outV, outV ) ) );
-				scale = _mm_min_ps( scale, oneV );
-				_mm_store_ps( puLine + x, _mm_mul_ps( scale, outU ) );
-				_mm_store_ps( pvLine + x, _mm_mul_ps( scale, outV ) );
-			}
-#else
-			int startOffset = 0;
+			__m128 gX = _mm_loadu_ps( gxL + x );
+			__m128 gY = _mm_loadu_ps( gyL + x );
+			__m128 u_ = _mm_loadu_ps( uL + x );
+			__m128 v_ = _mm_loadu_ps( vL + x );
+			__m128 rho = _mm_add_ps( _mm_loadu_ps( rhoL + x ),
+									 _mm_add_ps( _mm_mul_ps( u_, gX ), _mm_mul_ps( v_, gY ) ) );
+			__m128 magSq = _mm_add_ps( _mm_mul_ps( gX, gX ), _mm_mul_ps( gY, gY ) );
+			__m128 step = _mm_div_ps( rho, _mm_max_ps( magSq, minV ) );
+			step = _mm_min_ps( ltV, _mm_max_ps( nltV, step ) );
+			step = _mm_and_ps( _mm_cmpgt_ps( magSq, zeroV ), step );
+
+			__m128 divU = _mm_add_ps(
+				_mm_sub_ps( _mm_loadu_ps( puuL + x ), _mm_loadu_ps( puuL + x - 1 ) ),
+				_mm_sub_ps( _mm_loadu_ps( puvL + x ), _mm_loadu_ps( puvL + x - up ) ) );
+			__m128 divV = _mm_add_ps(
+				_mm_sub_ps( _mm_loadu_ps( pvuL + x ), _mm_loadu_ps( pvuL + x - 1 ) ),
+				_mm_sub_ps( _mm_loadu_ps( pvvL + x ), _mm_loadu_ps( pvvL + x - up ) ) );
+
+			_mm_storeu_ps( uL + x, _mm_add_ps( _mm_sub_ps( u_, _mm_mul_ps( step, gX ) ), _mm_mul_ps( divU, thetaV ) ) );
+			_mm_storeu_ps( vL + x, _mm_add_ps( _mm_sub_ps( v_, _mm_mul_ps( step, gY ) ), _mm_mul_ps( divV, thetaV ) ) );
+		}
 #endif
-			for ( int x = startOffset; x < w; ++x )
-			{
-				float outU = puLine[x];
-				float outV = pvLine[x];
-				float uX = uLine[x];
-				float uY = up1Line[x] - uX;
-				if ( x < (w - 1) )
-					uX = uLine[x + 1] - uX;
-				else
-					uX = 0.F;
-
-				outU = outU + tau * ( uX - epsilon * outU );
-				outV = outV + tau * ( uY - epsilon * outV );
-
-				float scale = mymaxf( 1.F, sqrtf( outU * outU + outV * outV ) );
-				outU = outU / scale;
-				outV = outV / scale;
-				puLine[x] = outU;
-				pvLine[x] = outV;
-			}
+		for ( ; x < lw; ++x )
+			tvl1_updateU_pixel( x, up, true, uL, vL, puuL, puvL, pvuL, pvvL, rhoL, gxL, gyL, lamTheta, theta );
+	}
+}
+
+template <bool useEdge>
+static void
+tvl1_local_updateP( float *local, int lw, int lh, tvl1_plane uIdx, tvl1_plane pxIdx, tvl1_plane pyIdx, float tau, float epsilon )
+{
+	const size_t planeSize = static_cast<size_t>( lw ) * static_cast<size_t>( lh );
+	for ( int y = 0; y < lh; ++y )
+	{
+		const size_t off = static_cast<size_t>( y ) * static_cast<size_t>( lw );
+		const float * __restrict__ uL = local + uIdx * planeSize + off;
+		float * __restrict__ pxL = local + pxIdx * planeSize + off;
+		float * __restrict__ pyL = local + pyIdx * planeSize + off;
+		const float * __restrict__ eL = local + TVL1_EDGE * planeSize + off;
+		// the last row has no row below, point at itself so the
+		// vertical gradient is 0
+		const size_t down = y < ( lh - 1 ) ? static_cast<size_t>( lw ) : 0;
+
+		int x = 0;
+#if defined(__SSE__)
+		const __m128 tauV = _mm_set1_ps( tau );
+		const __m128 epsV = _mm_set1_ps( epsilon );
+		const __m128 oneV = _mm_set1_ps( 1.F );
+		for ( ; ( x + 5 ) <= lw; x += 4 )
+		{
+			__m128 u_ = _mm_loadu_ps( uL + x );
+			__m128 uX = _mm_sub_ps( _mm_loadu_ps( uL + x + 1 ), u_ );
+			__m128 uY = _mm_sub_ps( _mm_loadu_ps( uL + x + down ), u_ );
+			__m128 outU = _mm_loadu_ps( pxL + x );
+			__m128 outV = _mm_loadu_ps( pyL + x );
+			outU = _mm_add_ps( outU, _mm_mul_ps( tauV, _mm_sub_ps( uX, _mm_mul_ps( epsV, outU ) ) ) );
+			outV = _mm_add_ps( outV, _mm_mul_ps( tauV, _mm_sub_ps( uY, _mm_mul_ps( epsV, outV ) ) ) );
+
+			__m128 scale = rsqrtSafe( _mm_add_ps( _mm_mul_ps( outU, outU ), _mm_mul_ps( outV, outV ) ) );
+			scale = _mm_min_ps( scale, oneV );
+			if ( useEdge )
+				scale = _mm_mul_ps( scale, _mm_loadu_ps( eL + x ) );
+			_mm_storeu_ps( pxL + x, _mm_mul_ps( scale, outU ) );
+			_mm_storeu_ps( pyL + x, _mm_mul_ps( scale, outV ) );
 		}
-		else
+#endif
+		for ( ; x < lw; ++x )
 		{
-			for ( int x = 0; x < w; ++x )
-			{
-				float outU = puLine[x];
-				float outV = pvLine[x];
-				float uX = uLine[x];
-				float uY = 0.F;
-				if ( x < (w - 1) )
-					uX = uLine[x + 1] - uX;
-				else
-					uX = 0.F;
-
-				outU = outU + tau * ( uX - epsilon * outU );
-				outV = outV + tau * ( uY - epsilon * outV );
-
-				float scale = std::max( 1.F, sqrtf( outU * outU + outV * outV ) );
-				outU = outU / scale;
-				outV = outV / scale;
-				puLine[x] = outU;
-				pvLine[x] = outV;
-			}
+			float uX = x < ( lw - 1 ) ? uL[x + 1] - uL[x] : 0.F;
+			float uY = uL[x + down] - uL[x];
+			float outU = pxL[x];
+			float outV = pyL[x];
+			outU = outU + tau * ( uX - epsilon * outU );
+			outV = outV + tau * ( uY - epsilon * outV );
+
+			float scale = 1.F / mymaxf( 1.F, sqrtf( outU * outU + outV * outV ) );
+			if ( useEdge )
+				scale *= eL[x];
+			pxL[x] = outU * scale;
+			pyL[x] = outV * scale;
 		}
 	}
 }
 
 static void
-ahtvl1_updatePedge_thread( size_t, int s, int e, plane_buffer &pu, plane_buffer &pv, const const_plane_buffer &u, const const_plane_buffer &edgeW, float tau, float epsilon )
+ahtvl1_fused_thread( size_t tIdx, int s, int e, tvl1_fused_job &job )
 {
-	int w = pu.width();
-	for ( int y = s; y < e; ++y )
+	const int w = job.t.width();
+	const int h = job.t.height();
+	const int py1 = job.t.y1();
+	const int halo = job.iters;
+	const bool useEdge = job.edgeW.valid();
+
+	const int maxL = kTVL1Tile + 2 * halo;
+	std::vector<float> localBuf( static_cast<size_t>( maxL ) * static_cast<size_t>( maxL ) * TVL1_LOCAL_COUNT );
+	float *local = localBuf.data();
+	double change = 0.0;
+
+	for ( int tile = s; tile < e; ++tile )
 	{
-		float *puLine = pu.line( y );
-		float *pvLine = pv.line( y );
-		const float *uLine = u.line( y );
-		const float *eLine = edgeW.line( y );
-
-		if ( y < pu.y2() )
+		const int x0 = ( tile % job.tilesX ) * kTVL1Tile;
+		const int y0 = ( tile / job.tilesX ) * kTVL1Tile;
+		const int x1 = std::min( w, x0 + kTVL1Tile );
+		const int y1 = std::min( h, y0 + kTVL1Tile );
+		const int lx0 = std::max( 0, x0 - halo );
+		const int ly0 = std::max( 0, y0 - halo );
+		const int lw = std::min( w, x1 + halo ) - lx0;
+		const int lh = std::min( h, y1 + halo ) - ly0;
+		const size_t planeSize = static_cast<size_t>( lw ) * static_cast<size_t>( lh );
+
+		for ( int y = 0; y < lh; ++y )
 		{
-			const float *up1Line = u.line( y + 1 );
-			for ( int x = 0; x < w; ++x )
+			const int srcY = py1 + ly0 + y;
+			const size_t off = static_cast<size_t>( y ) * static_cast<size_t>( lw );
+			for ( size_t i = 0; i != TVL1_STATE_COUNT; ++i )
+				std::copy( job.src[i].line( srcY ) + lx0, job.src[i].line( srcY ) + lx0 + lw, local + i * planeSize + off );
+
+			const float *u0L = job.u0.line( srcY ) + lx0;
+			const float *v0L = job.v0.line( srcY ) + lx0;
+			const float *tL = job.t.line( srcY ) + lx0;
+			const float *gxL = job.gx.line( srcY ) + lx0;
+			const float *gyL = job.gy.line( srcY ) + lx0;
+			float *rhoO = local + TVL1_RHO * planeSize + off;
+			float *gxO = local + TVL1_GX * planeSize + off;
+			float *gyO = local + TVL1_GY * planeSize + off;
+			for ( int x = 0; x < lw; ++x )
 			{
-				float outU = puLine[x];
-				float outV = pvLine[x];
-				float eW = eLine[x];
-				float uX = uLine[x];
-				float uY = up1Line[x] - uX;
-				if ( x < (w - 1) )
-					uX = uLine[x + 1] - uX;
-				else
-					uX = 0.F;
-
-				outU = outU + tau * ( uX - epsilon * outU );
-				outV = outV + tau * ( uY - epsilon * outV );
-
-				float scale = eW / mymaxf( 1.F, sqrtf( outU * outU + outV * outV ) );
-				outU = outU * scale;
-				outV = outV * scale;
-				puLine[x] = outU;
-				pvLine[x] = outV;
+				gxO[x] = gxL[x];
+				gyO[x] = gyL[x];
+				// t + ( u - u0 ) * gx + ( v - v0 ) * gy, with the
+				// constant part precomputed
+				rhoO[x] = tL[x] - u0L[x] * gxL[x] - v0L[x] * gyL[x];
 			}
+			if ( useEdge )
+				std::copy( job.edgeW.line( srcY ) + lx0, job.edgeW.line( srcY ) + lx0 + lw, local + TVL1_EDGE * planeSize + off );
 		}
-		else
+
+		for ( int i = 0; i < job.iters; ++i )
 		{
-			for ( int x = 0; x < w; ++x )
+			tvl1_local_updateU( local, lw, lh, job.lamTheta, job.theta );
+			if ( useEdge )
+			{
+				tvl1_local_updateP<true>( local, lw, lh, TVL1_U, TVL1_PUU, TVL1_PUV, job.tau, job.epsilon );
+				tvl1_local_updateP<true>( local, lw, lh, TVL1_V, TVL1_PVU, TVL1_PVV, job.tau, job.epsilon );
+			}
+			else
 			{
-				float outU = puLine[x];
-				float outV = pvLine[x];
-				float eW = eLine[x];
-				float uX = uLine[x];
-				float uY = 0.F;
-				if ( x < (w - 1) )
-					uX = uLine[x + 1] - uX;
-				else
-					uX = 0.F;
-
-				outU = outU + tau * ( uX - epsilon * outU );
-				outV = outV + tau * ( uY - epsilon * outV );
-
-				float scale = eW / mymaxf( 1.F, sqrtf( outU * outU + outV * outV ) );
-				outU = outU * scale;
-				outV = outV * scale;
-				puLine[x] = outU;
-				pvLine[x] = outV;
+				tvl1_local_updateP<false>( local, lw, lh, TVL1_U, TVL1_PUU, TVL1_PUV, job.tau, job.epsilon );
+				tvl1_local_updateP<false>( local, lw, lh, TVL1_V, TVL1_PVU, TVL1_PVV, job.tau, job.epsilon );
 			}
 		}
+
+		// write back the interior
+		const int ix = x0 - lx0;
+		const int iw = x1 - x0;
+		for ( int y = y0; y < y1; ++y )
+		{
+			const size_t off = static_cast<size_t>( y - ly0 ) * static_cast<size_t>( lw ) + static_cast<size_t>( ix );
+			const int dstY = py1 + y;
+			for ( size_t i = 0; i != TVL1_STATE_COUNT; ++i )
+				std::copy( local + i * planeSize + off, local + i * planeSize + off + iw, job.dst[i].line( dstY ) + x0 );
+
+			const float *uN = local + TVL1_U * planeSize + off;
+			const float *vN = local + TVL1_V * planeSize + off;
+			const float *uO = job.src[TVL1_U].line( dstY ) + x0;
+			const float *vO = job.src[TVL1_V].line( dstY ) + x0;
+			float rowChange = 0.F;
+			for ( int x = 0; x < iw; ++x )
+				rowChange += fabsf( uN[x] - uO[x] ) + fabsf( vN[x] - vO[x] );
+			change += static_cast<double>( rowChange );
+		}
 	}
+
+	job.change[tIdx].value += change;
 }
 
-static void
-ahtvl1_updateP( plane &puu, plane &puv, const plane &u, const plane &edgeW, float tau, float epsilon )
+/// runs up to iters iterations of the U / P updates, returning the
+/// number of iterations actually run
+static int
+ahtvl1_fused( std::array<plane, TVL1_STATE_COUNT> &state,
+			  std::array<plane, TVL1_STATE_COUNT> &scratch,
+			  const plane &u0, const plane &v0, const plane &t,
+			  const plane &gxAve, const plane &gyAve, const plane &edgeW,
+			  int iters, float lamTheta, float theta, float tau, float epsilon )
 {
-	plane_buffer puub = puu;
-	plane_buffer puvb = puv;
-	const_plane_buffer ub = u;
-	const_plane_buffer eb = edgeW;
-
+	tvl1_fused_job job;
+	job.u0 = u0;
+	job.v0 = v0;
+	job.t = t;
+	job.gx = gxAve;
+	job.gy = gyAve;
 	if ( edgeW.valid() )
+		job.edgeW = edgeW;
+	job.lamTheta = lamTheta;
+	job.theta = theta;
+	job.tau = tau;
+	job.epsilon = epsilon;
+	job.tilesX = ( t.width() + kTVL1Tile - 1 ) / kTVL1Tile;
+	const int nTiles = job.tilesX * ( ( t.height() + kTVL1Tile - 1 ) / kTVL1Tile );
+	const double nPix = static_cast<double>( t.width() ) * static_cast<double>( t.height() );
+
+	int done = 0;
+	while ( done < iters )
 	{
-		threading::get().dispatch( std::bind( ahtvl1_updatePedge_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( puub ), std::ref( puvb ), std::cref( ub ), std::cref( eb ), tau, epsilon ), puu.y1(), puu.height() );
-	}
-	else
-	{
-		threading::get().dispatch( std::bind( ahtvl1_updatePnoedge_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( puub ), std::ref( puvb ), std::cref( ub ), tau, epsilon ), puu.y1(), puu.height() );
+		job.iters = std::min( kTVL1Block, iters - done );
+		for ( size_t i = 0; i != TVL1_STATE_COUNT; ++i )
+		{
+			job.src[i] = state[i];
+			job.dst[i] = scratch[i];
+		}
+		job.change.assign( threading::get().size(), padded_partial<double>{ 0.0, {} } );
+
+		threading::get().dispatch( std::bind( ahtvl1_fused_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( job ) ), 0, nTiles );
+
+		std::swap( state, scratch );
+		done += job.iters;
+
+		double change = 0.0;
+		for ( auto &c: job.change )
+			change += c.value;
+		if ( change / ( nPix * static_cast<double>( job.iters ) ) < static_cast<double>( kTVL1Converge ) )
+			break;
 	}
+	return done;
 }
-static std::string kPyramidFilter = "bilinear";
-//static std::string kPyramidFilter = "bicubic";
+
+static std::string kPyramidFilter = "gaussian";
+//static std::string kPyramidFilter = "bilinear";
 
 ////////////////////////////////////////
 
-vector_field
-runAHTVL1( const plane &a, const plane &b, const plane &alpha, const plane &alphaNext, const vector_field &initUV, float lambda, float theta, float epsilon, float edgePower, float edgeAlpha, int edgeBorder, int tvl1Iters, int warpIters, bool adaptiveIters, float eta )
+static std::vector<float>
+ahtvl1_edgeKernel( float edgeAlpha, int &edgeBorder )
 {
-	std::vector<plane> hierA = make_pyramid( a, kPyramidFilter, eta, 0, 16 );
-	std::vector<plane> hierB = make_pyramid( b, kPyramidFilter, eta, 0, 16 );
-	std::vector<plane> hierAlpha, hierAlphaNext;
-	if ( alpha.valid() && alphaNext.valid() )
-	{
-		hierAlpha = make_pyramid( alpha, kPyramidFilter, eta, 0, 16 );
-		hierAlphaNext = make_pyramid( alphaNext, kPyramidFilter, eta, 0, 16 );
-	}
-
-	if ( initUV.valid() )
-		std::cout << "add constraint / init for initial UV passed in" << std::endl;
-
-//	const float tau = 1.F / ( 4.F * theta + epsilon );
 	std::vector<float> edgeKern;
 	if ( edgeAlpha > 0.F )
 	{
@@ -1042,15 +934,112 @@ runAHTVL1( const plane &a, const plane &b, const plane &alpha, const plane &alph
 		edgeKern[4] = 1.F / 17.F;
 		edgeBorder = std::max( 1, edgeBorder );
 	}
+	return edgeKern;
+}
+
+////////////////////////////////////////
+
+/// Runs the warps of one pyramid level of the solve for the flow from
+/// curA to curB, upsampling u and v from the previous level (or
+/// initializing them on the first). The gradients and edge weights
+/// are passed in so the bidirectional solve can share them between
+/// the two directions.
+static void
+ahtvl1_level( plane &u, plane &v, const plane &curA, const plane &curB, const plane &curAlpha, const plane &ax, const plane &ay, const plane &bx, const plane &by, const plane &edgeW, float lambda, float theta, float epsilon, int wI, int iI, bool lastLevel )
+{
+	const float tau = 1.F / ( 4.F + epsilon );
+
+	if ( ! u.valid() )
+	{
+		u = plane( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
+		v = plane( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
+		memset( u.data(), 0, u.buffer_size() );
+		memset( v.data(), 0, v.buffer_size() );
+	}
+	else if ( u.width() != curA.width() || u.height() != curA.height() )
+	{
+		int curW = curA.width();
+		int curH = curA.height();
+
+		float scaleX = static_cast<float>( curW ) / static_cast<float>( u.width() );
+		float scaleY = static_cast<float>( curH ) / static_cast<float>( u.height() );
+
+		u = resize_bilinear( u, curW, curH ) * scaleX;
+		u.data();
+		v = resize_bilinear( v, curW, curH ) * scaleY;
+		v.data();
+	}
+
+	std::array<plane, TVL1_STATE_COUNT> state, scratch;
+	state[TVL1_U] = u;
+	state[TVL1_V] = v;
+	state[TVL1_PUU] = create_plane( curA.x1(), curA.y1(), curA.x2(), curA.y2(), 0.F );
+	for ( int i = TVL1_PUV; i != TVL1_STATE_COUNT; ++i )
+		state[i] = state[TVL1_PUU].copy();
+	for ( auto &sp: scratch )
+		sp = plane( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
+
+	plane t( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
+	plane gxAve( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
+	plane gyAve( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
+	plane u0( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
+	plane v0( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
+
+	for ( int curWarp = 0; curWarp < wI; ++curWarp )
+	{
+		std::cout << ' ' << (curWarp + 1) << std::flush;
+		ahtvl1_T( t, curB, curA, curAlpha, u0, v0, u, v );
+		ahtvl1_gradAve( gxAve, bx, ax, u0, v0 );
+		ahtvl1_gradAve( gyAve, by, ay, u0, v0 );
+		killAlpha( gxAve, gyAve, curAlpha );
+
+		ahtvl1_fused( state, scratch, u0, v0, t, gxAve, gyAve, edgeW, iI, lambda * theta, theta, tau, epsilon );
+		u = state[TVL1_U];
+		v = state[TVL1_V];
+
+		killAlpha( u, v, curAlpha );
+	}
+
+	if ( lastLevel )
+		zilchAlpha( u, v, curAlpha );
+}
+
+////////////////////////////////////////
+
+/// when warm started, only the pyramid levels at least this fraction
+/// of the full resolution are solved, as the initial flow should only
+/// be off by a few pixels, and the tv-l1 iterations are scaled by
+/// kWarmStartIters, as they are only refining the estimate
+static const float kWarmStartScale = 0.25F;
+static const float kWarmStartIters = 0.5F;
+
+vector_field
+runAHTVL1( const plane &a, const plane &b, const plane &alpha, const plane &alphaNext, const vector_field &initUV, float lambda, float theta, float epsilon, float edgePower, float edgeAlpha, int edgeBorder, int tvl1Iters, int warpIters, bool adaptiveIters, float eta )
+{
+	int levels = 0;
+	vector_field init;
+	if ( initUV.valid() )
+	{
+		init = initUV.is_absolute() ? convert_to_relative( initUV ) : initUV;
+		levels = 1 + static_cast<int>( floorf( logf( kWarmStartScale ) / logf( eta ) ) );
+		tvl1Iters = std::max( 1, static_cast<int>( static_cast<float>( tvl1Iters ) * kWarmStartIters ) );
+	}
+
+	std::vector<plane> hierA = make_pyramid( a, kPyramidFilter, eta, levels, 16 );
+	std::vector<plane> hierB = make_pyramid( b, kPyramidFilter, eta, levels, 16 );
+	std::vector<plane> hierAlpha, hierAlphaNext;
+	if ( alpha.valid() && alphaNext.valid() )
+	{
+		hierAlpha = make_pyramid( alpha, kPyramidFilter, eta, levels, 16 );
+		hierAlphaNext = make_pyramid( alphaNext, kPyramidFilter, eta, levels, 16 );
+	}
+
+	std::vector<float> edgeKern = ahtvl1_edgeKernel( edgeAlpha, edgeBorder );
 	plane u, v;
 	float lScale = 1.F + 1.F / static_cast<float>( hierA.size() );
 	float eScale = 1.F + 1.F / static_cast<float>( hierA.size() );
-//	static int oflowCount = 0;
-//	int hierCount = 0;
 	while ( ! hierA.empty() )
 	{
-		const float tau = 1.F / ( 4.F + epsilon );
-
 		plane curA = hierA.back();
 		plane curB = hierB.back();
 		hierA.pop_back();
@@ -1068,49 +1057,152 @@ runAHTVL1( const plane &a, const plane &b, const plane &alpha, const plane &alph
 			nextAlpha.cdata();
 		}
 
-		if ( ! u.valid() )
+		plane edgeW;
+		if ( edgeAlpha > 0.F )
+			edgeW = ahtvl1_edgeWeight( curA, curAlpha, edgeKern, edgePower, edgeAlpha, edgeBorder );
+
+		plane ax = doGradX( curA, curAlpha, lambda );
+		plane ay = doGradY( curA, curAlpha, lambda );
+		plane bx = doGradX( curB, nextAlpha, lambda );
+		plane by = doGradY( curB, nextAlpha, lambda );
+
+		int wI = warpIters;
+		int iI = tvl1Iters;
+		if ( adaptiveIters )
 		{
-			u = plane( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
-			v = plane( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
-			memset( u.data(), 0, u.buffer_size() );
-			memset( v.data(), 0, v.buffer_size() );
+			wI = std::max( std::min( 2, warpIters ), warpIters - static_cast<int>( hierA.size() ) );
+			iI = std::max( std::min( 5, tvl1Iters ), tvl1Iters / wI );
 		}
-		else
+
+		if ( ! u.valid() && init.valid() )
 		{
 			int curW = curA.width();
 			int curH = curA.height();
+			float scaleX = static_cast<float>( curW ) / static_cast<float>( init.width() );
+			float scaleY = static_cast<float>( curH ) / static_cast<float>( init.height() );
+			u = ( resize( init.u(), kPyramidFilter, curW, curH ) * scaleX ).copy();
+			v = ( resize( init.v(), kPyramidFilter, curW, curH ) * scaleY ).copy();
+		}
 
-			float scaleX = static_cast<float>( curW ) / static_cast<float>( u.width() );
-			float scaleY = static_cast<float>( curH ) / static_cast<float>( u.height() );
+		std::cout << "pyramid " << curA.width() << 'x' << curA.height() << '(' << warpIters << "->" << wI << ',' << tvl1Iters << "->" << iI << ") l " << lambda << " e " << epsilon << ": ";
+		ahtvl1_level( u, v, curA, curB, curAlpha, ax, ay, bx, by, edgeW, lambda, theta, epsilon, wI, iI, hierA.empty() );
+		std::cout << std::endl;
 
-			u = resize_bilinear( u, curW, curH ) * scaleX;
-			u.data();
-			v = resize_bilinear( v, curW, curH ) * scaleY;
-			v.data();
+		lambda *= lScale;
+		epsilon *= eScale;
+	}
+
+	return vector_field::create( std::move( u ), std::move( v ), false );
+}
+
+////////////////////////////////////////
+
+static void
+ahtvl1_consistency_thread( size_t, int s, int e, plane_buffer &err, const const_plane_buffer &uF, const const_plane_buffer &vF, const const_plane_buffer &uB, const const_plane_buffer &vB )
+{
+	const int w = err.width();
+	const int h = err.height();
+	const float maxX = static_cast<float>( w - 1 );
+	const float maxY = static_cast<float>( h - 1 );
+	const int y1 = err.y1();
+	for ( int y = s; y < e; ++y )
+	{
+		float *errLine = err.line( y );
+		const float *uLine = uF.line( y );
+		const float *vLine = vF.line( y );
+		for ( int x = 0; x < w; ++x )
+		{
+			// bilinear sample of the backward flow where the
+			// forward flow lands
+			float fx = std::max( 0.F, std::min( maxX, static_cast<float>( x ) + uLine[x] ) );
+			float fy = std::max( 0.F, std::min( maxY, static_cast<float>( y - y1 ) + vLine[x] ) );
+			int ix = std::min( static_cast<int>( fx ), std::max( 0, w - 2 ) );
+			int iy = std::min( static_cast<int>( fy ), std::max( 0, h - 2 ) );
+			int ix2 = std::min( ix + 1, w - 1 );
+			int iy2 = std::min( iy + 1, h - 1 );
+			float tx = fx - static_cast<float>( ix );
+			float ty = fy - static_cast<float>( iy );
+
+			const float *ub0 = uB.line( iy + y1 );
+			const float *ub1 = uB.line( iy2 + y1 );
+			const float *vb0 = vB.line( iy + y1 );
+			const float *vb1 = vB.line( iy2 + y1 );
+			float bu = ( ub0[ix] * ( 1.F - tx ) + ub0[ix2] * tx ) * ( 1.F - ty ) + ( ub1[ix] * ( 1.F - tx ) + ub1[ix2] * tx ) * ty;
+			float bv = ( vb0[ix] * ( 1.F - tx ) + vb0[ix2] * tx ) * ( 1.F - ty ) + ( vb1[ix] * ( 1.F - tx ) + vb1[ix2] * tx ) * ty;
+
+			float du = uLine[x] + bu;
+			float dv = vLine[x] + bv;
+			errLine[x] = sqrtf( du * du + dv * dv );
 		}
+	}
+}
 
-//		std::stringstream prefn;
-//		prefn << "/local1/kthurston/oflow" << oflowCount << "_hier" << std::setw(2) << std::setfill('0') << hierCount << "_pre.exr";
-//		image_buf preDbg;
-//		preDbg.add_plane( u );
-//		preDbg.add_plane( v );
-//		preDbg.add_plane( curA );
-//		preDbg.add_plane( curB );
-//		debug_save_image( preDbg, prefn.str(), 0, { "R", "G", "B", "A"}, "f16" );
+/// Solves the flow from a to b and from b to a together. The
+/// pyramids and gradients of the two images are shared between the
+/// directions, and the forward / backward error is computed directly
+/// from the solved planes. When both initial flows are given, the
+/// solve is warm started as runAHTVL1 is. Returns an image with the
+/// forward u, v, the backward u, v, and the error
+image_buf
+runAHTVL1Bidir( const plane &a, const plane &b, const plane &alpha, const plane &alphaNext, const vector_field &initF, const vector_field &initB, float lambda, float theta, float epsilon, float edgePower, float edgeAlpha, int edgeBorder, int tvl1Iters, int warpIters, bool adaptiveIters, float eta )
+{
+	int levels = 0;
+	vector_field fInit, bInit;
+	if ( initF.valid() && initB.valid() )
+	{
+		fInit = initF.is_absolute() ? convert_to_relative( initF ) : initF;
+		bInit = initB.is_absolute() ? convert_to_relative( initB ) : initB;
+		levels = 1 + static_cast<int>( floorf( logf( kWarmStartScale ) / logf( eta ) ) );
+		tvl1Iters = std::max( 1, static_cast<int>( static_cast<float>( tvl1Iters ) * kWarmStartIters ) );
+	}
 
-		plane puu = create_plane( curA.x1(), curA.y1(), curA.x2(), curA.y2(), 0.F );
-		plane puv = puu.copy();
-		plane pvu = puu.copy();
-		plane pvv = puu.copy();
+	std::vector<plane> hierA = make_pyramid( a, kPyramidFilter, eta, levels, 16 );
+	std::vector<plane> hierB = make_pyramid( b, kPyramidFilter, eta, levels, 16 );
+	std::vector<plane> hierAlpha, hierAlphaNext;
+	if ( alpha.valid() && alphaNext.valid() )
+	{
+		hierAlpha = make_pyramid( alpha, kPyramidFilter, eta, levels, 16 );
+		hierAlphaNext = make_pyramid( alphaNext, kPyramidFilter, eta, levels, 16 );
+	}
 
-		plane edgeW;
+	std::vector<float> edgeKern = ahtvl1_edgeKernel( edgeAlpha, edgeBorder );
+	plane uF, vF, uB, vB;
+	float lScale = 1.F + 1.F / static_cast<float>( hierA.size() );
+	float eScale = 1.F + 1.F / static_cast<float>( hierA.size() );
+	while ( ! hierA.empty() )
+	{
+		plane curA = hierA.back();
+		plane curB = hierB.back();
+		hierA.pop_back();
+		hierB.pop_back();
+		plane curAlpha, nextAlpha;
+		curA.cdata();
+		curB.cdata();
+		if ( ! hierAlpha.empty() )
+		{
+			curAlpha = hierAlpha.back();
+			hierAlpha.pop_back();
+			curAlpha.cdata();
+			nextAlpha = hierAlphaNext.back();
+			hierAlphaNext.pop_back();
+			nextAlpha.cdata();
+		}
+
+		plane edgeWA, edgeWB;
 		if ( edgeAlpha > 0.F )
-			edgeW = ahtvl1_edgeWeight( curA, curAlpha, edgeKern, edgePower, edgeAlpha, edgeBorder );
+		{
+			edgeWA = ahtvl1_edgeWeight( curA, curAlpha, edgeKern, edgePower, edgeAlpha, edgeBorder );
+			edgeWB = ahtvl1_edgeWeight( curB, nextAlpha, edgeKern, edgePower, edgeAlpha, edgeBorder );
+		}
 
 		plane ax = doGradX( curA, curAlpha, lambda );
 		plane ay = doGradY( curA, curAlpha, lambda );
 		plane bx = doGradX( curB, nextAlpha, lambda );
 		plane by = doGradY( curB, nextAlpha, lambda );
+		ax.cdata();
+		ay.cdata();
+		bx.cdata();
+		by.cdata();
 
 		int wI = warpIters;
 		int iI = tvl1Iters;
@@ -1120,90 +1212,43 @@ runAHTVL1( const plane &a, const plane &b, const plane &alpha, const plane &alph
 			iI = std::max( std::min( 5, tvl1Iters ), tvl1Iters / wI );
 		}
 
-		plane t( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
-		plane gxAve( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
-		plane gyAve( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
-
-		std::cout << "pyramid " << curA.width() << 'x' << curA.height() << '(' << warpIters << "->" << wI << ',' << tvl1Iters << "->" << iI << ") l " << lambda << " e " << epsilon << ": ";
-
-//		plane junkCopyDELETEME_u = u.copy();
-//		plane junkCopyDELETEME_v = v.copy();
-		plane u0( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
-		plane v0( curA.x1(), curA.y1(), curA.x2(), curA.y2() );
-
-		for ( int curWarp = 0; curWarp < wI; ++curWarp )
+		if ( ! uF.valid() && fInit.valid() )
 		{
-			std::cout << ' ' << (curWarp + 1) << std::flush;
-			ahtvl1_T( t, curB, curA, curAlpha, u0, v0, u, v );
-			ahtvl1_gradAve( gxAve, bx, ax, u0, v0 );
-			ahtvl1_gradAve( gyAve, by, ay, u0, v0 );
-			killAlpha( gxAve, gyAve, curAlpha );
-//			if ( curWarp == 0 )
-//			{
-//				std::stringstream initgradfn;
-//				initgradfn << "/local1/kthurston/oflow" << oflowCount << "_hier" << std::setw(2) << std::setfill('0') << hierCount << "_initgrad.exr";
-//				image_buf initgradDbg;
-//				initgradDbg.add_plane( gxAve );
-//				initgradDbg.add_plane( gyAve );
-//				initgradDbg.add_plane( t );
-//				initgradDbg.add_plane( u0 );
-//				debug_save_image( initgradDbg, initgradfn.str(), 0, { "R", "G", "B", "A"}, "f16" );
-//			}
-
-			for ( int i = 0; i < iI; ++i )
-			{
-				ahtvl1_updateU( u, v, puu, puv, pvu, pvv, u0, v0, t,
-								gxAve, gyAve, lambda * theta, theta );
-
-//				if ( curWarp == 0 && i == 0 )
-//				{
-//					std::stringstream upd0fn;
-//					upd0fn << "/local1/kthurston/oflow" << oflowCount << "_hier" << std::setw(2) << std::setfill('0') << hierCount << "_upd0.exr";
-//					image_buf upd0Dbg;
-//					upd0Dbg.add_plane( u );
-//					upd0Dbg.add_plane( v );
-//					upd0Dbg.add_plane( u0 );
-//					upd0Dbg.add_plane( v0 );
-//					debug_save_image( upd0Dbg, upd0fn.str(), 0, { "R", "G", "B", "A"}, "f16" );
-//				}
-
-				ahtvl1_updateP( puu, puv, u, edgeW, tau, epsilon );
-				ahtvl1_updateP( pvu, pvv, v, edgeW, tau, epsilon );
-			}
-
-			killAlpha( u, v, curAlpha );
-//			if ( ( curWarp + 1 ) < wI )
-//			{
-//				using namespace std;
-//				removePeaks( u0, v0, u, v, 3 );
-//				swap( u0, u );
-//				swap( v0, v );
-//			}
+			int curW = curA.width();
+			int curH = curA.height();
+			float scaleX = static_cast<float>( curW ) / static_cast<float>( fInit.width() );
+			float scaleY = static_cast<float>( curH ) / static_cast<float>( fInit.height() );
+			uF = ( resize( fInit.u(), kPyramidFilter, curW, curH ) * scaleX ).copy();
+			vF = ( resize( fInit.v(), kPyramidFilter, curW, curH ) * scaleY ).copy();
+			uB = ( resize( bInit.u(), kPyramidFilter, curW, curH ) * scaleX ).copy();
+			vB = ( resize( bInit.v(), kPyramidFilter, curW, curH ) * scaleY ).copy();
 		}
-		std::cout << std::endl;
-
-//		std::stringstream postfn;
-//		postfn << "/local1/kthurston/oflow" << oflowCount << "_hier" << std::setw(2) << std::setfill('0') << hierCount << "_post.exr";
-//		image_buf postDbg;
-//		postDbg.add_plane( u );
-//		postDbg.add_plane( v );
-//		postDbg.add_plane( junkCopyDELETEME_u );
-//		postDbg.add_plane( junkCopyDELETEME_v );
-//		debug_save_image( postDbg, postfn.str(), 0, { "R", "G", "B", "A"}, "f16" );
-//		++hierCount;
-		
-//		if ( ! hierA.empty() )
-//			removePeaks( u, v, 3 );
 
-		if ( hierA.empty() )
-			zilchAlpha( u, v, curAlpha );
+		std::cout << "pyramid " << curA.width() << 'x' << curA.height() << '(' << warpIters << "->" << wI << ',' << tvl1Iters << "->" << iI << ") l " << lambda << " e " << epsilon << ": fwd";
+		ahtvl1_level( uF, vF, curA, curB, curAlpha, ax, ay, bx, by, edgeWA, lambda, theta, epsilon, wI, iI, hierA.empty() );
+		std::cout << " bwd";
+		ahtvl1_level( uB, vB, curB, curA, nextAlpha, bx, by, ax, ay, edgeWB, lambda, theta, epsilon, wI, iI, hierA.empty() );
+		std::cout << std::endl;
 
 		lambda *= lScale;
 		epsilon *= eScale;
 	}
-//	++oflowCount;
 
-	return vector_field::create( std::move( u ), std::move( v ), false );
+	plane err( uF.x1(), uF.y1(), uF.x2(), uF.y2() );
+	plane_buffer errB = err;
+	const_plane_buffer uFB = uF;
+	const_plane_buffer vFB = vF;
+	const_plane_buffer uBB = uB;
+	const_plane_buffer vBB = vB;
+	threading::get().dispatch( std::bind( ahtvl1_consistency_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( errB ), std::cref( uFB ), std::cref( vFB ), std::cref( uBB ), std::cref( vBB ) ), err );
+
+	image_buf ret;
+	ret.add_plane( std::move( uF ) );
+	ret.add_plane( std::move( vF ) );
+	ret.add_plane( std::move( uB ) );
+	ret.add_plane( std::move( vB ) );
+	ret.add_plane( std::move( err ) );
+	return ret;
 }
 
 ////////////////////////////////////////
@@ -1909,12 +1954,43 @@ oflow_ahtvl1( const plane &a, const plane &b, const plane &alpha, const plane &a
 	precondition( a.dims() == b.dims(), "oflow_ahtvl1 must have a & b of same size, received a {0} b {1}", a.dims(), b.dims() );
 	engine::dimensions d = a.dims();
 	d.planes = 2;
+	precondition( ! initUV.valid() || initUV.dims() == d, "oflow_ahtvl1 initial flow must be the size of a, received a {0} initUV {1}", a.dims(), initUV.dims() );
 
 	return vector_field( false, "p.oflow_ahtvl1", d, a, b, alpha, alphaNext, initUV, lambda, theta, epsilon, edgePower, edgeAlpha, edgeBorder, tvl1Iters, warpIters, adaptiveIters, eta );
 }
 
 ////////////////////////////////////////
 
+flow_pair
+oflow_ahtvl1_bidir( const plane &a, const plane &b, const plane &alpha, const plane &alphaNext, const vector_field &initForward, const vector_field &initBackward, float lambda, float theta, float epsilon, float edgePower, float edgeAlpha, int edgeBorder, int tvl1Iters, int warpIters, bool adaptiveIters, float eta, int conservativeness )
+{
+	precondition( a.dims() == b.dims(), "oflow_ahtvl1_bidir must have a & b of same size, received a {0} b {1}", a.dims(), b.dims() );
+	engine::dimensions d = a.dims();
+	engine::dimensions vd = d;
+	vd.planes = 2;
+	precondition( ! initForward.valid() || initForward.dims() == vd, "oflow_ahtvl1_bidir initial forward flow must be the size of a, received a {0} initForward {1}", a.dims(), initForward.dims() );
+	precondition( ! initBackward.valid() || initBackward.dims() == vd, "oflow_ahtvl1_bidir initial backward flow must be the size of a, received a {0} initBackward {1}", a.dims(), initBackward.dims() );
+	d.planes = 5;
+	d.images = 1;
+
+	image_buf r( "p.oflow_ahtvl1_bidir", d, a, b, alpha, alphaNext, initForward, initBackward, lambda, theta, epsilon, edgePower, edgeAlpha, edgeBorder, tvl1Iters, warpIters, adaptiveIters, eta );
+
+	flow_pair ret;
+	ret.forward = modify_vectors( r[0], r[1], false );
+	ret.backward = modify_vectors( r[2], r[3], false );
+	// matches confidence( forward, backward, conservativeness ), but
+	// without re-warping the backward field
+	if ( conservativeness <= 0 )
+		ret.consistency = log1p( r[4] );
+	else
+		ret.consistency = log1p( r[4] *
+								 magnitude( erode( r[0], conservativeness ) - dilate( r[0], conservativeness ),
+											erode( r[1], conservativeness ) - dilate( r[1], conservativeness ) ) );
+	return ret;
+}
+
+////////////////////////////////////////
+
 vector_field
 oflow_primaldual( const plane &a, const plane &b, const plane &alpha, const plane &alphaNext, const vector_field &initUV, float lambda, float sigma, int innerIters, int warpIters, bool adaptiveIters, float eta )
 {
@@ -1946,6 +2022,7 @@ add_oflow( engine::registry &r )
 	using namespace engine;
 
 	r.add( op( "p.oflow_ahtvl1", runAHTVL1, op::threaded ) );
+	r.add( op( "p.oflow_ahtvl1_bidir", runAHTVL1Bidir, op::threaded ) );
 	r.add( op( "p.oflow_primaldual", runPD, op::threaded ) );
 	r.add( op( "v.zilch_alpha", runZilch, op::threaded ) );
 }
@@ -10,6 +10,7 @@
 #include "vector_field.h"
 #include "vector_ops.h"
 #include "patch_match.h"
+#include "flow_cache.h"
 #include "op_registry.h"
 
 ////////////////////////////////////////
@@ -33,8 +34,31 @@ namespace image
 /// innerIters 10, controls tv-l1 iters per warp
 /// warpIters 5, controls number of warps per pyramid
 /// eta pyramid scale factor 0.5, 0.5 - 0.95, 0.5 is fastest
+/// initUV warm starts the solve with a prior estimate of the flow
+/// (i.e. from flow_cache::predict), skipping the coarse pyramid
+/// levels. With the fused solver, the iterations also stop early
+/// once the estimate has converged
 vector_field oflow_ahtvl1( const plane &a, const plane &b, const plane &alpha = plane(), const plane &alphaNext = plane(), const vector_field &initUV = vector_field(), float lambda = 70.F, float theta = 0.1F, float epsilon = 0.005F, float edgePower = 2.F, float edgeAlpha = 50.F, int edgeBorder = 5, int tvl1Iters = 100, int warpIters = 2, bool adaptiveIters = true, float eta = 0.5F );
 
+/// @brief forward and backward flow between two frames, along with
+/// their consistency
+struct flow_pair
+{
+	vector_field forward;
+	vector_field backward;
+	/// same measure as confidence( forward, backward, conservativeness ),
+	/// lower values are more consistent
+	plane consistency;
+};
+
+/// Solves oflow_ahtvl1( a, b ) and oflow_ahtvl1( b, a ) in one op,
+/// sharing the pyramids and gradients of the two frames, and computes
+/// the forward-backward consistency (occlusion) measure directly
+/// rather than requiring a separate call to confidence. The initial
+/// flows warm start the solve as in oflow_ahtvl1, and are only used
+/// when both are provided
+flow_pair oflow_ahtvl1_bidir( const plane &a, const plane &b, const plane &alpha = plane(), const plane &alphaNext = plane(), const vector_field &initForward = vector_field(), const vector_field &initBackward = vector_field(), float lambda = 70.F, float theta = 0.1F, float epsilon = 0.005F, float edgePower = 2.F, float edgeAlpha = 50.F, int edgeBorder = 5, int tvl1Iters = 100, int warpIters = 2, bool adaptiveIters = true, float eta = 0.5F, int conservativeness = 2 );
+
 //// TODO: Add arguments and implement
 //vector_field oflow_htvl1( const image_buf &a, const image_buf &b );
 
@@ -11,7 +11,18 @@
 #include "media_io.h"
 #include "threading.h"
 #include <random>
+#include <cstring>
 #include <iomanip>
+#include <limits>
+
+#ifdef __SSE__
+# if defined(LINUX) || defined(__linux__)
+#  include <x86intrin.h>
+# else
+#  include <xmmintrin.h>
+#  include <immintrin.h>
+# endif
+#endif
 
 ////////////////////////////////////////
 
@@ -19,12 +30,72 @@ namespace
 {
 using namespace image;
 
+// Nearly all patches lie entirely inside both planes, and skip the
+// per-pixel bounds checks in favor of whole rows, 8 pixels at a
+// time. As the distance only grows with each row, a candidate is
+// abandoned as soon as it is worse than the best distance so far.
+inline bool
+patchInside( int x1, int y1, int x2, int y2, int ax, int ay, int px, int py, int radius )
+{
+	return ( std::min( ax, px ) - radius ) >= x1 && ( std::max( ax, px ) + radius ) <= x2 &&
+		( std::min( ay, py ) - radius ) >= y1 && ( std::max( ay, py ) + radius ) <= y2;
+}
+
+inline const float *
+patchRow( const const_plane_buffer &p, int x, int y, int radius )
+{
+	return p.line( y ) + ( x - radius - p.x1() );
+}
+
+inline float
+ssdRow( const float *a, const float *b, int n )
+{
+	int x = 0;
+	float ret = 0.F;
+#if defined(__SSE__)
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	for ( ; ( x + 8 ) <= n; x += 8 )
+	{
+		__m128 d0 = _mm_sub_ps( _mm_loadu_ps( a + x ), _mm_loadu_ps( b + x ) );
+		__m128 d1 = _mm_sub_ps( _mm_loadu_ps( a + x + 4 ), _mm_loadu_ps( b + x + 4 ) );
+		acc0 = _mm_add_ps( acc0, _mm_mul_ps( d0, d0 ) );
+		acc1 = _mm_add_ps( acc1, _mm_mul_ps( d1, d1 ) );
+	}
+	if ( ( x + 4 ) <= n )
+	{
+		__m128 d0 = _mm_sub_ps( _mm_loadu_ps( a + x ), _mm_loadu_ps( b + x ) );
+		acc0 = _mm_add_ps( acc0, _mm_mul_ps( d0, d0 ) );
+		x += 4;
+	}
+	acc0 = _mm_add_ps( acc0, acc1 );
+	acc0 = _mm_add_ps( acc0, _mm_movehl_ps( acc0, acc0 ) );
+	acc0 = _mm_add_ss( acc0, _mm_shuffle_ps( acc0, acc0, 1 ) );
+	ret = _mm_cvtss_f32( acc0 );
+#endif
+	for ( ; x < n; ++x )
+	{
+		float d = a[x] - b[x];
+		ret += d * d;
+	}
+	return ret;
+}
+
 struct PatchMatchSSD
 {
-	static inline float compute( const const_plane_buffer &a, const const_plane_buffer &b, const const_plane_buffer &, const const_plane_buffer &, const const_plane_buffer &, const const_plane_buffer &, int ax, int ay, int px, int py, int radius )
+	static inline float compute( const const_plane_buffer &a, const const_plane_buffer &b, const const_plane_buffer &, const const_plane_buffer &, const const_plane_buffer &, const const_plane_buffer &, int ax, int ay, int px, int py, int radius, float best = std::numeric_limits<float>::max() )
 	{
 		float ret = 0.F;
-		for ( int y = -radius; y <= radius; ++y )
+		if ( patchInside( a.x1(), a.y1(), a.x2(), a.y2(), ax, ay, px, py, radius ) )
+		{
+			const int n = 2 * radius + 1;
+			for ( int y = -radius; y <= radius && ret <= best; ++y )
+			{
+				ret += ssdRow( patchRow( a, ax, ay + y, radius ), patchRow( b, px, py + y, radius ), n );
+			}
+			return ret;
+		}
+		for ( int y = -radius; y <= radius && ret <= best; ++y )
 		{
 			int say = ay + y;
 			int sby = py + y;
@@ -56,12 +127,24 @@ struct PatchMatchSSD
 		return ret;
 	}
 
-	static inline float compute( const std::vector<const_plane_buffer> &a, const std::vector<const_plane_buffer> &b, const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &, int ax, int ay, int px, int py, int radius )
+	static inline float compute( const std::vector<const_plane_buffer> &a, const std::vector<const_plane_buffer> &b, const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &, int ax, int ay, int px, int py, int radius, float best = std::numeric_limits<float>::max() )
 	{
 		float ret = 0.F;
 		size_t numC = a.size();
 		int x1 = a[0].x1(), y1 = a[0].y1(), x2 = a[0].x2(), y2 = a[0].y2();
-		for ( int y = -radius; y <= radius; ++y )
+		if ( patchInside( x1, y1, x2, y2, ax, ay, px, py, radius ) )
+		{
+			const int n = 2 * radius + 1;
+			for ( int y = -radius; y <= radius && ret <= best; ++y )
+			{
+				for ( size_t c = 0; c != numC; ++c )
+				{
+					ret += ssdRow( patchRow( a[c], ax, ay + y, radius ), patchRow( b[c], px, py + y, radius ), n );
+				}
+			}
+			return ret;
+		}
+		for ( int y = -radius; y <= radius && ret <= best; ++y )
 		{
 			int say = ay + y;
 			int sby = py + y;
@@ -99,10 +182,21 @@ struct PatchMatchSSD
 
 struct PatchMatchSSDGrad
 {
-	static inline float compute( const const_plane_buffer &a, const const_plane_buffer &b, const const_plane_buffer &adx, const const_plane_buffer &ady, const const_plane_buffer &bdx, const const_plane_buffer &bdy, int ax, int ay, int px, int py, int radius )
+	static inline float compute( const const_plane_buffer &a, const const_plane_buffer &b, const const_plane_buffer &adx, const const_plane_buffer &ady, const const_plane_buffer &bdx, const const_plane_buffer &bdy, int ax, int ay, int px, int py, int radius, float best = std::numeric_limits<float>::max() )
 	{
 		float ret = 0.F;
-		for ( int y = -radius; y <= radius; ++y )
+		if ( patchInside( a.x1(), a.y1(), a.x2(), a.y2(), ax, ay, px, py, radius ) )
+		{
+			const int n = 2 * radius + 1;
+			for ( int y = -radius; y <= radius && ret <= best; ++y )
+			{
+				ret += ssdRow( patchRow( a, ax, ay + y, radius ), patchRow( b, px, py + y, radius ), n );
+				ret += ssdRow( patchRow( adx, ax, ay + y, radius ), patchRow( bdx, px, py + y, radius ), n );
+				ret += ssdRow( patchRow( ady, ax, ay + y, radius ), patchRow( bdy, px, py + y, radius ), n );
+			}
+			return ret;
+		}
+		for ( int y = -radius; y <= radius && ret <= best; ++y )
 		{
 			int say = ay + y;
 			int sby = py + y;
@@ -144,12 +238,26 @@ struct PatchMatchSSDGrad
 		return ret;
 	}
 
-	static inline float compute( const std::vector<const_plane_buffer> &a, const std::vector<const_plane_buffer> &b, const std::vector<const_plane_buffer> &adx, const std::vector<const_plane_buffer> &ady, const std::vector<const_plane_buffer> &bdx, const std::vector<const_plane_buffer> &bdy, int ax, int ay, int px, int py, int radius )
+	static inline float compute( const std::vector<const_plane_buffer> &a, const std::vector<const_plane_buffer> &b, const std::vector<const_plane_buffer> &adx, const std::vector<const_plane_buffer> &ady, const std::vector<const_plane_buffer> &bdx, const std::vector<const_plane_buffer> &bdy, int ax, int ay, int px, int py, int radius, float best = std::numeric_limits<float>::max() )
 	{
 		float ret = 0.F;
 		size_t numC = a.size();
 		int x1 = a[0].x1(), y1 = a[0].y1(), x2 = a[0].x2(), y2 = a[0].y2();
-		for ( int y = -radius; y <= radius; ++y )
+		if ( patchInside( x1, y1, x2, y2, ax, ay, px, py, radius ) )
+		{
+			const int n = 2 * radius + 1;
+			for ( int y = -radius; y <= radius && ret <= best; ++y )
+			{
+				for ( size_t c = 0; c != numC; ++c )
+				{
+					ret += ssdRow( patchRow( a[c], ax, ay + y, radius ), patchRow( b[c], px, py + y, radius ), n );
+					ret += ssdRow( patchRow( adx[c], ax, ay + y, radius ), patchRow( bdx[c], px, py + y, radius ), n );
+					ret += ssdRow( patchRow( ady[c], ax, ay + y, radius ), patchRow( bdy[c], px, py + y, radius ), n );
+				}
+			}
+			return ret;
+		}
+		for ( int y = -radius; y <= radius && ret <= best; ++y )
 		{
 			int say = ay + y;
 			int sby = py + y;
@@ -198,13 +306,24 @@ struct PatchMatchSSDGrad
 
 struct PatchMatchSSDGradDist
 {
-	static inline float compute( const const_plane_buffer &a, const const_plane_buffer &b, const const_plane_buffer &adx, const const_plane_buffer &ady, const const_plane_buffer &bdx, const const_plane_buffer &bdy, int ax, int ay, int px, int py, int radius )
+	static inline float compute( const const_plane_buffer &a, const const_plane_buffer &b, const const_plane_buffer &adx, const const_plane_buffer &ady, const const_plane_buffer &bdx, const const_plane_buffer &bdy, int ax, int ay, int px, int py, int radius, float best = std::numeric_limits<float>::max() )
 	{
 		TODO( "validate that this is correct math in a datawindow box world" );
 		float distX = static_cast<float>( ax - px ) / static_cast<float>( a.width() );
 		float distY = static_cast<float>( ay - py ) / static_cast<float>( a.height() );
 		float ret = distX * distX + distY * distY;
-		for ( int y = -radius; y <= radius; ++y )
+		if ( patchInside( a.x1(), a.y1(), a.x2(), a.y2(), ax, ay, px, py, radius ) )
+		{
+			const int n = 2 * radius + 1;
+			for ( int y = -radius; y <= radius && ret <= best; ++y )
+			{
+				ret += ssdRow( patchRow( a, ax, ay + y, radius ), patchRow( b, px, py + y, radius ), n );
+				ret += ssdRow( patchRow( adx, ax, ay + y, radius ), patchRow( bdx, px, py + y, radius ), n );
+				ret += ssdRow( patchRow( ady, ax, ay + y, radius ), patchRow( bdy, px, py + y, radius ), n );
+			}
+			return ret;
+		}
+		for ( int y = -radius; y <= radius && ret <= best; ++y )
 		{
 			int say = ay + y;
 			int sby = py + y;
@@ -238,7 +357,7 @@ struct PatchMatchSSDGradDist
 		return ret;
 	}
 
-	static inline float compute( const std::vector<const_plane_buffer> &a, const std::vector<const_plane_buffer> &b, const std::vector<const_plane_buffer> &adx, const std::vector<const_plane_buffer> &ady, const std::vector<const_plane_buffer> &bdx, const std::vector<const_plane_buffer> &bdy, int ax, int ay, int px, int py, int radius )
+	static inline float compute( const std::vector<const_plane_buffer> &a, const std::vector<const_plane_buffer> &b, const std::vector<const_plane_buffer> &adx, const std::vector<const_plane_buffer> &ady, const std::vector<const_plane_buffer> &bdx, const std::vector<const_plane_buffer> &bdy, int ax, int ay, int px, int py, int radius, float best = std::numeric_limits<float>::max() )
 	{
 		TODO( "validate that this is correct math in a datawindow box world" );
 		float distX = static_cast<float>( ax - px ) / static_cast<float>( a[0].width() );
@@ -246,7 +365,21 @@ struct PatchMatchSSDGradDist
 		float ret = distX * distX + distY * distY;
 		size_t numC = a.size();
 		int x1 = a[0].x1(), y1 = a[0].y1(), x2 = a[0].x2(), y2 = a[0].y2();
-		for ( int y = -radius; y <= radius; ++y )
+		if ( patchInside( x1, y1, x2, y2, ax, ay, px, py, radius ) )
+		{
+			const int n = 2 * radius + 1;
+			for ( int y = -radius; y <= radius && ret <= best; ++y )
+			{
+				for ( size_t c = 0; c != numC; ++c )
+				{
+					ret += ssdRow( patchRow( a[c], ax, ay + y, radius ), patchRow( b[c], px, py + y, radius ), n );
+					ret += ssdRow( patchRow( adx[c], ax, ay + y, radius ), patchRow( bdx[c], px, py + y, radius ), n );
+					ret += ssdRow( patchRow( ady[c], ax, ay + y, radius ), patchRow( bdy[c], px, py + y, radius ), n );
+				}
+			}
+			return ret;
+		}
+		for ( int y = -radius; y <= radius && ret <= best; ++y )
 		{
 			int say = ay + y;
 			int sby = py + y;
@@ -286,10 +419,20 @@ struct PatchMatchSSDGradDist
 
 struct PatchMatchGrad
 {
-	static inline float compute( const const_plane_buffer &, const const_plane_buffer &, const const_plane_buffer &adx, const const_plane_buffer &ady, const const_plane_buffer &bdx, const const_plane_buffer &bdy, int ax, int ay, int px, int py, int radius )
+	static inline float compute( const const_plane_buffer &, const const_plane_buffer &, const const_plane_buffer &adx, const const_plane_buffer &ady, const const_plane_buffer &bdx, const const_plane_buffer &bdy, int ax, int ay, int px, int py, int radius, float best = std::numeric_limits<float>::max() )
 	{
 		float ret = 0.F;
-		for ( int y = -radius; y <= radius; ++y )
+		if ( patchInside( adx.x1(), adx.y1(), adx.x2(), adx.y2(), ax, ay, px, py, radius ) )
+		{
+			const int n = 2 * radius + 1;
+			for ( int y = -radius; y <= radius && ret <= best; ++y )
+			{
+				ret += ssdRow( patchRow( adx, ax, ay + y, radius ), patchRow( bdx, px, py + y, radius ), n );
+				ret += ssdRow( patchRow( ady, ax, ay + y, radius ), patchRow( bdy, px, py + y, radius ), n );
+			}
+			return ret;
+		}
+		for ( int y = -radius; y <= radius && ret <= best; ++y )
 		{
 			int say = ay + y;
 			int sby = py + y;
@@ -322,12 +465,25 @@ struct PatchMatchGrad
 		return ret;
 	}
 
-	static inline float compute( const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &adx, const std::vector<const_plane_buffer> &ady, const std::vector<const_plane_buffer> &bdx, const std::vector<const_plane_buffer> &bdy, int ax, int ay, int px, int py, int radius )
+	static inline float compute( const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &, const std::vector<const_plane_buffer> &adx, const std::vector<const_plane_buffer> &ady, const std::vector<const_plane_buffer> &bdx, const std::vector<const_plane_buffer> &bdy, int ax, int ay, int px, int py, int radius, float best = std::numeric_limits<float>::max() )
 	{
 		float ret = 0.F;
 		size_t numC = adx.size();
 		int x1 = adx[0].x1(), y1 = adx[0].y1(), x2 = adx[0].x2(), y2 = adx[0].y2();
-		for ( int y = -radius; y <= radius; ++y )
+		if ( patchInside( x1, y1, x2, y2, ax, ay, px, py, radius ) )
+		{
+			const int n = 2 * radius + 1;
+			for ( int y = -radius; y <= radius && ret <= best; ++y )
+			{
+				for ( size_t c = 0; c != numC; ++c )
+				{
+					ret += ssdRow( patchRow( adx[c], ax, ay + y, radius ), patchRow( bdx[c], px, py + y, radius ), n );
+					ret += ssdRow( patchRow( ady[c], ax, ay + y, radius ), patchRow( bdy[c], px, py + y, radius ), n );
+				}
+			}
+			return ret;
+		}
+		for ( int y = -radius; y <= radius && ret <= best; ++y )
 		{
 			int say = ay + y;
 			int sby = py + y;
@@ -390,9 +546,7 @@ template <typename BufType, typename DistFunc>
 inline void
 matchPassInit( plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius )
 {
-	std::cout << "patch_match init: " << std::flush;
 	threading::get().dispatch( std::bind( matchPassInitThread<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( d ), std::cref( u ), std::cref( v ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius ), u.y1(), u.height() );
-	std::cout << "finished" << std::endl;
 }
 
 ////////////////////////////////////////
@@ -425,327 +579,11 @@ template <typename BufType, typename DistFunc>
 inline void
 matchPassInit( plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius )
 {
-	std::cout << "patch_match init: " << std::flush;
 	threading::get().dispatch( std::bind( matchPassInitThreadAlpha<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( d ), std::cref( u ), std::cref( v ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius ), u.y1(), u.height() );
-	std::cout << "finished" << std::endl;
 }
 
 ////////////////////////////////////////
 
-template <typename BufType, typename DistFunc>
-static void
-matchPassHorizThreadForward1( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, float eps )
-{
-	int w = d.width();
-	int offX = d.x1();
-	size_t changeCount = 0;
-	for ( int y = s; y < e; ++y )
-	{
-		float *uLine = u.line( y );
-		float *vLine = v.line( y );
-		float *dLine = d.line( y );
-
-		for ( int x = 1; x < w; ++x )
-		{
-			float &curDist = dLine[x];
-			if ( curDist <= eps )
-				continue;
-			int altDX = static_cast<int>( uLine[x-1] ) + 1;
-			int altDY = static_cast<int>( vLine[x-1] );
-
-			float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x + offX, y, altDX, altDY, radius );
-			if ( hDist < curDist )
-			{
-				uLine[x] = static_cast<float>( altDX );
-				vLine[x] = static_cast<float>( altDY );
-				curDist = hDist;
-				++changeCount;
-			}
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-template <typename BufType, typename DistFunc>
-static void
-matchPassHorizThreadForwardN( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, int maxSkip, float eps )
-{
-	int w = d.width();
-	int offX = d.x1();
-	size_t changeCount = 0;
-	for ( int y = s; y < e; ++y )
-	{
-		float *uLine = u.line( y );
-		float *vLine = v.line( y );
-		float *dLine = d.line( y );
-
-		for ( int x = 1; x < w; ++x )
-		{
-			float curDist = dLine[x];
-			if ( curDist <= eps )
-				continue;
-
-			int curDX = static_cast<int>( uLine[x] );
-			int curDY = static_cast<int>( vLine[x] );
-			bool changed = false;
-
-			int skip = maxSkip;
-			while ( skip > 0 )
-			{
-				if ( skip <= x )
-				{
-					int altDX = static_cast<int>( uLine[x-skip] ) + skip;
-					int altDY = static_cast<int>( vLine[x-skip] );
-
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x + offX, y, altDX, altDY, radius );
-
-					if ( hDist < curDist )
-					{
-						curDX = altDX;
-						curDY = altDY;
-						curDist = hDist;
-						changed = true;
-					}
-				}
-				skip /= 2;
-			}
-			if ( changed )
-			{
-				uLine[x] = static_cast<float>( curDX );
-				vLine[x] = static_cast<float>( curDY );
-				dLine[x] = curDist;
-				++changeCount;
-			}
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-template <typename BufType, typename DistFunc>
-static void
-matchPassHorizThreadBackward1( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, float eps )
-{
-	int w = d.width();
-	int offX = d.x1();
-	size_t changeCount = 0;
-	for ( int y = s; y < e; ++y )
-	{
-		float *uLine = u.line( y );
-		float *vLine = v.line( y );
-		float *dLine = d.line( y );
-
-		for ( int x = w - 2; x >= 0; --x )
-		{
-			float &curDist = dLine[x];
-			if ( curDist <= eps )
-				continue;
-			int altDX = static_cast<int>( uLine[x+1] ) - 1;
-			int altDY = static_cast<int>( vLine[x+1] );
-
-			float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
-			if ( hDist < curDist )
-			{
-				uLine[x] = static_cast<float>( altDX );
-				vLine[x] = static_cast<float>( altDY );
-				curDist = hDist;
-				++changeCount;
-			}
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-template <typename BufType, typename DistFunc>
-static void
-matchPassHorizThreadBackwardN( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, int maxSkip, float eps )
-{
-	int w = d.width();
-	int offX = d.x1();
-	size_t changeCount = 0;
-	for ( int y = s; y < e; ++y )
-	{
-		float *uLine = u.line( y );
-		float *vLine = v.line( y );
-		float *dLine = d.line( y );
-
-		for ( int x = w - 2; x >= 0; --x )
-		{
-			float curDist = dLine[x];
-			if ( curDist <= eps )
-				continue;
-			int curDX = static_cast<int>( uLine[x] );
-			int curDY = static_cast<int>( vLine[x] );
-			bool changed = false;
-
-			int skip = maxSkip;
-			while ( skip > 0 )
-			{
-				if ( (x + skip) < w )
-				{
-					int altDX = static_cast<int>( uLine[x+skip] ) - skip;
-					int altDY = static_cast<int>( vLine[x+skip] );
-
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
-					if ( hDist < curDist )
-					{
-						curDX = altDX;
-						curDY = altDY;
-						curDist = hDist;
-						changed = true;
-					}
-				}
-				skip /= 2;
-			}
-			if ( changed )
-			{
-				uLine[x] = static_cast<float>( curDX );
-				vLine[x] = static_cast<float>( curDY );
-				dLine[x] = curDist;
-				++changeCount;
-			}
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-template <typename BufType, typename DistFunc>
-static void
-matchPassVertThreadDown1( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, float eps )
-{
-	size_t changeCount = 0;
-	for ( int x = s; x < e; ++x )
-	{
-		for ( int y = u.y1() + 1; y <= u.y2(); ++y )
-		{
-			float &curDist = d.get( x, y );
-			if ( curDist <= eps )
-				continue;
-
-			int altDX = static_cast<int>( u.get( x, y - 1 ) );
-			int altDY = static_cast<int>( v.get( x, y - 1 ) ) + 1;
-
-			float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius );
-			if ( hDist < curDist )
-			{
-				u.get( x, y ) = static_cast<float>( altDX );
-				v.get( x, y ) = static_cast<float>( altDY );
-				curDist = hDist;
-				++changeCount;
-			}
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-template <typename BufType, typename DistFunc>
-static void
-matchPassVertThreadDownN( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, int maxSkip, float eps )
-{
-	size_t changeCount = 0;
-	for ( int x = s; x < e; ++x )
-	{
-		for ( int y = u.y1() + 1; y <= u.y2(); ++y )
-		{
-			float &curDist = d.get( x, y );
-			if ( curDist <= eps )
-				continue;
-
-			bool changed = false;
-			int skip = maxSkip;
-			while ( skip > 0 )
-			{
-				if ( ( y - skip ) >= u.y1() )
-				{
-					int altDX = static_cast<int>( u.get( x, y - skip ) );
-					int altDY = static_cast<int>( v.get( x, y - skip ) ) + skip;
-
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius );
-					if ( hDist < curDist )
-					{
-						u.get( x, y ) = static_cast<float>( altDX );
-						v.get( x, y ) = static_cast<float>( altDY );
-						curDist = hDist;
-						changed = true;
-					}
-				}
-				skip /= 2;
-			}
-			if ( changed )
-				++changeCount;
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-template <typename BufType, typename DistFunc>
-static void
-matchPassVertThreadUp1( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, float eps )
-{
-	size_t changeCount = 0;
-	for ( int x = s; x < e; ++x )
-	{
-		for ( int y = u.y2() - 2; y >= u.y1(); --y )
-		{
-			float &curDist = d.get( x, y );
-			if ( curDist <= eps )
-				continue;
-			int altDX = static_cast<int>( u.get( x, y + 1 ) );
-			int altDY = static_cast<int>( v.get( x, y + 1 ) ) - 1;
-
-			float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius );
-			if ( hDist < curDist )
-			{
-				u.get( x, y ) = static_cast<float>( altDX );
-				v.get( x, y ) = static_cast<float>( altDY );
-				curDist = hDist;
-				++changeCount;
-			}
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-template <typename BufType, typename DistFunc>
-static void
-matchPassVertThreadUpN( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, int maxSkip, float eps )
-{
-	size_t changeCount = 0;
-	for ( int x = s; x < e; ++x )
-	{
-		for ( int y = u.y2() - 2; y >= u.y1(); --y )
-		{
-			float &curDist = d.get( x, y );
-			if ( curDist <= eps )
-				continue;
-
-			bool changed = false;
-			int skip = maxSkip;
-			while ( skip > 0 )
-			{
-				if ( (skip + y) < u.y2() )
-				{
-					int altDX = static_cast<int>( u.get( x, y + skip ) );
-					int altDY = static_cast<int>( v.get( x, y + skip ) ) - skip;
-
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius );
-					if ( hDist < curDist )
-					{
-						u.get( x, y ) = static_cast<float>( altDX );
-						v.get( x, y ) = static_cast<float>( altDY );
-						curDist = hDist;
-						changed = true;
-					}
-				}
-				skip /= 2;
-			}
-			if ( changed )
-				++changeCount;
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-
 template <typename BufType, typename DistFunc>
 static void
 matchPassDiagonal( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, int red, float eps )
@@ -778,7 +616,7 @@ matchPassDiagonal( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v,
 
 			int altDX = static_cast<int>( prevULine[x-1] ) + 1;
 			int altDY = static_cast<int>( prevVLine[x-1] ) + 1;
-			float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+			float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 			if ( hDist < curDist )
 			{
 				curDX = altDX;
@@ -789,7 +627,7 @@ matchPassDiagonal( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v,
 
 			altDX = static_cast<int>( prevULine[x+1] ) - 1;
 			altDY = static_cast<int>( prevVLine[x+1] ) + 1;
-			hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+			hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 			if ( hDist < curDist )
 			{
 				curDX = altDX;
@@ -800,7 +638,7 @@ matchPassDiagonal( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v,
 
 			altDX = static_cast<int>( nextULine[x-1] ) + 1;
 			altDY = static_cast<int>( nextVLine[x-1] ) - 1;
-			hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+			hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 			if ( hDist < curDist )
 			{
 				curDX = altDX;
@@ -811,7 +649,7 @@ matchPassDiagonal( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v,
 
 			altDX = static_cast<int>( nextULine[x+1] ) - 1;
 			altDY = static_cast<int>( nextVLine[x+1] ) - 1;
-			hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+			hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 			if ( hDist < curDist )
 			{
 				curDX = altDX;
@@ -846,7 +684,7 @@ matchPassRandomThread( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer
 	size_t changeCount = 0;
 	for ( int y = s; y < e; ++y )
 	{
-		std::mt19937 rndg( seeds[static_cast<size_t>(y)] );
+		std::mt19937 rndg( seeds[static_cast<size_t>( y - u.y1() )] );
 		float *uLine = u.line( y );
 		float *vLine = v.line( y );
 		float *dLine = d.line( y );
@@ -872,7 +710,7 @@ matchPassRandomThread( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer
 				altDX = std::max( offX, std::min( maxX, altDX ) );
 				altDY = std::max( offY, std::min( maxY, altDY ) );
 
-				float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+				float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 				if ( hDist < curDist )
 				{
 					curDX = altDX;
@@ -959,188 +797,99 @@ matchPassRegAve( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, pl
 				altDX += x + offX;
 				altDY += y;
 
-				float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
 				float distRatio = static_cast<float>( curMagSq ) / static_cast<float>( tmpMagSq );
 					// the closer the potential match, the more slop we allow
 				float slop = powf( 1.15F, distRatio );
-				if ( hDist < curDist ||
-					 ( tmpMagSq < curMagSq && hDist <= ( curDist * slop ) ) )
-				{
-					uLine[x] = static_cast<float>( altDX );
-					vLine[x] = static_cast<float>( altDY );
-					dLine[x] = curDist;
-					++changeCount;
-				}
-			}
-		}
-	}
-	changeCounts[tIdx] = changeCount;
-}
-
-static inline size_t
-getCount( std::vector<size_t> &counts )
-{
-	size_t ret = 0;
-	for ( size_t &a: counts )
-	{
-		ret += a;
-		a = 0;
-	}
-	return ret;
-}
-
-template <typename BufType, typename DistFunc>
-static bool matchPass2( plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, std::mt19937 &gen, int radius, int iter, float eps )
-{
-	std::vector<size_t> counts( static_cast<size_t>( threading::get().size() ), size_t(0) );
-	size_t nChange;
-	size_t totChange = 0;
-	// do one round of jump flood on second iteration
-	int maxSkipX = ( iter == 1 ) ? std::max( int(1), u.width() / (iter * iter + 1) ) : 1;
-	int maxSkipY = ( iter == 1 ) ? std::max( int(1), u.height() / (iter * iter + 1) ) : 1;
-
-	std::cout << "   iter " << iter
-			  << " skip: " << maxSkipX << ' ' << maxSkipY
-			  << " l->r: " << std::flush;
-	if ( maxSkipX == 1 )
-		threading::get().dispatch( std::bind( matchPassHorizThreadForward1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), u.y1(), u.height() );
-	else
-		threading::get().dispatch( std::bind( matchPassHorizThreadForwardN<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), maxSkipX, eps ), u.y1(), u.height() );
-	nChange = getCount( counts );
-	std::cout << nChange << " t->b: " << std::flush;
-	totChange += nChange;
-
-	if ( maxSkipY == 1 )
-		threading::get().dispatch( std::bind( matchPassVertThreadDown1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), u.x1(), u.width() );
-	else
-		threading::get().dispatch( std::bind( matchPassVertThreadDownN<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), maxSkipY, eps ), u.x1(), u.width() );
-	nChange = getCount( counts );
-	std::cout << nChange << " random: " << std::flush;
-	totChange += nChange;
-
-	size_t nSeeds = static_cast<size_t>( u.height() );
-	std::vector<std::uint_fast32_t> seeds( nSeeds );
-	for ( size_t y = 0; y < nSeeds; ++y )
-		seeds[y] = gen();
-
-	threading::get().dispatch( std::bind( matchPassRandomThread<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::cref( seeds ), std::ref( counts ), eps ), u.y1(), u.height() );
-	nChange = getCount( counts );
-	std::cout << nChange << " r->l: " << std::flush;
-	totChange += nChange;
-
-	if ( maxSkipX == 1 )
-		threading::get().dispatch( std::bind( matchPassHorizThreadBackward1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), u.y1(), u.height() );
-	else
-		threading::get().dispatch( std::bind( matchPassHorizThreadBackwardN<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), maxSkipX, eps ), u.y1(), u.height() );
-	nChange = getCount( counts );
-	std::cout << nChange << " b->t: " << std::flush;
-	totChange += nChange;
-
-	if ( maxSkipY == 1 )
-		threading::get().dispatch( std::bind( matchPassVertThreadUp1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), u.x1(), u.width() );
-	else
-		threading::get().dispatch( std::bind( matchPassVertThreadUpN<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), maxSkipY, eps ), u.x1(), u.width() );
-	nChange = getCount( counts );
-	std::cout << nChange << " EVEN: " << std::flush;
-	totChange += nChange;
-
-	threading::get().dispatch( std::bind( matchPassDiagonal<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), 0, eps ), u.y1(), u.height() / 2 );
-	nChange = getCount( counts );
-	std::cout << nChange << " ODD: " << std::flush;
-	totChange += nChange;
-
-	threading::get().dispatch( std::bind( matchPassDiagonal<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), 1, eps ), u.y1(), u.height() / 2 );
-	nChange = getCount( counts );
-	std::cout << nChange << " REGE: " << std::flush;
-	totChange += nChange;
-
-	threading::get().dispatch( std::bind( matchPassRegAve<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), 0, eps ), u.y1(), u.height() / 2 );
-	nChange = getCount( counts );
-	std::cout << nChange << " REGO: " << std::flush;
-	totChange += nChange;
-
-	threading::get().dispatch( std::bind( matchPassRegAve<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), 1, eps ), u.y1(), u.height() / 2 );
-	std::cout << nChange << std::endl;
-	totChange += nChange;
-
-	return totChange == 0;
-}
-
-////////////////////////////////////////
-
-
-////////////////////////////////////////
-
-template <typename BufType, typename DistFunc>
-static void
-matchPassHorizThreadForwardAlpha1( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, float eps )
-{
-	int w = d.width();
-	int offX = d.x1();
-	size_t changeCount = 0;
-	for ( int y = s; y < e; ++y )
-	{
-		float *uLine = u.line( y );
-		float *vLine = v.line( y );
-		float *dLine = d.line( y );
-		const float *aLine = alpha.line( y );
-
-		for ( int x = 1; x < w; ++x )
-		{
-			float &curDist = dLine[x];
-			if ( curDist <= eps )
-				continue;
-			if ( aLine[x] < 0.000001F )
-			{
-				uLine[x] = static_cast<float>( x + offX );
-				vLine[x] = static_cast<float>( y );
-				curDist = 0.F;
-				++changeCount;
-				continue;
-			}
-			if ( aLine[x-1] < 0.000001F )
-				continue;
-
-			int altDX = static_cast<int>( uLine[x-1] ) + 1;
-			int altDY = static_cast<int>( vLine[x-1] );
-
-			float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x + offX, y, altDX, altDY, radius );
-			if ( hDist < curDist )
-			{
-				uLine[x] = static_cast<float>( altDX );
-				vLine[x] = static_cast<float>( altDY );
-				curDist = hDist;
-				++changeCount;
+				float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, std::max( curDist, curDist * slop ) );
+				if ( hDist < curDist ||
+					 ( tmpMagSq < curMagSq && hDist <= ( curDist * slop ) ) )
+				{
+					uLine[x] = static_cast<float>( altDX );
+					vLine[x] = static_cast<float>( altDY );
+					dLine[x] = curDist;
+					++changeCount;
+				}
 			}
 		}
 	}
 	changeCounts[tIdx] = changeCount;
 }
 
+static inline size_t
+getCount( std::vector<size_t> &counts )
+{
+	size_t ret = 0;
+	for ( size_t &a: counts )
+	{
+		ret += a;
+		a = 0;
+	}
+	return ret;
+}
+
+// The propagation runs over tiles of kPropagateTile pixels square.
+// Each tile propagates internally, forward and then backward in
+// scanline order, only looking at its own pixels so the tiles are
+// independent of each other. The matches are then exchanged between
+// the tiles by jump flooding, each pixel looking at the pixels a step
+// away in each direction, the step halving down to 1. The jump steps
+// read a copy of the field from before the step, so the result does
+// not depend on the number of threads or the order they run in.
+constexpr int kPropagateTile = 64;
+
 template <typename BufType, typename DistFunc>
-static void
-matchPassHorizThreadForwardAlphaN( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, int maxSkip, float eps )
+static inline bool
+tryMatch( const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int x, int y, int altDX, int altDY, int radius, int &curDX, int &curDY, float &curDist )
 {
-	int w = d.width();
-	int offX = d.x1();
+	// neighbors mostly agree, and the current match is not going to
+	// be better than itself
+	if ( altDX == curDX && altDY == curDY )
+		return false;
+	float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius, curDist );
+	if ( hDist < curDist )
+	{
+		curDX = altDX;
+		curDY = altDY;
+		curDist = hDist;
+		return true;
+	}
+	return false;
+}
+
+// one sweep over the tile (tx1, ty1) - (tx2, ty2), exclusive, in
+// plane coordinates. dir 1 looks to the left and above, -1 to the
+// right and below. Pixels without alpha match themselves, and are not
+// propagated from.
+template <typename BufType, typename DistFunc>
+static size_t
+sweepTile( plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer *alpha, int radius, int tx1, int ty1, int tx2, int ty2, int dir, float eps )
+{
+	const int offX = d.x1();
 	size_t changeCount = 0;
-	for ( int y = s; y < e; ++y )
+	for ( int i = 0, th = ty2 - ty1; i < th; ++i )
 	{
+		const int y = dir > 0 ? ty1 + i : ty2 - 1 - i;
+		const int py = y - dir;
+		const bool hasPrev = py >= ty1 && py < ty2;
 		float *uLine = u.line( y );
 		float *vLine = v.line( y );
 		float *dLine = d.line( y );
-		const float *aLine = alpha.line( y );
+		const float *uPrev = hasPrev ? u.line( py ) : nullptr;
+		const float *vPrev = hasPrev ? v.line( py ) : nullptr;
+		const float *aLine = alpha ? alpha->line( y ) : nullptr;
+		const float *aPrev = alpha && hasPrev ? alpha->line( py ) : nullptr;
 
-		for ( int x = 1; x < w; ++x )
+		for ( int j = 0, tw = tx2 - tx1; j < tw; ++j )
 		{
+			const int x = dir > 0 ? tx1 + j : tx2 - 1 - j;
 			float curDist = dLine[x];
 			if ( curDist <= eps )
 				continue;
-			if ( aLine[x] < 0.000001F )
+			if ( aLine && aLine[x] < 0.000001F )
 			{
 				uLine[x] = static_cast<float>( x + offX );
 				vLine[x] = static_cast<float>( y );
-				curDist = 0.F;
+				dLine[x] = 0.F;
 				++changeCount;
 				continue;
 			}
@@ -1148,27 +897,11 @@ matchPassHorizThreadForwardAlphaN( size_t tIdx, int s, int e, plane_buffer &u, p
 			int curDX = static_cast<int>( uLine[x] );
 			int curDY = static_cast<int>( vLine[x] );
 			bool changed = false;
-
-			int skip = maxSkip;
-			while ( skip > 0 )
-			{
-				if ( skip <= x && aLine[x-skip] > 0.F )
-				{
-					int altDX = static_cast<int>( uLine[x-skip] ) + skip;
-					int altDY = static_cast<int>( vLine[x-skip] );
-
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x + offX, y, altDX, altDY, radius );
-
-					if ( hDist < curDist )
-					{
-						curDX = altDX;
-						curDY = altDY;
-						curDist = hDist;
-						changed = true;
-					}
-				}
-				skip /= 2;
-			}
+			const int px = x - dir;
+			if ( px >= tx1 && px < tx2 && ( ! aLine || aLine[px] >= 0.000001F ) )
+				changed = tryMatch<BufType,DistFunc>( a, b, adx, ady, bdx, bdy, x + offX, y, static_cast<int>( uLine[px] ) + dir, static_cast<int>( vLine[px] ), radius, curDX, curDY, curDist );
+			if ( hasPrev && ( ! aPrev || aPrev[x] >= 0.000001F ) )
+				changed = tryMatch<BufType,DistFunc>( a, b, adx, ady, bdx, bdy, x + offX, y, static_cast<int>( uPrev[x] ), static_cast<int>( vPrev[x] ) + dir, radius, curDX, curDY, curDist ) || changed;
 			if ( changed )
 			{
 				uLine[x] = static_cast<float>( curDX );
@@ -1178,125 +911,96 @@ matchPassHorizThreadForwardAlphaN( size_t tIdx, int s, int e, plane_buffer &u, p
 			}
 		}
 	}
-	changeCounts[tIdx] = changeCount;
+	return changeCount;
 }
 
 template <typename BufType, typename DistFunc>
 static void
-matchPassVertThreadDownAlpha1( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, float eps )
+matchPassTileThread( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, float eps )
 {
+	const int tilesX = ( d.width() + kPropagateTile - 1 ) / kPropagateTile;
 	size_t changeCount = 0;
-	for ( int x = s; x < e; ++x )
+	for ( int t = s; t < e; ++t )
 	{
-		for ( int y = u.y1() + 1; y <= u.y2(); ++y )
-		{
-			float &curDist = d.get( x, y );
-			if ( curDist <= eps )
-				continue;
-
-			if ( alpha.get( x, y - 1 ) < 0.000001F )
-				continue;
-
-			int altDX = static_cast<int>( u.get( x, y - 1 ) );
-			int altDY = static_cast<int>( v.get( x, y - 1 ) ) + 1;
-
-			float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius );
-			if ( hDist < curDist )
-			{
-				u.get( x, y ) = static_cast<float>( altDX );
-				v.get( x, y ) = static_cast<float>( altDY );
-				curDist = hDist;
-				++changeCount;
-			}
-		}
+		int tx1 = ( t % tilesX ) * kPropagateTile;
+		int ty1 = d.y1() + ( t / tilesX ) * kPropagateTile;
+		int tx2 = std::min( d.width(), tx1 + kPropagateTile );
+		int ty2 = std::min( d.y2() + 1, ty1 + kPropagateTile );
+		changeCount += sweepTile<BufType,DistFunc>( u, v, d, a, b, adx, ady, bdx, bdy, nullptr, radius, tx1, ty1, tx2, ty2, 1, eps );
+		changeCount += sweepTile<BufType,DistFunc>( u, v, d, a, b, adx, ady, bdx, bdy, nullptr, radius, tx1, ty1, tx2, ty2, -1, eps );
 	}
 	changeCounts[tIdx] = changeCount;
 }
 
 template <typename BufType, typename DistFunc>
 static void
-matchPassHorizThreadBackwardAlpha1( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, float eps )
+matchPassTileThreadAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, float eps )
 {
-	int w = d.width();
-	int offX = d.x1();
+	const int tilesX = ( d.width() + kPropagateTile - 1 ) / kPropagateTile;
 	size_t changeCount = 0;
-	for ( int y = s; y < e; ++y )
+	for ( int t = s; t < e; ++t )
 	{
-		float *uLine = u.line( y );
-		float *vLine = v.line( y );
-		float *dLine = d.line( y );
-		const float *aLine = alpha.line( y );
-		for ( int x = w - 2; x >= 0; --x )
-		{
-			float &curDist = dLine[x];
-			if ( curDist <= eps )
-				continue;
-			if ( aLine[x+1] <= 0.F )
-				continue;
-
-			int altDX = static_cast<int>( uLine[x+1] ) - 1;
-			int altDY = static_cast<int>( vLine[x+1] );
-
-			if ( get_zero( alpha, altDX, altDY ) > 0.F )
-			{
-				float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
-				if ( hDist < curDist )
-				{
-					uLine[x] = static_cast<float>( altDX );
-					vLine[x] = static_cast<float>( altDY );
-					curDist = hDist;
-					++changeCount;
-				}
-			}
-		}
+		int tx1 = ( t % tilesX ) * kPropagateTile;
+		int ty1 = d.y1() + ( t / tilesX ) * kPropagateTile;
+		int tx2 = std::min( d.width(), tx1 + kPropagateTile );
+		int ty2 = std::min( d.y2() + 1, ty1 + kPropagateTile );
+		changeCount += sweepTile<BufType,DistFunc>( u, v, d, a, b, adx, ady, bdx, bdy, &alpha, radius, tx1, ty1, tx2, ty2, 1, eps );
+		changeCount += sweepTile<BufType,DistFunc>( u, v, d, a, b, adx, ady, bdx, bdy, &alpha, radius, tx1, ty1, tx2, ty2, -1, eps );
 	}
 	changeCounts[tIdx] = changeCount;
 }
 
-template <typename BufType, typename DistFunc>
 static void
-matchPassHorizThreadBackwardAlphaN( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, int maxSkip, float eps )
+copyFieldThread( size_t, int s, int e, plane_buffer &su, plane_buffer &sv, const plane_buffer &u, const plane_buffer &v )
 {
-	int w = d.width();
-	int offX = d.x1();
+	const size_t bytes = static_cast<size_t>( u.width() ) * sizeof(float);
+	for ( int y = s; y < e; ++y )
+	{
+		std::memcpy( su.line( y ), u.line( y ), bytes );
+		std::memcpy( sv.line( y ), v.line( y ), bytes );
+	}
+}
+
+// one jump flood step, reading the neighbors from the copy of the
+// field (su, sv) and updating (u, v, d)
+template <typename BufType, typename DistFunc>
+static size_t
+jumpLines( int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const plane_buffer &su, const plane_buffer &sv, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer *alpha, int radius, int step, float eps )
+{
+	static const int kDirs[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+	const int w = d.width();
+	const int offX = d.x1();
 	size_t changeCount = 0;
 	for ( int y = s; y < e; ++y )
 	{
 		float *uLine = u.line( y );
 		float *vLine = v.line( y );
 		float *dLine = d.line( y );
-		const float *aLine = alpha.line( y );
-
-		for ( int x = w - 2; x >= 0; --x )
+		const float *aLine = alpha ? alpha->line( y ) : nullptr;
+		for ( int x = 0; x < w; ++x )
 		{
 			float curDist = dLine[x];
-			if ( curDist <= eps )
+			// pixels without alpha were matched to themselves by the
+			// tile pass
+			if ( curDist <= eps || ( aLine && aLine[x] < 0.000001F ) )
 				continue;
+
 			int curDX = static_cast<int>( uLine[x] );
 			int curDY = static_cast<int>( vLine[x] );
 			bool changed = false;
-
-			int skip = maxSkip;
-			while ( skip > 0 )
+			for ( auto &dir: kDirs )
 			{
-				if ( (x + skip) < w && aLine[x+skip] > 0.F )
-				{
-					int altDX = static_cast<int>( uLine[x+skip] ) - skip;
-					int altDY = static_cast<int>( vLine[x+skip] );
-
-					if ( get_zero( alpha, altDX, altDY ) > 0.F )
-					{
-						float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
-						if ( hDist < curDist )
-						{
-							curDX = altDX;
-							curDY = altDY;
-							curDist = hDist;
-							changed = true;
-						}
-					}
-				}
-				skip /= 2;
+				const int ox = dir[0] * step;
+				const int oy = dir[1] * step;
+				const int nx = x + ox;
+				const int ny = y + oy;
+				if ( nx < 0 || nx >= w || ny < d.y1() || ny > d.y2() )
+					continue;
+				if ( alpha && alpha->line( ny )[nx] < 0.000001F )
+					continue;
+				const int altDX = static_cast<int>( su.line( ny )[nx] ) - ox;
+				const int altDY = static_cast<int>( sv.line( ny )[nx] ) - oy;
+				changed = tryMatch<BufType,DistFunc>( a, b, adx, ady, bdx, bdy, x + offX, y, altDX, altDY, radius, curDX, curDY, curDist ) || changed;
 			}
 			if ( changed )
 			{
@@ -1307,129 +1011,118 @@ matchPassHorizThreadBackwardAlphaN( size_t tIdx, int s, int e, plane_buffer &u,
 			}
 		}
 	}
-	changeCounts[tIdx] = changeCount;
+	return changeCount;
 }
 
 template <typename BufType, typename DistFunc>
 static void
-matchPassVertThreadDownAlphaN( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, int maxSkip, float eps )
+matchPassJumpThread( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const plane_buffer &su, const plane_buffer &sv, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, int radius, std::vector<size_t> &changeCounts, int step, float eps )
 {
-	size_t changeCount = 0;
-	for ( int x = s; x < e; ++x )
-	{
-		for ( int y = u.y1() + 1; y <= u.y2(); ++y )
-		{
-			float &curDist = d.get( x, y );
-			if ( curDist <= eps )
-				continue;
-
-			bool changed = false;
-			int skip = maxSkip;
-			while ( skip > 0 )
-			{
-				if ( ( y - skip ) >= u.y1() && alpha.get( x, y - skip ) > 0.F )
-				{
-					int altDX = static_cast<int>( u.get( x, y - skip ) );
-					int altDY = static_cast<int>( v.get( x, y - skip ) ) + skip;
-
-					if ( get_zero( alpha, altDX, altDY ) > 0.F )
-					{
-						float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius );
-						if ( hDist < curDist )
-						{
-							u.get( x, y ) = static_cast<float>( altDX );
-							v.get( x, y ) = static_cast<float>( altDY );
-							curDist = hDist;
-							changed = true;
-						}
-					}
-				}
-				skip /= 2;
-			}
-			if ( changed )
-				++changeCount;
-		}
-	}
-	changeCounts[tIdx] = changeCount;
+	changeCounts[tIdx] = jumpLines<BufType,DistFunc>( s, e, u, v, d, su, sv, a, b, adx, ady, bdx, bdy, nullptr, radius, step, eps );
 }
 
 template <typename BufType, typename DistFunc>
 static void
-matchPassVertThreadUpAlpha1( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, float eps )
+matchPassJumpThreadAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const plane_buffer &su, const plane_buffer &sv, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, int step, float eps )
 {
-	size_t changeCount = 0;
-	for ( int x = s; x < e; ++x )
-	{
-		for ( int y = u.y2() - 2; y >= u.y1(); --y )
-		{
-			float &curDist = d.get( x, y );
-			if ( curDist <= eps )
-				continue;
-			if ( alpha.get( x, y + 1 ) <= 0.F )
-				continue;
-
-			int altDX = static_cast<int>( u.get( x, y + 1 ) );
-			int altDY = static_cast<int>( v.get( x, y + 1 ) ) - 1;
+	changeCounts[tIdx] = jumpLines<BufType,DistFunc>( s, e, u, v, d, su, sv, a, b, adx, ady, bdx, bdy, &alpha, radius, step, eps );
+}
 
-			if ( get_zero( alpha, altDX, altDY ) > 0.F )
-			{
-				float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius );
-				if ( hDist < curDist )
-				{
-					u.get( x, y ) = static_cast<float>( altDX );
-					v.get( x, y ) = static_cast<float>( altDY );
-					curDist = hDist;
-					++changeCount;
-				}
-			}
-		}
+// the tile pass, then the jump flood steps from firstStep down to 1,
+// returning the number of matches changed. Without a valid alpha,
+// every pixel is matched.
+template <typename BufType, typename DistFunc>
+static size_t
+matchPassPropagate( plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &counts, int firstStep, float eps )
+{
+	const int tiles = ( ( u.width() + kPropagateTile - 1 ) / kPropagateTile ) * ( ( u.height() + kPropagateTile - 1 ) / kPropagateTile );
+	if ( alpha.valid() )
+		threading::get().dispatch( std::bind( matchPassTileThreadAlpha<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), 0, tiles );
+	else
+		threading::get().dispatch( std::bind( matchPassTileThread<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), 0, tiles );
+	size_t nChange = getCount( counts );
+
+	plane sU( u.x1(), u.y1(), u.x2(), u.y2() );
+	plane sV( u.x1(), u.y1(), u.x2(), u.y2() );
+	plane_buffer su = sU;
+	plane_buffer sv = sV;
+	for ( int step = firstStep; step > 0; step /= 2 )
+	{
+		threading::get().dispatch( std::bind( copyFieldThread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( su ), std::ref( sv ), std::cref( u ), std::cref( v ) ), u.y1(), u.height() );
+		if ( alpha.valid() )
+			threading::get().dispatch( std::bind( matchPassJumpThreadAlpha<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( su ), std::cref( sv ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), step, eps ), u.y1(), u.height() );
+		else
+			threading::get().dispatch( std::bind( matchPassJumpThread<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( su ), std::cref( sv ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), step, eps ), u.y1(), u.height() );
+		nChange += getCount( counts );
 	}
-	changeCounts[tIdx] = changeCount;
+	return nChange;
+}
+
+// the first step of the jump flood, the tiles only need to exchange
+// with their neighbors, but on the second iteration, matches are
+// spread over the whole image once
+static inline int
+firstJumpStep( const plane_buffer &u, int iter )
+{
+	int maxStep = iter == 1 ? std::max( u.width(), u.height() ) / 2 : kPropagateTile / 2;
+	int step = 1;
+	while ( step * 2 <= maxStep )
+		step *= 2;
+	return step;
 }
 
 template <typename BufType, typename DistFunc>
-static void
-matchPassVertThreadUpAlphaN( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, int maxSkip, float eps )
+static bool matchPass2( plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, std::mt19937 &gen, int radius, int iter, float eps )
 {
-	size_t changeCount = 0;
-	for ( int x = s; x < e; ++x )
-	{
-		for ( int y = u.y2() - 2; y >= u.y1(); --y )
-		{
-			float &curDist = d.get( x, y );
-			if ( curDist <= eps )
-				continue;
+	std::vector<size_t> counts( static_cast<size_t>( threading::get().size() ), size_t(0) );
+	size_t nChange;
+	size_t totChange = 0;
+	const int step = firstJumpStep( u, iter );
 
-			bool changed = false;
-			int skip = maxSkip;
-			while ( skip > 0 )
-			{
-				if ( (skip + y) < u.y2() && alpha.get( x, y + skip ) > 0.F )
-				{
-					int altDX = static_cast<int>( u.get( x, y + skip ) );
-					int altDY = static_cast<int>( v.get( x, y + skip ) ) - skip;
+	std::cout << "   iter " << iter
+			  << " step: " << step
+			  << " propagate: " << std::flush;
+	nChange = matchPassPropagate<BufType,DistFunc>( u, v, d, a, b, adx, ady, bdx, bdy, const_plane_buffer(), radius, counts, step, eps );
+	std::cout << nChange << " random: " << std::flush;
+	totChange += nChange;
 
-					if ( get_zero( alpha, altDX, altDY ) > 0.F )
-					{
-						float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, x, y, altDX, altDY, radius );
-						if ( hDist < curDist )
-						{
-							u.get( x, y ) = static_cast<float>( altDX );
-							v.get( x, y ) = static_cast<float>( altDY );
-							curDist = hDist;
-							changed = true;
-						}
-					}
-				}
-				skip /= 2;
-			}
-			if ( changed )
-				++changeCount;
-		}
-	}
-	changeCounts[tIdx] = changeCount;
+	size_t nSeeds = static_cast<size_t>( u.height() );
+	std::vector<std::uint_fast32_t> seeds( nSeeds );
+	for ( size_t y = 0; y < nSeeds; ++y )
+		seeds[y] = gen();
+
+	threading::get().dispatch( std::bind( matchPassRandomThread<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::cref( seeds ), std::ref( counts ), eps ), u.y1(), u.height() );
+	nChange = getCount( counts );
+	std::cout << nChange << " EVEN: " << std::flush;
+	totChange += nChange;
+
+	threading::get().dispatch( std::bind( matchPassDiagonal<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), 0, eps ), u.y1(), u.height() / 2 );
+	nChange = getCount( counts );
+	std::cout << nChange << " ODD: " << std::flush;
+	totChange += nChange;
+
+	threading::get().dispatch( std::bind( matchPassDiagonal<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), 1, eps ), u.y1(), u.height() / 2 );
+	nChange = getCount( counts );
+	std::cout << nChange << " REGE: " << std::flush;
+	totChange += nChange;
+
+	threading::get().dispatch( std::bind( matchPassRegAve<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), 0, eps ), u.y1(), u.height() / 2 );
+	nChange = getCount( counts );
+	std::cout << nChange << " REGO: " << std::flush;
+	totChange += nChange;
+
+	threading::get().dispatch( std::bind( matchPassRegAve<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), 1, eps ), u.y1(), u.height() / 2 );
+	std::cout << nChange << std::endl;
+	totChange += nChange;
+
+	return totChange == 0;
 }
 
+////////////////////////////////////////
+
+
+////////////////////////////////////////
+
 template <typename BufType, typename DistFunc>
 static void
 matchPassDiagonalAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, const BufType &b, const BufType &adx, const BufType &ady, const BufType &bdx, const BufType &bdy, const const_plane_buffer &alpha, int radius, std::vector<size_t> &changeCounts, int red, float eps )
@@ -1467,7 +1160,7 @@ matchPassDiagonalAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer
 				int altDY = static_cast<int>( prevVLine[x-1] ) + 1;
 				if ( get_zero( alpha, altDX, altDY ) > 0.F )
 				{
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 					if ( hDist < curDist )
 					{
 						curDX = altDX;
@@ -1484,7 +1177,7 @@ matchPassDiagonalAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer
 				int altDY = static_cast<int>( prevVLine[x+1] ) + 1;
 				if ( get_zero( alpha, altDX, altDY ) > 0.F )
 				{
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 					if ( hDist < curDist )
 					{
 						curDX = altDX;
@@ -1501,7 +1194,7 @@ matchPassDiagonalAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer
 				int altDY = static_cast<int>( nextVLine[x-1] ) - 1;
 				if ( get_zero( alpha, altDX, altDY ) > 0.F )
 				{
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 					if ( hDist < curDist )
 					{
 						curDX = altDX;
@@ -1518,7 +1211,7 @@ matchPassDiagonalAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer
 				int altDY = static_cast<int>( nextVLine[x+1] ) - 1;
 				if ( get_zero( alpha, altDX, altDY ) > 0.F )
 				{
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 					if ( hDist < curDist )
 					{
 						curDX = altDX;
@@ -1555,7 +1248,7 @@ matchPassRandomThreadAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_bu
 	size_t changeCount = 0;
 	for ( int y = s; y < e; ++y )
 	{
-		std::mt19937 rndg( seeds[static_cast<size_t>(y)] );
+		std::mt19937 rndg( seeds[static_cast<size_t>( y - u.y1() )] );
 		float *uLine = u.line( y );
 		float *vLine = v.line( y );
 		float *dLine = d.line( y );
@@ -1583,7 +1276,7 @@ matchPassRandomThreadAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_bu
 
 				if ( get_zero( alpha, altDX, altDY ) > 0.F )
 				{
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
+					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, curDist );
 					if ( hDist < curDist )
 					{
 						curDX = altDX;
@@ -1677,10 +1370,10 @@ matchPassRegAveAlpha( size_t tIdx, int s, int e, plane_buffer &u, plane_buffer &
 				altDY += y;
 				if ( get_zero( alpha, altDX, altDY ) > 0.F )
 				{
-					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius );
 					float distRatio = static_cast<float>( curMagSq ) / static_cast<float>( tmpMagSq );
 					// the closer the potential match, the more slop we allow
 					float slop = powf( 1.15F, distRatio );
+					float hDist = DistFunc::compute( a, b, adx, ady, bdx, bdy, offX + x, y, altDX, altDY, radius, std::max( curDist, curDist * slop ) );
 					if ( hDist < curDist ||
 						 ( tmpMagSq < curMagSq && hDist <= ( curDist * slop ) ) )
 					{
@@ -1704,26 +1397,12 @@ static bool matchPass2( plane_buffer &u, plane_buffer &v, plane_buffer &d, const
 	std::vector<size_t> counts( static_cast<size_t>( threading::get().size() ), size_t(0) );
 	size_t nChange;
 	size_t totChange = 0;
-	// do one round of jump flood on second iteration
-	int maxSkipX = ( iter == 1 ) ? std::max( int(1), u.width() / (iter * iter + 1) ) : 1;
-	int maxSkipY = ( iter == 1 ) ? std::max( int(1), u.height() / (iter * iter + 1) ) : 1;
+	const int step = firstJumpStep( u, iter );
 
 	std::cout << "   iter " << iter
-			  << " skip: " << maxSkipX << ' ' << maxSkipY
-			  << " l->r: " << std::flush;
-	if ( maxSkipX == 1 )
-		threading::get().dispatch( std::bind( matchPassHorizThreadForwardAlpha1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), u.y1(), u.height() );
-	else
-		threading::get().dispatch( std::bind( matchPassHorizThreadForwardAlphaN<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), maxSkipX, eps ), u.y1(), u.height() );
-	nChange = getCount( counts );
-	std::cout << nChange << " t->b: " << std::flush;
-	totChange += nChange;
-
-	if ( maxSkipY == 1 )
-		threading::get().dispatch( std::bind( matchPassVertThreadDownAlpha1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), u.x1(), u.width() );
-	else
-		threading::get().dispatch( std::bind( matchPassVertThreadDownAlphaN<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), maxSkipY, eps ), u.x1(), u.width() );
-	nChange = getCount( counts );
+			  << " step: " << step
+			  << " propagate: " << std::flush;
+	nChange = matchPassPropagate<BufType,DistFunc>( u, v, d, a, b, adx, ady, bdx, bdy, alpha, radius, counts, step, eps );
 	std::cout << nChange << " random: " << std::flush;
 	totChange += nChange;
 
@@ -1734,22 +1413,6 @@ static bool matchPass2( plane_buffer &u, plane_buffer &v, plane_buffer &d, const
 
 	threading::get().dispatch( std::bind( matchPassRandomThreadAlpha<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::cref( seeds ), std::ref( counts ), eps ), u.y1(), u.height() );
 	nChange = getCount( counts );
-	std::cout << nChange << " r->l: " << std::flush;
-	totChange += nChange;
-
-	if ( maxSkipX == 1 )
-		threading::get().dispatch( std::bind( matchPassHorizThreadBackwardAlpha1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), u.y1(), u.height() );
-	else
-		threading::get().dispatch( std::bind( matchPassHorizThreadBackwardAlphaN<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), maxSkipX, eps ), u.y1(), u.height() );
-	nChange = getCount( counts );
-	std::cout << nChange << " b->t: " << std::flush;
-	totChange += nChange;
-
-	if ( maxSkipY == 1 )
-		threading::get().dispatch( std::bind( matchPassVertThreadUpAlpha1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), u.x1(), u.width() );
-	else
-		threading::get().dispatch( std::bind( matchPassVertThreadUpAlphaN<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), maxSkipY, eps ), u.x1(), u.width() );
-	nChange = getCount( counts );
 	std::cout << nChange << " EVEN: " << std::flush;
 	totChange += nChange;
 
@@ -1922,11 +1585,19 @@ runMatch( plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a, c
 	}
 }
 
-static vector_field pmPlane( const plane &a, const plane &b, const plane &alpha, int64_t frameA, int64_t frameB, int radius, int style, int iters )
+static inline uint32_t
+matchSeed( int64_t frameA, int64_t frameB, int64_t seed )
+{
+	if ( seed >= 0 )
+		return static_cast<uint32_t>( seed );
+	return static_cast<uint32_t>( frameA + (frameA - frameB) + 1 );
+}
+
+static vector_field pmPlane( const plane &a, const plane &b, const plane &alpha, int64_t frameA, int64_t frameB, int radius, int style, int iters, int64_t seed )
 {
 	plane dist = create_plane( a.x1(), a.y1(), a.x2(), a.y2(), std::numeric_limits<plane::value_type>::max() );
-	uint32_t seedU = static_cast<uint32_t>( frameA + (frameA - frameB) + 1 );
-	uint32_t seedV = static_cast<uint32_t>( frameA + (frameA - frameB) - 1 );
+	uint32_t seedU = matchSeed( frameA, frameB, seed );
+	uint32_t seedV = seedU - 2;
 	plane u = create_random_plane( a.x1(), a.y1(), a.x2(), a.y2(), seedU, static_cast<float>( a.x1() ), static_cast<float>( a.x2() ) );
 	plane v = create_random_plane( a.x1(), a.y1(), a.x2(), a.y2(), seedV, static_cast<float>( a.y1() ), static_cast<float>( a.y2() ) );
 //	plane u = create_iotaX_plane( a.width(), a.height() );
@@ -1960,11 +1631,11 @@ static vector_field pmPlane( const plane &a, const plane &b, const plane &alpha,
 	return vector_field::create( std::move( u ), std::move( v ), true );
 }
 
-static vector_field pmImage( const image_buf &a, const image_buf &b, const plane &alpha, int64_t frameA, int64_t frameB, int radius, int style, int iters )
+static vector_field pmImage( const image_buf &a, const image_buf &b, const plane &alpha, int64_t frameA, int64_t frameB, int radius, int style, int iters, int64_t seed )
 {
 	plane dist = create_plane( a.x1(), a.y1(), a.x2(), a.y2(), std::numeric_limits<plane::value_type>::max() );
-	uint32_t seedU = static_cast<uint32_t>( frameA + (frameA - frameB) + 1 );
-	uint32_t seedV = static_cast<uint32_t>( frameA + (frameA - frameB) - 1 );
+	uint32_t seedU = matchSeed( frameA, frameB, seed );
+	uint32_t seedV = seedU - 2;
 	plane u = create_random_plane( a.x1(), a.y1(), a.x2(), a.y2(), seedU, static_cast<float>( a.x1() ), static_cast<float>( a.x2() ) );
 	plane v = create_random_plane( a.x1(), a.y1(), a.x2(), a.y2(), seedV, static_cast<float>( a.y1() ), static_cast<float>( a.y2() ) );
 	if ( alpha.valid() )
@@ -2027,21 +1698,8 @@ static bool matchRefineIter( plane_buffer &u, plane_buffer &v, plane_buffer &d,
 	size_t nChange;
 	size_t totChange = 0;
 
-	std::cout << "   iter " << iter << " left->right " << std::flush;
-	if ( alpha.valid() )
-		threading::get().dispatch( std::bind( matchPassHorizThreadForwardAlpha1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), u.y1(), u.height() );
-	else
-		threading::get().dispatch( std::bind( matchPassHorizThreadForward1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), u.y1(), u.height() );
-	nChange = getCount( counts );
-	std::cout << nChange << std::flush;
-	totChange += nChange;
-
-	std::cout << " top->bottom " << std::flush;
-	if ( alpha.valid() )
-		threading::get().dispatch( std::bind( matchPassVertThreadDownAlpha1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), u.x1(), u.width() );
-	else
-		threading::get().dispatch( std::bind( matchPassVertThreadDown1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), u.x1(), u.width() );
-	nChange = getCount( counts );
+	std::cout << "   iter " << iter << " propagate " << std::flush;
+	nChange = matchPassPropagate<BufType,DistFunc>( u, v, d, a, b, adx, ady, bdx, bdy, alpha, radius, counts, firstJumpStep( u, 0 ), eps );
 	std::cout << nChange << std::flush;
 	totChange += nChange;
 
@@ -2059,24 +1717,6 @@ static bool matchRefineIter( plane_buffer &u, plane_buffer &v, plane_buffer &d,
 	std::cout << nChange << std::flush;
 	totChange += nChange;
 
-	std::cout << " right->left " << std::flush;
-	if ( alpha.valid() )
-		threading::get().dispatch( std::bind( matchPassHorizThreadBackwardAlpha1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), u.y1(), u.height() );
-	else
-		threading::get().dispatch( std::bind( matchPassHorizThreadBackward1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), u.y1(), u.height() );
-	nChange = getCount( counts );
-	std::cout << nChange << std::flush;
-	totChange += nChange;
-
-	std::cout << " bottom->top " << std::flush;
-	if ( alpha.valid() )
-		threading::get().dispatch( std::bind( matchPassVertThreadUpAlpha1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), eps ), u.x1(), u.width() );
-	else
-		threading::get().dispatch( std::bind( matchPassVertThreadUp1<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), radius, std::ref( counts ), eps ), u.x1(), u.width() );
-	nChange = getCount( counts );
-	std::cout << nChange << std::flush;
-	totChange += nChange;
-
 	std::cout << " EVEN " << std::flush;
 	if ( alpha.valid() )
 		threading::get().dispatch( std::bind( matchPassDiagonalAlpha<BufType,DistFunc>, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( u ), std::ref( v ), std::ref( d ), std::cref( a ), std::cref( b ), std::cref( adx ), std::cref( ady ), std::cref( bdx ), std::cref( bdy ), std::cref( alpha ), radius, std::ref( counts ), 0, eps ), u.y1(), u.height() / 2 );
@@ -2242,9 +1882,9 @@ matchRefine( plane_buffer &u, plane_buffer &v, plane_buffer &d, const BufType &a
 	}
 }
 
-static vector_field pmHierPlane( const plane &a, const plane &b, const plane &alpha, int64_t frameA, int64_t frameB, int radius, int style, int iters )
+static vector_field pmHierPlane( const plane &a, const plane &b, const plane &alpha, int64_t frameA, int64_t frameB, int radius, int style, int iters, int64_t seed )
 {
-	uint32_t seedU = static_cast<uint32_t>( frameA + (frameA - frameB) + 1 );
+	uint32_t seedU = matchSeed( frameA, frameB, seed );
 
 	std::vector<plane> hierA = make_pyramid( a, "bilinear", 0.5F, 0, 100 );
 	std::vector<plane> hierB = make_pyramid( b, "bilinear", 0.5F, 0, 100 );
@@ -2273,7 +1913,7 @@ static vector_field pmHierPlane( const plane &a, const plane &b, const plane &al
 		levelRadius = std::min( radius, levelRadius + 1 );
 		if ( ! prevUV.valid() )
 		{
-			prevUV = pmPlane( curA, curB, curAlpha, frameA, frameB, levelRadius, style, iters );
+			prevUV = pmPlane( curA, curB, curAlpha, frameA, frameB, levelRadius, style, iters, static_cast<int64_t>( seedU ) );
 			continue;
 		}
 		
@@ -2332,9 +1972,9 @@ static vector_field pmHierPlane( const plane &a, const plane &b, const plane &al
 	return prevUV;
 }
 
-static vector_field pmHierImage( const image_buf &a, const image_buf &b, const plane &alpha, int64_t frameA, int64_t frameB, int radius, int style, int iters )
+static vector_field pmHierImage( const image_buf &a, const image_buf &b, const plane &alpha, int64_t frameA, int64_t frameB, int radius, int style, int iters, int64_t seed )
 {
-	uint32_t seedU = static_cast<uint32_t>( frameA + (frameA - frameB) + 1 );
+	uint32_t seedU = matchSeed( frameA, frameB, seed );
 
 	std::vector<image_buf> hierA = make_pyramid( a, "bilinear", 0.5F, 0, 100 );
 	std::vector<image_buf> hierB = make_pyramid( b, "bilinear", 0.5F, 0, 100 );
@@ -2362,7 +2002,7 @@ static vector_field pmHierImage( const image_buf &a, const image_buf &b, const p
 		levelRadius = std::min( radius, levelRadius + 1 );
 		if ( ! prevUV.valid() )
 		{
-			prevUV = pmImage( curA, curB, curAlpha, frameA, frameB, levelRadius, style, refineIters * refineIters * 2 );
+			prevUV = pmImage( curA, curB, curAlpha, frameA, frameB, levelRadius, style, refineIters * refineIters * 2, static_cast<int64_t>( seedU ) );
 			refineIters -= iters;
 			continue;
 		}
@@ -2447,19 +2087,19 @@ namespace image
 
 ////////////////////////////////////////
 
-vector_field patch_match( const plane &a, const plane &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters )
+vector_field patch_match( const plane &a, const plane &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters, int64_t seed )
 {
 	engine::dimensions d;
 	precondition( a.dims() == b.dims(), "patch_match must have a & b of same size, received a {0} and b {1}", a.dims(), b.dims() );
 	d = a.dims();
 	d.planes = 2;
 
-	return vector_field( true, "p.patch_match", d, a, b, alpha, framenumA, framenumB, radius, static_cast<int>(style), iters );
+	return vector_field( true, "p.patch_match", d, a, b, alpha, framenumA, framenumB, radius, static_cast<int>(style), iters, seed );
 }
 
 ////////////////////////////////////////
 
-vector_field patch_match( const image_buf &a, const image_buf &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters )
+vector_field patch_match( const image_buf &a, const image_buf &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters, int64_t seed )
 {
 	engine::dimensions d;
 	precondition( !a.empty() && a.dims() == b.dims(), "patch_match must have a & b of same size, received a {0} and b {1}", a.dims(), b.dims() );
@@ -2467,26 +2107,26 @@ vector_field patch_match( const image_buf &a, const image_buf &b, const plane &a
 	d = a.dims();
 	d.planes = 2;
 
-	return vector_field( true, "i.patch_match", d, a, b, alpha, framenumA, framenumB, radius, static_cast<int>(style), iters );
+	return vector_field( true, "i.patch_match", d, a, b, alpha, framenumA, framenumB, radius, static_cast<int>(style), iters, seed );
 }
 
 ////////////////////////////////////////
 
 vector_field
-hier_patch_match( const plane &a, const plane &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters )
+hier_patch_match( const plane &a, const plane &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters, int64_t seed )
 {
 	engine::dimensions d;
 	precondition( a.dims() == b.dims(), "hier_patch_match must have a & b of same size, received a {0} and b {1}", a.dims(), b.dims() );
 	d = a.dims();
 	d.planes = 2;
 
-	return vector_field( true, "p.hier_patch_match", d, a, b, alpha, framenumA, framenumB, radius, static_cast<int>(style), iters );
+	return vector_field( true, "p.hier_patch_match", d, a, b, alpha, framenumA, framenumB, radius, static_cast<int>(style), iters, seed );
 }
 
 ////////////////////////////////////////
 
 vector_field
-hier_patch_match( const image_buf &a, const image_buf &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters )
+hier_patch_match( const image_buf &a, const image_buf &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters, int64_t seed )
 {
 	engine::dimensions d;
 	precondition( !a.empty() && a.dims() == b.dims(), "hier_patch_match must have a & b of same size, received a {0} and b {1}", a.dims(), b.dims() );
@@ -2494,7 +2134,7 @@ hier_patch_match( const image_buf &a, const image_buf &b, const plane &alpha, in
 
 	d = a.dims();
 	d.planes = 2;
-	return vector_field( true, "i.hier_patch_match", d, a, b, alpha, framenumA, framenumB, radius, static_cast<int>(style), iters );
+	return vector_field( true, "i.hier_patch_match", d, a, b, alpha, framenumA, framenumB, radius, static_cast<int>(style), iters, seed );
 }
 
 ////////////////////////////////////////
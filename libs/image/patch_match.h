@@ -24,13 +24,17 @@ enum class patch_style : int
 	GRAD ///< sum square difference gradients only
 };
 
-vector_field patch_match( const plane &a, const plane &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters );
+/// The random initialization and search are seeded from seed, or
+/// from the frame numbers when seed is negative. The random sequence
+/// is assigned per scanline, so the result for a given seed does not
+/// depend on the number of threads.
+vector_field patch_match( const plane &a, const plane &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters, int64_t seed = -1 );
 /// pass in empty plane for no-alpha treatment
-vector_field patch_match( const image_buf &a, const image_buf &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters );
+vector_field patch_match( const image_buf &a, const image_buf &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters, int64_t seed = -1 );
 
-vector_field hier_patch_match( const plane &a, const plane &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters );
+vector_field hier_patch_match( const plane &a, const plane &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters, int64_t seed = -1 );
 /// pass in empty plane for no-alpha treatment
-vector_field hier_patch_match( const image_buf &a, const image_buf &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters );
+vector_field hier_patch_match( const image_buf &a, const image_buf &b, const plane &alpha, int64_t framenumA, int64_t framenumB, int radius, patch_style style, int iters, int64_t seed = -1 );
 
 
 void add_patchmatch( engine::registry &r );
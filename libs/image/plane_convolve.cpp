@@ -11,6 +11,10 @@
 #include <base/cpu_features.h>
 #include "scanline_process.h"
 #include "threading.h"
+#include "fft.h"
+#include "vertical_filter.h"
+#include <list>
+#include <mutex>
 
 ////////////////////////////////////////
 
@@ -535,26 +539,374 @@ vert_convolve( scanline &dest, int y, const plane &src, const std::vector<float>
 {
 	precondition( dest.get() != src.line( y ), "Need not-in-place flag to op" );
 
-	int halfK = static_cast<int>( k.size() / 2 );
+	const int halfK = static_cast<int>( k.size() / 2 );
+	const int w = dest.width();
+
+	// accumulate a short strip at a time in a local buffer so the
+	// destination is only written once instead of once per tap
+	const int kStrip = 64;
+	float acc[kStrip];
+	for ( int x0 = 0; x0 < w; x0 += kStrip )
+	{
+		const int sw = std::min( kStrip, w - x0 );
+		for ( int x = 0; x < sw; ++x )
+			acc[x] = 0.F;
+
+		for ( int l = - halfK; l <= halfK; ++l )
+		{
+			const float kVal = k[static_cast<size_t>( l + halfK )];
+			const int curY = std::max( src.y1(), std::min( src.y2(), y + l ) );
+			const float *s = src.line( curY ) + x0;
+			for ( int x = 0; x < sw; ++x )
+				acc[x] += s[x] * kVal;
+		}
+
+		for ( int x = 0; x < sw; ++x )
+			dest[x0 + x] = acc[x];
+	}
+}
+
+////////////////////////////////////////
+
+static plane
+vert_cgrad_strip( const plane &p )
+{
+	vertical_taps taps( p.y1(), p.y2() );
+	for ( int y = p.y1(); y <= p.y2(); ++y )
+	{
+		if ( y != p.y1() && y != p.y2() )
+		{
+			taps.add( y + 1, 0.5F );
+			taps.add( y - 1, -0.5F );
+		}
+		taps.next_row();
+	}
+	return apply_vertical_taps( p, taps );
+}
+
+////////////////////////////////////////
+
+static plane
+vert_ngrad5_strip( const plane &p )
+{
+	vertical_taps taps( p.y1(), p.y2() );
+	for ( int y = p.y1(); y <= p.y2(); ++y )
+	{
+		if ( y > ( p.y1() + 1 ) && y < ( p.y2() - 1 ) )
+		{
+			taps.add( y - 2, 1.F / 12.F );
+			taps.add( y - 1, -8.F / 12.F );
+			taps.add( y + 1, 8.F / 12.F );
+			taps.add( y + 2, -1.F / 12.F );
+		}
+		taps.next_row();
+	}
+	return apply_vertical_taps( p, taps );
+}
+
+////////////////////////////////////////
+
+static plane
+vert_convolve_strip( const plane &p, const std::vector<float> &k )
+{
+	const int halfK = static_cast<int>( k.size() / 2 );
+	vertical_taps taps( p.y1(), p.y2() );
+	for ( int y = p.y1(); y <= p.y2(); ++y )
+	{
+		for ( int l = - halfK; l <= halfK; ++l )
+			taps.add( std::max( p.y1(), std::min( p.y2(), y + l ) ), k[static_cast<size_t>( l + halfK )] );
+		taps.next_row();
+	}
+	return apply_vertical_taps( p, taps );
+}
+
+////////////////////////////////////////
+
+static void
+direct_convolve2d( scanline &dest, int y, const plane &src, const plane &k )
+{
+	precondition( dest.get() != src.line( y ), "Need not-in-place flag to op" );
+
+	int w = dest.width();
+	int wm1 = w - 1;
+	int kw = k.width();
+	int kh = k.height();
+	int hx = kw / 2;
+	int hy = kh / 2;
+
+	for ( int x = 0; x < w; ++x )
+		dest[x] = 0.F;
+
+	// accumulate a kernel row at a time, so the inner loop is a
+	// straight multiply-add across the scanline
+	for ( int ky = 0; ky < kh; ++ky )
+	{
+		int sy = std::max( src.y1(), std::min( src.y2(), y + ky - hy ) );
+		const float *srcL = src.line( sy );
+		const float *kL = k.line( k.y1() + ky );
+		for ( int kx = 0; kx < kw; ++kx )
+		{
+			const float kV = kL[kx];
+			const int off = kx - hx;
+			const int xs = std::min( w, std::max( 0, -off ) );
+			const int xe = std::max( xs, std::min( w, w - off ) );
+			for ( int x = 0; x < xs; ++x )
+				dest[x] += srcL[std::max( 0, std::min( wm1, x + off ) )] * kV;
+			for ( int x = xs; x < xe; ++x )
+				dest[x] += srcL[x + off] * kV;
+			for ( int x = xe; x < w; ++x )
+				dest[x] += srcL[std::max( 0, std::min( wm1, x + off ) )] * kV;
+		}
+	}
+}
+
+////////////////////////////////////////
+
+typedef fft_plan::complex_type fft_complex;
+typedef std::vector<fft_complex> fft_spectrum;
+
+struct spectrum_cache_entry
+{
+	uint64_t key;
+	int size;
+	std::shared_ptr<const fft_spectrum> spectrum;
+};
+
+std::mutex theSpectrumMutex;
+std::list<spectrum_cache_entry> theSpectrumCache;
+static const size_t kMaxCachedSpectra = 32;
+
+////////////////////////////////////////
+
+static inline void
+mul_spectrum( fft_complex *a, const fft_complex *b, size_t n )
+{
+	float *aF = reinterpret_cast<float *>( a );
+	const float *bF = reinterpret_cast<const float *>( b );
+	for ( size_t i = 0; i < n; ++i, aF += 2, bF += 2 )
+	{
+		float r = aF[0] * bF[0] - aF[1] * bF[1];
+		float im = aF[0] * bF[1] + aF[1] * bF[0];
+		aF[0] = r;
+		aF[1] = im;
+	}
+}
+
+////////////////////////////////////////
+
+/// forward 2D transform of an n x n real tile (row major), producing a
+/// column major ( n/2+1 columns of n ) spectrum
+static void
+forward_tile( const fft_plan &plan, const float *tile, fft_complex *spec, fft_complex *rowbins, fft_complex *scratch )
+{
+	const size_t n = plan.size();
+	const size_t bins = plan.real_bins();
+	for ( size_t r = 0; r < n; ++r )
+	{
+		plan.forward_real( tile + r * n, rowbins, scratch );
+		for ( size_t c = 0; c < bins; ++c )
+			spec[c * n + r] = rowbins[c];
+	}
+	for ( size_t c = 0; c < bins; ++c )
+		plan.forward( spec + c * n );
+}
+
+////////////////////////////////////////
+
+static std::shared_ptr<const fft_spectrum>
+find_kernel_spectrum( const plane &k, uint64_t key, const fft_plan &plan )
+{
+	const int n = static_cast<int>( plan.size() );
+	{
+		std::lock_guard<std::mutex> lk( theSpectrumMutex );
+		for ( auto i = theSpectrumCache.begin(); i != theSpectrumCache.end(); ++i )
+		{
+			if ( i->key == key && i->size == n )
+			{
+				// move to the front for lru behavior
+				theSpectrumCache.splice( theSpectrumCache.begin(), theSpectrumCache, i );
+				return theSpectrumCache.front().spectrum;
+			}
+		}
+	}
 
-	for ( int l = - halfK; l <= halfK; ++l )
+	// flip the kernel so the circular convolution applies it in the
+	// same orientation as the direct form, and pre-scale by the
+	// normalization of the inverse transform
+	const size_t nn = static_cast<size_t>( n );
+	std::vector<float> tile( nn * nn, 0.F );
+	const float norm = 1.F / static_cast<float>( n * n );
+	int kw = k.width();
+	int kh = k.height();
+	for ( int ky = 0; ky < kh; ++ky )
 	{
-		float kVal = k[static_cast<size_t>( l + halfK )];
-		int curY = std::max( src.y1(), std::min( src.y2(), y + l ) );
-		scanline s = scan_ref( src, curY );
-		if ( l == - halfK )
+		const float *kL = k.line( k.y1() + ky );
+		float *tL = tile.data() + static_cast<size_t>( kh - 1 - ky ) * nn;
+		for ( int kx = 0; kx < kw; ++kx )
+			tL[kw - 1 - kx] = kL[kx] * norm;
+	}
+
+	auto spec = std::make_shared<fft_spectrum>( plan.real_bins() * nn );
+	fft_spectrum rowbins( plan.real_bins() );
+	fft_spectrum scratch( nn / 2 );
+	forward_tile( plan, tile.data(), spec->data(), rowbins.data(), scratch.data() );
+
+	std::lock_guard<std::mutex> lk( theSpectrumMutex );
+	theSpectrumCache.push_front( spectrum_cache_entry{ key, n, spec } );
+	while ( theSpectrumCache.size() > kMaxCachedSpectra )
+		theSpectrumCache.pop_back();
+	return spec;
+}
+
+////////////////////////////////////////
+
+static void
+fft_convolve_tiles( size_t, int s, int e, plane &dest, const plane &src, const plane &k, const fft_plan &plan, const fft_spectrum &kspec, int tilesX )
+{
+	const size_t n = plan.size();
+	const size_t bins = plan.real_bins();
+	const int ni = static_cast<int>( n );
+	const int kw = k.width();
+	const int kh = k.height();
+	const int hx = kw / 2;
+	const int hy = kh / 2;
+	const int stepX = ni - kw + 1;
+	const int stepY = ni - kh + 1;
+	const int wm1 = src.width() - 1;
+
+	std::vector<float> tile( n * n );
+	fft_spectrum spec( bins * n );
+	fft_spectrum rowbins( bins );
+	fft_spectrum scratch( n / 2 );
+	std::vector<int> xoff( n );
+
+	for ( int t = s; t < e; ++t )
+	{
+		const int tx = t % tilesX;
+		const int ty = t / tilesX;
+		const int ox = tx * stepX;
+		const int oy = src.y1() + ty * stepY;
+
+		// overlap-save: gather the input block (holding the edges),
+		// the first kw-1 / kh-1 outputs are wrapped and discarded
+		for ( int i = 0; i < ni; ++i )
+			xoff[static_cast<size_t>( i )] = std::max( 0, std::min( wm1, ox - hx + i ) );
+		for ( int r = 0; r < ni; ++r )
 		{
-			for ( int x = 0, w = dest.width(); x < w; ++x )
-				dest[x] = s[x] * kVal;
+			int sy = std::max( src.y1(), std::min( src.y2(), oy - hy + r ) );
+			const float *srcL = src.line( sy );
+			float *tL = tile.data() + static_cast<size_t>( r ) * n;
+			for ( size_t i = 0; i < n; ++i )
+				tL[i] = srcL[xoff[i]];
 		}
-		else
+
+		forward_tile( plan, tile.data(), spec.data(), rowbins.data(), scratch.data() );
+		mul_spectrum( spec.data(), kspec.data(), spec.size() );
+		for ( size_t c = 0; c < bins; ++c )
+			plan.inverse( spec.data() + c * n );
+
+		const int outW = std::min( stepX, wm1 + 1 - ox );
+		for ( int r = kh - 1; r < ni; ++r )
 		{
-			for ( int x = 0, w = dest.width(); x < w; ++x )
-				dest[x] += s[x] * kVal;
+			int dy = oy + r - ( kh - 1 );
+			if ( dy > dest.y2() )
+				break;
+
+			const size_t rr = static_cast<size_t>( r );
+			for ( size_t c = 0; c < bins; ++c )
+				rowbins[c] = spec[c * n + rr];
+			plan.inverse_real( rowbins.data(), tile.data(), scratch.data() );
+
+			float *destL = dest.line( dy ) + ox;
+			const float *valid = tile.data() + ( kw - 1 );
+			for ( int x = 0; x < outW; ++x )
+				destL[x] = valid[x];
 		}
 	}
 }
 
+////////////////////////////////////////
+
+static plane
+fft_convolve( const plane &p, const plane &k, uint64_t kernelKey, int tileSize )
+{
+	std::shared_ptr<const fft_plan> plan = fft_plan::get( static_cast<size_t>( tileSize ) );
+	std::shared_ptr<const fft_spectrum> kspec = find_kernel_spectrum( k, kernelKey, *plan );
+
+	plane r( p.x1(), p.y1(), p.x2(), p.y2() );
+
+	int stepX = tileSize - k.width() + 1;
+	int stepY = tileSize - k.height() + 1;
+	int tilesX = ( p.width() + stepX - 1 ) / stepX;
+	int tilesY = ( p.height() + stepY - 1 ) / stepY;
+
+	threading::get().dispatch( std::bind( fft_convolve_tiles, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( r ), std::cref( p ), std::cref( k ), std::cref( *plan ), std::cref( *kspec ), tilesX ), 0, tilesX * tilesY );
+
+	return r;
+}
+
+////////////////////////////////////////
+
+/// estimated flops per output pixel of the direct convolution
+static inline double
+direct_cost( int kw, int kh )
+{
+	return 2.0 * static_cast<double>( kw ) * static_cast<double>( kh );
+}
+
+/// estimated flops per output pixel of the overlap-save fft, using
+/// 5 n log2(n) for a complex transform, and a fudge factor for the
+/// less friendly memory access pattern
+static inline double
+fft_cost( int n, int kw, int kh )
+{
+	double nd = static_cast<double>( n );
+	double valid = static_cast<double>( n - kw + 1 ) * static_cast<double>( n - kh + 1 );
+	double flops = 10.0 * nd * nd * log2( nd ) + 3.0 * nd * nd;
+	return 1.5 * flops / valid;
+}
+
+/// returns the best tile size for the fft, and the estimated cost
+static int
+choose_fft_size( int w, int h, int kw, int kh, double &cost )
+{
+	int kmax = std::max( kw, kh );
+	int maxN = static_cast<int>( fft_plan::next_size( static_cast<size_t>( std::max( w, h ) + kmax - 1 ) ) );
+	maxN = std::max( std::min( maxN, 1024 ), 16 );
+
+	int best = 0;
+	cost = 0.0;
+	for ( int n = std::max( 16, static_cast<int>( fft_plan::next_size( static_cast<size_t>( kmax ) ) ) ); n <= maxN; n *= 2 )
+	{
+		if ( n <= kmax )
+			continue;
+		double c = fft_cost( n, kw, kh );
+		if ( best == 0 || c < cost )
+		{
+			best = n;
+			cost = c;
+		}
+	}
+	return best;
+}
+
+////////////////////////////////////////
+
+static uint64_t
+kernel_key( const plane &k )
+{
+	engine::hash h;
+	if ( ! k.compute_hash( h ) )
+	{
+		// already computed, the address may be re-used for a
+		// different kernel, so hash the values
+		h << k.width() << k.height();
+		for ( int y = k.y1(); y <= k.y2(); ++y )
+			h.add( k.line( y ), sizeof(float) * static_cast<size_t>( k.width() ) );
+	}
+	return h.finish()[0];
+}
+
 }
 
 ////////////////////////////////////////
@@ -587,6 +939,8 @@ plane central_gradient_horiz( const plane &p )
 
 plane central_gradient_vert( const plane &p )
 {
+	if ( p.width() >= vertical_strip_min_width )
+		return plane( "p.cgrad_v_strip", p.dims(), p );
 	return plane( "p.cgrad_v", p.dims(), p );
 }
 
@@ -601,6 +955,8 @@ plane noise_gradient_horiz5( const plane &p )
 
 plane noise_gradient_vert5( const plane &p )
 {
+	if ( p.width() >= vertical_strip_min_width )
+		return plane( "p.ngrad_v5_strip", p.dims(), p );
 	return plane( "p.ngrad_v5", p.dims(), p );
 }
 
@@ -681,11 +1037,50 @@ plane convolve_vert( const plane &p, const std::vector<float> &k )
 	}
 
 	precondition( k.size() % 2 != 0, "non-odd-sized kernel {0}", k.size() );
+	if ( p.width() >= vertical_strip_min_width )
+		return plane( "p.sep_conv_v_strip", p.dims(), p, k );
 	return plane( "p.sep_conv_v", p.dims(), p, k );
 }
 
 ////////////////////////////////////////
 
+plane convolve( const plane &p, const plane &k )
+{
+	precondition( k.width() % 2 != 0 && k.height() % 2 != 0, "non-odd-sized kernel {0}x{1}", k.width(), k.height() );
+
+	double fc = 0.0;
+	int n = choose_fft_size( p.width(), p.height(), k.width(), k.height(), fc );
+	if ( n > 0 && fc < direct_cost( k.width(), k.height() ) )
+		return convolve_fft( p, k, n );
+
+	return convolve_direct( p, k );
+}
+
+////////////////////////////////////////
+
+plane convolve_direct( const plane &p, const plane &k )
+{
+	precondition( k.width() % 2 != 0 && k.height() % 2 != 0, "non-odd-sized kernel {0}x{1}", k.width(), k.height() );
+	return plane( "p.convolve2d", p.dims(), p, k );
+}
+
+////////////////////////////////////////
+
+plane convolve_fft( const plane &p, const plane &k, int tileSize )
+{
+	precondition( k.width() % 2 != 0 && k.height() % 2 != 0, "non-odd-sized kernel {0}x{1}", k.width(), k.height() );
+	if ( tileSize <= 0 )
+	{
+		double fc = 0.0;
+		tileSize = choose_fft_size( p.width(), p.height(), k.width(), k.height(), fc );
+	}
+	precondition( tileSize > std::max( k.width(), k.height() ) && ( tileSize & ( tileSize - 1 ) ) == 0, "invalid fft tile size {0} for kernel {1}x{2}", tileSize, k.width(), k.height() );
+
+	return plane( "p.convolve2d_fft", p.dims(), p, k, kernel_key( k ), tileSize );
+}
+
+////////////////////////////////////////
+
 void add_convolve( engine::registry &r )
 {
 	using namespace engine;
@@ -711,6 +1106,15 @@ void add_convolve( engine::registry &r )
 	r.add( op( "p.sep_conv3_mirror_v", base::choose_runtime( vert_convolve3_mirror ), n_scanline_plane_adapter<false, decltype(vert_convolve3_mirror)>(), dispatch_scan_processing, op::n_to_one ) );
 	r.add( op( "p.sep_conv3_v", base::choose_runtime( vert_convolve3 ), n_scanline_plane_adapter<false, decltype(vert_convolve3)>(), dispatch_scan_processing, op::n_to_one ) );
 	r.add( op( "p.sep_conv_v", base::choose_runtime( vert_convolve ), n_scanline_plane_adapter<false, decltype(vert_convolve)>(), dispatch_scan_processing, op::n_to_one ) );
+
+	// wide planes are processed in column strips instead of by scanline
+	r.add( op( "p.cgrad_v_strip", vert_cgrad_strip, op::threaded ) );
+	r.add( op( "p.ngrad_v5_strip", vert_ngrad5_strip, op::threaded ) );
+	r.add( op( "p.sep_conv_v_strip", vert_convolve_strip, op::threaded ) );
+
+	r.add( op( "p.convolve2d", base::choose_runtime( direct_convolve2d ), n_scanline_plane_adapter<false, decltype(direct_convolve2d)>(), dispatch_scan_processing, op::n_to_one ) );
+	// fft tiles need their own scratch buffers, so do generic threading
+	r.add( op( "p.convolve2d_fft", fft_convolve, op::threaded ) );
 }
 
 ////////////////////////////////////////
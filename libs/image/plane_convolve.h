@@ -48,6 +48,26 @@ inline plane separable_convolve( const plane &p, const std::vector<float> &k )
 	return convolve_horiz( convolve_vert( p, k ), k );
 }
 
+/// 2D convolution with an arbitrary kernel, stored as a plane with
+/// odd width and height, the center pixel of which is the center of
+/// the kernel. The kernel is applied in the same orientation as
+/// convolve_horiz / convolve_vert, and the edges of p are held.
+///
+/// Automatically chooses between a direct convolution and an FFT
+/// (overlap-save) based approach, depending on the kernel size.
+plane convolve( const plane &p, const plane &k );
+
+/// explicitly request direct 2D convolution
+plane convolve_direct( const plane &p, const plane &k );
+
+/// explicitly request FFT based convolution, tileSize is the
+/// (power of two) transform size to use, or 0 to pick automatically.
+///
+/// The kernel spectra are cached based on the hash of the kernel, so
+/// repeated application of the same kernel does not re-transform
+/// the kernel
+plane convolve_fft( const plane &p, const plane &k, int tileSize = 0 );
+
 void add_convolve( engine::registry &r );
 
 } // namespace image
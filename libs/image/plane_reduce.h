@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <vector>
+#include "plane.h"
+#include "threading.h"
+
+////////////////////////////////////////
+
+namespace image
+{
+
+/// @brief storage for the per-thread partial result of a reduction.
+///
+/// The trailing cache line of padding ensures no two partials share
+/// a cache line, regardless of where the allocator places the array.
+template <typename T>
+struct padded_partial
+{
+	T value;
+	char pad[64];
+};
+
+/// Runs a parallel reduction over the scanlines of a plane.
+///
+/// Each thread accumulates into a private copy of init, calling
+/// rowF( T &partial, const float *line, int width ) for each of its
+/// scanlines, and only writes the result to its (padded) partial when
+/// done. The partials are then combined pairwise in a tree with
+/// mergeF( T &into, const T &from ). init must be the identity for
+/// the merge, as threads that are not given any scanlines leave their
+/// partial untouched.
+template <typename T, typename RowFunc, typename MergeFunc>
+inline T
+reduce_rows( const plane &p, const T &init, RowFunc rowF, MergeFunc mergeF )
+{
+	const size_t n = threading::get().size();
+	std::vector<padded_partial<T>> parts( n, padded_partial<T>{ init, {} } );
+
+	threading::get().dispatch(
+		[&]( size_t tIdx, int s, int e )
+		{
+			T local = init;
+			const int w = p.width();
+			for ( int y = s; y < e; ++y )
+				rowF( local, p.line( y ), w );
+			mergeF( parts[tIdx].value, local );
+		}, p );
+
+	for ( size_t step = 1; step < n; step *= 2 )
+	{
+		for ( size_t i = 0; ( i + step ) < n; i += 2 * step )
+			mergeF( parts[i].value, parts[i + step].value );
+	}
+	return parts[0].value;
+}
+
+} // namespace image
+
+
+
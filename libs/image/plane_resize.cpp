@@ -7,8 +7,20 @@
 
 #include "plane_resize.h"
 #include "scanline_process.h"
+#include "vertical_filter.h"
+#include "resample.h"
+#include "threading.h"
 #include <base/cpu_features.h>
 
+#ifdef __SSE__
+# if defined(LINUX) || defined(__linux__)
+#  include <x86intrin.h>
+# else
+#  include <xmmintrin.h>
+#  include <immintrin.h>
+# endif
+#endif
+
 ////////////////////////////////////////
 
 namespace
@@ -108,6 +120,168 @@ doResizeHorizBicubic( scanline &dest, const scanline &in, float scale )
 	}
 }
 
+////////////////////////////////////////
+
+static void
+doResizeVertFilter( scanline &dest, int y, const plane &in, const std::shared_ptr<const resample_weights> &rw )
+{
+	const int nT = rw->taps();
+	const float *w = rw->weights( y - in.y1() );
+	const int srcY = rw->start( y - in.y1() ) + in.y1();
+
+	const float *l = in.line( srcY );
+	for ( int x = 0; x < dest.width(); ++x )
+		dest[x] = l[x] * w[0];
+	for ( int t = 1; t < nT; ++t )
+	{
+		const float wt = w[t];
+		if ( wt == 0.F )
+			continue;
+		l = in.line( srcY + t );
+		for ( int x = 0; x < dest.width(); ++x )
+			dest[x] += l[x] * wt;
+	}
+}
+
+static void
+doResizeHorizFilter( scanline &dest, const scanline &in, const std::shared_ptr<const resample_weights> &rw )
+{
+	const int nT = rw->taps();
+	const float *src = in.get();
+	for ( int x = 0; x < dest.width(); ++x )
+	{
+		const float *w = rw->weights( x );
+		const float *s = src + rw->start( x );
+		int t = 0;
+		float v = 0.F;
+#ifdef __SSE__
+		// the taps are padded to a multiple of 4 unless the input is
+		// narrower than the filter
+		__m128 acc = _mm_setzero_ps();
+		for ( ; ( t + 4 ) <= nT; t += 4 )
+			acc = _mm_add_ps( acc, _mm_mul_ps( _mm_loadu_ps( s + t ), _mm_loadu_ps( w + t ) ) );
+		acc = _mm_add_ps( acc, _mm_movehl_ps( acc, acc ) );
+		acc = _mm_add_ss( acc, _mm_shuffle_ps( acc, acc, 1 ) );
+		v = _mm_cvtss_f32( acc );
+#endif
+		for ( ; t < nT; ++t )
+			v += s[t] * w[t];
+		dest[x] = v;
+	}
+}
+
+////////////////////////////////////////
+
+static void
+resizeVertFilterThread( size_t, int s, int e, plane &dest, const plane &in, const std::shared_ptr<const resample_weights> &rw )
+{
+	for ( int y = s; y < e; ++y )
+	{
+		scanline d( dest.x1(), dest.line( y ), dest.width(), dest.stride() );
+		doResizeVertFilter( d, y, in, rw );
+	}
+}
+
+static plane
+resizeVertFilter( const plane &in, const std::string &filter, int newh )
+{
+	// the weights are shared by every scanline, so only look them up
+	// once rather than per line
+	std::shared_ptr<const resample_weights> rw = resample_weights::get( filter, in.height(), newh );
+	plane r( in.x1(), in.y1(), in.x2(), in.y1() + newh - 1 );
+	threading::get().dispatch( std::bind( resizeVertFilterThread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( r ), std::cref( in ), std::cref( rw ) ), r );
+	return r;
+}
+
+////////////////////////////////////////
+
+static void
+resizeHorizFilterThread( size_t, int s, int e, plane &dest, const plane &in, const std::shared_ptr<const resample_weights> &rw )
+{
+	for ( int y = s; y < e; ++y )
+	{
+		scanline d( dest.x1(), dest.line( y ), dest.width(), dest.stride() );
+		scanline src( in.x1(), in.line( y ), in.width(), in.stride() );
+		doResizeHorizFilter( d, src, rw );
+	}
+}
+
+static plane
+resizeHorizFilter( const plane &in, const std::string &filter, int neww )
+{
+	std::shared_ptr<const resample_weights> rw = resample_weights::get( filter, in.width(), neww );
+	plane r( in.x1(), in.y1(), in.x1() + neww - 1, in.y2() );
+	threading::get().dispatch( std::bind( resizeHorizFilterThread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( r ), std::cref( in ), std::cref( rw ) ), r );
+	return r;
+}
+
+////////////////////////////////////////
+
+static plane
+resizeVertFilterStrip( const plane &in, const std::string &filter, int newh )
+{
+	std::shared_ptr<const resample_weights> rw = resample_weights::get( filter, in.height(), newh );
+	vertical_taps taps( in.y1(), in.y1() + newh - 1 );
+	for ( int i = 0; i < newh; ++i )
+	{
+		const float *w = rw->weights( i );
+		const int srcY = rw->start( i ) + in.y1();
+		for ( int t = 0; t < rw->taps(); ++t )
+		{
+			if ( w[t] != 0.F )
+				taps.add( srcY + t, w[t] );
+		}
+		taps.next_row();
+	}
+	return apply_vertical_taps( in, taps );
+}
+
+////////////////////////////////////////
+
+static plane
+resizeVertBilinearStrip( const plane &in, int newh, float scale )
+{
+	vertical_taps taps( in.y1(), in.y1() + newh - 1 );
+	for ( int y = taps.y1(); y <= taps.y2(); ++y )
+	{
+		int zeroY = y - in.y1();
+		float srcY1 = ( static_cast<float>( zeroY ) + 0.5F ) * scale;
+		int p1 = static_cast<int>( srcY1 );
+		float perc = srcY1 - static_cast<float>( p1 );
+		p1 = std::min( in.y2(), p1 + in.y1() );
+		int p2 = std::min( in.y2(), p1 + 1 );
+		taps.add( p1, 1.F - perc );
+		taps.add( p2, perc );
+		taps.next_row();
+	}
+	return apply_vertical_taps( in, taps );
+}
+
+////////////////////////////////////////
+
+static plane
+resizeVertBicubicStrip( const plane &in, int newh, float scale )
+{
+	vertical_taps taps( in.y1(), in.y1() + newh - 1 );
+	for ( int y = taps.y1(); y <= taps.y2(); ++y )
+	{
+		float srcY = static_cast<float>( y - in.y1() ) * scale + static_cast<float>( in.y1() );
+		int pY = static_cast<int>( srcY );
+		float t = srcY - static_cast<float>( pY );
+		float t2 = t * t;
+		float t3 = t2 * t;
+		pY = std::min( in.y2(), pY );
+
+		// weights of base::cubic_interp
+		taps.add( std::max( in.y1(), pY - 1 ), -0.5F * t + t2 - 0.5F * t3 );
+		taps.add( pY, 1.F - 2.5F * t2 + 1.5F * t3 );
+		taps.add( std::min( in.y2(), pY + 1 ), 0.5F * t + 2.F * t2 - 1.5F * t3 );
+		taps.add( std::min( in.y2(), pY + 2 ), -0.5F * t2 + 0.5F * t3 );
+		taps.next_row();
+	}
+	return apply_vertical_taps( in, taps );
+}
+
 } // empty namespace
 
 ////////////////////////////////////////
@@ -160,6 +334,8 @@ resize_vert_bilinear( const plane &p, int newh )
 	engine::dimensions d = p.dims();
 	d.y2 = d.y1 + newh - 1;
 	float scale = static_cast<float>( p.height() ) / static_cast<float>( newh );
+	if ( p.width() >= vertical_strip_min_width )
+		return plane( "p.resize_vert_bilinear_strip", d, p, newh, scale );
 	return plane( "p.resize_vert_bilinear", d, p, scale );
 }
 
@@ -184,6 +360,8 @@ resize_vert_bicubic( const plane &p, int newh )
 	engine::dimensions d = p.dims();
 	d.y2 = d.y1 + newh - 1;
 	float scale = static_cast<float>( p.height() ) / static_cast<float>( newh );
+	if ( p.width() >= vertical_strip_min_width )
+		return plane( "p.resize_vert_bicubic_strip", d, p, newh, scale );
 	return plane( "p.resize_vert_bicubic", d, p, scale );
 }
 
@@ -192,7 +370,18 @@ resize_vert_bicubic( const plane &p, int newh )
 plane
 resize_horiz( const plane &p, const std::string &filter, int neww )
 {
-	throw_not_yet();
+	if ( filter == "point" || filter == "dirac" )
+		return resize_horiz_point( p, neww );
+	if ( filter == "bilinear" )
+		return resize_horiz_bilinear( p, neww );
+	if ( filter == "bicubic" )
+		return resize_horiz_bicubic( p, neww );
+
+	precondition( neww > 0, "Invalid new width {0} to resize", neww );
+	precondition( resample_weights::is_filter( filter ), "Unknown resize filter '{0}'", filter );
+	engine::dimensions d = p.dims();
+	d.x2 = d.x1 + neww - 1;
+	return plane( "p.resize_horiz_filter", d, p, filter, neww );
 }
 
 ////////////////////////////////////////
@@ -200,7 +389,20 @@ resize_horiz( const plane &p, const std::string &filter, int neww )
 plane
 resize_vert( const plane &p, const std::string &filter, int newh )
 {
-	throw_not_yet();
+	if ( filter == "point" || filter == "dirac" )
+		return resize_vert_point( p, newh );
+	if ( filter == "bilinear" )
+		return resize_vert_bilinear( p, newh );
+	if ( filter == "bicubic" )
+		return resize_vert_bicubic( p, newh );
+
+	precondition( newh > 0, "Invalid new height {0} to resize", newh );
+	precondition( resample_weights::is_filter( filter ), "Unknown resize filter '{0}'", filter );
+	engine::dimensions d = p.dims();
+	d.y2 = d.y1 + newh - 1;
+	if ( p.width() >= vertical_strip_min_width )
+		return plane( "p.resize_vert_filter_strip", d, p, filter, newh );
+	return plane( "p.resize_vert_filter", d, p, filter, newh );
 }
 
 ////////////////////////////////////////
@@ -235,18 +437,16 @@ make_pyramid( const plane &in, const std::string &filter, float eta, int n, int
 //		std::cout << "adding level " << curLev << " at " << curW << "x" << curH << std::endl;
 #define DIRECT_PYRAMIDS 1
 #if DIRECT_PYRAMIDS
-		plane tmp = in;
+		// the interpolating filters alias badly when reducing by more
+		// than 2x, so are always computed from the full resolution
+		// plane. The resampling filters are stretched to band limit
+		// the input, so are computed from the previous level, which
+		// keeps the filter small
+		plane tmp = resample_weights::is_filter( filter ) ? ret.back() : in;
 #else
 		plane tmp = ret.back();
 #endif
-		if ( filter == "bilinear" )
-			ret.push_back( resize_bilinear( tmp, curW, curH ) );
-		else if ( filter == "bicubic" )
-			ret.push_back( resize_bicubic( tmp, curW, curH ) );
-		else if ( filter == "point" || filter == "dirac" )
-			ret.push_back( resize_point( tmp, curW, curH ) );
-		else
-			throw_not_yet();
+		ret.push_back( resize( tmp, filter, curW, curH ) );
 		++curLev;
 	}
 
@@ -284,32 +484,13 @@ make_pyramid( const image_buf &in, const std::string &filter, float eta, int n,
 
 //		std::cout << "adding level " << curLev << " at " << curW << "x" << curH << std::endl;
 #if DIRECT_PYRAMIDS
-		image_buf tmp = in;
+		image_buf tmp = resample_weights::is_filter( filter ) ? ret.back() : in;
 #else
 		image_buf tmp = ret.back();
 #endif
-		if ( filter == "bilinear" )
-		{
-			for ( size_t p = 0; p != in.size(); ++p )
-				tmp[p] = resize_bilinear( in[p], curW, curH );
-			ret.emplace_back( std::move( tmp ) );
-		}
-		else if ( filter == "bicubic" )
-		{
-			for ( size_t p = 0; p != tmp.size(); ++p )
-				tmp[p] = resize_bicubic( tmp[p], curW, curH );
-			ret.emplace_back( std::move( tmp ) );
-		}
-		else if ( filter == "point" || filter == "dirac" )
-		{
-			for ( size_t p = 0; p != tmp.size(); ++p )
-				tmp[p] = resize_point( tmp[p], curW, curH );
-			ret.emplace_back( std::move( tmp ) );
-		}
-		else
-		{
-			throw_not_yet();
-		}
+		for ( size_t p = 0; p != tmp.size(); ++p )
+			tmp[p] = resize( tmp[p], filter, curW, curH );
+		ret.emplace_back( std::move( tmp ) );
 		++curLev;
 	}
 
@@ -331,8 +512,13 @@ add_resize( engine::registry &r )
 	r.add( op( "p.resize_vert_bicubic", base::choose_runtime( doResizeVertBicubic ), n_scanline_plane_adapter<false, decltype(doResizeVertBicubic)>(), dispatch_scan_processing, op::n_to_one ) );
 	r.add( op( "p.resize_horiz_bicubic", base::choose_runtime( doResizeHorizBicubic ), scanline_plane_adapter<true, decltype(doResizeHorizBicubic)>(), dispatch_scan_processing, op::one_to_one ) );
 
-//	r.add( op( "p.resize_vert_generic", base::choose_runtime( doResizeVertGeneric ), n_scanline_plane_adapter<false, decltype(doResizeVertGeneric)>(), dispatch_scan_processing, op::n_to_one ) );
-//	r.add( op( "p.resize_horiz_generic", base::choose_runtime( doResizeHorizGeneric ), scanline_plane_adapter<true, decltype(doResizeHorizGeneric)>(), dispatch_scan_processing, op::one_to_one ) );
+	// wide planes are processed in column strips instead of by scanline
+	r.add( op( "p.resize_vert_bilinear_strip", resizeVertBilinearStrip, op::threaded ) );
+	r.add( op( "p.resize_vert_bicubic_strip", resizeVertBicubicStrip, op::threaded ) );
+
+	r.add( op( "p.resize_vert_filter", resizeVertFilter, op::threaded ) );
+	r.add( op( "p.resize_horiz_filter", resizeHorizFilter, op::threaded ) );
+	r.add( op( "p.resize_vert_filter_strip", resizeVertFilterStrip, op::threaded ) );
 }
 
 ////////////////////////////////////////
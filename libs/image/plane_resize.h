@@ -40,6 +40,11 @@ inline plane resize_bicubic( const plane &p, int neww, int newh )
 	return resize_horiz_bicubic( resize_vert_bicubic( p, newh ), neww );
 }
 
+/// Resizes using the named filter. point (or dirac), bilinear and
+/// bicubic use the interpolating resizes above, any of the filters
+/// supported by resample_weights (box, triangle, gaussian, mitchell,
+/// catmull-rom, lanczos2, lanczos3) use a polyphase resample, which
+/// also filters the input appropriately when reducing the size.
 plane resize_horiz( const plane &p, const std::string &filter, int neww );
 plane resize_vert( const plane &p, const std::string &filter, int newh );
 
@@ -7,7 +7,9 @@
 
 #include "plane_stats.h"
 #include "threading.h"
+#include "plane_reduce.h"
 #include "scanline_process.h"
+#include "plane_ops.h"
 #include <base/cpu_features.h>
 #include <base/contract.h>
 
@@ -19,40 +21,97 @@ namespace
 {
 using namespace image;
 
-static void sum_thread( size_t tIdx, int s, int e, const plane &p, std::vector<double> &vals )
+static double sum_plane( const plane &p )
 {
-	double v = 0.0;
-	int w = p.width();
-	for ( int y = s; y < e; ++y )
+	return reduce_rows( p, 0.0,
+						[]( double &v, const float *line, int w )
+						{
+							double rowV = 0.0;
+							for ( int x = 0; x < w; ++x )
+								rowV += static_cast<double>( line[x] );
+							v += rowV;
+						},
+						[]( double &a, const double &b ) { a += b; } );
+}
+
+////////////////////////////////////////
+
+// combines the stats of two sets, with the mean / variance merged
+// using the parallel form of Welford's algorithm (Chan et al.)
+static void
+merge_summary( plane_summary &a, const plane_summary &b )
+{
+	if ( b.count == 0 )
+		return;
+	if ( a.count == 0 )
 	{
-		const float *lineP = p.line( y );
-		for ( int x = 0; x < w; ++x )
-			v += static_cast<double>( lineP[x] );
+		a = b;
+		return;
 	}
-	vals[tIdx] += v;
+	double na = static_cast<double>( a.count );
+	double nb = static_cast<double>( b.count );
+	double n = na + nb;
+	double delta = b.mean - a.mean;
+	a.mean += delta * nb / n;
+	a.m2 += b.m2 + delta * delta * na * nb / n;
+	a.sum += b.sum;
+	a.count += b.count;
+	a.min_value = std::min( a.min_value, b.min_value );
+	a.max_value = std::max( a.max_value, b.max_value );
 }
 
-static double sum_plane( const plane &p )
+static plane_summary
+summarize_plane( const plane &p )
 {
-	std::vector<double> vals;
-	vals.resize( threading::get().size(), 0.0 );
-
-	threading::get().dispatch( std::bind( sum_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::cref( p ), std::ref( vals ) ), p );
-
-	double r = 0.0;
-	for ( double d: vals )
-		r += d;
+	plane_summary r = reduce_rows( p, plane_summary(),
+		[]( plane_summary &v, const float *line, int w )
+		{
+			// stats of the row with a two-pass mean / variance (the
+			// row is in cache), then merged into the running values
+			plane_summary rowS;
+			double rowSum = 0.0;
+			float minV = line[0], maxV = line[0];
+			for ( int x = 0; x < w; ++x )
+			{
+				rowSum += static_cast<double>( line[x] );
+				minV = std::min( minV, line[x] );
+				maxV = std::max( maxV, line[x] );
+			}
+			double rowMean = rowSum / static_cast<double>( w );
+			double m2 = 0.0;
+			for ( int x = 0; x < w; ++x )
+			{
+				double d = static_cast<double>( line[x] ) - rowMean;
+				m2 += d * d;
+			}
+			rowS.count = static_cast<uint64_t>( w );
+			rowS.sum = rowSum;
+			rowS.mean = rowMean;
+			rowS.m2 = m2;
+			rowS.min_value = minV;
+			rowS.max_value = maxV;
+			merge_summary( v, rowS );
+		},
+		merge_summary );
+
+	if ( r.count > 1 )
+		r.variance = r.m2 / static_cast<double>( r.count - 1 );
 	return r;
 }
 
+////////////////////////////////////////
+
+// the summed area table ops are shared between the double (accum_buf)
+// and compensated float (plane) storage
+template <typename SAT>
 static void
-compute_mean_sat( scanline &dest, int y, const accum_buf &sat, int radius )
+compute_mean_sat( scanline &dest, int y, const SAT &sat, int radius )
 {
 	int wm1 = sat.width() - 1;
 	int y0 = y - radius - 1;
 	int y1 = std::max( sat.y1(), std::min( sat.y2(), y + radius ) );
 	int nY = y1 - (y0 < sat.y1() ? -1 : y0 );
-	const double *y1line = sat.line( y1 );
+	const auto *y1line = sat.line( y1 );
 	if ( y0 < sat.y1() )
 	{
 		for ( int x = 0; x <= wm1; ++x )
@@ -62,21 +121,21 @@ compute_mean_sat( scanline &dest, int y, const accum_buf &sat, int radius )
 			int nX = x1 - (x0 < 0 ? -1 : x0);
 			double C = 0.0;
 			if ( x0 >= 0 )
-				C = y1line[x0];
-			double D = y1line[x1];
+				C = static_cast<double>( y1line[x0] );
+			double D = static_cast<double>( y1line[x1] );
 			double sum = D - C;
 			dest[x] = static_cast<float>( sum / static_cast<double>( nX * nY ) );
 		}
 	}
 	else
 	{
-		const double *y0line = sat.line( y0 );
+		const auto *y0line = sat.line( y0 );
 		int x1 = std::min( wm1, radius );
 		for ( int x = 0; x <= radius; ++x )
 		{
 			int nX = x1 + 1;
-			double B = y0line[x1];
-			double D = y1line[x1];
+			double B = static_cast<double>( y0line[x1] );
+			double D = static_cast<double>( y1line[x1] );
 			double sum = D - B;
 			dest[x] = static_cast<float>( sum / static_cast<double>( nX * nY ) );
 			x1 = std::min( wm1, x1 + 1 );
@@ -85,10 +144,10 @@ compute_mean_sat( scanline &dest, int y, const accum_buf &sat, int radius )
 		for ( int x = (radius + 1); x <= wm1; ++x, ++x0 )
 		{
 			int nX = x1 - x0;
-			double A = y0line[x0];
-			double B = y0line[x1];
-			double C = y1line[x0];
-			double D = y1line[x1];
+			double A = static_cast<double>( y0line[x0] );
+			double B = static_cast<double>( y0line[x1] );
+			double C = static_cast<double>( y1line[x0] );
+			double D = static_cast<double>( y1line[x1] );
 			double sum = A + D - B - C;
 			dest[x] = static_cast<float>( sum / static_cast<double>( nX * nY ) );
 			x1 = std::min( wm1, x1 + 1 );
@@ -145,8 +204,9 @@ compute_mean( scanline &dest, int y, const plane &p, int radius )
 
 ////////////////////////////////////////
 
+template <typename SAT>
 static void
-compute_variance_sat( scanline &dest, int y, const accum_buf &sat, const accum_buf &sat2, int radius )
+compute_variance_sat( scanline &dest, int y, const SAT &sat, const SAT &sat2, int radius )
 {
 	int wm1 = sat.width() - 1;
 	int y0 = y - radius - 1;
@@ -219,140 +279,345 @@ compute_variance( scanline &dest, int y, const plane &p, int radius )
 
 ////////////////////////////////////////
 
-static void sat_cols( size_t, int s, int e, accum_buf &dest, const plane &p, int power )
+// the summed area table is built in bands of rows, one (or more)
+// per thread. Each band computes a local table with a single pass
+// over its rows (prefix sum along the row, plus the row above), which
+// streams through memory instead of walking the columns. The carry
+// for each band (the sum of the last rows of the bands above) is then
+// added in a second pass.
+inline int
+sat_band_row( int b, int nBands, const plane &p )
 {
-	int dS = dest.stride();
-	int pS = p.stride();
-	int h = dest.height();
-	for ( int x = s; x < e; ++x )
+	return p.y1() + static_cast<int>( ( static_cast<int64_t>( p.height() ) * b ) / nBands );
+}
+
+static void
+sat_row_values( double *out, const float *in, int w, int power )
+{
+	switch ( power )
 	{
-		double sum = 0.0;
-		double *out = dest.data() + ( x - p.x1() );
-		const float *col = p.cdata() + ( x - p.x1() );
-		switch ( power )
+		case 1:
+			for ( int x = 0; x < w; ++x )
+				out[x] = static_cast<double>( in[x] );
+			break;
+		case 2:
+			for ( int x = 0; x < w; ++x )
+			{
+				double v = static_cast<double>( in[x] );
+				out[x] = v * v;
+			}
+			break;
+		case 3:
+			for ( int x = 0; x < w; ++x )
+			{
+				double v = static_cast<double>( in[x] );
+				out[x] = v * v * v;
+			}
+			break;
+		case 4:
+			for ( int x = 0; x < w; ++x )
+			{
+				double v = static_cast<double>( in[x] );
+				v *= v;
+				out[x] = v * v;
+			}
+			break;
+		default:
+			for ( int x = 0; x < w; ++x )
+				out[x] = pow( static_cast<double>( in[x] ), power );
+			break;
+	}
+}
+
+static void sat_bands( size_t, int s, int e, accum_buf &dest, const plane &p, int power, int nBands )
+{
+	int w = p.width();
+	std::vector<double> vals( static_cast<size_t>( w ) );
+	for ( int b = s; b < e; ++b )
+	{
+		int yS = sat_band_row( b, nBands, p );
+		int yE = sat_band_row( b + 1, nBands, p );
+		for ( int y = yS; y < yE; ++y )
 		{
-			case 1:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
-				{
-					sum += static_cast<double>( *col );
-					*out = sum;
-				}
-				break;
-			case 2:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
-				{
-					double cv = static_cast<double>( *col );
-					sum += cv * cv;
-					*out = sum;
-				}
-				break;
-			case 3:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
-				{
-					double cv = static_cast<double>( *col );
-					sum += cv * cv * cv;
-					*out = sum;
-				}
-				break;
-			case 4:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
+			sat_row_values( vals.data(), p.line( y ), w, power );
+			double *out = dest.line( y );
+			double sum = 0.0;
+			if ( y == yS )
+			{
+				for ( int x = 0; x < w; ++x )
 				{
-					double cv = static_cast<double>( *col );
-					sum += cv * cv * cv * cv;
-					*out = sum;
+					sum += vals[static_cast<size_t>( x )];
+					out[x] = sum;
 				}
-				break;
-			default:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
+			}
+			else
+			{
+				const double *prev = dest.line( y - 1 );
+				for ( int x = 0; x < w; ++x )
 				{
-					sum += pow( static_cast<double>( *col ), power );
-					*out = sum;
+					sum += vals[static_cast<size_t>( x )];
+					out[x] = sum + prev[x];
 				}
-				break;
+			}
 		}
 	}
 }
 
-static void sat_rows( size_t, int s, int e, accum_buf &dest )
+static void sat_carry( size_t, int s, int e, accum_buf &dest, const plane &p, const std::vector<double> &carry, int nBands )
 {
-	int w = dest.width();
-	for ( int y = s; y < e; ++y )
+	size_t w = static_cast<size_t>( p.width() );
+	for ( int b = std::max( 1, s ); b < e; ++b )
 	{
-		double *out = dest.line( y );
-		double sum = 0.0;
-		for ( int x = 0; x < w; ++x )
+		const double *c = carry.data() + static_cast<size_t>( b ) * w;
+		int yE = sat_band_row( b + 1, nBands, p );
+		for ( int y = sat_band_row( b, nBands, p ); y < yE; ++y )
 		{
-			sum += out[x];
-			out[x] = sum;
+			double *out = dest.line( y );
+			for ( size_t x = 0; x < w; ++x )
+				out[x] += c[x];
 		}
 	}
 }
 
 // summed area table is p(x,y) + SAT(x-1,y) + SAT(x,y-1) - SAT(x-1,y-1)
 //
-// if you compute a column
+// if you compute a row
 //
-// SAT(x,y) = p(x,y) + SAT(x,y-1)
+// R(x,y) = p(x,y) + R(x-1,y)
 //
-// then you make a horizontal pass, you end up with the summed area
-// table formulation which allows arbitrary window manipulation after
-// for computing windowed sums
+// then add the SAT of the row above, SAT(x,y) = R(x,y) + SAT(x,y-1),
+// you end up with the summed area table formulation which allows
+// arbitrary window manipulation after for computing windowed sums
 static accum_buf
 compute_SAT( const plane &p, int power )
 {
 	accum_buf dest( p.x1(), p.y1(), p.x2(), p.y2() );
-	threading::get().dispatch( std::bind( sat_cols, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ), power ), p.x1(), p.width() );
+	int nBands = std::min( p.height(), static_cast<int>( threading::get().size() ) );
+	threading::get().dispatch( std::bind( sat_bands, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ), power, nBands ), 0, nBands );
 
-	threading::get().dispatch( std::bind( sat_rows, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ) ), p.y1(), dest.height() );
+	if ( nBands > 1 )
+	{
+		size_t w = static_cast<size_t>( p.width() );
+		std::vector<double> carry( w * static_cast<size_t>( nBands ), 0.0 );
+		for ( int b = 1; b < nBands; ++b )
+		{
+			const double *last = dest.line( sat_band_row( b, nBands, p ) - 1 );
+			const double *prevC = carry.data() + static_cast<size_t>( b - 1 ) * w;
+			double *c = carry.data() + static_cast<size_t>( b ) * w;
+			for ( size_t x = 0; x < w; ++x )
+				c[x] = prevC[x] + last[x];
+		}
+		threading::get().dispatch( std::bind( sat_carry, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ), std::cref( carry ), nBands ), 0, nBands );
+	}
 
 	return dest;
 }
 
 ////////////////////////////////////////
 
-static void
-add_histo( size_t tIdx, int s, int e, const plane &p, std::vector<std::vector<uint64_t>> &vals, float lowV, float highV )
+// Kahan compensated float form of the above. Each band keeps a
+// compensation term per column for the running vertical sum, and the
+// compensation of the last row is handed on with the carry, such that
+// the only error is the final rounding of the stored value
+static void sat_bands_float( size_t, int s, int e, plane &dest, const plane &p, int power, int nBands, std::vector<float> &lastComp )
 {
-	std::vector<uint64_t> &histo = vals[tIdx];
-	float binScale = static_cast<float>( histo.size() - 1 );
 	int w = p.width();
-	for ( int y = s; y < e; ++y )
+	size_t sw = static_cast<size_t>( w );
+	std::vector<double> vals( sw );
+	std::vector<float> comp( sw );
+	for ( int b = s; b < e; ++b )
 	{
-		const float *in = p.line( y );
-		for ( int x = 0; x < w; ++x )
+		int yS = sat_band_row( b, nBands, p );
+		int yE = sat_band_row( b + 1, nBands, p );
+		std::fill( comp.begin(), comp.end(), 0.F );
+		for ( int y = yS; y < yE; ++y )
 		{
-			float v = binScale * ( in[x] - lowV ) / ( highV - lowV );
-			size_t idx = static_cast<size_t>( std::max( 0.F, std::min( binScale, v ) ) );
-			++histo[idx];
+			sat_row_values( vals.data(), p.line( y ), w, power );
+			float *out = dest.line( y );
+			const float *prev = y == yS ? nullptr : dest.line( y - 1 );
+			float sum = 0.F, sumC = 0.F;
+			for ( int x = 0; x < w; ++x )
+			{
+				size_t sx = static_cast<size_t>( x );
+				// row prefix
+				float v = static_cast<float>( vals[sx] ) - sumC;
+				float t = sum + v;
+				sumC = ( t - sum ) - v;
+				sum = t;
+				if ( prev )
+				{
+					// column accumulation, compensation of the row
+					// sum is folded into the column term
+					float cv = sum - ( comp[sx] + sumC );
+					float ct = prev[x] + cv;
+					comp[sx] = ( ct - prev[x] ) - cv;
+					out[x] = ct;
+				}
+				else
+				{
+					comp[sx] = sumC;
+					out[x] = sum;
+				}
+			}
 		}
+		std::copy( comp.begin(), comp.end(), lastComp.begin() + static_cast<std::ptrdiff_t>( static_cast<size_t>( b ) * sw ) );
 	}
 }
 
-static std::vector<uint64_t>
-compute_histogram( const plane &p, int bins, float lowV, float highV )
+static void sat_carry_float( size_t, int s, int e, plane &dest, const plane &p, const std::vector<double> &carry, int nBands )
 {
-	size_t n = threading::get().size();
-	std::vector<std::vector<uint64_t>> vals;
-	if ( n > 1 )
+	size_t w = static_cast<size_t>( p.width() );
+	for ( int b = std::max( 1, s ); b < e; ++b )
 	{
-		size_t nThread = threading::get().size();
-		vals.resize( nThread, std::vector<uint64_t>( static_cast<size_t>( bins ), 0 ) );
-		
-		threading::get().dispatch( std::bind( add_histo, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::cref( p ), std::ref( vals ), lowV, highV ), p );
+		const double *c = carry.data() + static_cast<size_t>( b ) * w;
+		int yE = sat_band_row( b + 1, nBands, p );
+		for ( int y = sat_band_row( b, nBands, p ); y < yE; ++y )
+		{
+			float *out = dest.line( y );
+			for ( size_t x = 0; x < w; ++x )
+				out[x] = static_cast<float>( static_cast<double>( out[x] ) + c[x] );
+		}
+	}
+}
 
-		std::vector<uint64_t> &ret = vals[0];
-		for ( size_t i = 1; i < nThread; ++i )
+static plane
+compute_SAT_float( const plane &p, int power )
+{
+	plane dest( p.x1(), p.y1(), p.x2(), p.y2() );
+	size_t w = static_cast<size_t>( p.width() );
+	int nBands = std::min( p.height(), static_cast<int>( threading::get().size() ) );
+	std::vector<float> lastComp( w * static_cast<size_t>( nBands ), 0.F );
+	threading::get().dispatch( std::bind( sat_bands_float, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ), power, nBands, std::ref( lastComp ) ), 0, nBands );
+
+	if ( nBands > 1 )
+	{
+		std::vector<double> carry( w * static_cast<size_t>( nBands ), 0.0 );
+		for ( int b = 1; b < nBands; ++b )
 		{
-			const std::vector<uint64_t> &cur = vals[i];
-			for ( size_t b = 0; b != static_cast<size_t>( bins ); ++b )
-				ret[b] += cur[b];
+			const float *last = dest.line( sat_band_row( b, nBands, p ) - 1 );
+			const float *lastC = lastComp.data() + static_cast<size_t>( b - 1 ) * w;
+			const double *prevC = carry.data() + static_cast<size_t>( b - 1 ) * w;
+			double *c = carry.data() + static_cast<size_t>( b ) * w;
+			for ( size_t x = 0; x < w; ++x )
+				c[x] = prevC[x] + static_cast<double>( last[x] ) - static_cast<double>( lastC[x] );
 		}
+		threading::get().dispatch( std::bind( sat_carry_float, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ), std::cref( carry ), nBands ), 0, nBands );
+	}
+
+	return dest;
+}
+
+////////////////////////////////////////
+
+inline size_t
+histo_bin( float v, float lowV, float scale, float binMax )
+{
+	return static_cast<size_t>( std::max( 0.F, std::min( binMax, ( v - lowV ) * scale ) ) );
+}
+
+static std::vector<uint64_t>
+compute_histogram( const plane &p, int bins, float lowV, float highV )
+{
+	precondition( bins > 0, "Invalid number of histogram bins {0}", bins );
+	const float binMax = static_cast<float>( bins - 1 );
+	const float scale = highV > lowV ? binMax / ( highV - lowV ) : 0.F;
+	return reduce_rows( p, std::vector<uint64_t>( static_cast<size_t>( bins ), 0 ),
+		[=]( std::vector<uint64_t> &histo, const float *line, int w )
+		{
+			uint64_t *h = histo.data();
+			for ( int x = 0; x < w; ++x )
+				++h[histo_bin( line[x], lowV, scale, binMax )];
+		},
+		[]( std::vector<uint64_t> &a, const std::vector<uint64_t> &b )
+		{
+			for ( size_t i = 0, N = a.size(); i != N; ++i )
+				a[i] += b[i];
+		} );
+}
+
+////////////////////////////////////////
+
+// exact percentiles, linearly interpolated between the closest ranks.
+// A fine histogram over the range of the plane locates the bin
+// containing each rank, and then a second pass gathers only the
+// values in those bins for a partial sort, such that the memory used
+// is proportional to the contents of the bins of interest, not the
+// plane
+static std::vector<float>
+compute_percentiles( const plane &p, const std::vector<float> &pcts )
+{
+	const int kBins = 16384;
+	plane_summary ps = summarize_plane( p );
+	std::vector<float> ret( pcts.size(), ps.min_value );
+	if ( ps.count == 0 || ! ( ps.max_value > ps.min_value ) )
 		return ret;
+
+	const float lowV = ps.min_value;
+	const float binMax = static_cast<float>( kBins - 1 );
+	const float scale = binMax / ( ps.max_value - ps.min_value );
+	std::vector<uint64_t> histo = compute_histogram( p, kBins, lowV, ps.max_value );
+	std::vector<uint64_t> cum( histo.size() + 1, 0 );
+	for ( size_t i = 0; i != histo.size(); ++i )
+		cum[i + 1] = cum[i] + histo[i];
+
+	// the ranks needed, and the bins they are in
+	const uint64_t lastRank = ps.count - 1;
+	std::vector<uint64_t> ranks;
+	for ( float q: pcts )
+	{
+		double pos = std::max( 0.0, std::min( 1.0, static_cast<double>( q ) / 100.0 ) ) * static_cast<double>( lastRank );
+		uint64_t r0 = static_cast<uint64_t>( pos );
+		ranks.push_back( r0 );
+		ranks.push_back( std::min( lastRank, r0 + 1 ) );
+	}
+	std::vector<size_t> binOf( ranks.size() );
+	std::vector<size_t> wanted;
+	for ( size_t i = 0; i != ranks.size(); ++i )
+	{
+		size_t b = static_cast<size_t>( std::upper_bound( cum.begin(), cum.end(), ranks[i] ) - cum.begin() ) - 1;
+		binOf[i] = b;
+		wanted.push_back( b );
 	}
+	std::sort( wanted.begin(), wanted.end() );
+	wanted.erase( std::unique( wanted.begin(), wanted.end() ), wanted.end() );
 
-	vals.resize( 1, std::vector<uint64_t>( static_cast<size_t>( bins ), 0 ) );
-	add_histo( 0, p.y1(), p.y2(), p, vals, lowV, highV );
-	return vals[0];
+	std::vector<int> slot( static_cast<size_t>( kBins ), -1 );
+	for ( size_t i = 0; i != wanted.size(); ++i )
+		slot[wanted[i]] = static_cast<int>( i );
+
+	std::vector<std::vector<float>> vals = reduce_rows( p, std::vector<std::vector<float>>( wanted.size() ),
+		[&]( std::vector<std::vector<float>> &v, const float *line, int w )
+		{
+			for ( int x = 0; x < w; ++x )
+			{
+				int s = slot[histo_bin( line[x], lowV, scale, binMax )];
+				if ( s >= 0 )
+					v[static_cast<size_t>( s )].push_back( line[x] );
+			}
+		},
+		[]( std::vector<std::vector<float>> &a, const std::vector<std::vector<float>> &b )
+		{
+			for ( size_t i = 0; i != a.size(); ++i )
+				a[i].insert( a[i].end(), b[i].begin(), b[i].end() );
+		} );
+
+	auto rankValue = [&]( size_t i )
+	{
+		std::vector<float> &bv = vals[static_cast<size_t>( slot[binOf[i]] )];
+		size_t local = static_cast<size_t>( ranks[i] - cum[binOf[i]] );
+		std::nth_element( bv.begin(), bv.begin() + static_cast<std::ptrdiff_t>( local ), bv.end() );
+		return bv[local];
+	};
+
+	for ( size_t i = 0; i != pcts.size(); ++i )
+	{
+		double pos = std::max( 0.0, std::min( 1.0, static_cast<double>( pcts[i] ) / 100.0 ) ) * static_cast<double>( lastRank );
+		double t = pos - static_cast<double>( ranks[i * 2] );
+		float v0 = rankValue( i * 2 );
+		float v1 = rankValue( i * 2 + 1 );
+		ret[i] = static_cast<float>( static_cast<double>( v0 ) + t * ( static_cast<double>( v1 ) - static_cast<double>( v0 ) ) );
+	}
+	return ret;
 }
 
 ////////////////////////////////////////
@@ -484,6 +749,64 @@ compute_ssim( scanline &dest, int y, const plane &p, const plane &p2, int radius
 	}
 }
 
+
+////////////////////////////////////////
+
+// box windowed form of the above, where all the window sums come
+// from summed area tables of x, y, x^2, y^2 and xy
+static void
+compute_ssim_sat( scanline &dest, int y, const accum_buf &sx, const accum_buf &sy, const accum_buf &sxx, const accum_buf &syy, const accum_buf &sxy, int radius, const float L, const float k1, const float k2 )
+{
+	const double c1 = static_cast<double>( ( k1 * L ) * ( k1 * L ) );
+	const double c2 = static_cast<double>( ( k2 * L ) * ( k2 * L ) );
+	int wm1 = sx.width() - 1;
+	int y0 = y - radius - 1;
+	int y1 = std::max( sx.y1(), std::min( sx.y2(), y + radius ) );
+	int nY = y1 - (y0 < sx.y1() ? -1 : y0 );
+	auto boxSum = [&]( const accum_buf &sat, int x0, int x1 )
+	{
+		const double *y1line = sat.line( y1 );
+		double r = y1line[x1];
+		if ( x0 >= 0 )
+			r -= y1line[x0];
+		if ( y0 >= sat.y1() )
+		{
+			const double *y0line = sat.line( y0 );
+			r -= y0line[x1];
+			if ( x0 >= 0 )
+				r += y0line[x0];
+		}
+		return r;
+	};
+
+	for ( int x = 0; x <= wm1; ++x )
+	{
+		int x0 = x - radius - 1;
+		int x1 = std::max( int(0), std::min( wm1, x + radius ) );
+		int nX = x1 - (x0 < 0 ? -1 : x0);
+		double norm = 1.0 / static_cast<double>( nX * nY );
+		double ave1 = boxSum( sx, x0, x1 ) * norm;
+		double ave2 = boxSum( sy, x0, x1 ) * norm;
+		double var1 = std::max( 0.0, boxSum( sxx, x0, x1 ) * norm - ave1 * ave1 );
+		double var2 = std::max( 0.0, boxSum( syy, x0, x1 ) * norm - ave2 * ave2 );
+		double cov = boxSum( sxy, x0, x1 ) * norm - ave1 * ave2;
+
+		double num1 = ( 2.0 * ave1 * ave2 + c1 );
+		double num2 = ( 2.0 * cov + c2 );
+		double den1 = ( ave1*ave1 + ave2*ave2 + c1 );
+		double den2 = ( var1 + var2 + c2 );
+		double den = den1 * den2;
+		double ssval;
+		if ( den > 0.0 )
+			ssval = num1 * num2 / den;
+		else if ( den1 > 0.0 )
+			ssval = num1 / den1;
+		else
+			ssval = 1.0;
+		dest[x] = static_cast<float>( ssval );
+	}
+}
+
 }
 
 ////////////////////////////////////////
@@ -496,23 +819,29 @@ namespace image
 TODO( "check breakover point where local ops are worth the summed area table optimization" )
 
 plane
-local_mean( const plane &p, int radius )
+local_mean( const plane &p, int radius, sat_storage s )
 {
 	// worth the extra buffer?
 	if ( radius < 2 )
 		return plane( "p.local_mean", p.dims(), p, radius );
 
+	if ( s == sat_storage::COMPENSATED_FLOAT )
+		return plane( "p.local_mean_fsat", p.dims(), sum_area_table_float( p, 1 ), radius );
+
 	return local_mean( sum_area_table( p, 1 ), radius );
 }
 
 ////////////////////////////////////////
 
 plane
-local_variance( const plane &p, int radius )
+local_variance( const plane &p, int radius, sat_storage s )
 {
 	if ( radius < 2 )
 		return plane( "p.local_variance", p.dims(), p, radius );
 
+	if ( s == sat_storage::COMPENSATED_FLOAT )
+		return plane( "p.local_variance_fsat", p.dims(), sum_area_table_float( p, 1 ), sum_area_table_float( p, 2 ), radius );
+
 	return local_variance( sum_area_table( p, 1 ), sum_area_table( p, 2 ), radius );
 }
 
@@ -549,19 +878,38 @@ sum_area_table( const plane &p, int power )
 ////////////////////////////////////////
 
 plane
-mse( const plane &p, const plane &p2, int radius )
+sum_area_table_float( const plane &p, int power )
+{
+	return plane( "p.sum_area_table_float", p.dims(), p, power );
+}
+
+////////////////////////////////////////
+
+plane
+mse( const plane &p, const plane &p2, int radius, sat_storage s )
 {
 	precondition( p.dims() == p2.dims(), "unable to compute MSE for planes of different sizes" );
-	return plane( "p.mean_square_error", p.dims(), p, p2, radius );
+	if ( radius < 2 )
+		return plane( "p.mean_square_error", p.dims(), p, p2, radius );
+
+	// local mean of the squared difference
+	plane diff = p - p2;
+	if ( s == sat_storage::COMPENSATED_FLOAT )
+		return plane( "p.local_mean_fsat", p.dims(), sum_area_table_float( diff, 2 ), radius );
+
+	return local_mean( sum_area_table( diff, 2 ), radius );
 }
 
 ////////////////////////////////////////
 
 plane
-ssim( const plane &p, const plane &p2, int radius, float L, float k1, float k2 )
+ssim( const plane &p, const plane &p2, int radius, float L, float k1, float k2, float sigma )
 {
 	precondition( p.dims() == p2.dims(), "unable to compute SSIM for planes of different sizes" );
-	return plane( "p.ssim", p.dims(), p, p2, radius, L, k1, k2 );
+	if ( sigma == 0.F )
+		return plane( "p.ssim_sat", p.dims(), sum_area_table( p, 1 ), sum_area_table( p2, 1 ), sum_area_table( p, 2 ), sum_area_table( p2, 2 ), sum_area_table( p * p2, 1 ), radius, L, k1, k2 );
+
+	return plane( "p.ssim", p.dims(), p, p2, radius, L, k1, k2, sigma );
 }
 
 ////////////////////////////////////////
@@ -580,6 +928,30 @@ histogram( const plane &p, int bins, float lowV, float highV )
 
 ////////////////////////////////////////
 
+engine::computed_value<plane_summary>
+summarize( const plane &p )
+{
+	engine::dimensions d;
+	d.bytes_per_item = static_cast<engine::dimensions::value_type>( sizeof(plane_summary) );
+	return engine::computed_value<plane_summary>( op_registry(), "p.summarize", d, p );
+}
+
+////////////////////////////////////////
+
+engine::computed_value<std::vector<float>>
+percentiles( const plane &p, const std::vector<float> &pcts )
+{
+	engine::dimensions d;
+	d.x1 = 0;
+	d.y1 = 0;
+	d.x2 = static_cast<engine::dimensions::value_type>( pcts.size() ) - 1;
+	d.y2 = 0;
+	d.bytes_per_item = static_cast<engine::dimensions::value_type>( sizeof(float) );
+	return engine::computed_value<std::vector<float>>( op_registry(), "p.percentiles", d, p, pcts );
+}
+
+////////////////////////////////////////
+
 void
 add_plane_stats( engine::registry &r )
 {
@@ -587,11 +959,17 @@ add_plane_stats( engine::registry &r )
 
 	r.add( op( "p.sum", sum_plane, op::threaded ) );
 	r.add( op( "p.sum_area_table", base::choose_runtime( compute_SAT, { { base::cpu::simd_feature::SSE3, sse3::compute_SAT } } ), op::threaded ) );
+	r.add( op( "p.sum_area_table_float", compute_SAT_float, op::threaded ) );
+	r.add( op( "p.summarize", summarize_plane, op::threaded ) );
 	r.add( op( "p.histogram", compute_histogram, op::threaded ) );
+	r.add( op( "p.percentiles", compute_percentiles, op::threaded ) );
 
 	// methods using the summed area table
-	r.add( op( "p.local_mean_sat", base::choose_runtime( compute_mean_sat ), n_scanline_plane_adapter<false, decltype(compute_mean_sat)>(), dispatch_scan_processing, op::n_to_one ) );
-	r.add( op( "p.local_variance_sat", base::choose_runtime( compute_variance_sat ), n_scanline_plane_adapter<false, decltype(compute_variance_sat)>(), dispatch_scan_processing, op::n_to_one ) );
+	r.add( op( "p.local_mean_sat", base::choose_runtime( compute_mean_sat<accum_buf> ), n_scanline_plane_adapter<false, decltype(compute_mean_sat<accum_buf>)>(), dispatch_scan_processing, op::n_to_one ) );
+	r.add( op( "p.local_variance_sat", base::choose_runtime( compute_variance_sat<accum_buf> ), n_scanline_plane_adapter<false, decltype(compute_variance_sat<accum_buf>)>(), dispatch_scan_processing, op::n_to_one ) );
+	r.add( op( "p.local_mean_fsat", base::choose_runtime( compute_mean_sat<plane> ), n_scanline_plane_adapter<false, decltype(compute_mean_sat<plane>)>(), dispatch_scan_processing, op::n_to_one ) );
+	r.add( op( "p.local_variance_fsat", base::choose_runtime( compute_variance_sat<plane> ), n_scanline_plane_adapter<false, decltype(compute_variance_sat<plane>)>(), dispatch_scan_processing, op::n_to_one ) );
+	r.add( op( "p.ssim_sat", base::choose_runtime( compute_ssim_sat ), n_scanline_plane_adapter<false, decltype(compute_ssim_sat)>(), dispatch_scan_processing, op::n_to_one ) );
 
 	r.add( op( "p.local_mean", base::choose_runtime( compute_mean ), n_scanline_plane_adapter<false, decltype(compute_mean)>(), dispatch_scan_processing, op::n_to_one ) );
 	r.add( op( "p.local_variance", base::choose_runtime( compute_variance ), n_scanline_plane_adapter<false, decltype(compute_variance)>(), dispatch_scan_processing, op::n_to_one ) );
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <base/contract.h>
+#include <limits>
 #include "plane.h"
 #include "accum_buf.h"
 #include "op_registry.h"
@@ -31,30 +32,64 @@ inline engine::computed_value<double> sum( plane &&p )
 	return engine::computed_value<double>( op_registry(), "p.sum", d, std::move( p ) );
 }
 
+/// Storage used for the summed area tables behind the local operators
+enum class sat_storage : int
+{
+	DOUBLE, ///< double accumulation and storage
+	COMPENSATED_FLOAT ///< Kahan compensated float accumulation and storage, half the memory, but precision decreases as the sums grow, so best suited to smaller planes
+};
+
 // TODO: combine these into one local operator (mean/variance/skewness/kurtosis)?
-plane local_mean( const plane &p, int radius );
-plane local_variance( const plane &p, int radius );
+plane local_mean( const plane &p, int radius, sat_storage s = sat_storage::DOUBLE );
+plane local_variance( const plane &p, int radius, sat_storage s = sat_storage::DOUBLE );
 
 /// scales the plane coming in as the power provided, so 1 gives the
 /// SAT of just p, 2 gives the square, 3 and 4 can give skewness and
 /// kurtosis
 accum_buf sum_area_table( const plane &p, int power );
+/// float storage form of sum_area_table (see sat_storage::COMPENSATED_FLOAT)
+plane sum_area_table_float( const plane &p, int power );
 
 /// Summed Area Table optimized form of local mean
 plane local_mean( const accum_buf &sat, int radius );
 /// Summed Area Table optimized form of local variance
 plane local_variance( const accum_buf &sat, const accum_buf &sat2, int radius );
 
-plane mse( const plane &p1, const plane &p2, int radius );
+/// local mean of the squared difference of the two planes
+plane mse( const plane &p1, const plane &p2, int radius, sat_storage s = sat_storage::DOUBLE );
 /// Computes structured similarity
-/// if sigma is negative, it auto computes it based on the radius
+/// if sigma is negative, it auto computes it based on the radius, if
+/// sigma is 0, an unweighted (box) window is used, which is computed
+/// using summed area tables
 plane ssim( const plane &p1, const plane &p2, int radius, float L = 1.f, float k1 = 0.01f, float k2 = 0.03f, float sigma = -1.f );
 
+/// Summary statistics of a plane
+struct plane_summary
+{
+	uint64_t count = 0;
+	double sum = 0.0;
+	double mean = 0.0;
+	/// sample (n - 1) variance
+	double variance = 0.0;
+	/// sum of squared differences from the mean, used to merge partial summaries
+	double m2 = 0.0;
+	float min_value = std::numeric_limits<float>::max();
+	float max_value = std::numeric_limits<float>::lowest();
+};
+
+/// Computes the count, sum, min, max, mean and variance of the plane
+/// in one (parallel) pass
+engine::computed_value<plane_summary> summarize( const plane &p );
+
 /// Computes a histogram of the plane
 ///
 /// pre-normalizes based on the low/high range and then computes bins
 engine::computed_value<std::vector<uint64_t>> histogram( const plane &p, int bins, float lowVal, float highVal );
 
+/// Computes the (exact) percentiles of the plane values, so 50 is the
+/// median, interpolating between the closest ranks
+engine::computed_value<std::vector<float>> percentiles( const plane &p, const std::vector<float> &pcts );
+
 void add_plane_stats( engine::registry &r );
 
 } // namespace image
@@ -0,0 +1,221 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "resample.h"
+#include <base/contract.h>
+#include <engine/types.h>
+#include <cmath>
+#include <list>
+#include <mutex>
+
+////////////////////////////////////////
+
+namespace
+{
+
+typedef double (*filter_func)( double );
+
+inline double
+sinc( double x )
+{
+	if ( std::abs( x ) < 1e-8 )
+		return 1.0;
+	x *= M_PI;
+	return sin( x ) / x;
+}
+
+inline double
+bc_cubic( double x, double B, double C )
+{
+	x = std::abs( x );
+	double x2 = x * x;
+	double x3 = x2 * x;
+	if ( x < 1.0 )
+		return ( ( 12.0 - 9.0 * B - 6.0 * C ) * x3 + ( -18.0 + 12.0 * B + 6.0 * C ) * x2 + ( 6.0 - 2.0 * B ) ) / 6.0;
+	if ( x < 2.0 )
+		return ( ( -B - 6.0 * C ) * x3 + ( 6.0 * B + 30.0 * C ) * x2 + ( -12.0 * B - 48.0 * C ) * x + ( 8.0 * B + 24.0 * C ) ) / 6.0;
+	return 0.0;
+}
+
+double triangle_filter( double x ) { x = std::abs( x ); return x < 1.0 ? 1.0 - x : 0.0; }
+double gaussian_filter( double x ) { return exp( -2.0 * x * x ); }
+double mitchell_filter( double x ) { return bc_cubic( x, 1.0 / 3.0, 1.0 / 3.0 ); }
+double catmull_rom_filter( double x ) { return bc_cubic( x, 0.0, 0.5 ); }
+double lanczos2_filter( double x ) { return std::abs( x ) < 2.0 ? sinc( x ) * sinc( x / 2.0 ) : 0.0; }
+double lanczos3_filter( double x ) { return std::abs( x ) < 3.0 ? sinc( x ) * sinc( x / 3.0 ) : 0.0; }
+
+struct filter_def
+{
+	const char *name;
+	double radius;
+	// box filter is null, and computed as the area of overlap
+	filter_func func;
+};
+
+const filter_def theFilters[] =
+{
+	{ "box", 0.5, nullptr },
+	{ "area", 0.5, nullptr },
+	{ "triangle", 1.0, triangle_filter },
+	{ "tent", 1.0, triangle_filter },
+	{ "gaussian", 2.0, gaussian_filter },
+	{ "mitchell", 2.0, mitchell_filter },
+	{ "catmull-rom", 2.0, catmull_rom_filter },
+	{ "catmullrom", 2.0, catmull_rom_filter },
+	{ "lanczos2", 2.0, lanczos2_filter },
+	{ "lanczos3", 3.0, lanczos3_filter },
+	{ "lanczos", 3.0, lanczos3_filter }
+};
+
+const filter_def *
+find_filter( const std::string &name )
+{
+	for ( const filter_def &f: theFilters )
+	{
+		if ( name == f.name )
+			return &f;
+	}
+	return nullptr;
+}
+
+struct weight_cache_entry
+{
+	engine::hash::value key;
+	std::shared_ptr<const image::resample_weights> weights;
+};
+
+std::mutex theWeightMutex;
+std::list<weight_cache_entry> theWeights;
+// a pyramid of a few sizes in both directions, for a handful of
+// filters, fits comfortably
+static const size_t kMaxCachedWeights = 64;
+
+}
+
+////////////////////////////////////////
+
+namespace image
+{
+
+////////////////////////////////////////
+
+resample_weights::resample_weights( const std::string &filter, int inSize, int outSize )
+	: _in_size( inSize ), _out_size( outSize )
+{
+	precondition( inSize > 0 && outSize > 0, "Invalid resample sizes {0} -> {1}", inSize, outSize );
+	const filter_def *fd = find_filter( filter );
+	precondition( fd, "Unknown resample filter '{0}'", filter );
+
+	// the filter is stretched when downsampling so it also band
+	// limits the input
+	const double scale = static_cast<double>( inSize ) / static_cast<double>( outSize );
+	const double fscale = std::max( 1.0, scale );
+	const double support = fd->radius * fscale;
+	// a box overlaps the half pixel either side of the support
+	const double ext = fd->func ? 0.0 : 0.5;
+
+	auto center = [=]( int i ) { return ( static_cast<double>( i ) + 0.5 ) * scale - 0.5; };
+	auto left = [=]( double c ) { return static_cast<int>( floor( c - support - ext ) ) + 1; };
+	auto right = [=]( double c ) { return static_cast<int>( ceil( c + support + ext ) ) - 1; };
+
+	int nTaps = 1;
+	for ( int i = 0; i < outSize; ++i )
+	{
+		double c = center( i );
+		nTaps = std::max( nTaps, right( c ) - left( c ) + 1 );
+	}
+	_taps = std::min( inSize, ( nTaps + 3 ) & ~3 );
+
+	const size_t nT = static_cast<size_t>( _taps );
+	_start.resize( static_cast<size_t>( outSize ) );
+	_weights.resize( static_cast<size_t>( outSize ) * nT );
+	std::vector<double> w( nT );
+	for ( int i = 0; i < outSize; ++i )
+	{
+		double c = center( i );
+		int l = left( c );
+		int r = right( c );
+		int s = std::max( 0, std::min( l, inSize - _taps ) );
+
+		std::fill( w.begin(), w.end(), 0.0 );
+		double sum = 0.0;
+		for ( int j = l; j <= r; ++j )
+		{
+			double v;
+			if ( fd->func )
+				v = fd->func( ( static_cast<double>( j ) - c ) / fscale );
+			else
+			{
+				double lo = std::max( static_cast<double>( j ) - 0.5, c - support );
+				double hi = std::min( static_cast<double>( j ) + 0.5, c + support );
+				v = std::max( 0.0, hi - lo );
+			}
+			// the edge samples are repeated
+			int jj = std::max( 0, std::min( inSize - 1, j ) );
+			w[static_cast<size_t>( jj - s )] += v;
+			sum += v;
+		}
+
+		float *out = _weights.data() + static_cast<size_t>( i ) * nT;
+		if ( std::abs( sum ) < 1e-12 )
+		{
+			int jj = std::max( 0, std::min( inSize - 1, static_cast<int>( floor( c + 0.5 ) ) ) );
+			std::fill( w.begin(), w.end(), 0.0 );
+			w[static_cast<size_t>( jj - s )] = 1.0;
+			sum = 1.0;
+		}
+		for ( size_t t = 0; t != nT; ++t )
+			out[t] = static_cast<float>( w[t] / sum );
+		_start[static_cast<size_t>( i )] = s;
+	}
+}
+
+////////////////////////////////////////
+
+bool
+resample_weights::is_filter( const std::string &filter )
+{
+	return find_filter( filter ) != nullptr;
+}
+
+////////////////////////////////////////
+
+std::shared_ptr<const resample_weights>
+resample_weights::get( const std::string &filter, int inSize, int outSize )
+{
+	engine::hash h;
+	h << filter << inSize << outSize;
+	engine::hash::value hv = h.finish();
+
+	{
+		std::lock_guard<std::mutex> lk( theWeightMutex );
+		for ( auto i = theWeights.begin(); i != theWeights.end(); ++i )
+		{
+			if ( i->key == hv )
+			{
+				// move to the front for lru behavior
+				theWeights.splice( theWeights.begin(), theWeights, i );
+				return theWeights.front().weights;
+			}
+		}
+	}
+
+	std::shared_ptr<const resample_weights> r = std::make_shared<resample_weights>( filter, inSize, outSize );
+
+	std::lock_guard<std::mutex> lk( theWeightMutex );
+	theWeights.push_front( weight_cache_entry{ hv, r } );
+	while ( theWeights.size() > kMaxCachedWeights )
+		theWeights.pop_back();
+	return r;
+}
+
+////////////////////////////////////////
+
+} // image
+
+
+
@@ -0,0 +1,76 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////
+
+namespace image
+{
+
+///
+/// @brief Class resample_weights holds the precomputed filter taps
+/// for resampling one dimension from an input size to an output size.
+///
+/// Every output sample has the same number of taps, taken from a
+/// contiguous window of the input that lies entirely inside the
+/// input, with the edge samples repeated by folding the out of range
+/// taps into the first / last weights. This allows the apply loops to
+/// run without any bounds checks. When downsampling, the filter is
+/// stretched by the scale factor so it also acts as the pre-filter.
+///
+/// Supported filters are:
+///   - box (or area): area average of the input covered by the output
+///   - triangle (or tent)
+///   - gaussian: sigma of 0.5, truncated at 2
+///   - mitchell: Mitchell-Netravali cubic (B = C = 1/3)
+///   - catmull-rom: cubic (B = 0, C = 0.5)
+///   - lanczos2, lanczos3 (or lanczos)
+///
+class resample_weights
+{
+public:
+	resample_weights( const std::string &filter, int inSize, int outSize );
+
+	inline int in_size( void ) const { return _in_size; }
+	inline int out_size( void ) const { return _out_size; }
+	/// number of taps for each output sample. When there are enough
+	/// input samples, this is a multiple of 4 (with zero weights to pad)
+	inline int taps( void ) const { return _taps; }
+
+	/// first input sample for output sample i
+	inline int start( int i ) const { return _start[static_cast<size_t>( i )]; }
+	/// taps() weights for output sample i
+	inline const float *weights( int i ) const { return _weights.data() + static_cast<size_t>( i ) * static_cast<size_t>( _taps ); }
+
+	/// returns true if the filter name is one of the supported filters
+	static bool is_filter( const std::string &filter );
+
+	/// returns the shared weight table for the provided filter and
+	/// sizes, creating it if needed. The most recently used tables
+	/// are cached by a hash of the parameters, so repeated resizes
+	/// (i.e. the planes of an image, or each frame of a sequence)
+	/// only compute them once. Look the table up once per plane
+	/// rather than per scanline, as this takes a global lock
+	static std::shared_ptr<const resample_weights> get( const std::string &filter, int inSize, int outSize );
+
+private:
+	int _in_size;
+	int _out_size;
+	int _taps = 0;
+	std::vector<int> _start;
+	std::vector<float> _weights;
+};
+
+} // namespace image
+
+
+
@@ -13,6 +13,7 @@
 #include "plane_ops.h"
 #include "scanline_process.h"
 #include "threading.h"
+#include <limits>
 
 ////////////////////////////////////////
 
@@ -29,7 +30,7 @@ apply_erode( scanline &dest, int y, const plane &p, int radius )
 
 	for ( int x = 0, w = dest.width(); x < w; ++x )
 	{
-		float minV = dest[x];
+		float minV = std::numeric_limits<float>::max();
 		for ( int cy = y - radius; cy <= y + radius; ++cy )
 		{
 			if ( cy < p.y1() || cy > p.y2() )
@@ -38,7 +39,7 @@ apply_erode( scanline &dest, int y, const plane &p, int radius )
 			const float *inP = p.line( cy );
 			for ( int cx = x - radius; cx <= x + radius; ++cx )
 			{
-				if ( cx < 0 || cy >= maxx )
+				if ( cx < 0 || cx > maxx )
 					continue;
 
 				minV = std::min( minV, inP[cx] );
@@ -57,7 +58,7 @@ apply_dilate( scanline &dest, int y, const plane &p, int radius )
 
 	for ( int x = 0, w = dest.width(); x < w; ++x )
 	{
-		float maxV = dest[x];
+		float maxV = std::numeric_limits<float>::lowest();
 		for ( int cy = y - radius; cy <= y + radius; ++cy )
 		{
 			if ( cy < p.y1() || cy > p.y2() )
@@ -66,7 +67,7 @@ apply_dilate( scanline &dest, int y, const plane &p, int radius )
 			const float *inP = p.line( cy );
 			for ( int cx = x - radius; cx <= x + radius; ++cx )
 			{
-				if ( cx < 0 || cy >= maxx )
+				if ( cx < 0 || cx > maxx )
 					continue;
 
 				maxV = std::max( maxV, inP[cx] );
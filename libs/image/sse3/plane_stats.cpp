@@ -26,132 +26,124 @@ using namespace image;
 
 ////////////////////////////////////////
 
-static void sat_cols1( size_t, int s, int e, accum_buf &dest, const plane &p )
+inline int
+sat_band_row( int b, int nBands, const plane &p )
 {
-	int dS = dest.stride();
-	int pS = p.stride();
-	int h = dest.height();
+	return p.y1() + static_cast<int>( ( static_cast<int64_t>( p.height() ) * b ) / nBands );
+}
 
-	// we aren't using x for direct access, convert to 0 basis for
-	// easier math
-	s = s - dest.x1();
-	e = e - dest.x1();
+////////////////////////////////////////
 
-	int x = s;
-	while ( x < e )
+// adds the in-register prefix sum of 4 values (as 2 pairs) to the
+// running sum (both lanes), and the row above, returning the new
+// running sum
+inline __m128d
+prefix4( double *out, const double *prev, __m128d lo, __m128d hi, __m128d run )
+{
+	const __m128d zed = _mm_setzero_pd();
+	// { a, a + b }, { c, c + d }
+	lo = _mm_add_pd( lo, _mm_unpacklo_pd( zed, lo ) );
+	hi = _mm_add_pd( hi, _mm_unpacklo_pd( zed, hi ) );
+	hi = _mm_add_pd( hi, _mm_unpackhi_pd( lo, lo ) );
+	lo = _mm_add_pd( lo, run );
+	hi = _mm_add_pd( hi, run );
+	run = _mm_unpackhi_pd( hi, hi );
+	if ( prev )
 	{
-		if ( x % 4 == 0 && ( x + 4 ) < e )
-		{
-			__m128d sumL = _mm_setzero_pd();
-			__m128d sumH = _mm_setzero_pd();
-			double *out = dest.data() + x;
-			const float *col = p.cdata() + x;
-			for ( int c = 0; c < h; ++c, out += dS, col += pS )
-			{
-				__m128 inV = _mm_load_ps( col );
-				__m128d loV = _mm_cvtps_pd( inV );
-				__m128d hiV = _mm_cvtps_pd( _mm_movehl_ps( inV, inV ) );
-				sumL = _mm_add_pd( sumL, loV );
-				sumH = _mm_add_pd( sumH, hiV );
-				_mm_store_pd( out, sumL );
-				_mm_store_pd( out + 2, sumH );
-			}
-			x += 4;
-		}
-		else
-		{
-			double sum = 0.0;
-			double *out = dest.data() + x;
-			const float *col = p.cdata() + x;
-			for ( int c = 0; c < h; ++c, out += dS, col += pS )
-			{
-				sum += static_cast<double>( *col );
-				*out = sum;
-			}
-			++x;
-		}
+		lo = _mm_add_pd( lo, _mm_loadu_pd( prev ) );
+		hi = _mm_add_pd( hi, _mm_loadu_pd( prev + 2 ) );
 	}
+	_mm_storeu_pd( out, lo );
+	_mm_storeu_pd( out + 2, hi );
+	return run;
 }
 
 ////////////////////////////////////////
 
-static void sat_cols( size_t, int s, int e, accum_buf &dest, const plane &p, int power )
+static void sat_bands( size_t, int s, int e, accum_buf &dest, const plane &p, int power, int nBands )
 {
-	int dS = dest.stride();
-	int pS = p.stride();
-	int h = dest.height();
-	// we aren't using x for direct access, convert to 0 basis for
-	// easier math
-	s = s - dest.x1();
-	e = e - dest.x1();
-
-	for ( int x = s; x < e; ++x )
+	const int w = p.width();
+	std::vector<double> vals;
+	if ( power > 2 )
+		vals.resize( static_cast<size_t>( w ) );
+
+	for ( int b = s; b < e; ++b )
 	{
-		double sum = 0.0;
-		double *out = dest.data() + x;
-		const float *col = p.cdata() + x;
-		switch ( power )
+		int yS = sat_band_row( b, nBands, p );
+		int yE = sat_band_row( b + 1, nBands, p );
+		for ( int y = yS; y < yE; ++y )
 		{
-			case 1:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
-				{
-					sum += static_cast<double>( *col );
-					*out = sum;
-				}
-				break;
-			case 2:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
-				{
-					double cv = static_cast<double>( *col );
-					sum += cv * cv;
-					*out = sum;
-				}
-				break;
-			case 3:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
-				{
-					double cv = static_cast<double>( *col );
-					sum += cv * cv * cv;
-					*out = sum;
-				}
-				break;
-			case 4:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
-				{
-					double cv = static_cast<double>( *col );
-					sum += cv * cv * cv * cv;
-					*out = sum;
-				}
-				break;
-			default:
-				for ( int c = 0; c < h; ++c, out += dS, col += pS )
-				{
-					sum += pow( static_cast<double>( *col ), power );
-					*out = sum;
-				}
-				break;
+			const float *in = p.line( y );
+			double *out = dest.line( y );
+			const double *prev = y == yS ? nullptr : dest.line( y - 1 );
+			__m128d run = _mm_setzero_pd();
+			int x = 0;
+			switch ( power )
+			{
+				case 1:
+					for ( ; ( x + 4 ) <= w; x += 4 )
+					{
+						__m128 inV = _mm_loadu_ps( in + x );
+						run = prefix4( out + x, prev ? prev + x : nullptr,
+									   _mm_cvtps_pd( inV ),
+									   _mm_cvtps_pd( _mm_movehl_ps( inV, inV ) ),
+									   run );
+					}
+					break;
+				case 2:
+					for ( ; ( x + 4 ) <= w; x += 4 )
+					{
+						__m128 inV = _mm_loadu_ps( in + x );
+						__m128d lo = _mm_cvtps_pd( inV );
+						__m128d hi = _mm_cvtps_pd( _mm_movehl_ps( inV, inV ) );
+						run = prefix4( out + x, prev ? prev + x : nullptr,
+									   _mm_mul_pd( lo, lo ), _mm_mul_pd( hi, hi ),
+									   run );
+					}
+					break;
+				default:
+					for ( int i = 0; i < w; ++i )
+						vals[static_cast<size_t>( i )] = pow( static_cast<double>( in[i] ), power );
+					for ( ; ( x + 4 ) <= w; x += 4 )
+					{
+						run = prefix4( out + x, prev ? prev + x : nullptr,
+									   _mm_loadu_pd( vals.data() + x ),
+									   _mm_loadu_pd( vals.data() + x + 2 ),
+									   run );
+					}
+					break;
+			}
+
+			double sum = _mm_cvtsd_f64( run );
+			for ( ; x < w; ++x )
+			{
+				double v = static_cast<double>( in[x] );
+				if ( power == 2 )
+					v *= v;
+				else if ( power != 1 )
+					v = vals[static_cast<size_t>( x )];
+				sum += v;
+				out[x] = prev ? sum + prev[x] : sum;
+			}
 		}
 	}
 }
 
-static void sat_rows( size_t, int s, int e, accum_buf &dest )
+static void sat_carry( size_t, int s, int e, accum_buf &dest, const plane &p, const std::vector<double> &carry, int nBands )
 {
-	int w = dest.width();
-	const __m128d zed = _mm_setzero_pd();
-	for ( int y = s; y < e; ++y )
+	const int w = p.width();
+	for ( int b = std::max( 1, s ); b < e; ++b )
 	{
-		double *out = dest.line( y );
-		__m128d sum = zed;
-		for ( int x = 0; x < w; x += 2 )
+		const double *c = carry.data() + static_cast<size_t>( b ) * static_cast<size_t>( w );
+		int yE = sat_band_row( b + 1, nBands, p );
+		for ( int y = sat_band_row( b, nBands, p ); y < yE; ++y )
 		{
-			__m128d v = _mm_load_pd( out );
-			sum = _mm_add_pd( sum, _mm_movedup_pd( v ) );
-			sum = _mm_add_pd( sum, _mm_move_sd( v, zed ) );
-			_mm_store_pd( out, sum );
-
-			sum = _mm_add_pd( sum, _mm_shuffle_pd( v, zed, 1 ) );
-
-			out += 2;
+			double *out = dest.line( y );
+			int x = 0;
+			for ( ; ( x + 2 ) <= w; x += 2 )
+				_mm_storeu_pd( out + x, _mm_add_pd( _mm_loadu_pd( out + x ), _mm_loadu_pd( c + x ) ) );
+			for ( ; x < w; ++x )
+				out[x] += c[x];
 		}
 	}
 }
@@ -172,18 +164,26 @@ accum_buf
 compute_SAT( const plane &p, int power )
 {
 	accum_buf dest( p.x1(), p.y1(), p.x2(), p.y2() );
-	switch ( power )
+	int nBands = std::min( p.height(), static_cast<int>( threading::get().size() ) );
+	threading::get().dispatch( std::bind( sat_bands, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ), power, nBands ), 0, nBands );
+
+	if ( nBands > 1 )
 	{
-		case 1:
-			threading::get().dispatch( std::bind( sat_cols1, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ) ), p.x1(), p.width() );
-			break;
-		default:
-			threading::get().dispatch( std::bind( sat_cols, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ), power ), p.x1(), p.width() );
-			break;
+		// carry for each band is the sum of the last rows of the
+		// bands above
+		size_t w = static_cast<size_t>( p.width() );
+		std::vector<double> carry( w * static_cast<size_t>( nBands ), 0.0 );
+		for ( int b = 1; b < nBands; ++b )
+		{
+			const double *last = dest.line( sat_band_row( b, nBands, p ) - 1 );
+			const double *prevC = carry.data() + static_cast<size_t>( b - 1 ) * w;
+			double *c = carry.data() + static_cast<size_t>( b ) * w;
+			for ( size_t x = 0; x < w; ++x )
+				c[x] = prevC[x] + last[x];
+		}
+		threading::get().dispatch( std::bind( sat_carry, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ), std::cref( p ), std::cref( carry ), nBands ), 0, nBands );
 	}
 
-	threading::get().dispatch( std::bind( sat_rows, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( dest ) ), dest.y1(), dest.height() );
-
 	return dest;
 }
 
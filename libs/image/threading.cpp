@@ -7,6 +7,7 @@
 
 #include "threading.h"
 #include <base/thread_util.h>
+#include <media/exr_writer.h>
 #include <base/contract.h>
 #include <atomic>
 
@@ -33,6 +34,9 @@ static void initThreading( int count )
 		theThreadObj = std::make_shared<image::threading>( count );
 	else
 		theThreadObj = std::make_shared<image::threading>( base::thread::core_count() );
+	// the codecs compress / decompress blocks with the same number
+	// of threads as the image processing
+	media::set_exr_thread_count( static_cast<int>( theThreadObj->size() ) );
 	std::atexit( shutdownThreading );
 }
 
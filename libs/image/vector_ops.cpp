@@ -12,9 +12,20 @@
 #include "plane_util.h"
 #include <base/cpu_features.h>
 #include <base/contract.h>
+#include <base/math_functions.h>
 #include <cfloat>
+#include <memory>
 #include <math.h>
 
+#ifdef __SSE__
+# if defined(LINUX) || defined(__linux__)
+#  include <x86intrin.h>
+# else
+#  include <xmmintrin.h>
+#  include <immintrin.h>
+# endif
+#endif
+
 ////////////////////////////////////////
 
 namespace
@@ -74,37 +85,416 @@ cvtToRelV( scanline &dest, int y, const plane &v )
 
 ////////////////////////////////////////
 
+// the warps are processed in tiles of destination pixels, computing
+// the source coordinates and weights of a tile row once for all the
+// planes being warped. The coordinates for the next row of the tile
+// are computed (and the source prefetched) before the current row is
+// sampled, so the loads for the next row are in flight while the
+// current row is blended.
+constexpr int kWarpTileW = 64;
+constexpr int kWarpTileH = 16;
+// only prefetch when the source of a tile row lies within this many
+// pixels / rows, as incoherent vectors would just pollute the cache
+constexpr int kWarpPrefetchSpan = 2 * kWarpTileW;
+constexpr int kWarpPrefetchRows = 8;
+constexpr int kLanczosTaps = 6;
+
+struct warp_job
+{
+	std::vector<const_plane_buffer> src;
+	std::vector<plane_buffer> dst;
+	const_plane_buffer u;
+	const_plane_buffer v;
+	bool absolute;
+};
+
+/// source coordinates for a row of a tile. The coordinates are
+/// relative to the source origin, and already clamped to hold the
+/// edge, so the samplers do not need to bounds check
+struct warp_coords
+{
+	alignas(16) int ix0[kWarpTileW];
+	alignas(16) int ix1[kWarpTileW];
+	alignas(16) int iy0[kWarpTileW];
+	alignas(16) int iy1[kWarpTileW];
+	alignas(16) float fx[kWarpTileW];
+	alignas(16) float fy[kWarpTileW];
+	int minX, maxX, minY, maxY;
+};
+
+struct lanczos_coords
+{
+	int ix[kWarpTileW];
+	int iy[kWarpTileW];
+	float wx[kWarpTileW][kLanczosTaps];
+	float wy[kWarpTileW][kLanczosTaps];
+	int minX, maxX, minY, maxY;
+};
+
 static void
-applyWarpBilinearP( scanline &dest, int y, const plane &src, const vector_field &v )
+warp_bilinear_coords( warp_coords &c, const warp_job &job, int y, int x0, int n )
 {
-	if ( v.is_absolute() )
+	const int w = job.u.width();
+	const int h = job.u.height();
+	const float *uLine = job.u.line( y ) + x0;
+	const float *vLine = job.v.line( y ) + x0;
+	const float maxX = static_cast<float>( w - 1 );
+	const float maxY = static_cast<float>( h - 1 );
+	const float offX = job.absolute ? -static_cast<float>( job.u.x1() ) : static_cast<float>( x0 );
+	const float offY = job.absolute ? -static_cast<float>( job.u.y1() ) : static_cast<float>( y - job.u.y1() );
+
+	int x = 0;
+#if defined(__SSE__)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.F );
+	const __m128 vMaxX = _mm_set1_ps( maxX );
+	const __m128 vMaxY = _mm_set1_ps( maxY );
+	const __m128 vOffY = _mm_set1_ps( offY );
+	// absolute vectors only need the origin removed
+	__m128 xs = _mm_set1_ps( offX );
+	__m128 step = _mm_setzero_ps();
+	if ( ! job.absolute )
 	{
-		const plane::value_type *uLine = v.u().line( y );
-		const plane::value_type *vLine = v.v().line( y );
-		for ( int x = 0; x < dest.width(); ++x )
+		xs = _mm_add_ps( xs, _mm_setr_ps( 0.F, 1.F, 2.F, 3.F ) );
+		step = _mm_set1_ps( 4.F );
+	}
+	for ( ; x + 3 < n; x += 4 )
+	{
+		__m128 sx = _mm_add_ps( _mm_loadu_ps( uLine + x ), xs );
+		__m128 sy = _mm_add_ps( _mm_loadu_ps( vLine + x ), vOffY );
+		sx = _mm_min_ps( _mm_max_ps( sx, zero ), vMaxX );
+		sy = _mm_min_ps( _mm_max_ps( sy, zero ), vMaxY );
+		// non-negative, so truncation is floor
+		__m128i ix = _mm_cvttps_epi32( sx );
+		__m128i iy = _mm_cvttps_epi32( sy );
+		__m128 fx = _mm_cvtepi32_ps( ix );
+		__m128 fy = _mm_cvtepi32_ps( iy );
+		_mm_store_si128( reinterpret_cast<__m128i *>( c.ix0 + x ), ix );
+		_mm_store_si128( reinterpret_cast<__m128i *>( c.iy0 + x ), iy );
+		_mm_store_si128( reinterpret_cast<__m128i *>( c.ix1 + x ), _mm_cvttps_epi32( _mm_min_ps( _mm_add_ps( fx, one ), vMaxX ) ) );
+		_mm_store_si128( reinterpret_cast<__m128i *>( c.iy1 + x ), _mm_cvttps_epi32( _mm_min_ps( _mm_add_ps( fy, one ), vMaxY ) ) );
+		_mm_store_ps( c.fx + x, _mm_sub_ps( sx, fx ) );
+		_mm_store_ps( c.fy + x, _mm_sub_ps( sy, fy ) );
+		xs = _mm_add_ps( xs, step );
+	}
+#endif
+	for ( ; x < n; ++x )
+	{
+		float sx = uLine[x] + ( job.absolute ? offX : offX + static_cast<float>( x ) );
+		float sy = vLine[x] + offY;
+		// written so a NaN vector clamps to 0, matching _mm_max_ps
+		sx = ( sx >= 0.F ) ? std::min( sx, maxX ) : 0.F;
+		sy = ( sy >= 0.F ) ? std::min( sy, maxY ) : 0.F;
+		int ix = static_cast<int>( sx );
+		int iy = static_cast<int>( sy );
+		c.ix0[x] = ix;
+		c.iy0[x] = iy;
+		c.ix1[x] = std::min( ix + 1, w - 1 );
+		c.iy1[x] = std::min( iy + 1, h - 1 );
+		c.fx[x] = sx - static_cast<float>( ix );
+		c.fy[x] = sy - static_cast<float>( iy );
+	}
+
+	c.minX = c.maxX = c.ix0[0];
+	c.minY = c.maxY = c.iy0[0];
+	for ( x = 1; x < n; ++x )
+	{
+		c.minX = std::min( c.minX, c.ix0[x] );
+		c.maxX = std::max( c.maxX, c.ix0[x] );
+		c.minY = std::min( c.minY, c.iy0[x] );
+		c.maxY = std::max( c.maxY, c.iy0[x] );
+	}
+}
+
+////////////////////////////////////////
+
+/// lanczos3 weights for the 6 taps around a sample at fractional
+/// offset f. sin( pi * ( k - f ) ) only changes sign between taps,
+/// and sin( pi * ( k - f ) / 3 ) is expanded with the angle sum
+/// identity, so only 3 trig evaluations are needed per sample
+static void
+lanczos_weights( float *w, float f )
+{
+	if ( f < 1e-5F )
+	{
+		for ( int k = 0; k < kLanczosTaps; ++k )
+			w[k] = 0.F;
+		w[2] = 1.F;
+		return;
+	}
+
+	static const float kSin3[kLanczosTaps] = { -0.8660254F, -0.8660254F, 0.F, 0.8660254F, 0.8660254F, 0.F };
+	static const float kCos3[kLanczosTaps] = { -0.5F, 0.5F, 1.F, 0.5F, -0.5F, -1.F };
+	const float pi = static_cast<float>( M_PI );
+	const float sF = sinf( pi * f );
+	const float s3 = sinf( pi * f / 3.F );
+	const float c3 = cosf( pi * f / 3.F );
+	float sum = 0.F;
+	for ( int k = 0; k < kLanczosTaps; ++k )
+	{
+		// taps are at -2 .. 3 relative to the floor of the sample
+		const float d = static_cast<float>( k - 2 ) - f;
+		const float sinD = ( k & 1 ) ? sF : -sF;
+		const float sinD3 = kSin3[k] * c3 - kCos3[k] * s3;
+		w[k] = 3.F * sinD * sinD3 / ( pi * pi * d * d );
+		sum += w[k];
+	}
+	sum = 1.F / sum;
+	for ( int k = 0; k < kLanczosTaps; ++k )
+		w[k] *= sum;
+}
+
+static void
+warp_lanczos_coords( lanczos_coords &c, const warp_job &job, int y, int x0, int n )
+{
+	const int w = job.u.width();
+	const int h = job.u.height();
+	const float *uLine = job.u.line( y ) + x0;
+	const float *vLine = job.v.line( y ) + x0;
+	const float maxX = static_cast<float>( w - 1 );
+	const float maxY = static_cast<float>( h - 1 );
+	const float offX = job.absolute ? -static_cast<float>( job.u.x1() ) : static_cast<float>( x0 );
+	const float offY = job.absolute ? -static_cast<float>( job.u.y1() ) : static_cast<float>( y - job.u.y1() );
+
+	for ( int x = 0; x < n; ++x )
+	{
+		float sx = uLine[x] + ( job.absolute ? offX : offX + static_cast<float>( x ) );
+		float sy = vLine[x] + offY;
+		// a NaN vector clamps to 0, as in the bilinear path
+		sx = ( sx >= 0.F ) ? std::min( sx, maxX ) : 0.F;
+		sy = ( sy >= 0.F ) ? std::min( sy, maxY ) : 0.F;
+		int ix = static_cast<int>( sx );
+		int iy = static_cast<int>( sy );
+		c.ix[x] = ix;
+		c.iy[x] = iy;
+		lanczos_weights( c.wx[x], sx - static_cast<float>( ix ) );
+		lanczos_weights( c.wy[x], sy - static_cast<float>( iy ) );
+		if ( x == 0 )
 		{
-			plane::value_type uV = uLine[x];
-			plane::value_type vV = vLine[x];
-			dest[x] = bilinear_hold( src, uV, vV );
+			c.minX = c.maxX = ix;
+			c.minY = c.maxY = iy;
+		}
+		else
+		{
+			c.minX = std::min( c.minX, ix );
+			c.maxX = std::max( c.maxX, ix );
+			c.minY = std::min( c.minY, iy );
+			c.maxY = std::max( c.maxY, iy );
 		}
 	}
-	else
+}
+
+////////////////////////////////////////
+
+static void
+warp_prefetch( const warp_job &job, int minX, int maxX, int minY, int maxY )
+{
+	if ( ( maxX - minX ) > kWarpPrefetchSpan || ( maxY - minY ) > kWarpPrefetchRows )
+		return;
+
+	for ( auto &src: job.src )
 	{
-		const plane::value_type *uLine = v.u().line( y );
-		const plane::value_type *vLine = v.v().line( y );
-		plane::value_type yOff = static_cast<plane::value_type>( y );
-		plane::value_type xOff = static_cast<plane::value_type>( dest.offset() );
-		for ( int x = 0; x < dest.width(); ++x )
+		const int y2 = std::min( maxY, src.height() - 1 );
+		const int x2 = std::min( maxX, src.width() - 1 );
+		for ( int y = std::max( 0, minY ); y <= y2; ++y )
 		{
-			plane::value_type uV = uLine[x] + static_cast<plane::value_type>( x ) + xOff;
-			plane::value_type vV = vLine[x] + yOff;
-			dest[x] = bilinear_hold( src, uV, vV );
+			const char *line = reinterpret_cast<const char *>( src.line( y + src.y1() ) );
+			// one prefetch per cache line
+			for ( int x = std::max( 0, minX ); x <= x2; x += 16 )
+			{
+#if defined(__SSE__)
+				_mm_prefetch( line + x * sizeof(float), _MM_HINT_T0 );
+#else
+				__builtin_prefetch( line + x * sizeof(float) );
+#endif
+			}
 		}
 	}
 }
 
 ////////////////////////////////////////
 
+static void
+warp_bilinear_row( float *out, const const_plane_buffer &src, const warp_coords &c, int n )
+{
+	const float *base = src.cdata();
+	const int stride = src.stride();
+	int x = 0;
+#if defined(__SSE__)
+	const __m128 one = _mm_set1_ps( 1.F );
+	for ( ; x + 3 < n; x += 4 )
+	{
+		const float *r00 = base + c.iy0[x] * stride;
+		const float *r01 = base + c.iy0[x+1] * stride;
+		const float *r02 = base + c.iy0[x+2] * stride;
+		const float *r03 = base + c.iy0[x+3] * stride;
+		const float *r10 = base + c.iy1[x] * stride;
+		const float *r11 = base + c.iy1[x+1] * stride;
+		const float *r12 = base + c.iy1[x+2] * stride;
+		const float *r13 = base + c.iy1[x+3] * stride;
+		__m128 a00 = _mm_setr_ps( r00[c.ix0[x]], r01[c.ix0[x+1]], r02[c.ix0[x+2]], r03[c.ix0[x+3]] );
+		__m128 a10 = _mm_setr_ps( r00[c.ix1[x]], r01[c.ix1[x+1]], r02[c.ix1[x+2]], r03[c.ix1[x+3]] );
+		__m128 a01 = _mm_setr_ps( r10[c.ix0[x]], r11[c.ix0[x+1]], r12[c.ix0[x+2]], r13[c.ix0[x+3]] );
+		__m128 a11 = _mm_setr_ps( r10[c.ix1[x]], r11[c.ix1[x+1]], r12[c.ix1[x+2]], r13[c.ix1[x+3]] );
+		__m128 fx = _mm_load_ps( c.fx + x );
+		__m128 fy = _mm_load_ps( c.fy + x );
+		__m128 ifx = _mm_sub_ps( one, fx );
+		__m128 t0 = _mm_add_ps( _mm_mul_ps( a00, ifx ), _mm_mul_ps( a10, fx ) );
+		__m128 t1 = _mm_add_ps( _mm_mul_ps( a01, ifx ), _mm_mul_ps( a11, fx ) );
+		_mm_storeu_ps( out + x, _mm_add_ps( _mm_mul_ps( t0, _mm_sub_ps( one, fy ) ), _mm_mul_ps( t1, fy ) ) );
+	}
+#endif
+	for ( ; x < n; ++x )
+	{
+		const float *r0 = base + c.iy0[x] * stride;
+		const float *r1 = base + c.iy1[x] * stride;
+		float t0 = base::lerp( r0[c.ix0[x]], r0[c.ix1[x]], c.fx[x] );
+		float t1 = base::lerp( r1[c.ix0[x]], r1[c.ix1[x]], c.fx[x] );
+		out[x] = base::lerp( t0, t1, c.fy[x] );
+	}
+}
+
+////////////////////////////////////////
+
+static void
+warp_lanczos_row( float *out, const const_plane_buffer &src, const lanczos_coords &c, int n )
+{
+	const float *base = src.cdata();
+	const int stride = src.stride();
+	const int w = src.width();
+	const int h = src.height();
+	for ( int x = 0; x < n; ++x )
+	{
+		const int sx = c.ix[x] - 2;
+		const int sy = c.iy[x] - 2;
+		const float *wx = c.wx[x];
+		const float *wy = c.wy[x];
+		float sum = 0.F;
+		if ( sx >= 0 && ( sx + kLanczosTaps ) <= w )
+		{
+			for ( int k = 0; k < kLanczosTaps; ++k )
+			{
+				const float *line = base + std::min( std::max( sy + k, 0 ), h - 1 ) * stride + sx;
+				float rs = 0.F;
+				for ( int t = 0; t < kLanczosTaps; ++t )
+					rs += line[t] * wx[t];
+				sum += rs * wy[k];
+			}
+		}
+		else
+		{
+			for ( int k = 0; k < kLanczosTaps; ++k )
+			{
+				const float *line = base + std::min( std::max( sy + k, 0 ), h - 1 ) * stride;
+				float rs = 0.F;
+				for ( int t = 0; t < kLanczosTaps; ++t )
+					rs += line[std::min( std::max( sx + t, 0 ), w - 1 )] * wx[t];
+				sum += rs * wy[k];
+			}
+		}
+		out[x] = sum;
+	}
+}
+
+////////////////////////////////////////
+
+template <typename Coords, typename CoordFunc, typename RowFunc>
+static void
+warp_tiles( int s, int e, warp_job &job, CoordFunc coordF, RowFunc rowF, int pad )
+{
+	std::unique_ptr<Coords> bufA( new Coords ), bufB( new Coords );
+	Coords *cur = bufA.get();
+	Coords *next = bufB.get();
+	const int w = job.u.width();
+	for ( int ty = s; ty < e; ty += kWarpTileH )
+	{
+		const int tyE = std::min( e, ty + kWarpTileH );
+		for ( int tx = 0; tx < w; tx += kWarpTileW )
+		{
+			const int n = std::min( kWarpTileW, w - tx );
+			coordF( *next, job, ty, tx, n );
+			for ( int y = ty; y < tyE; ++y )
+			{
+				std::swap( cur, next );
+				if ( ( y + 1 ) < tyE )
+				{
+					coordF( *next, job, y + 1, tx, n );
+					warp_prefetch( job, next->minX - pad, next->maxX + pad + 1, next->minY - pad, next->maxY + pad + 1 );
+				}
+				for ( size_t p = 0; p != job.src.size(); ++p )
+					rowF( job.dst[p].line( y ) + tx, job.src[p], *cur, n );
+			}
+		}
+	}
+}
+
+static void
+warp_bilinear_thread( size_t, int s, int e, warp_job &job )
+{
+	warp_tiles<warp_coords>( s, e, job, warp_bilinear_coords, warp_bilinear_row, 0 );
+}
+
+static void
+warp_lanczos_thread( size_t, int s, int e, warp_job &job )
+{
+	warp_tiles<lanczos_coords>( s, e, job, warp_lanczos_coords, warp_lanczos_row, 2 );
+}
+
+////////////////////////////////////////
+
+static image_buf
+warp_image( const image_buf &src, const vector_field &v, bool lanczos )
+{
+	warp_job job;
+	job.u = v.u();
+	job.v = v.v();
+	job.absolute = v.is_absolute();
+
+	image_buf ret;
+	for ( int p = 0; p != src.planes(); ++p )
+	{
+		ret.add_plane( plane( src.x1(), src.y1(), src.x2(), src.y2() ) );
+		job.src.push_back( src[p] );
+		job.dst.push_back( ret[p] );
+	}
+
+	if ( lanczos )
+		threading::get().dispatch( std::bind( warp_lanczos_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( job ) ), v.u() );
+	else
+		threading::get().dispatch( std::bind( warp_bilinear_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( job ) ), v.u() );
+	return ret;
+}
+
+static image_buf
+warp_image_bilinear( const image_buf &src, const vector_field &v )
+{
+	return warp_image( src, v, false );
+}
+
+static image_buf
+warp_image_lanczos( const image_buf &src, const vector_field &v )
+{
+	return warp_image( src, v, true );
+}
+
+static plane
+warp_plane_bilinear( const plane &src, const vector_field &v )
+{
+	image_buf tmp;
+	tmp.add_plane( src );
+	return warp_image( tmp, v, false )[0];
+}
+
+static plane
+warp_plane_lanczos( const plane &src, const vector_field &v )
+{
+	image_buf tmp;
+	tmp.add_plane( src );
+	return warp_image( tmp, v, true )[0];
+}
+
+////////////////////////////////////////
+
 static void
 applyWarpDiracP( scanline &dest, int y, const plane &src, const vector_field &v )
 {
@@ -517,11 +907,44 @@ plane warp_bilinear( const plane &src, const vector_field &v )
 
 image_buf warp_bilinear( const image_buf &src, const vector_field &v )
 {
-	image_buf ret;
-	// anything to be gained from inlining this?
-	for ( int i = 0; i != src.planes(); ++i )
-		ret.add_plane( warp_bilinear( src[i], v ) );
-	return ret;
+	if ( src.planes() == 1 )
+	{
+		image_buf ret;
+		ret.add_plane( warp_bilinear( src[0], v ) );
+		return ret;
+	}
+
+	precondition( v.x1() == src.x1() && v.y1() == src.y1() && v.x2() == src.x2() && v.y2() == src.y2(), "Vector field not same size as image requested for warp" );
+	// all the planes are warped together, sharing the coordinate and
+	// weight computation
+	engine::dimensions d = src.dims();
+	d.planes = static_cast<engine::dimensions::value_type>( src.planes() );
+	d.images = 1;
+	return image_buf( "v.i.warp_bilinear", d, src, v );
+}
+
+////////////////////////////////////////
+
+plane warp_lanczos( const plane &src, const vector_field &v )
+{
+	precondition( v.x1() == src.x1() && v.y1() == src.y1() && v.x2() == src.x2() && v.y2() == src.y2(), "Vector field not same size as plane requested for warp" );
+	return plane( "v.p.warp_lanczos", src.dims(), src, v );
+}
+
+image_buf warp_lanczos( const image_buf &src, const vector_field &v )
+{
+	if ( src.planes() == 1 )
+	{
+		image_buf ret;
+		ret.add_plane( warp_lanczos( src[0], v ) );
+		return ret;
+	}
+
+	precondition( v.x1() == src.x1() && v.y1() == src.y1() && v.x2() == src.x2() && v.y2() == src.y2(), "Vector field not same size as image requested for warp" );
+	engine::dimensions d = src.dims();
+	d.planes = static_cast<engine::dimensions::value_type>( src.planes() );
+	d.images = 1;
+	return image_buf( "v.i.warp_lanczos", d, src, v );
 }
 
 vector_field convert_to_absolute( const vector_field &v )
@@ -590,8 +1013,8 @@ vector_field concatenate( const vector_field &a, const vector_field &b )
 			pull = convert_to_relative( b );
 	}
 
-	plane u = warp_bilinear( b.u(), a );
-	plane v = warp_bilinear( b.u(), a );
+	plane u = warp_bilinear( pull.u(), a );
+	plane v = warp_bilinear( pull.v(), a );
 	return vector_field( a.u() + u, a.v() + v, a.is_absolute() );
 }
 
@@ -607,7 +1030,10 @@ void add_vector_ops( engine::registry &r )
 	r.add( op( "v.modify", modify_uv, op::simple ) );
 
 	r.add( op( "v.p.warp_dirac", base::choose_runtime( applyWarpDiracP ), n_scanline_plane_adapter<false, decltype(applyWarpDiracP)>(), dispatch_scan_processing, op::n_to_one ) );
-	r.add( op( "v.p.warp_bilinear", base::choose_runtime( applyWarpBilinearP ), n_scanline_plane_adapter<false, decltype(applyWarpBilinearP)>(), dispatch_scan_processing, op::n_to_one ) );
+	r.add( op( "v.p.warp_bilinear", warp_plane_bilinear, op::threaded ) );
+	r.add( op( "v.i.warp_bilinear", warp_image_bilinear, op::threaded ) );
+	r.add( op( "v.p.warp_lanczos", warp_plane_lanczos, op::threaded ) );
+	r.add( op( "v.i.warp_lanczos", warp_image_lanczos, op::threaded ) );
 
 	r.add( op( "v.cvt_to_abs_u", base::choose_runtime( cvtToAbsU ), scanline_plane_adapter<true, decltype(cvtToAbsU)>(), dispatch_scan_processing, op::one_to_one ) );
 	r.add( op( "v.cvt_to_abs_v", base::choose_runtime( cvtToAbsV ), n_scanline_plane_adapter<false, decltype(cvtToAbsV)>(), dispatch_scan_processing, op::n_to_one ) );
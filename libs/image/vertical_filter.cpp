@@ -0,0 +1,201 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "vertical_filter.h"
+#include "threading.h"
+#include <base/contract.h>
+
+#ifdef __SSE__
+# if defined(LINUX) || defined(__linux__)
+#  include <x86intrin.h>
+# else
+#  include <xmmintrin.h>
+#  include <immintrin.h>
+# endif
+#endif
+
+////////////////////////////////////////
+
+namespace
+{
+using namespace image;
+
+// 512 floats keeps (taps + block rows) strips of source in L1 / L2
+// for the common filter sizes
+constexpr int kStripWidth = 512;
+// number of output rows accumulated at once
+constexpr int kRowBlock = 4;
+
+////////////////////////////////////////
+
+struct row_block
+{
+	int nRows = 0;
+	int minRow = 0;
+	int nSrc = 0;
+	// weight for source row ( minRow + r ) for output row j is
+	// weights[r * kRowBlock + j]
+	std::vector<float> weights;
+	std::vector<const float *> lines;
+	std::vector<bool> used;
+};
+
+////////////////////////////////////////
+
+static void
+build_block( row_block &b, const plane &src, const vertical_taps &taps, int y, int nRows )
+{
+	int minR = src.y2();
+	int maxR = src.y1();
+	for ( int j = 0; j < nRows; ++j )
+	{
+		for ( size_t t = taps.tap_begin( y + j ), e = taps.tap_end( y + j ); t != e; ++t )
+		{
+			minR = std::min( minR, taps.row( t ) );
+			maxR = std::max( maxR, taps.row( t ) );
+		}
+	}
+
+	b.nRows = nRows;
+	b.minRow = minR;
+	b.nSrc = std::max( 0, maxR - minR + 1 );
+	size_t nS = static_cast<size_t>( b.nSrc );
+	b.weights.assign( nS * kRowBlock, 0.F );
+	b.used.assign( nS, false );
+	b.lines.resize( nS );
+	for ( int j = 0; j < nRows; ++j )
+	{
+		for ( size_t t = taps.tap_begin( y + j ), e = taps.tap_end( y + j ); t != e; ++t )
+		{
+			size_t r = static_cast<size_t>( taps.row( t ) - minR );
+			// clamped edges can list a row more than once
+			b.weights[r * kRowBlock + static_cast<size_t>( j )] += taps.weight( t );
+			b.used[r] = true;
+		}
+	}
+	for ( size_t r = 0; r < nS; ++r )
+		b.lines[r] = b.used[r] ? src.line( minR + static_cast<int>( r ) ) : nullptr;
+}
+
+////////////////////////////////////////
+
+static void
+apply_block( const row_block &b, float * const *out, int x0, int x1 )
+{
+	int x = x0;
+#ifdef __SSE__
+	for ( ; ( x + 4 ) <= x1; x += 4 )
+	{
+		__m128 a0 = _mm_setzero_ps();
+		__m128 a1 = _mm_setzero_ps();
+		__m128 a2 = _mm_setzero_ps();
+		__m128 a3 = _mm_setzero_ps();
+		const float *w = b.weights.data();
+		for ( int r = 0; r < b.nSrc; ++r, w += kRowBlock )
+		{
+			const float *l = b.lines[static_cast<size_t>( r )];
+			if ( ! l )
+				continue;
+			__m128 s = _mm_loadu_ps( l + x );
+			a0 = _mm_add_ps( a0, _mm_mul_ps( s, _mm_set1_ps( w[0] ) ) );
+			a1 = _mm_add_ps( a1, _mm_mul_ps( s, _mm_set1_ps( w[1] ) ) );
+			a2 = _mm_add_ps( a2, _mm_mul_ps( s, _mm_set1_ps( w[2] ) ) );
+			a3 = _mm_add_ps( a3, _mm_mul_ps( s, _mm_set1_ps( w[3] ) ) );
+		}
+		switch ( b.nRows )
+		{
+			case 4: _mm_storeu_ps( out[3] + x, a3 ); // fall through
+			case 3: _mm_storeu_ps( out[2] + x, a2 ); // fall through
+			case 2: _mm_storeu_ps( out[1] + x, a1 ); // fall through
+			default: _mm_storeu_ps( out[0] + x, a0 ); break;
+		}
+	}
+#endif
+	for ( ; x < x1; ++x )
+	{
+		float a[kRowBlock] = { 0.F, 0.F, 0.F, 0.F };
+		const float *w = b.weights.data();
+		for ( int r = 0; r < b.nSrc; ++r, w += kRowBlock )
+		{
+			const float *l = b.lines[static_cast<size_t>( r )];
+			if ( ! l )
+				continue;
+			float s = l[x];
+			for ( int j = 0; j < kRowBlock; ++j )
+				a[j] += s * w[j];
+		}
+		for ( int j = 0; j < b.nRows; ++j )
+			out[j][x] = a[j];
+	}
+}
+
+////////////////////////////////////////
+
+static void
+vert_strip_thread( size_t, int s, int e, plane &dest, const plane &src, const vertical_taps &taps )
+{
+	const int w = dest.width();
+
+	// the taps are the same for every strip, so compute the blocks
+	// once for our range of rows
+	std::vector<row_block> blocks;
+	blocks.resize( static_cast<size_t>( ( e - s + kRowBlock - 1 ) / kRowBlock ) );
+	size_t bi = 0;
+	for ( int y = s; y < e; y += kRowBlock, ++bi )
+		build_block( blocks[bi], src, taps, y, std::min( kRowBlock, e - y ) );
+
+	float *out[kRowBlock];
+	for ( int x0 = 0; x0 < w; x0 += kStripWidth )
+	{
+		int x1 = std::min( w, x0 + kStripWidth );
+		bi = 0;
+		for ( int y = s; y < e; y += kRowBlock, ++bi )
+		{
+			const row_block &b = blocks[bi];
+			for ( int j = 0; j < b.nRows; ++j )
+				out[j] = dest.line( y + j );
+			apply_block( b, out, x0, x1 );
+		}
+	}
+}
+
+}
+
+////////////////////////////////////////
+
+namespace image
+{
+
+////////////////////////////////////////
+
+vertical_taps::vertical_taps( int y1, int y2 )
+	: _y1( y1 ), _y2( y2 )
+{
+	_offsets.reserve( static_cast<size_t>( y2 - y1 + 2 ) );
+	_offsets.push_back( 0 );
+}
+
+////////////////////////////////////////
+
+plane
+apply_vertical_taps( const plane &src, const vertical_taps &taps )
+{
+	precondition( taps.complete(), "incomplete vertical taps for rows {0} - {1}", taps.y1(), taps.y2() );
+
+	plane r( src.x1(), taps.y1(), src.x2(), taps.y2() );
+
+	threading::get().dispatch( std::bind( vert_strip_thread, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::ref( r ), std::cref( src ), std::cref( taps ) ), r );
+
+	return r;
+}
+
+////////////////////////////////////////
+
+} // image
+
+
+
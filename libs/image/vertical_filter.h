@@ -0,0 +1,74 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <vector>
+#include "plane.h"
+
+////////////////////////////////////////
+
+namespace image
+{
+
+/// planes at least this wide use the column-strip vertical filters
+/// instead of the scanline versions, as the rows needed by the taps
+/// of a scanline op no longer fit in cache
+constexpr int vertical_strip_min_width = 2048;
+
+///
+/// @brief Class vertical_taps stores the source rows and weights
+/// contributing to each output row of a vertical (column) filter.
+///
+/// This allows the vertical passes of convolutions, gradients and
+/// resizes to share a single cache-blocked implementation.
+///
+class vertical_taps
+{
+public:
+	/// output rows are y1 through y2, inclusive
+	vertical_taps( int y1, int y2 );
+
+	inline int y1( void ) const { return _y1; }
+	inline int y2( void ) const { return _y2; }
+
+	/// adds a source row contribution to the current output row
+	inline void add( int srcRow, float weight )
+	{
+		_rows.push_back( srcRow );
+		_weights.push_back( weight );
+	}
+	/// finishes the current output row, moving to the next one. An
+	/// output row with no taps is zero
+	inline void next_row( void ) { _offsets.push_back( _rows.size() ); }
+
+	inline bool complete( void ) const { return _offsets.size() == static_cast<size_t>( _y2 - _y1 + 2 ); }
+
+	inline size_t tap_begin( int y ) const { return _offsets[static_cast<size_t>( y - _y1 )]; }
+	inline size_t tap_end( int y ) const { return _offsets[static_cast<size_t>( y - _y1 + 1 )]; }
+	inline int row( size_t t ) const { return _rows[t]; }
+	inline float weight( size_t t ) const { return _weights[t]; }
+
+private:
+	int _y1, _y2;
+	std::vector<size_t> _offsets;
+	std::vector<int> _rows;
+	std::vector<float> _weights;
+};
+
+/// Applies the vertical filter described by the taps to src,
+/// returning a plane with the width of src and the rows of the taps.
+///
+/// The plane is processed in column strips, with several output rows
+/// accumulated at once, such that the source rows are pulled into
+/// cache once and re-used by the following output rows.
+plane apply_vertical_taps( const plane &src, const vertical_taps &taps );
+
+} // namespace image
+
+
+
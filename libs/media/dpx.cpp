@@ -0,0 +1,635 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "dpx.h"
+#include <base/contract.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+////////////////////////////////////////
+
+namespace
+{
+
+using namespace media::dpx;
+
+static const uint32_t kDPXMagic = 0x53445058; // "SDPX"
+static const uint32_t kCineonMagic = 0x802A5FD7;
+// unset (undefined) numeric fields have all bits set
+static const uint32_t kUndefined = 0xFFFFFFFF;
+// the size of the generic headers, the industry (film and
+// television) headers are optional
+static const size_t kDPXGenericSize = 1664;
+static const size_t kCineonGenericSize = 1024;
+
+inline uint32_t get_u32( const char *p, bool swap )
+{
+	uint32_t v;
+	std::memcpy( &v, p, sizeof(v) );
+	return swap ? bswap_32( v ) : v;
+}
+
+inline uint16_t get_u16( const char *p, bool swap )
+{
+	uint16_t v;
+	std::memcpy( &v, p, sizeof(v) );
+	return swap ? bswap_16( v ) : v;
+}
+
+inline float get_f32( const char *p, bool swap )
+{
+	uint32_t u = get_u32( p, swap );
+	float v;
+	std::memcpy( &v, &u, sizeof(v) );
+	return v;
+}
+
+inline std::string get_string( const char *p, size_t maxlen )
+{
+	return std::string( p, strnlen( p, maxlen ) );
+}
+
+inline void put_u32( char *p, uint32_t v, bool swap )
+{
+	if ( swap )
+		v = bswap_32( v );
+	std::memcpy( p, &v, sizeof(v) );
+}
+
+inline void put_u16( char *p, uint16_t v, bool swap )
+{
+	if ( swap )
+		v = bswap_16( v );
+	std::memcpy( p, &v, sizeof(v) );
+}
+
+inline void put_f32( char *p, float v, bool swap )
+{
+	uint32_t u;
+	std::memcpy( &u, &v, sizeof(u) );
+	put_u32( p, u, swap );
+}
+
+inline void put_string( char *p, size_t maxlen, const std::string &s )
+{
+	std::memcpy( p, s.data(), std::min( maxlen, s.size() ) );
+}
+
+// scales a datum to 16 bits, repeating the high bits in the low bits
+// so the maximum maps to 65535
+inline uint16_t widen( uint32_t v, int bits )
+{
+	return static_cast<uint16_t>( ( v << ( 16 - bits ) ) | ( v >> ( 2 * bits - 16 ) ) );
+}
+
+inline uint32_t quantize( float v, float maxv )
+{
+	// written this way so NaN ends up as 0
+	v = v > 0.F ? ( v < 1.F ? v : 1.F ) : 0.F;
+	return static_cast<uint32_t>( std::lrint( v * maxv ) );
+}
+
+////////////////////////////////////////
+
+#ifdef __SSE2__
+inline __m128i bswap_32x4( __m128i v )
+{
+	// swap the bytes of the 16-bit halves, then the halves
+	v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+	v = _mm_shufflelo_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+	return _mm_shufflehi_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+}
+
+inline __m128i widen_10x8( __m128i v )
+{
+	return _mm_or_si128( _mm_slli_epi16( v, 6 ), _mm_srli_epi16( v, 4 ) );
+}
+
+inline __m128i quantize_10x4( const float *p )
+{
+	__m128 v = _mm_max_ps( _mm_loadu_ps( p ), _mm_setzero_ps() );
+	v = _mm_min_ps( v, _mm_set1_ps( 1.F ) );
+	return _mm_cvtps_epi32( _mm_mul_ps( v, _mm_set1_ps( 1023.F ) ) );
+}
+#endif
+
+// The common case of 3 datums per pixel, so each 32-bit word is a
+// pixel, unpacked 8 pixels at a time. Returns the number of pixels
+// unpacked.
+size_t unpack_10_rgb( const char *line, uint16_t *const *planes, size_t width, int shift, bool swap )
+{
+	size_t x = 0;
+#ifdef __SSE2__
+	const __m128i mask = _mm_set1_epi32( 0x3FF );
+	const __m128i s0 = _mm_cvtsi32_si128( 20 + shift );
+	const __m128i s1 = _mm_cvtsi32_si128( 10 + shift );
+	const __m128i s2 = _mm_cvtsi32_si128( shift );
+	for ( ; x + 8 <= width; x += 8 )
+	{
+		__m128i w0 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( line + x * 4 ) );
+		__m128i w1 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( line + x * 4 + 16 ) );
+		if ( swap )
+		{
+			w0 = bswap_32x4( w0 );
+			w1 = bswap_32x4( w1 );
+		}
+		// the 10-bit values fit the signed saturation of the packs
+		__m128i a = _mm_packs_epi32( _mm_and_si128( _mm_srl_epi32( w0, s0 ), mask ),
+									 _mm_and_si128( _mm_srl_epi32( w1, s0 ), mask ) );
+		__m128i b = _mm_packs_epi32( _mm_and_si128( _mm_srl_epi32( w0, s1 ), mask ),
+									 _mm_and_si128( _mm_srl_epi32( w1, s1 ), mask ) );
+		__m128i c = _mm_packs_epi32( _mm_and_si128( _mm_srl_epi32( w0, s2 ), mask ),
+									 _mm_and_si128( _mm_srl_epi32( w1, s2 ), mask ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( planes[0] + x ), widen_10x8( a ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( planes[1] + x ), widen_10x8( b ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( planes[2] + x ), widen_10x8( c ) );
+	}
+#else
+	(void)line; (void)planes; (void)width; (void)shift; (void)swap;
+#endif
+	return x;
+}
+
+// same as unpack_10_rgb, 4 pixels at a time
+size_t pack_10_rgb( char *line, const float *const *planes, size_t width, int shift, bool swap )
+{
+	size_t x = 0;
+#ifdef __SSE2__
+	const __m128i s0 = _mm_cvtsi32_si128( 20 + shift );
+	const __m128i s1 = _mm_cvtsi32_si128( 10 + shift );
+	const __m128i s2 = _mm_cvtsi32_si128( shift );
+	for ( ; x + 4 <= width; x += 4 )
+	{
+		__m128i w = _mm_or_si128(
+			_mm_or_si128( _mm_sll_epi32( quantize_10x4( planes[0] + x ), s0 ),
+						  _mm_sll_epi32( quantize_10x4( planes[1] + x ), s1 ) ),
+			_mm_sll_epi32( quantize_10x4( planes[2] + x ), s2 ) );
+		if ( swap )
+			w = bswap_32x4( w );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( line + x * 4 ), w );
+	}
+#else
+	(void)line; (void)planes; (void)width; (void)shift; (void)swap;
+#endif
+	return x;
+}
+
+////////////////////////////////////////
+
+header read_cineon( const char *p, size_t n, bool swap )
+{
+	if ( n < kCineonGenericSize )
+		throw_runtime( "Cineon header truncated ({0} bytes)", n );
+
+	header h;
+	h.cineon = true;
+	h.image_offset = get_u32( p + 4, swap );
+	h.file_size = get_u32( p + 20, swap );
+	h.file_name = get_string( p + 32, 100 );
+	h.create_time = get_string( p + 132, 12 ) + ' ' + get_string( p + 144, 12 );
+	h.orientation = static_cast<uint8_t>( p[192] );
+
+	int chans = static_cast<uint8_t>( p[193] );
+	if ( chans != 1 && chans != 3 )
+		throw_runtime( "Unsupported Cineon file with {0} channels", chans );
+	// channel information, 28 bytes each
+	const char *ci = p + 196;
+	element e;
+	e.desc = chans == 3 ? DESC_RGB : DESC_LUMA;
+	e.xfer = XFER_PRINTING_DENSITY;
+	e.colorimetric = XFER_PRINTING_DENSITY;
+	e.bit_depth = static_cast<uint8_t>( ci[2] );
+	for ( int c = 1; c < chans; ++c )
+	{
+		if ( static_cast<uint8_t>( ci[c * 28 + 2] ) != e.bit_depth )
+			throw_runtime( "Unsupported Cineon file with differing bit depths per channel" );
+	}
+	h.width = get_u32( ci + 4, swap );
+	h.height = get_u32( ci + 8, swap );
+	e.ref_low_data = static_cast<uint32_t>( get_f32( ci + 12, swap ) );
+	e.ref_low_quantity = get_f32( ci + 16, swap );
+	e.ref_high_data = static_cast<uint32_t>( get_f32( ci + 20, swap ) );
+	e.ref_high_quantity = get_f32( ci + 24, swap );
+
+	// 0 is a stream of bits, 5 and 6 are left and right justified in
+	// 32-bit words (DPX method A and B), 1 - 4 are the same for 8 and
+	// 16-bit boundaries
+	const int packing = p[681];
+	if ( packing == 0 )
+		e.packing = 0;
+	else if ( ( packing == 5 || packing == 6 ) && e.bit_depth == 10 )
+		e.packing = packing == 5 ? 1 : 2;
+	else if ( ( packing == 1 || packing == 2 ) && e.bit_depth == 8 )
+		e.packing = 1;
+	else if ( ( packing == 3 || packing == 4 ) && ( e.bit_depth == 12 || e.bit_depth == 16 ) )
+		e.packing = packing == 3 ? 1 : 2;
+	else
+		throw_runtime( "Unsupported Cineon packing {0} of {1} bit data", packing, int( e.bit_depth ) );
+	if ( e.bit_depth != 8 && e.bit_depth != 10 && e.bit_depth != 12 && e.bit_depth != 16 )
+		throw_runtime( "Unsupported Cineon bit depth {0}", int( e.bit_depth ) );
+	if ( h.width == 0 || h.height == 0 )
+		throw_runtime( "Invalid Cineon image size {0}x{1}", h.width, h.height );
+	e.data_sign = static_cast<uint8_t>( p[682] );
+	e.eol_padding = get_u32( p + 684, swap );
+	if ( e.eol_padding == kUndefined )
+		e.eol_padding = 0;
+	e.data_offset = h.image_offset;
+	h.input_device = get_string( p + 844, 64 );
+	h.elements.push_back( std::move( e ) );
+	return h;
+}
+
+} // empty namespace
+
+////////////////////////////////////////
+
+namespace media
+{
+
+namespace dpx
+{
+
+////////////////////////////////////////
+
+bool check_magic( const char *p, size_t n )
+{
+	if ( n < 4 )
+		return false;
+	uint32_t m = get_u32( p, false );
+	return m == kDPXMagic || m == bswap_32( kDPXMagic ) ||
+		m == kCineonMagic || m == bswap_32( kCineonMagic );
+}
+
+////////////////////////////////////////
+
+header read_header( const char *p, size_t n )
+{
+	if ( ! check_magic( p, n ) )
+		throw_runtime( "Not a DPX or Cineon file" );
+
+	const uint32_t m = get_u32( p, false );
+	const bool swap = m == bswap_32( kDPXMagic ) || m == bswap_32( kCineonMagic );
+	const base::endianness e = swap ? ( base::is_little_endian() ? base::endianness::BIG : base::endianness::LITTLE ) : base::endianness::NATIVE;
+	if ( m == kCineonMagic || m == bswap_32( kCineonMagic ) )
+	{
+		header h = read_cineon( p, n, swap );
+		h.endian = e;
+		return h;
+	}
+
+	if ( n < kDPXGenericSize )
+		throw_runtime( "DPX header truncated ({0} bytes)", n );
+
+	header h;
+	h.endian = e;
+	h.image_offset = get_u32( p + 4, swap );
+	h.file_size = get_u32( p + 16, swap );
+	h.file_name = get_string( p + 36, 100 );
+	h.create_time = get_string( p + 136, 24 );
+	h.creator = get_string( p + 160, 100 );
+	h.project = get_string( p + 260, 200 );
+	h.copyright = get_string( p + 460, 200 );
+
+	h.orientation = get_u16( p + 768, swap );
+	uint16_t nElem = get_u16( p + 770, swap );
+	h.width = get_u32( p + 772, swap );
+	h.height = get_u32( p + 776, swap );
+	if ( nElem < 1 || nElem > 8 )
+		throw_runtime( "Invalid DPX element count {0}", nElem );
+	if ( h.width == 0 || h.width == kUndefined || h.height == 0 || h.height == kUndefined )
+		throw_runtime( "Invalid DPX image size {0}x{1}", h.width, h.height );
+
+	for ( uint16_t i = 0; i != nElem; ++i )
+	{
+		const char *ep = p + 780 + i * 72;
+		element el;
+		el.data_sign = get_u32( ep, swap );
+		el.ref_low_data = get_u32( ep + 4, swap );
+		el.ref_low_quantity = get_f32( ep + 8, swap );
+		el.ref_high_data = get_u32( ep + 12, swap );
+		el.ref_high_quantity = get_f32( ep + 16, swap );
+		el.desc = static_cast<uint8_t>( ep[20] );
+		el.xfer = static_cast<uint8_t>( ep[21] );
+		el.colorimetric = static_cast<uint8_t>( ep[22] );
+		el.bit_depth = static_cast<uint8_t>( ep[23] );
+		el.packing = get_u16( ep + 24, swap );
+		el.encoding = get_u16( ep + 26, swap );
+		el.data_offset = get_u32( ep + 28, swap );
+		el.eol_padding = get_u32( ep + 32, swap );
+		el.eoi_padding = get_u32( ep + 36, swap );
+		el.description = get_string( ep + 40, 32 );
+		if ( el.eol_padding == kUndefined )
+			el.eol_padding = 0;
+		if ( el.eoi_padding == kUndefined )
+			el.eoi_padding = 0;
+
+		if ( channel_count( el.desc ) == 0 )
+			throw_runtime( "Unsupported DPX element descriptor {0}", int( el.desc ) );
+		if ( el.encoding != 0 )
+			throw_runtime( "Unsupported run length encoded DPX element" );
+		switch ( el.bit_depth )
+		{
+			case 8:
+			case 16:
+			case 32:
+				break;
+			case 10:
+			case 12:
+				if ( el.packing > 2 )
+					throw_runtime( "Unsupported DPX packing {0}", el.packing );
+				break;
+			default:
+				throw_runtime( "Unsupported DPX bit depth {0}", int( el.bit_depth ) );
+		}
+		h.elements.push_back( std::move( el ) );
+	}
+
+	h.input_device = get_string( p + 1556, 32 );
+	h.aspect_h = get_u32( p + 1628, swap );
+	h.aspect_v = get_u32( p + 1632, swap );
+	if ( h.aspect_h == kUndefined || h.aspect_v == kUndefined )
+		h.aspect_h = h.aspect_v = 0;
+
+	if ( n >= kHeaderSize && h.image_offset >= kHeaderSize )
+	{
+		// prefer the television frame rate, then the film one
+		for ( size_t off: { size_t( 1940 ), size_t( 1724 ) } )
+		{
+			float fr = get_f32( p + off, swap );
+			if ( std::isfinite( fr ) && fr > 0.F )
+			{
+				h.frame_rate = fr;
+				break;
+			}
+		}
+		h.timecode = get_u32( p + 1920, swap );
+		h.userbits = get_u32( p + 1924, swap );
+	}
+
+	return h;
+}
+
+////////////////////////////////////////
+
+void write_header( char *p, const header &h )
+{
+	precondition( ! h.cineon, "writing Cineon headers is not supported" );
+	precondition( ! h.elements.empty() && h.elements.size() <= 8, "invalid number of DPX elements {0}", h.elements.size() );
+	const bool swap = h.endian != base::endianness::NATIVE;
+	std::memset( p, 0, kHeaderSize );
+
+	// file information
+	put_u32( p, kDPXMagic, swap );
+	put_u32( p + 4, h.image_offset, swap );
+	put_string( p + 8, 8, "V2.0" );
+	put_u32( p + 16, h.file_size, swap );
+	put_u32( p + 20, 1, swap ); // new image
+	put_u32( p + 24, static_cast<uint32_t>( kDPXGenericSize ), swap );
+	put_u32( p + 28, static_cast<uint32_t>( kHeaderSize - kDPXGenericSize ), swap );
+	put_u32( p + 32, 0, swap );
+	put_string( p + 36, 100, h.file_name );
+	put_string( p + 136, 24, h.create_time );
+	put_string( p + 160, 100, h.creator );
+	put_string( p + 260, 200, h.project );
+	put_string( p + 460, 200, h.copyright );
+	put_u32( p + 660, kUndefined, swap ); // not encrypted
+
+	// image information
+	put_u16( p + 768, h.orientation, swap );
+	put_u16( p + 770, static_cast<uint16_t>( h.elements.size() ), swap );
+	put_u32( p + 772, h.width, swap );
+	put_u32( p + 776, h.height, swap );
+	for ( size_t i = 0; i != 8; ++i )
+	{
+		char *ep = p + 780 + i * 72;
+		if ( i >= h.elements.size() )
+		{
+			// unused elements are undefined
+			std::memset( ep, 0xFF, 40 );
+			continue;
+		}
+		const element &el = h.elements[i];
+		put_u32( ep, el.data_sign, swap );
+		put_u32( ep + 4, el.ref_low_data, swap );
+		put_f32( ep + 8, el.ref_low_quantity, swap );
+		put_u32( ep + 12, el.ref_high_data, swap );
+		put_f32( ep + 16, el.ref_high_quantity, swap );
+		ep[20] = static_cast<char>( el.desc );
+		ep[21] = static_cast<char>( el.xfer );
+		ep[22] = static_cast<char>( el.colorimetric );
+		ep[23] = static_cast<char>( el.bit_depth );
+		put_u16( ep + 24, el.packing, swap );
+		put_u16( ep + 26, el.encoding, swap );
+		put_u32( ep + 28, el.data_offset, swap );
+		put_u32( ep + 32, el.eol_padding, swap );
+		put_u32( ep + 36, el.eoi_padding, swap );
+		put_string( ep + 40, 32, el.description );
+	}
+
+	// orientation
+	put_u32( p + 1424, h.width, swap );
+	put_u32( p + 1428, h.height, swap );
+	put_string( p + 1432, 100, h.file_name );
+	put_string( p + 1532, 24, h.create_time );
+	put_string( p + 1556, 32, h.input_device );
+	put_u32( p + 1628, h.aspect_h ? h.aspect_h : kUndefined, swap );
+	put_u32( p + 1632, h.aspect_v ? h.aspect_v : kUndefined, swap );
+
+	// film and television
+	if ( h.frame_rate > 0.F )
+	{
+		put_f32( p + 1724, h.frame_rate, swap );
+		put_f32( p + 1940, h.frame_rate, swap );
+	}
+	else
+	{
+		put_u32( p + 1724, kUndefined, swap );
+		put_u32( p + 1940, kUndefined, swap );
+	}
+	put_u32( p + 1920, h.timecode, swap );
+	put_u32( p + 1924, h.userbits, swap );
+}
+
+////////////////////////////////////////
+
+int channel_count( uint8_t desc )
+{
+	switch ( desc )
+	{
+		case DESC_RED:
+		case DESC_GREEN:
+		case DESC_BLUE:
+		case DESC_ALPHA:
+		case DESC_LUMA:
+		case DESC_DEPTH:
+			return 1;
+		case DESC_RGB:
+			return 3;
+		case DESC_RGBA:
+		case DESC_ABGR:
+			return 4;
+		default:
+			break;
+	}
+	return 0;
+}
+
+////////////////////////////////////////
+
+std::vector<std::string> channel_names( uint8_t desc )
+{
+	switch ( desc )
+	{
+		case DESC_RED: return { "R" };
+		case DESC_GREEN: return { "G" };
+		case DESC_BLUE: return { "B" };
+		case DESC_ALPHA: return { "A" };
+		case DESC_LUMA: return { "Y" };
+		case DESC_DEPTH: return { "Z" };
+		case DESC_RGB: return { "R", "G", "B" };
+		case DESC_RGBA: return { "R", "G", "B", "A" };
+		case DESC_ABGR: return { "A", "B", "G", "R" };
+		default:
+			break;
+	}
+	throw_runtime( "Unsupported DPX element descriptor {0}", int( desc ) );
+}
+
+////////////////////////////////////////
+
+size_t line_bytes( const element &e, uint32_t width )
+{
+	const size_t datums = static_cast<size_t>( channel_count( e.desc ) ) * width;
+	if ( e.packing != 0 )
+	{
+		// lines of filled words
+		if ( e.bit_depth == 10 )
+			return ( datums + 2 ) / 3 * 4;
+		if ( e.bit_depth == 12 )
+			return ( datums + 1 ) / 2 * 4;
+	}
+	// lines always start on a 32-bit word
+	return ( datums * e.bit_depth + 31 ) / 32 * 4;
+}
+
+////////////////////////////////////////
+
+void unpack_line( const element &e, bool swap, const char *line, uint16_t *const *planes, int chans, size_t width )
+{
+	const size_t nc = static_cast<size_t>( chans );
+	const size_t n = nc * width;
+	const int bits = e.bit_depth;
+	precondition( bits == 10 || bits == 12, "unpacking {0} bit datums", bits );
+
+	if ( e.packing == 0 )
+	{
+		// a stream of bits, from the most significant bit of each
+		// 32-bit word
+		const uint64_t mask = ( uint64_t( 1 ) << bits ) - 1;
+		uint64_t acc = 0;
+		int accbits = 0;
+		for ( size_t d = 0; d != n; ++d )
+		{
+			if ( accbits < bits )
+			{
+				acc = ( acc << 32 ) | get_u32( line, swap );
+				line += 4;
+				accbits += 32;
+			}
+			accbits -= bits;
+			planes[d % nc][d / nc] = widen( static_cast<uint32_t>( ( acc >> accbits ) & mask ), bits );
+		}
+		return;
+	}
+
+	if ( bits == 12 )
+	{
+		// a datum in each 16 bits
+		const int shift = e.packing == 1 ? 4 : 0;
+		for ( size_t d = 0; d != n; ++d )
+			planes[d % nc][d / nc] = widen( ( get_u16( line + d * 2, swap ) >> shift ) & 0xFFF, 12 );
+		return;
+	}
+
+	const int shift = e.packing == 1 ? 2 : 0;
+	size_t d = 0;
+	if ( nc == 3 )
+		d = unpack_10_rgb( line, planes, width, shift, swap ) * 3;
+
+	uint32_t w = 0;
+	for ( ; d != n; ++d )
+	{
+		const size_t inword = d % 3;
+		if ( inword == 0 )
+			w = get_u32( line + ( d / 3 ) * 4, swap );
+		planes[d % nc][d / nc] = widen( ( w >> ( 20 - static_cast<int>( inword ) * 10 + shift ) ) & 0x3FF, 10 );
+	}
+}
+
+////////////////////////////////////////
+
+void pack_line( const element &e, bool swap, char *line, const float *const *planes, int chans, size_t width )
+{
+	const size_t nc = static_cast<size_t>( chans );
+	const size_t n = nc * width;
+	const size_t lb = line_bytes( e, static_cast<uint32_t>( width ) );
+
+	switch ( e.bit_depth )
+	{
+		case 8:
+			for ( size_t d = 0; d != n; ++d )
+				line[d] = static_cast<char>( quantize( planes[d % nc][d / nc], 255.F ) );
+			std::fill( line + n, line + lb, char( 0 ) );
+			break;
+
+		case 10:
+		{
+			precondition( e.packing == 1 || e.packing == 2, "10 bit DPX written as method A or B" );
+			const int shift = e.packing == 1 ? 2 : 0;
+			size_t d = 0;
+			if ( nc == 3 )
+				d = pack_10_rgb( line, planes, width, shift, swap ) * 3;
+			uint32_t w = 0;
+			for ( ; d != n; ++d )
+			{
+				const size_t inword = d % 3;
+				w |= quantize( planes[d % nc][d / nc], 1023.F ) << ( 20 - static_cast<int>( inword ) * 10 + shift );
+				if ( inword == 2 || d + 1 == n )
+				{
+					put_u32( line + ( d / 3 ) * 4, w, swap );
+					w = 0;
+				}
+			}
+			break;
+		}
+
+		case 12:
+		case 16:
+		{
+			precondition( e.bit_depth == 16 || e.packing == 1 || e.packing == 2, "12 bit DPX written as method A or B" );
+			const float maxv = e.bit_depth == 12 ? 4095.F : 65535.F;
+			const int shift = ( e.bit_depth == 12 && e.packing == 1 ) ? 4 : 0;
+			for ( size_t d = 0; d != n; ++d )
+				put_u16( line + d * 2, static_cast<uint16_t>( quantize( planes[d % nc][d / nc], maxv ) << shift ), swap );
+			std::fill( line + n * 2, line + lb, char( 0 ) );
+			break;
+		}
+
+		default:
+			throw_runtime( "Unable to write {0} bit DPX files", int( e.bit_depth ) );
+	}
+}
+
+////////////////////////////////////////
+
+} // namespace dpx
+
+} // namespace media
@@ -0,0 +1,156 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <base/endian.h>
+
+////////////////////////////////////////
+
+namespace media
+{
+
+namespace dpx
+{
+
+/// size of the (generic and industry) DPX header, which is where the
+/// writer puts the pixels
+static constexpr size_t kHeaderSize = 2048;
+
+/// Descriptor of an element, the datums it holds for each pixel
+enum descriptor : uint8_t
+{
+	DESC_USER = 0,
+	DESC_RED = 1,
+	DESC_GREEN = 2,
+	DESC_BLUE = 3,
+	DESC_ALPHA = 4,
+	DESC_LUMA = 6,
+	DESC_DEPTH = 8,
+	DESC_RGB = 50,
+	DESC_RGBA = 51,
+	DESC_ABGR = 52
+};
+
+/// Transfer characteristic of an element
+enum transfer : uint8_t
+{
+	XFER_USER = 0,
+	XFER_PRINTING_DENSITY = 1,
+	XFER_LINEAR = 2,
+	XFER_LOGARITHMIC = 3,
+	XFER_UNSPECIFIED_VIDEO = 4,
+	XFER_SMPTE_274M = 5,
+	XFER_BT709 = 6,
+	XFER_BT601_625 = 7,
+	XFER_BT601_525 = 8,
+	XFER_COMPOSITE_NTSC = 9,
+	XFER_COMPOSITE_PAL = 10,
+	XFER_Z_LINEAR = 11,
+	XFER_Z_HOMOGENEOUS = 12,
+	XFER_ADX = 13
+};
+
+/// Image element (a set of channels stored together) of a DPX file.
+///
+/// The packing is how datums smaller than 32 bits are stored: 0 is a
+/// continuous stream of bits, 1 (method A) fills 32-bit words
+/// leaving the padding in the low bits (i.e. 10-bit datums at bits
+/// 31-22, 21-12 and 11-2), 2 (method B) leaves the padding in the
+/// high bits.
+struct element
+{
+	uint32_t data_sign = 0;
+	uint32_t ref_low_data = 0;
+	float ref_low_quantity = 0.F;
+	uint32_t ref_high_data = 0;
+	float ref_high_quantity = 0.F;
+	uint8_t desc = DESC_RGB;
+	uint8_t xfer = XFER_USER;
+	uint8_t colorimetric = XFER_USER;
+	uint8_t bit_depth = 10;
+	uint16_t packing = 1;
+	uint16_t encoding = 0;
+	uint32_t data_offset = 0;
+	uint32_t eol_padding = 0;
+	uint32_t eoi_padding = 0;
+	std::string description;
+};
+
+///
+/// @brief The parts of a DPX (SMPTE 268M) header used by the reader
+/// and writer.
+///
+/// Kodak Cineon files, which DPX evolved from, are read into the same
+/// structure, as a single element.
+///
+struct header
+{
+	base::endianness endian = base::endianness::BIG;
+	bool cineon = false;
+	uint32_t image_offset = kHeaderSize;
+	uint32_t file_size = 0;
+	uint16_t orientation = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<element> elements;
+
+	std::string file_name;
+	std::string create_time;
+	std::string creator;
+	std::string project;
+	std::string copyright;
+	std::string input_device;
+	uint32_t aspect_h = 0;
+	uint32_t aspect_v = 0;
+	/// 0 when not given
+	float frame_rate = 0.F;
+	/// SMPTE time code and user bits, all bits set when not given
+	uint32_t timecode = 0xFFFFFFFF;
+	uint32_t userbits = 0xFFFFFFFF;
+};
+
+/// true if the first bytes of a file are a DPX or Cineon magic number
+/// (of either endianness)
+bool check_magic( const char *p, size_t n );
+
+/// parses the header of a DPX or Cineon file, throwing if it is not
+/// one (or one that can be read)
+header read_header( const char *p, size_t n );
+
+/// stores a DPX header into the first kHeaderSize bytes of p
+void write_header( char *p, const header &h );
+
+/// number of datums per pixel of an element, 0 if the descriptor is
+/// not supported
+int channel_count( uint8_t desc );
+
+/// names of the planes for the datums of a pixel, in the order stored
+std::vector<std::string> channel_names( uint8_t desc );
+
+/// bytes of a line of pixels of an element, not including the end of
+/// line padding
+size_t line_bytes( const element &e, uint32_t width );
+
+/// Unpacks a line of 10- or 12-bit datums (with any packing) into a
+/// 16-bit plane per channel, replicating the high bits into the low
+/// bits so the values cover the full 16-bit range. swap is true when
+/// the file endianness is not the native one.
+void unpack_line( const element &e, bool swap, const char *line, uint16_t *const *planes, int chans, size_t width );
+
+/// Quantizes a line of (0 - 1) float planes into an element of 8,
+/// 10, 12 or 16 bits, packed as method A (1) or method B (2).
+void pack_line( const element &e, bool swap, char *line, const float *const *planes, int chans, size_t width );
+
+} // namespace dpx
+
+////////////////////////////////////////
+
+} // namespace media
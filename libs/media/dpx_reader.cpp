@@ -0,0 +1,366 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "dpx_reader.h"
+#include "dpx.h"
+#include "file_per_sample_reader.h"
+#include "image.h"
+#include "image_buffer.h"
+#include "mapped_file.h"
+#include "video_track.h"
+#include "file_sequence.h"
+#include <base/contract.h>
+#include <base/file_system.h>
+#include <color/standards.h>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+
+////////////////////////////////////////
+
+namespace media
+{
+
+namespace
+{
+
+/// The contents of a file, either mapped into memory or read from
+/// the stream
+using file_bytes = std::shared_ptr<const char>;
+
+file_bytes read_file( base::istream &&str, size_t &size )
+{
+	auto s = std::make_shared<std::string>( std::istreambuf_iterator<char>( str ), std::istreambuf_iterator<char>() );
+	size = s->size();
+	return file_bytes( s, s->data() );
+}
+
+color::state element_color_state( const dpx::element &e )
+{
+	color::transfer t = color::transfer::LINEAR;
+	switch ( e.xfer )
+	{
+		case dpx::XFER_PRINTING_DENSITY:
+		case dpx::XFER_LOGARITHMIC:
+		case dpx::XFER_ADX:
+			t = color::transfer::CINEON;
+			break;
+		case dpx::XFER_UNSPECIFIED_VIDEO:
+		case dpx::XFER_SMPTE_274M:
+		case dpx::XFER_BT709:
+			t = color::transfer::GAMMA_BT709;
+			break;
+		case dpx::XFER_BT601_625:
+		case dpx::XFER_BT601_525:
+		case dpx::XFER_COMPOSITE_NTSC:
+		case dpx::XFER_COMPOSITE_PAL:
+			t = color::transfer::GAMMA_BT601;
+			break;
+		default:
+			break;
+	}
+
+	color::state::cx chroma = color::make_standard<color::standard::BT_709>().chroma();
+	if ( e.colorimetric == dpx::XFER_BT601_625 || e.colorimetric == dpx::XFER_COMPOSITE_PAL )
+		chroma = color::make_standard<color::standard::BT_601_PAL>().chroma();
+	else if ( e.colorimetric == dpx::XFER_BT601_525 || e.colorimetric == dpx::XFER_COMPOSITE_NTSC )
+		chroma = color::make_standard<color::standard::BT_601_NTSC>().chroma();
+
+	// video files record the legal range in the reference levels
+	color::range r = color::range::FULL;
+	if ( e.bit_depth >= 8 && e.bit_depth <= 16 &&
+		 e.ref_low_data == ( 16U << ( e.bit_depth - 8 ) ) &&
+		 e.ref_high_data == ( 235U << ( e.bit_depth - 8 ) ) )
+		r = color::range::SMPTE;
+
+	return color::state{
+		color::space::RGB,
+		chroma,
+		color::state::value_type( 1.0/0.18 ),
+		color::state::value_type( 0 ),
+		r,
+		t,
+		false
+	};
+}
+
+////////////////////////////////////////
+
+/// The planes of all the elements of a file. 8 and 16-bit integer and
+/// 32-bit float elements are used directly from the file contents
+/// (interleaved, in the endianness of the file), 10 and 12-bit
+/// elements are unpacked into 16-bit planes the first time a plane is
+/// needed.
+class dpx_image : public image
+{
+public:
+	dpx_image( const dpx::header &h, const file_bytes &bytes, size_t size )
+		: _header( h ), _bytes( bytes )
+	{
+		const int64_t w = static_cast<int64_t>( h.width );
+		const int64_t ht = static_cast<int64_t>( h.height );
+		set_area( area_rect::from_points( 0, 0, w - 1, ht - 1 ) );
+		if ( h.aspect_h != 0 && h.aspect_v != 0 && h.aspect_h != 0xFFFFFFFF && h.aspect_v != 0xFFFFFFFF )
+			aspect_ratio( static_cast<float>( h.aspect_h ) / static_cast<float>( h.aspect_v ) );
+		// left to right, bottom to top
+		const bool flip = h.orientation == 2;
+
+		size_t off = h.image_offset;
+		for ( size_t i = 0; i != h.elements.size(); ++i )
+		{
+			const dpx::element &e = h.elements[i];
+			if ( e.data_offset != 0 && e.data_offset != 0xFFFFFFFF )
+				off = e.data_offset;
+
+			const size_t stride = dpx::line_bytes( e, h.width ) + e.eol_padding;
+			if ( off + stride * h.height > size )
+				throw_runtime( "DPX element {0} extends past the end of the file", i );
+
+			const std::vector<std::string> names = dpx::channel_names( e.desc );
+			const int nc = static_cast<int>( names.size() );
+			const bool direct = e.bit_depth == 8 || e.bit_depth == 16 || e.bit_depth == 32;
+			const int64_t vbytes = e.bit_depth / 8;
+			const char *first = _bytes.get() + off + ( flip ? stride * ( h.height - 1 ) : 0 );
+			if ( direct && ( reinterpret_cast<uintptr_t>( first ) % static_cast<uintptr_t>( vbytes ) != 0 || stride % static_cast<size_t>( vbytes ) != 0 ) )
+				throw_runtime( "DPX element {0} is not aligned to its {1} bit values", i, int( e.bit_depth ) );
+
+			for ( int c = 0; c != nc; ++c )
+			{
+				plane_layout pl;
+				image_buffer b;
+				if ( direct )
+				{
+					const bool isfloat = e.bit_depth == 32;
+					pl._bits = static_cast<int8_t>( e.bit_depth );
+					pl._floating = isfloat;
+					pl._unsigned = ! isfloat;
+					pl._endian = e.bit_depth == 8 ? base::endianness::NATIVE : h.endian;
+					const size_t coff = static_cast<size_t>( first - _bytes.get() ) + static_cast<size_t>( c * vbytes );
+					const int64_t ys = static_cast<int64_t>( stride ) * ( flip ? -1 : 1 );
+					b = mapped_buffer( _bytes, coff, pl._bits, isfloat, ! isfloat, pl._endian,
+									   0, 0, w - 1, ht - 1, nc * vbytes, ys );
+				}
+				else
+				{
+					pl._bits = 16;
+					pl._floating = false;
+					pl._unsigned = true;
+				}
+				register_plane( names[static_cast<size_t>( c )], pl, 0.0 );
+				_planes.push_back( std::move( b ) );
+				_sources.emplace_back( i, off );
+			}
+
+			off += stride * h.height + e.eoi_padding;
+		}
+
+		color_state( element_color_state( h.elements.front() ) );
+		if ( ! h.creator.empty() )
+			set_meta( "creator", meta_string_t::make( h.creator ) );
+		if ( ! h.project.empty() )
+			set_meta( "project", meta_string_t::make( h.project ) );
+		if ( ! h.copyright.empty() )
+			set_meta( "copyright", meta_string_t::make( h.copyright ) );
+		if ( ! h.input_device.empty() )
+			set_meta( "inputDevice", meta_string_t::make( h.input_device ) );
+		if ( ! h.file_name.empty() )
+			set_meta( "originalFileName", meta_string_t::make( h.file_name ) );
+		if ( h.timecode != 0xFFFFFFFF )
+			set_meta( "timeCode", meta_smpte_timecode_t::make( std::make_pair( h.timecode, h.userbits ) ) );
+		// other orientations are read as stored
+		if ( h.orientation != 0 && h.orientation != 2 )
+			set_meta( "orientation", meta_uint16_t::make( h.orientation ) );
+	}
+
+protected:
+	bool storage_interleaved( void ) const override
+	{
+		return false;
+	}
+
+	void fill_plane( size_t plane, image_buffer &buffer ) override
+	{
+		copy_buffer( stored( plane ), buffer );
+	}
+
+	void fill_image( image_buffer &buffer ) override
+	{
+		for ( size_t p = 0; p != size(); ++p )
+			copy_to_interleaved( stored( p ), buffer, p );
+	}
+
+	image_buffer compute_direct_plane( size_t plane ) const override
+	{
+		return stored( plane );
+	}
+
+private:
+	const image_buffer &stored( size_t plane ) const
+	{
+		std::lock_guard<std::mutex> lk( _mutex );
+		if ( ! _planes.at( plane ).valid() )
+			unpack( _sources[plane].first );
+		return _planes[plane];
+	}
+
+	// unpacks all the channels of an element, as they are interleaved
+	void unpack( size_t elem ) const
+	{
+		const dpx::element &e = _header.elements[elem];
+		const int64_t w = static_cast<int64_t>( _header.width );
+		const int64_t ht = static_cast<int64_t>( _header.height );
+		const bool swap = _header.endian != base::endianness::NATIVE;
+		const bool flip = _header.orientation == 2;
+		const size_t stride = dpx::line_bytes( e, _header.width ) + e.eol_padding;
+
+		std::vector<size_t> planes;
+		for ( size_t p = 0; p != _sources.size(); ++p )
+		{
+			if ( _sources[p].first == elem )
+			{
+				planes.push_back( p );
+				_planes[p] = image_buffer::full_plane( 0, 0, w - 1, ht - 1, 16, 0, 0, false, true );
+			}
+		}
+
+		const char *src = _bytes.get() + _sources[planes.front()].second;
+		std::vector<uint16_t *> lines( planes.size() );
+		for ( int64_t y = 0; y < ht; ++y )
+		{
+			const int64_t dy = flip ? ht - 1 - y : y;
+			for ( size_t c = 0; c != planes.size(); ++c )
+				lines[c] = static_cast<uint16_t *>( _planes[planes[c]].row( dy ) );
+			dpx::unpack_line( e, swap, src + static_cast<size_t>( y ) * stride, lines.data(),
+							  static_cast<int>( planes.size() ), _header.width );
+		}
+	}
+
+	dpx::header _header;
+	file_bytes _bytes;
+	// element and offset of its pixels, for each plane
+	std::vector<std::pair<size_t, size_t>> _sources;
+	mutable std::mutex _mutex;
+	mutable std::vector<image_buffer> _planes;
+};
+
+////////////////////////////////////////
+
+class dpx_frame : public frame
+{
+public:
+	dpx_frame( const std::shared_ptr<base::file_system> &fs, const base::uri &u, int64_t num )
+		: frame( num )
+	{
+		size_t size = 0;
+		file_bytes bytes;
+		auto m = map_file( u, size );
+		if ( m )
+			bytes = file_bytes( m, m->get() );
+		else
+			bytes = read_file( fs->open_read( u ), size );
+
+		_header = dpx::read_header( bytes.get(), size );
+		layer &l = register_layer( std::string() );
+		l.add_view( std::string() ).store( std::make_shared<dpx_image>( _header, bytes, size ) );
+	}
+
+	sample_rate find_rate( void ) const
+	{
+		sample_rate sr;
+		if ( _header.frame_rate > 0.F )
+			sr.set_rate( static_cast<double>( _header.frame_rate ) );
+		return sr;
+	}
+
+private:
+	dpx::header _header;
+};
+
+////////////////////////////////////////
+
+class dpx_read_track : public video_track
+{
+public:
+	dpx_read_track( file_sequence &&fseq, int64_t b, int64_t e )
+		: video_track( std::string(), std::string(), b, e, sample_rate(), track_description( TRACK_VIDEO ) ),
+		  _files( std::move( fseq ) )
+	{
+	}
+
+	frame *doRead( int64_t f ) override
+	{
+		std::unique_ptr<dpx_frame> ret{
+			new dpx_frame(
+				base::file_system::get( _files.uri() ),
+				_files.get_frame( f ),
+				f )
+		};
+
+		if ( ! rate().valid() )
+			update_rate( ret->find_rate() );
+
+		return ret.release();
+	}
+
+	void doWrite( int64_t , const frame & ) override
+	{
+		throw_logic( "reader asked to write a frame" );
+	}
+
+private:
+	file_sequence _files;
+};
+
+////////////////////////////////////////
+
+class DPXReader : public file_per_sample_reader
+{
+public:
+	DPXReader( void )
+			: file_per_sample_reader( "DPX" )
+	{
+		_description = "DPX / Cineon Reader";
+		_extensions.emplace_back( "dpx" );
+		_extensions.emplace_back( "cin" );
+		_magics.push_back( { 'S', 'D', 'P', 'X' } );
+		_magics.push_back( { 'X', 'P', 'D', 'S' } );
+		_magics.push_back( { 0x80, 0x2A, 0x5F, 0xD7 } );
+		_magics.push_back( { 0xD7, 0x5F, 0x2A, 0x80 } );
+	}
+
+	~DPXReader( void ) override = default;
+	container create( const base::uri &u, const parameter_set &params ) override;
+};
+
+container
+DPXReader::create( const base::uri &u, const parameter_set &p )
+{
+	container result;
+
+	int64_t start, last;
+	file_sequence fseq( u );
+	auto fs = scan_samples( start, last, fseq );
+
+	result.add_track( std::make_shared<dpx_read_track>( std::move( fseq ), start, last ) );
+	result.set_parameters( p );
+
+	return result;
+}
+
+} // empty namespace
+
+////////////////////////////////////////
+
+void register_dpx_reader( void )
+{
+	reader::register_reader( std::make_shared<DPXReader>() );
+}
+
+////////////////////////////////////////
+
+}
+
@@ -0,0 +1,20 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+namespace media
+{
+
+////////////////////////////////////////
+
+void register_dpx_reader( void );
+
+////////////////////////////////////////
+
+}
+
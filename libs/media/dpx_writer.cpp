@@ -0,0 +1,311 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "dpx_writer.h"
+#include "dpx.h"
+#include "writer.h"
+#include "image.h"
+#include "image_buffer.h"
+#include "video_track.h"
+#include "file_sequence.h"
+#include <base/contract.h>
+#include <base/file_system.h>
+#include <base/string_util.h>
+#include <vector>
+
+////////////////////////////////////////
+
+namespace media
+{
+
+namespace
+{
+
+struct write_options
+{
+	uint8_t bits = 10;
+	uint16_t packing = 1;
+	base::endianness endian = base::endianness::BIG;
+};
+
+write_options extractOptions( const parameter_set &parms )
+{
+	write_options r;
+
+	auto b = parms.find( "bit_depth" );
+	if ( b != parms.end() && b->second.valid() )
+		r.bits = static_cast<uint8_t>( std::stoi( b->second.as_string() ) );
+
+	auto p = parms.find( "packing" );
+	if ( p != parms.end() && p->second.valid() )
+		r.packing = p->second.as_string() == "b" ? 2 : 1;
+
+	auto e = parms.find( "endian" );
+	if ( e != parms.end() && e->second.valid() )
+		r.endian = e->second.as_string() == "little" ? base::endianness::LITTLE : base::endianness::BIG;
+
+	return r;
+}
+
+uint8_t transfer_for( const color::state &cs )
+{
+	switch ( cs.curve() )
+	{
+		case color::transfer::CINEON:
+		case color::transfer::CINEON_SOFTCLIP:
+			return dpx::XFER_PRINTING_DENSITY;
+		case color::transfer::LINEAR:
+			return dpx::XFER_LINEAR;
+		case color::transfer::GAMMA_BT709:
+			return dpx::XFER_BT709;
+		case color::transfer::GAMMA_BT601:
+			return dpx::XFER_BT601_625;
+		default:
+			break;
+	}
+	return dpx::XFER_USER;
+}
+
+const std::string *find_string( const metadata &md, const char *name )
+{
+	auto i = md.find( name );
+	if ( i == md.end() || i->second.type() != meta_string_t::tag )
+		return nullptr;
+	return &meta_string_t::retrieve( i->second );
+}
+
+/// returns the planes of img to store (in the order of the
+/// descriptor), and the descriptor
+std::vector<size_t> choose_planes( const image &img, uint8_t &desc )
+{
+	auto find = [&img]( const char *n ) -> int
+	{
+		for ( size_t p = 0; p != img.size(); ++p )
+		{
+			if ( base::to_lower( img.plane_name( p ) ) == n )
+				return static_cast<int>( p );
+		}
+		return -1;
+	};
+
+	int r = find( "r" ), g = find( "g" ), b = find( "b" ), a = find( "a" ), y = find( "y" );
+	std::vector<size_t> ret;
+	if ( r >= 0 && g >= 0 && b >= 0 )
+	{
+		ret = { size_t( r ), size_t( g ), size_t( b ) };
+		desc = dpx::DESC_RGB;
+		if ( a >= 0 )
+		{
+			ret.push_back( size_t( a ) );
+			desc = dpx::DESC_RGBA;
+		}
+	}
+	else if ( y >= 0 || img.size() == 1 )
+	{
+		ret.push_back( y >= 0 ? size_t( y ) : 0 );
+		desc = dpx::DESC_LUMA;
+	}
+	else
+		throw_runtime( "DPX needs R, G, B (and A) or Y planes to write" );
+
+	return ret;
+}
+
+////////////////////////////////////////
+
+/// Writes a file per frame, the first image of the frame as a single
+/// element.
+class dpx_write_track : public video_track
+{
+public:
+	dpx_write_track( const base::uri &files, const parameter_set &parms )
+		: video_track( std::string(), std::string(), 0, 0, sample_rate(), track_description( TRACK_VIDEO ) ),
+		  _files( files ), _options( extractOptions( parms ) )
+	{
+	}
+
+	dpx_write_track( std::string n, std::string v, int64_t b, int64_t e, const sample_rate &sr, const base::uri &files, const media::track_description &td, const parameter_set &parms )
+		: video_track( std::move( n ), std::move( v ), b, e, sr, td ),
+		  _files( files ), _options( extractOptions( parms ) )
+	{
+	}
+
+	frame *doRead( int64_t ) override
+	{
+		throw_logic( "writer asked to read a frame" );
+	}
+
+	void doWrite( int64_t f, const frame &frm ) override
+	{
+		if ( frm.image_begin() == frm.image_end() )
+			throw_runtime( "No image to write to DPX for frame {0}", f );
+		image &img = *( frm.image_begin() );
+
+		dpx::element e;
+		std::vector<size_t> planes = choose_planes( img, e.desc );
+		const area_rect &a = img.active_area();
+		const int chans = static_cast<int>( planes.size() );
+		e.bit_depth = _options.bits;
+		e.packing = _options.packing;
+		e.xfer = transfer_for( img.color_state() );
+		e.colorimetric = e.xfer == dpx::XFER_LINEAR ? uint8_t( dpx::XFER_BT709 ) : e.xfer;
+		e.ref_high_data = ( 1U << e.bit_depth ) - 1;
+		if ( e.xfer == dpx::XFER_PRINTING_DENSITY )
+			e.ref_high_quantity = 2.047F;
+		e.data_offset = dpx::kHeaderSize;
+
+		dpx::header h;
+		h.endian = _options.endian;
+		h.width = static_cast<uint32_t>( a.width() );
+		h.height = static_cast<uint32_t>( a.height() );
+		h.elements.push_back( e );
+		if ( img.aspect_ratio() > 0.F && img.aspect_ratio() != 1.F )
+		{
+			h.aspect_h = static_cast<uint32_t>( img.aspect_ratio() * 1000.F + 0.5F );
+			h.aspect_v = 1000;
+		}
+		if ( rate().valid() )
+			h.frame_rate = static_cast<float>( rate().to_number() );
+		const metadata &md = img.meta();
+		if ( auto s = find_string( md, "creator" ) )
+			h.creator = *s;
+		if ( auto s = find_string( md, "project" ) )
+			h.project = *s;
+		if ( auto s = find_string( md, "copyright" ) )
+			h.copyright = *s;
+		if ( auto s = find_string( md, "inputDevice" ) )
+			h.input_device = *s;
+		auto tc = md.find( "timeCode" );
+		if ( tc != md.end() && tc->second.type() == meta_smpte_timecode_t::tag )
+		{
+			h.timecode = meta_smpte_timecode_t::retrieve( tc->second ).first;
+			h.userbits = meta_smpte_timecode_t::retrieve( tc->second ).second;
+		}
+
+		const base::uri u = _files.get_frame( f );
+		if ( ! u.path().empty() )
+			h.file_name = u.path().back();
+		const size_t lb = dpx::line_bytes( e, h.width );
+		std::vector<char> out( dpx::kHeaderSize + lb * h.height );
+		h.file_size = static_cast<uint32_t>( out.size() );
+		dpx::write_header( out.data(), h );
+
+		// the stored planes, from the file contents when possible
+		std::vector<image_buffer> src;
+		for ( size_t p: planes )
+		{
+			image_buffer b = img.direct_plane( p );
+			if ( ! b.valid() || b.x1() > a.x1() || b.y1() > a.y1() || b.x2() < a.x2() || b.y2() < a.y2() )
+			{
+				plane_layout pl = img.layout( p );
+				b = image_buffer::full_plane( a.x1(), a.y1(), a.x2(), a.y2(),
+											  pl._bits, pl._xsubsample_shift, pl._ysubsample_shift,
+											  pl._floating, pl._unsigned );
+				img.retrieve( p, b );
+			}
+			else
+				b = b.sub_buffer( a.x1(), a.y1(), a.x2(), a.y2() );
+			src.push_back( std::move( b ) );
+		}
+
+		const size_t w = static_cast<size_t>( h.width );
+		std::vector<float> lines( w * planes.size() );
+		std::vector<const float *> lp;
+		for ( size_t c = 0; c != planes.size(); ++c )
+			lp.push_back( lines.data() + c * w );
+		const bool swap = h.endian != base::endianness::NATIVE;
+		char *dst = out.data() + dpx::kHeaderSize;
+		for ( int64_t y = a.y1(); y <= a.y2(); ++y, dst += lb )
+		{
+			for ( size_t c = 0; c != src.size(); ++c )
+				src[c].get_scanline( y, lines.data() + c * w );
+			dpx::pack_line( e, swap, dst, lp.data(), chans, w );
+		}
+
+		auto fs = base::file_system::get( _files.uri() );
+		base::ostream stream = fs->open_write( u );
+		if ( ! stream.write( out.data(), static_cast<std::streamsize>( out.size() ) ) )
+			throw_runtime( "Unable to write DPX file {0}", u );
+	}
+
+private:
+	file_sequence _files;
+	write_options _options;
+};
+
+////////////////////////////////////////
+
+class DPXWriter : public writer
+{
+public:
+	DPXWriter( void )
+		: writer( "DPX" )
+	{
+		_description = "DPX Writer";
+		_extensions.emplace_back( "dpx" );
+		_parms.push_back(
+			media::parameter_definition(
+				"bit_depth",
+				std::vector<std::string>{ "8", "10", "12", "16" },
+				"10" ) );
+		_parms.back().help( "Bits per channel to store\n" );
+		_parms.push_back(
+			media::parameter_definition(
+				"packing",
+				std::vector<std::string>{ "a", "b" },
+				"a" ) );
+		_parms.back().help( "How 10 and 12 bit values are packed in 32-bit words:\n"
+							" a - Method A, padding in the low bits (most common)\n"
+							" b - Method B, padding in the high bits\n"
+							);
+		_parms.push_back(
+			media::parameter_definition(
+				"endian",
+				std::vector<std::string>{ "big", "little" },
+				"big" ) );
+		_parms.back().help( "Byte order of the file\n" );
+	}
+	~DPXWriter( void ) override = default;
+
+	container create( const base::uri &u, const std::vector<track_description> &td, const parameter_set &params ) override;
+};
+
+container
+DPXWriter::create( const base::uri &u, const std::vector<track_description> &tdlist, const parameter_set &params )
+{
+	container ret;
+
+	if ( tdlist.empty() )
+	{
+		ret.add_track( std::make_shared<dpx_write_track>( u, params ) );
+	}
+	else
+	{
+		const track_description &td = tdlist.front();
+		if ( tdlist.size() != 1 || td.type() != TRACK_VIDEO )
+			throw_runtime( "DPX only supports a single video track" );
+
+		ret.add_track( std::make_shared<dpx_write_track>( td.name(), td.view(), td.offset(), td.offset() + td.duration() - 1, td.rate(), u, td, params ) );
+	}
+	ret.set_parameters( params );
+
+	return ret;
+}
+
+} // empty namespace
+
+////////////////////////////////////////
+
+void register_dpx_writer( void )
+{
+	writer::register_writer( std::make_shared<DPXWriter>() );
+}
+
+////////////////////////////////////////
+
+} // namespace media
+
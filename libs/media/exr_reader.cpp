@@ -14,6 +14,8 @@
 # include "data.h"
 # include "video_track.h"
 # include "file_sequence.h"
+# include "mapped_file.h"
+# include <base/endian.h>
 # include <base/string_util.h>
 # include <base/file_system.h>
 # include <base/env.h>
@@ -76,6 +78,7 @@
 # pragma GCC diagnostic pop
 
 # include <algorithm>
+# include <cstring>
 # include <iostream>
 #endif
 
@@ -474,6 +477,194 @@ static void fill_metadata( M &md, color::state &cs, const EXR::Header &header )
 
 ////////////////////////////////////////
 
+// size of a value of the pixel type
+static size_t pixel_type_bytes( EXR::PixelType t, bool &flt )
+{
+	switch ( t )
+	{
+		case EXR::UINT:
+			flt = false;
+			return sizeof(uint32_t);
+
+		case EXR::HALF:
+			flt = true;
+			return sizeof(base::half);
+
+		case EXR::FLOAT:
+			flt = true;
+			return sizeof(float);
+
+		case EXR::NUM_PIXELTYPES:
+		default:
+			break;
+	}
+	throw_logic( "Unknown OpenEXR pixel type {0}", static_cast<int>( t ) );
+}
+
+// scanlines per compressed block for the compression type
+static int lines_per_block( EXR::Compression c )
+{
+	switch ( c )
+	{
+		case EXR::NO_COMPRESSION:
+		case EXR::RLE_COMPRESSION:
+		case EXR::ZIPS_COMPRESSION:
+			return 1;
+		case EXR::ZIP_COMPRESSION:
+		case EXR::PXR24_COMPRESSION:
+			return 16;
+		case EXR::PIZ_COMPRESSION:
+		case EXR::B44_COMPRESSION:
+		case EXR::B44A_COMPRESSION:
+		case EXR::DWAA_COMPRESSION:
+			return 32;
+		case EXR::DWAB_COMPRESSION:
+			return 256;
+		default:
+			break;
+	}
+	return 1;
+}
+
+////////////////////////////////////////
+
+// Where the scanlines of an uncompressed scanline part are in the
+// file, so the pixels can be used straight from a memory map of it
+struct mapped_lines
+{
+	std::shared_ptr<const mapped_file> map;
+	// offset of the pixels of the first scanline of the data window
+	size_t first = 0;
+	// bytes from one scanline to the next
+	int64_t stride = 0;
+};
+
+template <typename T>
+static T read_le( const char *p )
+{
+	T v;
+	std::memcpy( &v, p, sizeof(T) );
+	return base::is_little_endian() ? v : base::byteswap( v );
+}
+
+// skips the attributes of a header, up to (and including) the null
+// byte ending it
+static bool skip_header( const char *p, size_t size, size_t &pos )
+{
+	while ( pos < size )
+	{
+		if ( p[pos] == 0 )
+		{
+			++pos;
+			return true;
+		}
+
+		// attribute name and type, each null terminated
+		for ( int s = 0; s != 2; ++s )
+		{
+			const void *e = std::memchr( p + pos, 0, size - pos );
+			if ( ! e )
+				return false;
+			pos = static_cast<size_t>( static_cast<const char *>( e ) - p ) + 1;
+		}
+		if ( pos + 4 > size )
+			return false;
+		int32_t sz = read_le<int32_t>( p + pos );
+		if ( sz < 0 )
+			return false;
+		pos += 4 + static_cast<size_t>( sz );
+	}
+	return false;
+}
+
+// Finds the scanlines of an uncompressed scanline part in the mapped
+// file, following the headers to the line offset table. Only parts
+// where the scanlines are evenly spaced (the usual layout) can be used
+// directly, anything unexpected leaves it to OpenEXR
+static bool find_mapped_lines( mapped_lines &ml, size_t size, const EXR::MultiPartInputFile &f, int part )
+{
+	const char *p = ml.map->get();
+	if ( size < 8 || read_le<int32_t>( p ) != 20000630 )
+		return false;
+	const bool multi = ( read_le<int32_t>( p + 4 ) & 0x1000 ) != 0;
+
+	size_t pos = 8;
+	for ( int i = 0, nP = multi ? f.parts() : 1; i != nP; ++i )
+	{
+		if ( ! skip_header( p, size, pos ) )
+			return false;
+	}
+	if ( multi )
+	{
+		// empty header ending the list of headers
+		if ( pos >= size || p[pos] != 0 )
+			return false;
+		++pos;
+	}
+
+	// skip the offset tables of the previous parts, multi-part files
+	// always have a chunk count
+	for ( int i = 0; i != part; ++i )
+	{
+		try
+		{
+			int32_t chunks = f.header( i ).typedAttribute<EXR::IntAttribute>( "chunkCount" ).value();
+			pos += 8 * static_cast<size_t>( chunks );
+		}
+		catch ( ... )
+		{
+			return false;
+		}
+	}
+
+	const EXR::Header &h = f.header( part );
+	const IMATH::Box2i &dw = h.dataWindow();
+	const int64_t lines = int64_t( dw.max.y ) - int64_t( dw.min.y ) + 1;
+	const int64_t width = int64_t( dw.max.x ) - int64_t( dw.min.x ) + 1;
+	int64_t lineBytes = 0;
+	for ( auto c = h.channels().begin(); c != h.channels().end(); ++c )
+	{
+		bool flt = false;
+		if ( c.channel().xSampling != 1 || c.channel().ySampling != 1 )
+			return false;
+		lineBytes += width * static_cast<int64_t>( pixel_type_bytes( c.channel().type, flt ) );
+	}
+
+	if ( pos + 8 * static_cast<size_t>( lines ) > size )
+		return false;
+	const int64_t hdr = multi ? 12 : 8;
+	const int64_t o0 = static_cast<int64_t>( read_le<uint64_t>( p + pos ) );
+	const int64_t step = lines > 1 ? static_cast<int64_t>( read_le<uint64_t>( p + pos + 8 ) ) - o0 : hdr + lineBytes;
+	for ( int64_t i = 2; i < lines; ++i )
+	{
+		if ( static_cast<int64_t>( read_le<uint64_t>( p + pos + 8 * static_cast<size_t>( i ) ) ) != o0 + i * step )
+			return false;
+	}
+
+	// check the chunk at either end holds the expected scanline
+	for ( int64_t i: { int64_t(0), lines - 1 } )
+	{
+		const int64_t o = o0 + i * step;
+		if ( o < 0 || o + hdr + lineBytes > static_cast<int64_t>( size ) )
+			return false;
+		const char *c = p + o;
+		if ( multi )
+		{
+			if ( read_le<int32_t>( c ) != part )
+				return false;
+			c += 4;
+		}
+		if ( read_le<int32_t>( c ) != dw.min.y + i || read_le<int32_t>( c + 4 ) != lineBytes )
+			return false;
+	}
+
+	ml.first = static_cast<size_t>( o0 + hdr );
+	ml.stride = step;
+	return true;
+}
+
+////////////////////////////////////////
+
 class exr_image : public image
 {
 public:
@@ -484,21 +675,38 @@ public:
 		const EXR::Header &header,
 		std::vector<std::string> pnames,
 		std::vector<std::string> pfullnames,
-		const std::vector<plane_layout> &pl
+		const std::vector<plane_layout> &pl,
+		const mapped_lines &ml = mapped_lines()
 			  )
 		: _file( f ),
 		  _stream( s ),
 		  _header( header ),
 		  _plane_names( std::move( pnames ) ),
-		  _full_plane_names( std::move( pfullnames ) )
+		  _full_plane_names( std::move( pfullnames ) ),
+		  _mapped( ml )
 	{
 		if ( header.type() == EXR::TILEDIMAGE )
+		{
 			_tiled_part.reset( new EXR::TiledInputPart( *f, part ) );
+			set_tiling( static_cast<int>( _tiled_part->tileXSize() ), static_cast<int>( _tiled_part->tileYSize() ) );
+			switch ( _tiled_part->levelMode() )
+			{
+				case EXR::MIPMAP_LEVELS:
+					set_levels( level_mode::MIPMAP, _tiled_part->numXLevels(), _tiled_part->numYLevels() );
+					break;
+				case EXR::RIPMAP_LEVELS:
+					set_levels( level_mode::RIPMAP, _tiled_part->numXLevels(), _tiled_part->numYLevels() );
+					break;
+				case EXR::ONE_LEVEL:
+				default:
+					break;
+			}
+		}
 		else
 			_scan_part.reset( new EXR::InputPart( *f, part ) );
 
 		const auto &disp = header.displayWindow();
-		const auto &data = header.displayWindow();
+		const auto &data = header.dataWindow();
 		set_active_area( area_rect::from_points( data.min.x, data.min.y,
 												 data.max.x, data.max.y ) );
 		set_full_area( area_rect::from_points( disp.min.x, disp.min.y,
@@ -532,67 +740,62 @@ public:
 	}
 
 protected:
+	// a channel to read, at offset bytes into each pixel of the
+	// destination
+	struct chan_slice
+	{
+		const std::string *name;
+		EXR::PixelType type;
+		size_t offset;
+	};
+
 	bool storage_interleaved( void ) const override
 	{
 		return false;
 	}
 
 	void fill_plane( size_t plane, image_buffer &buffer ) override
+	{
+		fill_plane_level( plane, buffer, 0, 0 );
+	}
+
+	void fill_plane_level( size_t plane, image_buffer &buffer, int lx, int ly ) override
 	{
 		if ( plane >= _plane_names.size() )
 			throw_runtime( "Attempt to access plane {0}, beyond the end of the EXR image ({1} planes)", plane, _plane_names.size() );
 
 		const EXR::Channel &imfchan = _header.channels()[_full_plane_names[plane]];
-		IMATH::Box2i dataWin = _header.dataWindow();
 		// TODO: handle subsampling
-		size_t bytes = 0;
 		bool flt = false;
-
-		switch ( imfchan.type )
-		{
-			case EXR::UINT:
-				bytes = sizeof(uint32_t);
-				break;
-
-			case EXR::HALF:
-				bytes = sizeof(base::half);
-				flt = true;
-				break;
-
-			case EXR::FLOAT:
-				bytes = sizeof(float);
-				flt = true;
-				break;
-				
-			case EXR::NUM_PIXELTYPES:
-			default:
-				throw_logic( "Unknown OpenEXR pixel type {0}", static_cast<int>( imfchan.type ) );
-		}
+		size_t bytes = pixel_type_bytes( imfchan.type, flt );
 
 		if ( buffer.is_floating() != flt || static_cast<size_t>( buffer.bits() ) != ( bytes * 8 ) )
 			throw_runtime( "Attempt to access EXR image with wrong buffer type" );
 
-		// TODO: support sub-scanline reading (double copy :()
-		if ( buffer.x1() != dataWin.min.x || buffer.x2() != dataWin.max.x )
-			throw_runtime( "Only full scanline reading of EXR implemented" );
-
-		size_t scanlinebytes = static_cast<size_t>( dataWin.max.x - dataWin.min.x + 1 ) * bytes;
-		char *data = static_cast<char *>( buffer.data() );
-		data -= dataWin.min.x * bytes;
-		data -= buffer.y1() * scanlinebytes;
-		
-		EXR::FrameBuffer fbuf;
-		fbuf.insert(
-			_full_plane_names[plane],
-			EXR::Slice( imfchan.type, data, bytes, scanlinebytes ) );
-
-		if ( _scan_part )
+		// uncompressed pixels in a mapped file are just copied out
+		size_t moff = 0, mbytes = 0;
+		bool mflt = false;
+		if ( lx == 0 && ly == 0 && base::is_little_endian() && mapped_plane( plane, moff, mbytes, mflt ) )
 		{
-			_scan_part->setFrameBuffer( fbuf );
-			_scan_part->readPixels( buffer.y1(), buffer.y2() );
+			const IMATH::Box2i &dw = _header.dataWindow();
+			if ( buffer.x1() < dw.min.x || buffer.y1() < dw.min.y || buffer.x2() > dw.max.x || buffer.y2() > dw.max.y )
+				throw_runtime( "Request for EXR area ({0}, {1}) - ({2}, {3}) outside of data window ({4}, {5}) - ({6}, {7})",
+							   buffer.x1(), buffer.y1(), buffer.x2(), buffer.y2(), dw.min.x, dw.min.y, dw.max.x, dw.max.y );
+
+			const char *src = _mapped.map->get() + moff + static_cast<size_t>( buffer.x1() - dw.min.x ) * bytes;
+			const size_t copyBytes = static_cast<size_t>( buffer.width() ) * bytes;
+			for ( int64_t y = buffer.y1(); y <= buffer.y2(); ++y )
+				copy_span( static_cast<char *>( buffer.row( y ) ), buffer.xstride_bytes(),
+						   src + ( y - dw.min.y ) * _mapped.stride, bytes, copyBytes );
+			return;
 		}
-		else if ( _tiled_part )
-			throw_not_yet();
+
+		std::vector<chan_slice> chans{ chan_slice{ &_full_plane_names[plane], imfchan.type, 0 } };
+		read_area( chans, bytes, static_cast<char *>( buffer.data() ),
+				   buffer.xstride_bytes(), buffer.ystride_bytes(),
+				   static_cast<int>( buffer.x1() ), static_cast<int>( buffer.y1() ),
+				   static_cast<int>( buffer.x2() ), static_cast<int>( buffer.y2() ),
+				   lx, ly );
 	}
 
 	void fill_image( image_buffer &buffer ) override
@@ -615,28 +818,7 @@ protected:
 				throw_runtime( "Unhandled different pixel types for different planes retrieving all channels at once" );
 
 			if ( bytes == 0 )
-			{
-				switch ( type )
-				{
-					case EXR::UINT:
-						bytes = sizeof(uint32_t);
-						break;
-
-					case EXR::HALF:
-						bytes = sizeof(base::half);
-						flt = true;
-						break;
-
-					case EXR::FLOAT:
-						bytes = sizeof(float);
-						flt = true;
-						break;
-				
-					case EXR::NUM_PIXELTYPES:
-					default:
-						throw_logic( "Unknown OpenEXR pixel type {0}", static_cast<int>( type ) );
-				}
-			}
+				bytes = pixel_type_bytes( type, flt );
 		}
 
 		if ( buffer.is_floating() != flt || static_cast<size_t>( buffer.bits() ) != ( bytes * 8 ) )
@@ -650,33 +832,221 @@ protected:
 		size_t pixelbytes = bytes * nChans;
 		size_t scanlinebytes = width * pixelbytes;
 
-		char *data = static_cast<char *>( buffer.data() );
-		data -= dataWin.min.x * pixelbytes;
-		data -= buffer.y1() * scanlinebytes;
-		
-		EXR::FrameBuffer fbuf;
+		std::vector<chan_slice> chans;
 		for ( size_t c = 0; c != nChans; ++c )
+			chans.push_back( chan_slice{ &_full_plane_names[c], type, c * bytes } );
+
+		read_area( chans, pixelbytes, static_cast<char *>( buffer.data() ),
+				   static_cast<int64_t>( pixelbytes ), static_cast<int64_t>( scanlinebytes ),
+				   dataWin.min.x, static_cast<int>( buffer.y1() ),
+				   dataWin.max.x, static_cast<int>( buffer.y2() ),
+				   0, 0 );
+	}
+
+	area_rect compute_level_area( int lx, int ly ) const override
+	{
+		if ( ! _tiled_part )
+			return image::compute_level_area( lx, ly );
+
+		if ( ! _tiled_part->isValidLevel( lx, ly ) )
+			throw_runtime( "EXR image does not have resolution level ({0}, {1})", lx, ly );
+		IMATH::Box2i lw = _tiled_part->dataWindowForLevel( lx, ly );
+		return area_rect::from_points( lw.min.x, lw.min.y, lw.max.x, lw.max.y );
+	}
+
+	std::pair<int64_t, int64_t> compute_preferred_chunk( void ) const override
+	{
+		if ( _tiled_part )
+			return std::make_pair( static_cast<int64_t>( tile_x() ), static_cast<int64_t>( tile_y() ) );
+
+		return std::make_pair( active_area().width(), static_cast<int64_t>( lines_per_block( _header.compression() ) ) );
+	}
+
+	image_buffer compute_direct_plane( size_t plane ) const override
+	{
+		size_t offset = 0, bytes = 0;
+		bool flt = false;
+		if ( ! mapped_plane( plane, offset, bytes, flt ) )
+			return image_buffer();
+
+		// converting from the buffer needs the values aligned
+		if ( ( reinterpret_cast<uintptr_t>( _mapped.map->get() ) + offset ) % bytes != 0 ||
+			 _mapped.stride % static_cast<int64_t>( bytes ) != 0 )
+			return image_buffer();
+
+		const IMATH::Box2i &dw = _header.dataWindow();
+		return mapped_buffer( _mapped.map, offset, static_cast<int16_t>( bytes * 8 ), flt, ! flt,
+							  base::endianness::LITTLE, dw.min.x, dw.min.y, dw.max.x, dw.max.y,
+							  static_cast<int64_t>( bytes ), _mapped.stride );
+	}
+
+	// offset in the mapped file of the first scanline of the plane,
+	// and the size of its values, if the part is mapped
+	bool mapped_plane( size_t plane, size_t &offset, size_t &bytes, bool &flt ) const
+	{
+		if ( ! _mapped.map || plane >= _full_plane_names.size() )
+			return false;
+
+		// the channels of a scanline follow each other, in order
+		const IMATH::Box2i &dw = _header.dataWindow();
+		const size_t width = static_cast<size_t>( dw.max.x - dw.min.x + 1 );
+		offset = _mapped.first;
+		for ( auto c = _header.channels().begin(); c != _header.channels().end(); ++c )
 		{
-			fbuf.insert(
-				_full_plane_names[c],
-				EXR::Slice( type, data + c*bytes, pixelbytes, scanlinebytes ) );
+			bytes = pixel_type_bytes( c.channel().type, flt );
+			if ( _full_plane_names[plane] == c.name() )
+				return true;
+			offset += width * bytes;
 		}
+		return false;
+	}
 
-		if ( _scan_part )
+	// decode buffer for areas not aligned to the blocks, kept per
+	// thread (planes are filled from the worker threads) and grown as
+	// needed so it is not reallocated for every plane
+	static char *block_buffer( size_t bytes )
+	{
+		static thread_local std::vector<char> buf;
+		if ( buf.size() < bytes )
+			buf.resize( bytes );
+		return buf.data();
+	}
+
+	// copies a span of pixels from the packed src to dst, where the
+	// pixels are xs bytes apart
+	static void copy_span( char *dst, int64_t xs, const char *src, size_t pixelBytes, size_t bytes )
+	{
+		if ( xs == static_cast<int64_t>( pixelBytes ) )
+			std::memcpy( dst, src, bytes );
+		else
+		{
+			for ( const char *e = src + bytes; src != e; src += pixelBytes, dst += xs )
+				std::memcpy( dst, src, pixelBytes );
+		}
+	}
+
+	// reads the area (x1, y1) - (x2, y2) of level (lx, ly) into dst,
+	// which points to pixel (x1, y1), with the given strides in bytes
+	void read_area( const std::vector<chan_slice> &chans, size_t pixelBytes, char *dst, int64_t xs, int64_t ys, int x1, int y1, int x2, int y2, int lx, int ly )
+	{
+		if ( _tiled_part )
 		{
+			read_tiles( chans, pixelBytes, dst, xs, ys, x1, y1, x2, y2, lx, ly );
+			return;
+		}
+
+		if ( lx != 0 || ly != 0 )
+			throw_runtime( "EXR scanline image does not have resolution level ({0}, {1})", lx, ly );
+
+		IMATH::Box2i dataWin = _header.dataWindow();
+		if ( x1 < dataWin.min.x || y1 < dataWin.min.y || x2 > dataWin.max.x || y2 > dataWin.max.y )
+			throw_runtime( "Request for EXR area ({0}, {1}) - ({2}, {3}) outside of data window ({4}, {5}) - ({6}, {7})",
+						   x1, y1, x2, y2, dataWin.min.x, dataWin.min.y, dataWin.max.x, dataWin.max.y );
+
+		if ( x1 == dataWin.min.x && x2 == dataWin.max.x )
+		{
+			char *base = dst - static_cast<ptrdiff_t>( x1 ) * xs - static_cast<ptrdiff_t>( y1 ) * ys;
+			EXR::FrameBuffer fbuf;
+			for ( auto &c: chans )
+				fbuf.insert( *(c.name), EXR::Slice( c.type, base + c.offset, static_cast<size_t>( xs ), static_cast<size_t>( ys ) ) );
+
 			_scan_part->setFrameBuffer( fbuf );
-			_scan_part->readPixels( buffer.y1(), buffer.y2() );
+			_scan_part->readPixels( y1, y2 );
+			return;
+		}
+
+		// A scanline always decodes whole, so a narrower area is read
+		// a group of blocks at a time into a (full width) per thread
+		// buffer, and only the x span copied out. Only the blocks
+		// covering y1 - y2 are decoded, and a few blocks per call
+		// still lets the EXR thread pool decode them in parallel
+		const int lpb = lines_per_block( _header.compression() );
+		const int group = lpb * std::max( 1, kScanGroupLines / lpb );
+		const size_t rowBytes = static_cast<size_t>( dataWin.max.x - dataWin.min.x + 1 ) * pixelBytes;
+		const size_t copyBytes = static_cast<size_t>( x2 - x1 + 1 ) * pixelBytes;
+		char *scratch = block_buffer( rowBytes * static_cast<size_t>( group ) );
+
+		int gy1 = dataWin.min.y + ( ( y1 - dataWin.min.y ) / group ) * group;
+		for ( ; gy1 <= y2; gy1 += group )
+		{
+			const int ry1 = std::max( gy1, y1 );
+			const int ry2 = std::min( gy1 + group - 1, y2 );
+			char *base = scratch - static_cast<ptrdiff_t>( dataWin.min.x ) * static_cast<ptrdiff_t>( pixelBytes ) - static_cast<ptrdiff_t>( gy1 ) * static_cast<ptrdiff_t>( rowBytes );
+			EXR::FrameBuffer fbuf;
+			for ( auto &c: chans )
+				fbuf.insert( *(c.name), EXR::Slice( c.type, base + c.offset, pixelBytes, rowBytes ) );
+			_scan_part->setFrameBuffer( fbuf );
+			_scan_part->readPixels( ry1, ry2 );
+
+			for ( int y = ry1; y <= ry2; ++y )
+			{
+				const char *src = scratch + static_cast<size_t>( y - gy1 ) * rowBytes + static_cast<size_t>( x1 - dataWin.min.x ) * pixelBytes;
+				copy_span( dst + static_cast<ptrdiff_t>( y - y1 ) * ys, xs, src, pixelBytes, copyBytes );
+			}
 		}
-		else if ( _tiled_part )
-			throw_not_yet();
 	}
 
-	std::pair<int64_t, int64_t> compute_preferred_chunk( void ) const
+	// Tiles are always decoded whole, so an area aligned to the tiles
+	// (or the edge of the level) is decoded in place, otherwise a row
+	// of tiles at a time is decoded to a scratch buffer and the
+	// overlap copied out
+	void read_tiles( const std::vector<chan_slice> &chans, size_t pixelBytes, char *dst, int64_t xs, int64_t ys, int x1, int y1, int x2, int y2, int lx, int ly )
 	{
-		// TODO:
-		return image::compute_preferred_chunk();
+		if ( ! _tiled_part->isValidLevel( lx, ly ) )
+			throw_runtime( "EXR image does not have resolution level ({0}, {1})", lx, ly );
+
+		IMATH::Box2i lw = _tiled_part->dataWindowForLevel( lx, ly );
+		if ( x1 < lw.min.x || y1 < lw.min.y || x2 > lw.max.x || y2 > lw.max.y )
+			throw_runtime( "Request for EXR area ({0}, {1}) - ({2}, {3}) outside of level ({4}, {5}) data window ({6}, {7}) - ({8}, {9})",
+						   x1, y1, x2, y2, lx, ly, lw.min.x, lw.min.y, lw.max.x, lw.max.y );
+
+		const int tw = static_cast<int>( _tiled_part->tileXSize() );
+		const int th = static_cast<int>( _tiled_part->tileYSize() );
+		const int tx1 = ( x1 - lw.min.x ) / tw;
+		const int tx2 = ( x2 - lw.min.x ) / tw;
+		const int ty1 = ( y1 - lw.min.y ) / th;
+		const int ty2 = ( y2 - lw.min.y ) / th;
+		const int ax1 = lw.min.x + tx1 * tw;
+		const int ax2 = std::min( lw.max.x, lw.min.x + ( tx2 + 1 ) * tw - 1 );
+		const int ay1 = lw.min.y + ty1 * th;
+		const int ay2 = std::min( lw.max.y, lw.min.y + ( ty2 + 1 ) * th - 1 );
+
+		if ( x1 == ax1 && x2 == ax2 && y1 == ay1 && y2 == ay2 )
+		{
+			char *base = dst - static_cast<ptrdiff_t>( x1 ) * xs - static_cast<ptrdiff_t>( y1 ) * ys;
+			EXR::FrameBuffer fbuf;
+			for ( auto &c: chans )
+				fbuf.insert( *(c.name), EXR::Slice( c.type, base + c.offset, static_cast<size_t>( xs ), static_cast<size_t>( ys ) ) );
+			_tiled_part->setFrameBuffer( fbuf );
+			_tiled_part->readTiles( tx1, tx2, ty1, ty2, lx, ly );
+			return;
+		}
+
+		const size_t rowBytes = static_cast<size_t>( ax2 - ax1 + 1 ) * pixelBytes;
+		const size_t copyBytes = static_cast<size_t>( x2 - x1 + 1 ) * pixelBytes;
+		char *scratch = block_buffer( rowBytes * static_cast<size_t>( th ) );
+		for ( int ty = ty1; ty <= ty2; ++ty )
+		{
+			const int ry1 = lw.min.y + ty * th;
+			const int ry2 = std::min( lw.max.y, ry1 + th - 1 );
+			char *base = scratch - static_cast<ptrdiff_t>( ax1 ) * static_cast<ptrdiff_t>( pixelBytes ) - static_cast<ptrdiff_t>( ry1 ) * static_cast<ptrdiff_t>( rowBytes );
+			EXR::FrameBuffer fbuf;
+			for ( auto &c: chans )
+				fbuf.insert( *(c.name), EXR::Slice( c.type, base + c.offset, pixelBytes, rowBytes ) );
+			_tiled_part->setFrameBuffer( fbuf );
+			_tiled_part->readTiles( tx1, tx2, ty, ty, lx, ly );
+
+			for ( int y = std::max( ry1, y1 ), ye = std::min( ry2, y2 ); y <= ye; ++y )
+			{
+				const char *src = scratch + static_cast<size_t>( y - ry1 ) * rowBytes + static_cast<size_t>( x1 - ax1 ) * pixelBytes;
+				copy_span( dst + static_cast<ptrdiff_t>( y - y1 ) * ys, xs, src, pixelBytes, copyBytes );
+			}
+		}
 	}
 
+	// scanlines decoded per call for a partial width area
+	static constexpr int kScanGroupLines = 64;
+
 	std::shared_ptr<EXR::MultiPartInputFile> _file;
 	std::shared_ptr<exr_istream> _stream;
 	const EXR::Header &_header;
@@ -684,6 +1054,7 @@ protected:
 	std::unique_ptr<EXR::InputPart> _scan_part;
 	std::vector<std::string> _plane_names;
 	std::vector<std::string> _full_plane_names;
+	mapped_lines _mapped;
 };
 
 ////////////////////////////////////////
@@ -712,7 +1083,7 @@ public:
 			_scan_part.reset( new EXR::DeepScanLineInputPart( *f, part ) );
 
 		const auto &disp = header.displayWindow();
-		const auto &data = header.displayWindow();
+		const auto &data = header.dataWindow();
 		set_active_area( area_rect( data.min.x, data.min.y,
 									data.max.x - data.min.x + 1,
 									data.max.y - data.min.y + 1 ) );
@@ -804,6 +1175,21 @@ public:
 			if ( header.hasView() )
 				viewname = header.view();
 
+			// uncompressed scanlines can be used straight from a
+			// memory map of the file
+			mapped_lines ml;
+			if ( header.type() == EXR::SCANLINEIMAGE && header.compression() == EXR::NO_COMPRESSION )
+			{
+				if ( ! _map && ! _map_failed )
+				{
+					_map = map_file( frm, _map_size );
+					_map_failed = ! _map;
+				}
+				ml.map = _map;
+				if ( _map && ! find_mapped_lines( ml, _map_size, *_file, p ) )
+					ml = mapped_lines();
+			}
+
 			layer &l = register_layer( header.hasName() ? header.name() : std::string() );
 			for ( auto c = chans.begin(); c != chans.end(); ++c )
 			{
@@ -824,14 +1210,14 @@ public:
 							{
 								v.store(
 									std::make_shared<exr_image>(
-										_file, _stream, 0, header, channames, chanfullnames, chanl )
+										_file, _stream, p, header, channames, chanfullnames, chanl, ml )
 										);
 							}
 							else
 							{
 								v.store(
 									std::make_shared<exr_deep>(
-										_file, _stream, 0, header, channames, chanfullnames, chanl )
+										_file, _stream, p, header, channames, chanfullnames, chanl )
 										);
 							}
 						}
@@ -853,14 +1239,14 @@ public:
 				{
 					v.store(
 						std::make_shared<exr_image>(
-							_file, _stream, 0, header, channames, chanfullnames, chanl )
+							_file, _stream, p, header, channames, chanfullnames, chanl, ml )
 							);
 				}
 				else
 				{
 					v.store(
 						std::make_shared<exr_deep>(
-							_file, _stream, 0, header, channames, chanfullnames, chanl )
+							_file, _stream, p, header, channames, chanfullnames, chanl )
 							);
 				}
 			}
@@ -885,6 +1271,9 @@ private:
 	base::uri _uri;
 	std::shared_ptr<exr_istream> _stream;
 	std::shared_ptr<EXR::MultiPartInputFile> _file;
+	std::shared_ptr<const mapped_file> _map;
+	size_t _map_size = 0;
+	bool _map_failed = false;
 };
 
 class exr_read_track : public video_track
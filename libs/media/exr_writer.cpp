@@ -21,6 +21,11 @@
 # include <color/state.h>
 # include <thread>
 # include <chrono>
+# include <condition_variable>
+# include <deque>
+# include <future>
+# include <map>
+# include <mutex>
 # include <sstream>
 # include <iomanip>
 # include <time.h>
@@ -145,69 +150,134 @@ private:
 	base::ostream &_stream;
 };
 
-EXR::Compression extractCompression( const parameter_set &parms )
+EXR::Compression compression_from_name( const std::string &comp )
 {
-	EXR::Compression r = EXR::ZIP_COMPRESSION;
+	if ( comp == "none" )
+		return EXR::NO_COMPRESSION;
+	if ( comp == "rle" )
+		return EXR::RLE_COMPRESSION;
+	if ( comp == "zips" )
+		return EXR::ZIPS_COMPRESSION;
+	if ( comp == "zip" )
+		return EXR::ZIP_COMPRESSION;
+	if ( comp == "piz" )
+		return EXR::PIZ_COMPRESSION;
+	if ( comp == "pxr24" )
+		return EXR::PXR24_COMPRESSION;
+	if ( comp == "b44" )
+		return EXR::B44_COMPRESSION;
+	if ( comp == "b44a" )
+		return EXR::B44A_COMPRESSION;
+	if ( comp == "dwaa" )
+		return EXR::DWAA_COMPRESSION;
+	if ( comp == "dwab" )
+		return EXR::DWAB_COMPRESSION;
+	throw_runtime( "Unknown compression scheme {0} given to OpenEXR", comp );
+}
+
+// tile size used when writing resolution levels without a tile size
+// being given
+static const int kDefaultTileSize = 64;
+
+struct write_options
+{
+	EXR::Compression compression = EXR::ZIP_COMPRESSION;
+	// by part name (layer.view) or layer name
+	std::map<std::string, EXR::Compression> part_compression;
+	int tile_size = 0;
+	// otherwise, the levels present in the image are written
+	bool force_levels = false;
+	EXR::LevelMode levels = EXR::ONE_LEVEL;
+	size_t queue_depth = 2;
+};
+
+write_options extractOptions( const parameter_set &parms )
+{
+	write_options r;
 
 	auto c = parms.find( "compression" );
 	if ( c != parms.end() && c->second.valid() )
+		r.compression = compression_from_name( c->second.as_string() );
+
+	auto pc = parms.find( "part_compression" );
+	if ( pc != parms.end() && pc->second.valid() )
+	{
+		// not , and =, so it can be given in the writer options string
+		for ( auto &spec: base::split( pc->second.as_string(), std::string( ";" ), true ) )
+		{
+			size_t eq = spec.find( ':' );
+			if ( eq == std::string::npos )
+				throw_runtime( "Invalid part compression '{0}', expected <part>:<compression>", spec );
+			r.part_compression[base::trim( spec.substr( 0, eq ) )] = compression_from_name( base::trim( spec.substr( eq + 1 ) ) );
+		}
+	}
+
+	auto ts = parms.find( "tile_size" );
+	if ( ts != parms.end() && ts->second.valid() )
+		r.tile_size = static_cast<int>( std::max( int64_t(0), ts->second.as_int() ) );
+
+	auto l = parms.find( "levels" );
+	if ( l != parms.end() && l->second.valid() && l->second.as_string() != "image" )
 	{
-		const std::string &comp = c->second.as_string();
-		if ( comp == "none" )
-			r = EXR::NO_COMPRESSION;
-		else if ( comp == "rle" )
-			r = EXR::RLE_COMPRESSION;
-		else if ( comp == "zips" )
-			r = EXR::ZIPS_COMPRESSION;
-		else if ( comp == "zip" )
-			r = EXR::ZIP_COMPRESSION;
-		else if ( comp == "piz" )
-			r = EXR::PIZ_COMPRESSION;
-		else if ( comp == "pxr24" )
-			r = EXR::PXR24_COMPRESSION;
-		else if ( comp == "b44" )
-			r = EXR::B44_COMPRESSION;
-		else if ( comp == "b44a" )
-			r = EXR::RLE_COMPRESSION;
-		else if ( comp == "dwaa" )
-			r = EXR::DWAA_COMPRESSION;
-		else if ( comp == "dwab" )
-			r = EXR::DWAB_COMPRESSION;
+		const std::string &lm = l->second.as_string();
+		r.force_levels = true;
+		if ( lm == "single" )
+			r.levels = EXR::ONE_LEVEL;
+		else if ( lm == "mipmap" )
+			r.levels = EXR::MIPMAP_LEVELS;
+		else if ( lm == "ripmap" )
+			r.levels = EXR::RIPMAP_LEVELS;
 		else
-			throw_runtime( "Unknown compression scheme {0} given to OpenEXR", comp );
+			throw_runtime( "Unknown level mode {0} given to OpenEXR", lm );
 	}
+
+	auto q = parms.find( "write_queue" );
+	if ( q != parms.end() && q->second.valid() )
+		r.queue_depth = static_cast<size_t>( std::max( int64_t(0), q->second.as_int() ) );
+
 	return r;
 }
 
-static inline int
-num_scanlines( EXR::Compression c )
+// number of levels of a size, rounding down
+int level_count( int64_t size )
 {
-	switch ( c )
+	int n = 1;
+	while ( size > 1 )
 	{
-		case EXR::NO_COMPRESSION: return 1;
-		case EXR::RLE_COMPRESSION: return -1;
-		case EXR::ZIPS_COMPRESSION: return 1;
-		case EXR::ZIP_COMPRESSION: return 16;
-
-		case EXR::PIZ_COMPRESSION:
-		case EXR::PXR24_COMPRESSION:
-			// TODO: look at code to determine, for now pull whole image...
-			return -1;
-
-		case EXR::B44_COMPRESSION:
-		case EXR::B44A_COMPRESSION:
-			return 4;
-
-		case EXR::DWAA_COMPRESSION:
-			return 32;
-		case EXR::DWAB_COMPRESSION:
-			return 256;
-
-		case EXR::NUM_COMPRESSION_METHODS:
-		default:
-			break;
+		size >>= 1;
+		++n;
 	}
-	return -1;
+	return n;
+}
+
+// makes sure the image has all the levels of the mode, at the size
+// OpenEXR expects
+void check_levels( const image &img, EXR::LevelMode lm, const std::string &part )
+{
+	const area_rect &a = img.active_area();
+	int nx = level_count( a.width() ), ny = level_count( a.height() );
+	if ( lm == EXR::MIPMAP_LEVELS )
+	{
+		nx = std::max( nx, ny );
+		ny = nx;
+	}
+
+	bool ok = ( lm == EXR::MIPMAP_LEVELS ) ? img.has_mipmap() : ( img.levels() == image::level_mode::RIPMAP );
+	ok = ok && img.level_count_x() >= nx && img.level_count_y() >= ny;
+	for ( int ly = 0; ok && ly != ny; ++ly )
+	{
+		for ( int lx = 0; ok && lx != nx; ++lx )
+		{
+			if ( lm == EXR::MIPMAP_LEVELS && lx != ly )
+				continue;
+			area_rect la = img.level_area( lx, ly );
+			ok = la.width() == std::max( int64_t(1), a.width() >> lx ) &&
+				la.height() == std::max( int64_t(1), a.height() >> ly );
+		}
+	}
+	if ( ! ok )
+		throw_runtime( "Part '{0}' does not have the {1} levels to write, they need to be computed (i.e. image::to_frame_with_levels)",
+					   part, lm == EXR::MIPMAP_LEVELS ? "mipmap" : "ripmap" );
 }
 
 template <typename D, typename S>
@@ -318,7 +388,7 @@ test_meta_and_add( EXR::Header &header, const std::string &mname, const metadata
 }
 
 static void
-frame_to_headers( std::vector<EXR::Header> &headers, const frame &frm, EXR::Compression compression )
+frame_to_headers( std::vector<EXR::Header> &headers, const frame &frm, const write_options &opts )
 {
 	// just to make sure it's set...
 	tzset();
@@ -349,7 +419,7 @@ frame_to_headers( std::vector<EXR::Header> &headers, const frame &frm, EXR::Comp
 		// since we are copying metadata, but...
 		headers.emplace_back( disp, data, img.aspect_ratio(),
 							  IMATH::V2f(0, 0), 1.f, EXR::INCREASING_Y,
-							  compression );
+							  opts.compression );
 
 		EXR::Header &curheader = headers.back();
 		// TODO: seems like this should be EXR_VERSION, but the code only
@@ -405,8 +475,37 @@ frame_to_headers( std::vector<EXR::Header> &headers, const frame &frm, EXR::Comp
 			curheader.setView( vname );
 			curheader.setName( pname + "." + vname );
 		}
-		// TODO: handle tiled image
-		curheader.setType( EXR::SCANLINEIMAGE );
+
+		// the compression can be overridden by part (layer.view) or
+		// layer name
+		auto pc = opts.part_compression.find( curheader.name() );
+		if ( pc == opts.part_compression.end() )
+			pc = opts.part_compression.find( pname );
+		if ( pc != opts.part_compression.end() )
+			curheader.compression() = pc->second;
+
+		EXR::LevelMode lm = opts.levels;
+		if ( ! opts.force_levels )
+		{
+			if ( img.levels() == image::level_mode::MIPMAP )
+				lm = EXR::MIPMAP_LEVELS;
+			else if ( img.levels() == image::level_mode::RIPMAP )
+				lm = EXR::RIPMAP_LEVELS;
+		}
+		if ( lm != EXR::ONE_LEVEL )
+			check_levels( img, lm, curheader.name() );
+
+		int tsize = opts.tile_size;
+		if ( tsize == 0 && lm != EXR::ONE_LEVEL )
+			tsize = kDefaultTileSize;
+		if ( tsize > 0 )
+		{
+			curheader.setTileDescription( EXR::TileDescription( static_cast<unsigned int>( tsize ), static_cast<unsigned int>( tsize ),
+																lm, EXR::ROUND_DOWN ) );
+			curheader.setType( EXR::TILEDIMAGE );
+		}
+		else
+			curheader.setType( EXR::SCANLINEIMAGE );
 
 		auto stime = std::chrono::system_clock::to_time_t( std::chrono::system_clock::now() );
 		struct tm ltime;
@@ -425,73 +524,197 @@ frame_to_headers( std::vector<EXR::Header> &headers, const frame &frm, EXR::Comp
 
 ////////////////////////////////////////
 
-static void
-calc_bufs( image &img, std::vector< std::shared_ptr<image_buffer> > &bufs, int y, int nscans )
+// the pixels of one part of the file, copied out of the frame so the
+// frame can be released (and the next one processed) while it is
+// compressed and written
+struct level_pixels
 {
-	throw_not_yet();
-}
+	int lx = 0;
+	int ly = 0;
+	std::vector<image_buffer> planes;
+};
 
-static void rebuild_frame_buffer( EXR::FrameBuffer &fB, const image &img,
-								  const std::vector< std::shared_ptr<image_buffer> > &bufs )
+struct part_pixels
 {
-	precondition( bufs.size() == img.size(), "expecting calc_bufs to fill buffers" );
+	std::vector<std::string> names;
+	std::vector<level_pixels> levels;
+};
 
-	const area_rect &dataWin = img.active_area();
-	int64_t w = dataWin.width();
-	int64_t baseOff = dataWin.x1() + dataWin.y1() * w;
-	for ( size_t p = 0; p < img.size(); ++p )
+struct write_job
+{
+	int64_t frame = 0;
+	std::vector<EXR::Header> headers;
+	std::vector<part_pixels> parts;
+	std::shared_ptr<std::promise<void>> done;
+};
+
+// the levels written for the tile description of the header
+static std::vector<std::pair<int, int>>
+header_levels( const EXR::Header &h )
+{
+	std::vector<std::pair<int, int>> ret;
+	ret.emplace_back( 0, 0 );
+	if ( ! h.hasTileDescription() || h.tileDescription().mode == EXR::ONE_LEVEL )
+		return ret;
+
+	const IMATH::Box2i &dw = h.dataWindow();
+	int nx = level_count( dw.max.x - dw.min.x + 1 );
+	int ny = level_count( dw.max.y - dw.min.y + 1 );
+	if ( h.tileDescription().mode == EXR::MIPMAP_LEVELS )
 	{
-		const image_buffer &ib = *(bufs[p]);
-		int64_t curScanOff = ( ib.y1() - dataWin.y1() ) * w;
-		size_t offTotal = static_cast<size_t>( baseOff + curScanOff );
-		if ( ib.bits() == 16 && ib.is_floating() )
+		for ( int l = 1, nL = std::max( nx, ny ); l < nL; ++l )
+			ret.emplace_back( l, l );
+		return ret;
+	}
+
+	for ( int ly = 0; ly != ny; ++ly )
+	{
+		for ( int lx = 0; lx != nx; ++lx )
 		{
-			char *data = ( const_cast<char *>( static_cast<const char*>( ib.data() ) )
-						   - offTotal * sizeof(base::half) );
-			fB.insert( img.plane_name( p ),
-					   EXR::Slice( EXR::HALF,
-								   data,
-								   static_cast<size_t>( ib.xstride_bytes() ),
-								   static_cast<size_t>( ib.ystride_bytes() ) ) );
+			if ( lx != 0 || ly != 0 )
+				ret.emplace_back( lx, ly );
 		}
-		else if ( ib.bits() == 32 && ib.is_floating() )
+	}
+	return ret;
+}
+
+static void
+retrieve_pixels( std::vector<part_pixels> &parts, const std::vector<EXR::Header> &headers, const frame &frm )
+{
+	for ( auto i = frm.image_begin(); i != frm.image_end(); ++i )
+	{
+		image &img = (*i);
+		const EXR::Header &h = headers[parts.size()];
+		parts.emplace_back();
+		part_pixels &pp = parts.back();
+		for ( size_t p = 0; p < img.size(); ++p )
 		{
-			char *data = ( const_cast<char *>( static_cast<const char*>( ib.data() ) )
-						   - offTotal * sizeof(float) );
-			fB.insert( img.plane_name( p ),
-					   EXR::Slice( EXR::FLOAT,
-								   data,
-								   static_cast<size_t>( ib.xstride_bytes() ),
-								   static_cast<size_t>( ib.ystride_bytes() ) ) );
+			plane_layout pl = img.layout( p );
+			if ( pl._xsubsample_shift != 0 || pl._ysubsample_shift != 0 )
+				throw_not_yet();
+			pp.names.push_back( img.plane_name( p ) );
 		}
-		else if ( ib.bits() == 32 )
+
+		for ( auto &l: header_levels( h ) )
 		{
-			char *data = ( const_cast<char *>( static_cast<const char*>( ib.data() ) )
-						   - offTotal * sizeof(uint32_t) );
-			fB.insert( img.plane_name( p ),
-					   EXR::Slice( EXR::UINT,
-								   data,
-								   static_cast<size_t>( ib.xstride_bytes() ),
-								   static_cast<size_t>( ib.ystride_bytes() ) ) );
+			pp.levels.emplace_back();
+			level_pixels &lp = pp.levels.back();
+			lp.lx = l.first;
+			lp.ly = l.second;
+			const area_rect a = img.level_area( l.first, l.second );
+			for ( size_t p = 0; p < img.size(); ++p )
+			{
+				plane_layout pl = img.layout( p );
+				lp.planes.push_back( image_buffer::full_plane( a.x1(), a.y1(), a.x2(), a.y2(),
+															   pl._bits, 0, 0, pl._floating, pl._unsigned ) );
+				img.retrieve( p, lp.planes.back(), l.first, l.second );
+			}
 		}
+	}
+}
+
+// slices for the planes of a level, the buffers being placed at the
+// origin of the level data window
+static EXR::FrameBuffer
+level_frame_buffer( const part_pixels &pp, const level_pixels &lp, const IMATH::Box2i &levelWin )
+{
+	EXR::FrameBuffer fbuf;
+	for ( size_t p = 0; p != lp.planes.size(); ++p )
+	{
+		const image_buffer &ib = lp.planes[p];
+		EXR::PixelType t;
+		if ( ib.bits() == 16 && ib.is_floating() )
+			t = EXR::HALF;
+		else if ( ib.bits() == 32 && ib.is_floating() )
+			t = EXR::FLOAT;
+		else if ( ib.bits() == 32 )
+			t = EXR::UINT;
 		else
 			throw_runtime( "Invalid image buffer for writing to EXR" );
+
+		// EXR addresses the slice by the absolute pixel coordinate
+		char *base = ( const_cast<char *>( static_cast<const char *>( ib.data() ) )
+					   - static_cast<ptrdiff_t>( int64_t( levelWin.min.x ) * ib.xstride_bytes() )
+					   - static_cast<ptrdiff_t>( int64_t( levelWin.min.y ) * ib.ystride_bytes() ) );
+		fbuf.insert( pp.names[p], EXR::Slice( t, base,
+											  static_cast<size_t>( ib.xstride_bytes() ),
+											  static_cast<size_t>( ib.ystride_bytes() ) ) );
+	}
+	return fbuf;
+}
+
+static void
+write_parts( EXR::MultiPartOutputFile &outfile, const std::vector<EXR::Header> &headers, const std::vector<part_pixels> &parts )
+{
+	for ( size_t part = 0; part != parts.size(); ++part )
+	{
+		const part_pixels &pp = parts[part];
+		const EXR::Header &h = headers[part];
+
+		// all the scanlines / tiles of a level in one call, so the
+		// blocks are compressed in parallel by the OpenEXR thread pool
+		if ( h.hasTileDescription() )
+		{
+			EXR::TiledOutputPart curOut( outfile, static_cast<int>( part ) );
+			for ( auto &lp: pp.levels )
+			{
+				curOut.setFrameBuffer( level_frame_buffer( pp, lp, curOut.dataWindowForLevel( lp.lx, lp.ly ) ) );
+				curOut.writeTiles( 0, curOut.numXTiles( lp.lx ) - 1, 0, curOut.numYTiles( lp.ly ) - 1, lp.lx, lp.ly );
+			}
+		}
+		else
+		{
+			const IMATH::Box2i &dataWin = h.dataWindow();
+			EXR::OutputPart curOut( outfile, static_cast<int>( part ) );
+			curOut.setFrameBuffer( level_frame_buffer( pp, pp.levels.front(), dataWin ) );
+			curOut.writePixels( dataWin.max.y - dataWin.min.y + 1 );
+		}
 	}
 }
 
+////////////////////////////////////////
+
+/// Writes a file per frame. The pixels are copied out of the frame in
+/// store(), and the files compressed and written on a background
+/// thread, with up to queue depth frames waiting to be written before
+/// store() blocks.
 class exr_write_track : public video_track
 {
 public:
 	exr_write_track( const base::uri &files, const parameter_set &parms )
 		: video_track( std::string(), std::string(), 0, 0, sample_rate(), track_description( TRACK_VIDEO ) ),
-		  _files( files ), _compression( extractCompression( parms ) )
+		  _files( files ), _options( extractOptions( parms ) )
 	{
 	}
 		  
 	exr_write_track( std::string n, std::string v, int64_t b, int64_t e, const sample_rate &sr, const base::uri &files, const media::track_description &td, const parameter_set &parms )
 			: video_track( std::move( n ), std::move( v ), b, e, sr, td ),
-			  _files( files ), _compression( extractCompression( parms ) )
+			  _files( files ), _options( extractOptions( parms ) )
+	{
+	}
+
+	~exr_write_track( void ) override
 	{
+		{
+			std::unique_lock<std::mutex> lk( _mutex );
+			_idle.wait( lk, [this]() { return _queue.empty() && ! _busy; } );
+			_shutdown = true;
+		}
+		_work.notify_all();
+		if ( _writer.joinable() )
+			_writer.join();
+
+		for ( auto &p: _pending )
+		{
+			try
+			{
+				p.second.get();
+			}
+			catch ( std::exception &e )
+			{
+				std::cerr << "ERROR: writing EXR frame " << p.first << ": " << e.what() << std::endl;
+			}
+		}
 	}
 
 	virtual frame *doRead( int64_t )
@@ -501,57 +724,116 @@ public:
 
 	virtual void doWrite( int64_t f, const frame &frm )
 	{
-		auto fs = base::file_system::get( _files.uri() );
-		base::ostream stream = fs->open_write( _files.get_frame( f ) );
-		exr_ostream estr( stream );
-
-		std::vector<EXR::Header> headers;
-		frame_to_headers( headers, frm, _compression );
-
-		EXR::MultiPartOutputFile outfile{ estr, headers.data(), static_cast<int>( headers.size() ) };
+		if ( frm.data_begin() != frm.data_end() )
+			throw_logic( "Writing of deep data not yet finished" );
 
-		int partNum = 0;
-		int numScans = num_scanlines( _compression );
+		write_job j;
+		j.frame = f;
+		frame_to_headers( j.headers, frm, _options );
+		retrieve_pixels( j.parts, j.headers, frm );
+		j.done = std::make_shared<std::promise<void>>();
 
-		std::vector< std::shared_ptr<image_buffer> > bufs;
-		for ( auto i = frm.image_begin(); i != frm.image_end(); ++i, ++partNum )
+		if ( _options.queue_depth == 0 )
 		{
-			EXR::OutputPart curOut( outfile, partNum );
+			write( j );
+			return;
+		}
 
-			image &img = (*i);
-			auto prefchunk = img.preferred_chunk_size();
+		std::unique_lock<std::mutex> lk( _mutex );
+		if ( ! _writer.joinable() )
+			_writer = std::thread( &exr_write_track::run_writer, this );
 
-			int curScans = std::max( numScans, prefchunk.second );
-			int y = img.active_area().y1();
-			int yend = img.active_area().y2() + 1;
+		// back pressure, so frames are not processed faster than
+		// they can be written
+		_space.wait( lk, [this]() { return _queue.size() < _options.queue_depth; } );
+		_pending[f] = j.done->get_future().share();
+		_queue.push_back( std::move( j ) );
+		_work.notify_one();
+	}
 
-			while ( y < yend )
-			{
-				int ey = y + curScans;
-				if ( ey > yend )
-					ey = yend;
-				int curscans = ey - y;
+	std::shared_future<void> doFinish( int64_t f ) override
+	{
+		std::unique_lock<std::mutex> lk( _mutex );
+		auto i = _pending.find( f );
+		if ( i == _pending.end() )
+			return video_track::doFinish( f );
+		return i->second;
+	}
 
-				calc_bufs( img, bufs, y, curscans );
+	void doFlush( void ) override
+	{
+		std::map<int64_t, std::shared_future<void>> failed;
+		{
+			std::unique_lock<std::mutex> lk( _mutex );
+			_idle.wait( lk, [this]() { return _queue.empty() && ! _busy; } );
+			// only the failed writes are still pending
+			std::swap( failed, _pending );
+		}
+		for ( auto &p: failed )
+			p.second.get();
+	}
 
-				// hrm, this seems inefficient, but exr also copies all this stuff all the time
-				EXR::FrameBuffer fbuf;
-				rebuild_frame_buffer( fbuf, img, bufs );
+private:
+	void write( write_job &j )
+	{
+		auto fs = base::file_system::get( _files.uri() );
+		base::ostream stream = fs->open_write( _files.get_frame( j.frame ) );
+		exr_ostream estr( stream );
 
-				curOut.setFrameBuffer( fbuf );
-				curOut.writePixels( curscans );
+		EXR::MultiPartOutputFile outfile{ estr, j.headers.data(), static_cast<int>( j.headers.size() ) };
+		write_parts( outfile, j.headers, j.parts );
+	}
 
-				y = ey;
+	void run_writer( void )
+	{
+		std::unique_lock<std::mutex> lk( _mutex );
+		while ( true )
+		{
+			_work.wait( lk, [this]() { return _shutdown || ! _queue.empty(); } );
+			if ( _queue.empty() )
+				break;
+
+			write_job j = std::move( _queue.front() );
+			_queue.pop_front();
+			_busy = true;
+			_space.notify_one();
+			lk.unlock();
+
+			bool ok = true;
+			try
+			{
+				write( j );
+				j.done->set_value();
+			}
+			catch ( ... )
+			{
+				ok = false;
+				j.done->set_exception( std::current_exception() );
 			}
+			// release the pixels before waiting for more work
+			j.parts.clear();
+
+			lk.lock();
+			// keep the failures around for flush / finish_frame
+			if ( ok )
+				_pending.erase( j.frame );
+			_busy = false;
+			_idle.notify_all();
 		}
-
-		if ( frm.data_begin() != frm.data_end() )
-			throw_logic( "Writing of deep data not yet finished" );
 	}
 
-private:
 	file_sequence _files;
-	EXR::Compression _compression;
+	write_options _options;
+
+	std::mutex _mutex;
+	std::condition_variable _work;
+	std::condition_variable _space;
+	std::condition_variable _idle;
+	std::deque<write_job> _queue;
+	std::map<int64_t, std::shared_future<void>> _pending;
+	bool _busy = false;
+	bool _shutdown = false;
+	std::thread _writer;
 };
 
 ////////////////////////////////////////
@@ -575,7 +857,7 @@ public:
 					"rle",
 					"zips",
 					"zip",
-					"piz"
+					"piz",
 					"pxr24",
 					"b44",
 					"b44a",
@@ -585,6 +867,7 @@ public:
 				"zip" ) );
 		_parms.back().help( "Set the compression style:\n"
 							" none   - No compression\n"
+							" rle    - Run length encoding\n"
 							" zips   - Zip, one scanline per zip chunk\n"
 							" zip    - Zip, 16 scanlines per chunk\n"
 							" piz    - Piz-based wavelet compression\n"
@@ -594,6 +877,31 @@ public:
 							" dwaa   - Lossy DCT in blocks of 32 scanlines\n"
 							" dwab   - Lossy DCT in blocks of 256 scanlines\n"
 							);
+		_parms.push_back( media::parameter_definition( "part_compression", std::vector<std::string>(), "" ) );
+		_parms.back().help( "List of <part>:<compression> separated by ; overriding the compression\n"
+							"of parts, by layer.view or layer name (i.e. depth:zips;rgb.left:dwaa)\n" );
+		_parms.push_back( media::parameter_definition( "tile_size", int64_t(0), int64_t(4096), int64_t(0) ) );
+		_parms.back().help( "Size of the (square) tiles to write, 0 writes scanlines unless\n"
+							"resolution levels are written, which uses 64\n" );
+		_parms.push_back(
+			media::parameter_definition(
+				"levels",
+				std::vector<std::string>{
+					"image",
+					"single",
+					"mipmap",
+					"ripmap"
+				},
+				"image" ) );
+		_parms.back().help( "Resolution levels to write (as a tiled file):\n"
+							" image  - The levels the images have\n"
+							" single - Only the full resolution level\n"
+							" mipmap - Levels halved in both directions (the images must have them)\n"
+							" ripmap - Levels halved independently in x and y (the images must have them)\n"
+							);
+		_parms.push_back( media::parameter_definition( "write_queue", int64_t(0), int64_t(64), int64_t(2) ) );
+		_parms.back().help( "Number of frames waiting to be compressed and written in the\n"
+							"background before storing a frame blocks (0 writes synchronously)\n" );
 	}
 	virtual ~OpenEXRWriter( void ) = default;
 
@@ -638,6 +946,18 @@ register_exr_writer( void )
 
 ////////////////////////////////////////
 
+void
+set_exr_thread_count( int n )
+{
+#if defined(HAVE_OPENEXR)
+	EXR::setGlobalThreadCount( std::max( 0, n ) );
+#else
+	(void)n;
+#endif
+}
+
+////////////////////////////////////////
+
 } // namespace media
 
 
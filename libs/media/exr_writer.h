@@ -17,6 +17,11 @@ namespace media
 
 void register_exr_writer( void );
 
+/// Sets the number of threads OpenEXR uses to compress and
+/// decompress blocks of scanlines / tiles (when reading or writing
+/// more than one block at a time)
+void set_exr_thread_count( int n );
+
 } // namespace media
 
 
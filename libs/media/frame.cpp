@@ -192,6 +192,33 @@ layer &frame::register_layer( base::cstring lname )
 	return _layers.back();
 }
 
+////////////////////////////////////////
+
+std::unique_ptr<frame> copy_frame(
+	const frame &src,
+	const std::function<std::shared_ptr<image>( const layer &, const view &, const std::shared_ptr<image> & )> &wrap )
+{
+	std::unique_ptr<frame> ret( new frame( src.number() ) );
+	for ( auto &sl: src.layers() )
+	{
+		layer &l = ret->register_layer( sl.name() );
+		for ( auto &m: sl.meta() )
+			l.set_meta( m.first, m.second );
+		for ( size_t v = 0, nV = sl.view_count(); v != nV; ++v )
+		{
+			const view &sv = sl[v];
+			view &nv = l.add_view( sv.name() );
+			const std::shared_ptr<image> &img = static_cast<const std::shared_ptr<image> &>( sv );
+			if ( img )
+				nv.store( wrap( sl, sv, img ) );
+			const std::shared_ptr<data> &d = static_cast<const std::shared_ptr<data> &>( sv );
+			if ( d )
+				nv.store( d );
+		}
+	}
+	return ret;
+}
+
 } // media
 
 
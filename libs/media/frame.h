@@ -10,6 +10,7 @@
 #include <string>
 #include <cstdint>
 #include <memory>
+#include <functional>
 #include <base/const_string.h>
 #include "layer.h"
 #include "sample_data.h"
@@ -144,6 +145,14 @@ private:
 
 ////////////////////////////////////////
 
+/// Creates a new frame with the layers, views and data of src, with
+/// each image passed through wrap, which may return it as is or a
+/// replacement (i.e. a decoded copy)
+std::unique_ptr<frame> copy_frame(
+	const frame &src,
+	const std::function<std::shared_ptr<image>( const layer &, const view &, const std::shared_ptr<image> & )> &wrap );
+
+
 inline
 frame::const_image_iterator::const_image_iterator( const frame *f )
 	: _frame( f ), _cur_layer( 0 ), _cur_view( 0 )
@@ -202,24 +211,21 @@ frame::const_image_iterator::advance( bool incfirst )
 		return;
 
 	const layer_list &ll = _frame->layers();
+	if ( incfirst )
+		++_cur_view;
+
 	while ( _cur_layer < ll.size() )
 	{
 		const layer &l = ll[_cur_layer];
-		if ( incfirst )
-			++_cur_view;
-
 		while ( _cur_view < l.view_count() )
 		{
-			if ( ! static_cast<const std::shared_ptr<image> &>( l[_cur_view] ) )
-				++_cur_view;
+			if ( static_cast<const std::shared_ptr<image> &>( l[_cur_view] ) )
+				return;
+			++_cur_view;
 		}
 
-		if ( _cur_view >= l.view_count() )
-		{
-			_cur_view = 0;
-			++_cur_layer;
-			incfirst = false;
-		}
+		_cur_view = 0;
+		++_cur_layer;
 	}
 
 	if ( _cur_layer >= ll.size() )
@@ -278,24 +284,21 @@ frame::const_data_iterator::advance( bool incfirst )
 		return;
 
 	const layer_list &ll = _frame->layers();
+	if ( incfirst )
+		++_cur_view;
+
 	while ( _cur_layer < ll.size() )
 	{
 		const layer &l = ll[_cur_layer];
-		if ( incfirst )
-			++_cur_view;
-
 		while ( _cur_view < l.view_count() )
 		{
-			if ( ! static_cast<const std::shared_ptr<data> &>( l[_cur_view] ) )
-				++_cur_view;
+			if ( static_cast<const std::shared_ptr<data> &>( l[_cur_view] ) )
+				return;
+			++_cur_view;
 		}
 
-		if ( _cur_view >= l.view_count() )
-		{
-			_cur_view = 0;
-			++_cur_layer;
-			incfirst = false;
-		}
+		_cur_view = 0;
+		++_cur_layer;
 	}
 
 	if ( _cur_layer >= ll.size() )
@@ -0,0 +1,289 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "frame_cache.h"
+#include "preloaded_image.h"
+#include <base/contract.h>
+
+////////////////////////////////////////
+
+namespace
+{
+
+using namespace media;
+
+/// Stands in for an image not in the cache yet, decoding it (into the
+/// cache) the first time a plane is retrieved
+class cached_image : public image
+{
+public:
+	cached_image( const std::shared_ptr<image> &src, frame_cache &c, frame_cache::key k )
+		: _src( src ), _cache( c ), _key( std::move( k ) )
+	{
+		copy_description( *_src );
+	}
+
+protected:
+	bool storage_interleaved( void ) const override
+	{
+		return _src->interleaved();
+	}
+
+	void fill_plane( size_t plane, image_buffer &buffer ) override
+	{
+		decoded()->retrieve( plane, buffer );
+	}
+
+	void fill_image( image_buffer &buffer ) override
+	{
+		_src->retrieve( buffer );
+	}
+
+	void fill_plane_level( size_t plane, image_buffer &buffer, int lx, int ly ) override
+	{
+		if ( lx == 0 && ly == 0 )
+			fill_plane( plane, buffer );
+		else
+			_src->retrieve( plane, buffer, lx, ly );
+	}
+
+	area_rect compute_level_area( int lx, int ly ) const override
+	{
+		return _src->level_area( lx, ly );
+	}
+
+	std::pair<int64_t, int64_t> compute_preferred_chunk( void ) const override
+	{
+		std::pair<int, int> c = _src->preferred_chunk_size();
+		return std::make_pair( static_cast<int64_t>( c.first ), static_cast<int64_t>( c.second ) );
+	}
+
+	image_buffer compute_direct_plane( size_t plane ) const override
+	{
+		return decoded()->direct_plane( plane );
+	}
+
+private:
+	const std::shared_ptr<image> &decoded( void ) const
+	{
+		std::lock_guard<std::mutex> lk( _mutex );
+		if ( ! _decoded )
+		{
+			auto pre = std::make_shared<preloaded_image>( _src );
+			_cache.insert( _key, pre, pre->bytes() );
+			_decoded = pre;
+		}
+		return _decoded;
+	}
+
+	std::shared_ptr<image> _src;
+	frame_cache &_cache;
+	frame_cache::key _key;
+	mutable std::mutex _mutex;
+	mutable std::shared_ptr<image> _decoded;
+};
+
+} // empty namespace
+
+////////////////////////////////////////
+
+namespace media
+{
+
+////////////////////////////////////////
+
+frame_cache::frame_cache( size_t budget )
+	: _budget( budget )
+{
+}
+
+////////////////////////////////////////
+
+frame_cache::~frame_cache( void )
+{
+}
+
+////////////////////////////////////////
+
+frame_cache &frame_cache::global( void )
+{
+	static frame_cache theCache;
+	return theCache;
+}
+
+////////////////////////////////////////
+
+size_t frame_cache::budget( void ) const
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	return _budget;
+}
+
+////////////////////////////////////////
+
+void frame_cache::set_budget( size_t bytes )
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	_budget = bytes;
+	evict();
+}
+
+////////////////////////////////////////
+
+std::shared_ptr<image> frame_cache::find( const key &k )
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	auto i = _entries.find( k );
+	if ( i == _entries.end() )
+	{
+		++_stats.misses;
+		return std::shared_ptr<image>();
+	}
+
+	++_stats.hits;
+	_lru.splice( _lru.begin(), _lru, i->second.lru );
+	return i->second.img;
+}
+
+////////////////////////////////////////
+
+void frame_cache::insert( const key &k, const std::shared_ptr<image> &img, size_t bytes )
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	auto i = _entries.find( k );
+	if ( i != _entries.end() )
+	{
+		_stats.bytes -= i->second.bytes;
+		_lru.erase( i->second.lru );
+		_entries.erase( i );
+	}
+
+	if ( bytes > _budget )
+		return;
+
+	_lru.push_front( k );
+	_entries[k] = entry{ img, bytes, _lru.begin() };
+	_stats.bytes += bytes;
+	evict();
+}
+
+////////////////////////////////////////
+
+void frame_cache::pin( const std::string &track, int64_t first, int64_t last )
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	_pinned[track] = std::make_pair( first, last );
+	evict();
+}
+
+////////////////////////////////////////
+
+void frame_cache::unpin( const std::string &track )
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	_pinned.erase( track );
+	evict();
+}
+
+////////////////////////////////////////
+
+void frame_cache::clear( void )
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	_entries.clear();
+	_lru.clear();
+	_stats.bytes = 0;
+}
+
+////////////////////////////////////////
+
+frame_cache::statistics frame_cache::stats( void ) const
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	statistics ret = _stats;
+	ret.entries = _entries.size();
+	ret.budget = _budget;
+	return ret;
+}
+
+////////////////////////////////////////
+
+bool frame_cache::is_pinned( const key &k ) const
+{
+	auto p = _pinned.find( k.track );
+	return p != _pinned.end() && k.frame >= p->second.first && k.frame <= p->second.second;
+}
+
+////////////////////////////////////////
+
+void frame_cache::evict( void )
+{
+	auto i = _lru.end();
+	while ( _stats.bytes > _budget && i != _lru.begin() )
+	{
+		--i;
+		if ( is_pinned( *i ) )
+			continue;
+
+		auto e = _entries.find( *i );
+		_stats.bytes -= e->second.bytes;
+		++_stats.evictions;
+		_entries.erase( e );
+		i = _lru.erase( i );
+	}
+}
+
+////////////////////////////////////////
+
+cached_track::cached_track( std::shared_ptr<video_track> src, const base::uri &u, frame_cache &cache )
+	: video_track( src->name(), src->view(), src->begin(), src->end(), src->rate(), src->desc() ),
+	  _src( std::move( src ) ), _cache( cache )
+{
+	_key = u.pretty() + '#' + _src->name() + '/' + _src->view();
+}
+
+////////////////////////////////////////
+
+cached_track::~cached_track( void )
+{
+}
+
+////////////////////////////////////////
+
+frame *cached_track::doRead( int64_t f )
+{
+	std::shared_ptr<frame> src = _src->at( f );
+	if ( ! src )
+		throw_runtime( "Unable to read frame {0}", f );
+	if ( ! rate().valid() )
+		update_rate( _src->rate() );
+
+	std::unique_ptr<frame> ret = copy_frame( *src,
+		[&]( const layer &l, const media::view &v, const std::shared_ptr<image> &img ) -> std::shared_ptr<image>
+		{
+			if ( img->interleaved() )
+				return img;
+
+			frame_cache::key k{ _key, f, l.name(), v.name() };
+			std::shared_ptr<image> cached = _cache.find( k );
+			if ( cached )
+				return cached;
+			return std::make_shared<cached_image>( img, _cache, std::move( k ) );
+		} );
+	return ret.release();
+}
+
+////////////////////////////////////////
+
+void cached_track::doWrite( int64_t , const frame & )
+{
+	throw_logic( "cached track asked to write a frame" );
+}
+
+////////////////////////////////////////
+
+} // media
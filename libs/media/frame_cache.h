@@ -0,0 +1,153 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include "video_track.h"
+#include <base/uri.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+////////////////////////////////////////
+
+namespace media
+{
+
+class image;
+
+///
+/// @brief Class frame_cache is a least recently used cache of decoded
+/// images, limited to a budget of bytes.
+///
+/// Entries are keyed by the track (a string identifying the container
+/// and track), the frame number, and the layer / view of the image
+/// within the frame. A range of frames of a track can be pinned (the
+/// temporal window being processed), which keeps them from being
+/// evicted, even when that goes over the budget.
+///
+class frame_cache
+{
+public:
+	struct key
+	{
+		std::string track;
+		int64_t frame;
+		std::string layer;
+		std::string view;
+
+		bool operator<( const key &o ) const
+		{
+			if ( frame != o.frame )
+				return frame < o.frame;
+			if ( track != o.track )
+				return track < o.track;
+			if ( layer != o.layer )
+				return layer < o.layer;
+			return view < o.view;
+		}
+	};
+
+	struct statistics
+	{
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t evictions = 0;
+		size_t entries = 0;
+		size_t bytes = 0;
+		size_t budget = 0;
+	};
+
+	explicit frame_cache( size_t budget = kDefaultBudget );
+	~frame_cache( void );
+
+	/// the cache shared by every cached_track not given one
+	static frame_cache &global( void );
+
+	size_t budget( void ) const;
+	/// changes the budget, evicting as needed
+	void set_budget( size_t bytes );
+
+	/// returns the cached image (and makes it the most recently used),
+	/// or null, counting a hit or miss
+	std::shared_ptr<image> find( const key &k );
+	/// adds (or replaces) an entry of the given size, evicting the
+	/// least recently used unpinned entries to stay within the
+	/// budget. Entries larger than the budget are not kept.
+	void insert( const key &k, const std::shared_ptr<image> &img, size_t bytes );
+
+	/// pins frames first - last of the track, replacing the range
+	/// previously pinned for it
+	void pin( const std::string &track, int64_t first, int64_t last );
+	void unpin( const std::string &track );
+
+	void clear( void );
+	statistics stats( void ) const;
+
+private:
+	static constexpr size_t kDefaultBudget = size_t( 2048 ) * 1024 * 1024;
+
+	struct entry
+	{
+		std::shared_ptr<image> img;
+		size_t bytes;
+		std::list<key>::iterator lru;
+	};
+
+	bool is_pinned( const key &k ) const;
+	void evict( void );
+
+	mutable std::mutex _mutex;
+	size_t _budget;
+	std::map<key, entry> _entries;
+	// most recently used at the front
+	std::list<key> _lru;
+	std::map<std::string, std::pair<int64_t, int64_t>> _pinned;
+	statistics _stats;
+};
+
+///
+/// @brief Class cached_track wraps a video track, serving the images
+/// of the frames from a frame_cache.
+///
+/// The frames are still opened through the source track (for the
+/// layout of the layers and views), but the pixels of each image are
+/// only decoded the first time one of the frames containing it is
+/// retrieved, and come from the cache after that.
+///
+class cached_track : public video_track
+{
+public:
+	/// the uri of the container is used to identify the track in the
+	/// cache, along with the track name and view
+	cached_track( std::shared_ptr<video_track> src, const base::uri &u, frame_cache &cache = frame_cache::global() );
+	~cached_track( void ) override;
+
+	const std::shared_ptr<video_track> &source( void ) const { return _src; }
+	frame_cache &cache( void ) const { return _cache; }
+	const std::string &cache_key( void ) const { return _key; }
+
+	/// keeps frames first - last of this track in the cache (i.e. the
+	/// temporal window around the frame being processed)
+	void pin( int64_t first, int64_t last ) { _cache.pin( _key, first, last ); }
+	void unpin( void ) { _cache.unpin( _key ); }
+
+protected:
+	frame *doRead( int64_t f ) override;
+	void doWrite( int64_t f, const frame &frm ) override;
+
+private:
+	std::shared_ptr<video_track> _src;
+	frame_cache &_cache;
+	std::string _key;
+};
+
+////////////////////////////////////////
+
+} // namespace media
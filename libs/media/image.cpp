@@ -6,6 +6,8 @@
 //
 
 #include "image.h"
+#include "image_buffer.h"
+#include <base/contract.h>
 
 ////////////////////////////////////////
 
@@ -40,6 +42,25 @@ void image::color_state( const color::state &s )
 
 ////////////////////////////////////////
 
+void image::copy_description( const image &o )
+{
+    _full_area = o._full_area;
+    _active_area = o._active_area;
+    _pix_aspect_ratio = o._pix_aspect_ratio;
+    _tile_x = o._tile_x;
+    _tile_y = o._tile_y;
+    _level_mode = o._level_mode;
+    _level_count_x = o._level_count_x;
+    _level_count_y = o._level_count_y;
+    _color_state = o._color_state;
+    _planes.clear();
+    for ( auto &p: o._planes )
+        _planes.push_back( p );
+    _metadata = o._metadata;
+}
+
+////////////////////////////////////////
+
 image::plane_list image::available_planes( void ) const
 {
     image::plane_list r;
@@ -51,6 +72,31 @@ image::plane_list image::available_planes( void ) const
 
 ////////////////////////////////////////
 
+image_buffer image::direct_plane( size_t plane ) const
+{
+    return compute_direct_plane( plane );
+}
+
+////////////////////////////////////////
+
+void image::fill_plane_level( size_t plane, image_buffer &buffer, int lx, int ly )
+{
+    if ( lx != 0 || ly != 0 )
+        throw_runtime( "Image does not have resolution level ({0}, {1})", lx, ly );
+    fill_plane( plane, buffer );
+}
+
+////////////////////////////////////////
+
+area_rect image::compute_level_area( int lx, int ly ) const
+{
+    if ( lx != 0 || ly != 0 )
+        throw_runtime( "Image does not have resolution level ({0}, {1})", lx, ly );
+    return _active_area;
+}
+
+////////////////////////////////////////
+
 std::pair<int64_t, int64_t> image::compute_preferred_chunk( void ) const
 {
     return std::make_pair(
@@ -58,6 +104,13 @@ std::pair<int64_t, int64_t> image::compute_preferred_chunk( void ) const
         static_cast<int64_t>( _active_area.height() ) );
 }
 
+////////////////////////////////////////
+
+image_buffer image::compute_direct_plane( size_t ) const
+{
+    return image_buffer();
+}
+
 } // media
 
 
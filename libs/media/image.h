@@ -54,13 +54,28 @@ public:
 
     bool interleaved( void ) const { return storage_interleaved(); }
 
-    /// TODO: add level
-    //bool has_mipmap( void ) const ;
-    //bool is_tiled( void ) const;
-    /// TODO:
-    //int tile_x( void ) const;
-    //int tile_y( void ) const;
-    //int tile_z( void ) const;
+    /// Resolution levels stored in the image
+    enum class level_mode
+    {
+        SINGLE, ///< just the full resolution
+        MIPMAP, ///< levels (l, l), each half the size of the previous
+        RIPMAP ///< levels (lx, ly), halved independently in x and y
+    };
+
+    /// true if the image is stored as tiles of tile_x() by tile_y()
+    bool is_tiled( void ) const { return _tile_x > 0; }
+    int tile_x( void ) const { return _tile_x; }
+    int tile_y( void ) const { return _tile_y; }
+
+    level_mode levels( void ) const { return _level_mode; }
+    bool has_mipmap( void ) const { return _level_mode != level_mode::SINGLE; }
+    /// number of levels in x, or for mipmaps, the number of levels
+    int level_count_x( void ) const { return _level_count_x; }
+    /// number of levels in y, or for mipmaps, the number of levels
+    int level_count_y( void ) const { return _level_count_y; }
+    /// Active area of a level, (0, 0) being the active area. For
+    /// mipmaps, lx and ly must be the same
+    area_rect level_area( int lx, int ly ) const { return compute_level_area( lx, ly ); }
 
     /// this is informational only, but can be used to control the
     /// processing, such that the reader can help determine whether to
@@ -87,8 +102,18 @@ public:
     double outside_value( size_t p ) const { return at( p )._outside; }
 
     void retrieve( size_t plane, image_buffer &buffer ) { fill_plane( plane, buffer ); }
+    /// retrieves the area of the buffer from a level of the image, the
+    /// buffer should be within the level_area
+    void retrieve( size_t plane, image_buffer &buffer, int lx, int ly ) { fill_plane_level( plane, buffer, lx, ly ); }
     void retrieve( image_buffer &buffer ) { fill_image( buffer ); }
 
+    /// Returns a buffer referring directly to the stored pixels of the
+    /// plane (i.e. an uncompressed file mapped into memory), or an
+    /// invalid buffer when the image does not have them. The buffer
+    /// is read only, converting from it (get_scanline) avoids copying
+    /// to an intermediate buffer first.
+    image_buffer direct_plane( size_t plane ) const;
+
 	inline void set_meta( base::cstring name, metadata_value v ) { _metadata[name] = std::move( v ); }
 	inline const metadata &meta( void ) const { return _metadata; }
 
@@ -96,8 +121,15 @@ protected:
     virtual bool storage_interleaved( void ) const = 0;
     virtual void fill_plane( size_t plane, image_buffer &buffer ) = 0;
     virtual void fill_image( image_buffer &buffer ) = 0;
+    /// by default, only level (0, 0) is available, and is read with
+    /// fill_plane
+    virtual void fill_plane_level( size_t plane, image_buffer &buffer, int lx, int ly );
+    /// by default, returns the active area for level (0, 0)
+    virtual area_rect compute_level_area( int lx, int ly ) const;
     /// by default, returns the entire area
     virtual std::pair<int64_t, int64_t> compute_preferred_chunk( void ) const;
+    /// by default, returns an invalid buffer
+    virtual image_buffer compute_direct_plane( size_t plane ) const;
 
     /// sets both full and active area to the same value
     void set_area( const area_rect &r ) { _full_area = r; _active_area = r; }
@@ -105,6 +137,15 @@ protected:
     void set_full_area( const area_rect &r ) { _full_area = r; }
     /// sets only the active area (data window)
     void set_active_area( const area_rect &r ) { _active_area = r; }
+    /// sets the tile size, for images stored in tiles
+    void set_tiling( int tx, int ty ) { _tile_x = tx; _tile_y = ty; }
+    /// sets the resolution levels available
+    void set_levels( level_mode m, int nx, int ny ) { _level_mode = m; _level_count_x = nx; _level_count_y = ny; }
+
+    /// copies the areas, aspect ratio, color state, tiling, levels,
+    /// planes and metadata of another image, for images wrapping (or
+    /// caching) another one
+    void copy_description( const image &o );
 
     void register_plane( std::string name, const plane_layout &pl, double outsideval )
     {
@@ -129,6 +170,11 @@ private:
     area_rect _active_area;
 
     float _pix_aspect_ratio = 1.f;
+    int _tile_x = 0;
+    int _tile_y = 0;
+    level_mode _level_mode = level_mode::SINGLE;
+    int _level_count_x = 1;
+    int _level_count_y = 1;
     color::state _color_state;
 
     plane_store _planes;
@@ -7,6 +7,11 @@
 
 #include <base/contract.h>
 #include "image_buffer.h"
+#include <cstring>
+#include <vector>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 namespace media
 {
@@ -141,7 +146,27 @@ void image_buffer::get_scanline_u8( int64_t y, float *line, int64_t stride ) con
 	const uint8_t *data = static_cast<const uint8_t*>( _data.get() );
 	data += ( _offset + ( ( y - _y1 ) >> _ysubsample_shift ) * _ystride ) / 8;
 
-	for ( int64_t x = 0; x < _width; ++x )
+	int64_t x = 0;
+#ifdef __SSE2__
+	if ( _xstride == 8 && _xsubsample_shift == 0 && stride == 1 )
+	{
+		// divide (rather than multiply by the reciprocal) so the
+		// values match the scalar conversion
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 scale = _mm_set1_ps( 255.0F );
+		for ( ; x + 16 <= _width; x += 16 )
+		{
+			__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( data + x ) );
+			__m128i lo = _mm_unpacklo_epi8( v, zero );
+			__m128i hi = _mm_unpackhi_epi8( v, zero );
+			_mm_storeu_ps( line + x, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero ) ), scale ) );
+			_mm_storeu_ps( line + x + 4, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero ) ), scale ) );
+			_mm_storeu_ps( line + x + 8, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero ) ), scale ) );
+			_mm_storeu_ps( line + x + 12, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero ) ), scale ) );
+		}
+	}
+#endif
+	for ( ; x < _width; ++x )
 	{
 		const uint8_t *curData = data + ( ( x >> _xsubsample_shift ) * _xstride ) / 8;
 		line[x*stride] = convert_pel( *curData );
@@ -155,9 +180,26 @@ void image_buffer::get_scanline_u16( int64_t y, float *line, int64_t stride ) co
 	const uint16_t *data = static_cast<const uint16_t*>( _data.get() );
 	data += ( _offset + ( ( y - _y1 ) >> _ysubsample_shift ) * _ystride ) / 16;
 
+	int64_t x = 0;
+#ifdef __SSE2__
+	if ( _xstride == 16 && _xsubsample_shift == 0 && stride == 1 )
+	{
+		const bool swap = _endian != base::endianness::NATIVE;
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 scale = _mm_set1_ps( 65535.0F );
+		for ( ; x + 8 <= _width; x += 8 )
+		{
+			__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( data + x ) );
+			if ( swap )
+				v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+			_mm_storeu_ps( line + x, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( v, zero ) ), scale ) );
+			_mm_storeu_ps( line + x + 4, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( v, zero ) ), scale ) );
+		}
+	}
+#endif
 	if ( _endian == base::endianness::NATIVE )
 	{
-		for ( int64_t x = 0; x < _width; ++x )
+		for ( ; x < _width; ++x )
 		{
 			const uint16_t *curData = data + ( ( x >> _xsubsample_shift ) * _xstride ) / 16;
 			line[x*stride] = convert_pel( *curData );
@@ -165,7 +207,7 @@ void image_buffer::get_scanline_u16( int64_t y, float *line, int64_t stride ) co
 	}
 	else
 	{
-		for ( int64_t x = 0; x < _width; ++x )
+		for ( ; x < _width; ++x )
 		{
 			const uint16_t *curData = data + ( ( x >> _xsubsample_shift ) * _xstride ) / 16;
 			line[x*stride] = convert_pel( bswap_16( *curData ) );
@@ -398,5 +440,54 @@ void image_buffer::set_scanline_f64( int64_t y, const float *line, int64_t strid
 
 ////////////////////////////////////////
 
+void copy_buffer( const image_buffer &src, image_buffer &dst )
+{
+	if ( dst.x1() < src.x1() || dst.x2() > src.x2() || dst.y1() < src.y1() || dst.y2() > src.y2() )
+		throw_runtime( "Copy of ({0}, {1}) - ({2}, {3}) outside of the source buffer", dst.x1(), dst.y1(), dst.x2(), dst.y2() );
+
+	if ( dst.bits() == src.bits() && dst.is_floating() == src.is_floating() &&
+		 dst.endianness() == src.endianness() && ( dst.bits() % 8 ) == 0 )
+	{
+		const size_t pixelBytes = static_cast<size_t>( src.bits() / 8 );
+		const int64_t sxs = src.xstride_bytes();
+		const int64_t dxs = dst.xstride_bytes();
+		for ( int64_t y = dst.y1(); y <= dst.y2(); ++y )
+		{
+			const char *s = static_cast<const char *>( src.row( y ) ) + ( dst.x1() - src.x1() ) * sxs;
+			char *d = static_cast<char *>( dst.row( y ) );
+			if ( sxs == static_cast<int64_t>( pixelBytes ) && dxs == sxs )
+				std::memcpy( d, s, static_cast<size_t>( dst.width() ) * pixelBytes );
+			else
+			{
+				for ( int64_t x = 0; x < dst.width(); ++x, s += sxs, d += dxs )
+					std::memcpy( d, s, pixelBytes );
+			}
+		}
+		return;
+	}
+
+	image_buffer s = src.sub_buffer( dst.x1(), dst.y1(), dst.x2(), dst.y2() );
+	std::vector<float> line( static_cast<size_t>( dst.width() ) );
+	for ( int64_t y = dst.y1(); y <= dst.y2(); ++y )
+	{
+		s.get_scanline( y, line.data() );
+		dst.set_scanline( y, line.data() );
+	}
+}
+
+////////////////////////////////////////
+
+void copy_to_interleaved( const image_buffer &src, image_buffer &dst, size_t chan )
+{
+	const int64_t off = static_cast<int64_t>( chan ) * dst.bits();
+	if ( off + dst.bits() > dst.xstride_bytes() * 8 )
+		throw_runtime( "Sample {0} outside of the {1} bit pixels of the interleaved buffer", chan, dst.xstride_bytes() * 8 );
+
+	image_buffer c( dst, dst.offset() + off );
+	copy_buffer( src, c );
+}
+
+////////////////////////////////////////
+
 }
 
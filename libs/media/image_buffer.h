@@ -103,6 +103,9 @@ public:
 	image_buffer &operator=( image_buffer && ) = default;
 	~image_buffer( void ) = default;
 
+	/// false for a default constructed buffer, with no memory
+	inline bool valid( void ) const { return static_cast<bool>( _data ); }
+
 	inline int64_t x1( void ) const { return _x1; }
 	inline int64_t y1( void ) const { return _y1; }
 	inline int64_t x2( void ) const { return _x2; }
@@ -128,6 +131,11 @@ public:
 		return _floating;
 	}
 
+	inline bool is_unsigned( void ) const
+	{
+		return _unsigned;
+	}
+
 	inline int64_t xstride_bytes( void ) const
 	{
 		return _xstride / 8;
@@ -154,6 +162,19 @@ public:
 
 	const std::shared_ptr<void> &raw( void ) const { return _data; }
 
+	/// A buffer referring to the area (x1, y1) - (x2, y2) of this one,
+	/// sharing the memory
+	image_buffer sub_buffer( int64_t x1, int64_t y1, int64_t x2, int64_t y2 ) const
+	{
+		precondition( x1 >= _x1 && y1 >= _y1 && x2 <= _x2 && y2 <= _y2 && x1 <= x2 && y1 <= y2,
+					  "sub buffer ({0}, {1}) - ({2}, {3}) outside of buffer ({4}, {5}) - ({6}, {7})",
+					  x1, y1, x2, y2, _x1, _y1, _x2, _y2 );
+		precondition( _xsubsample_shift == 0 && _ysubsample_shift == 0, "sub buffer of a subsampled buffer" );
+		return image_buffer( _data, _bits, x1, y1, x2, y2, _xstride, _ystride,
+							 _offset + ( x1 - _x1 ) * _xstride + ( y1 - _y1 ) * _ystride,
+							 _endian, _floating, _unsigned );
+	}
+
 	void *data( void )
 	{
 		return static_cast<char *>( _data.get() ) + _offset / 8;
@@ -268,4 +289,15 @@ private:
 
 ////////////////////////////////////////
 
+/// Copies the area of dst from src (which has to cover it), as is
+/// when both store the values the same way, converted otherwise
+void copy_buffer( const image_buffer &src, image_buffer &dst );
+
+/// Copies src (a single plane) to sample chan of each pixel of the
+/// interleaved dst (laid out as simple_interleaved makes it), as
+/// copy_buffer does
+void copy_to_interleaved( const image_buffer &src, image_buffer &dst, size_t chan );
+
+////////////////////////////////////////
+
 }
@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "mapped_file.h"
+#include <base/contract.h>
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+////////////////////////////////////////
+
+namespace media
+{
+
+////////////////////////////////////////
+
+std::shared_ptr<const mapped_file> map_file( const base::uri &u, size_t &size )
+{
+	size = 0;
+#ifndef _WIN32
+	if ( u.scheme() != "file" )
+		return std::shared_ptr<const mapped_file>();
+
+	int fd = ::open( u.full_path().c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return std::shared_ptr<const mapped_file>();
+
+	std::shared_ptr<mapped_file> ret;
+	struct stat sb;
+	if ( ::fstat( fd, &sb ) == 0 && sb.st_size > 0 )
+	{
+		try
+		{
+			ret = std::make_shared<mapped_file>( fd, 0, static_cast<size_t>( sb.st_size ) );
+			size = static_cast<size_t>( sb.st_size );
+		}
+		catch ( ... )
+		{
+			// not all file systems can be mapped, fall back to reading
+			ret.reset();
+		}
+	}
+	// the mapping stays valid once the file is closed
+	::close( fd );
+	return ret;
+#else
+	(void)u;
+	return std::shared_ptr<const mapped_file>();
+#endif
+}
+
+////////////////////////////////////////
+
+image_buffer mapped_buffer( const std::shared_ptr<const char> &bytes, size_t offset,
+							int16_t bits, bool isfloat, bool isunsigned, base::endianness e,
+							int64_t x1, int64_t y1, int64_t x2, int64_t y2,
+							int64_t xstride, int64_t ystride )
+{
+	precondition( bytes, "mapped buffer of no file contents" );
+	// the scanline conversions access whole values
+	const int64_t vbytes = ( bits + 7 ) / 8;
+	precondition( ( reinterpret_cast<uintptr_t>( bytes.get() ) + offset ) % static_cast<uintptr_t>( vbytes ) == 0 &&
+				  xstride % vbytes == 0 && ystride % vbytes == 0,
+				  "mapped buffer at offset {0} with strides {1}, {2} is not aligned to {3} bit values", offset, xstride, ystride, bits );
+	// shares ownership of the contents, pointing at the pixels
+	std::shared_ptr<void> data( bytes, const_cast<char *>( bytes.get() + offset ) );
+	return image_buffer( data, bits, x1, y1, x2, y2, xstride * 8, ystride * 8, 0, e, isfloat, isunsigned );
+}
+
+////////////////////////////////////////
+
+image_buffer mapped_buffer( const std::shared_ptr<const mapped_file> &m, size_t offset,
+							int16_t bits, bool isfloat, bool isunsigned, base::endianness e,
+							int64_t x1, int64_t y1, int64_t x2, int64_t y2,
+							int64_t xstride, int64_t ystride )
+{
+	precondition( m && *m, "mapped buffer of an empty mapping" );
+	return mapped_buffer( std::shared_ptr<const char>( m, m->get() ), offset, bits, isfloat, isunsigned, e,
+						  x1, y1, x2, y2, xstride, ystride );
+}
+
+////////////////////////////////////////
+
+} // namespace media
+
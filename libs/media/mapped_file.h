@@ -0,0 +1,59 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include "image_buffer.h"
+#include <base/memory_map.h>
+#include <base/uri.h>
+#include <memory>
+
+////////////////////////////////////////
+
+namespace media
+{
+
+/// A local file mapped read only into memory, shared by the buffers
+/// referring to it
+using mapped_file = base::read_memory_map<char>;
+
+///
+/// @brief Maps an entire local file into memory.
+///
+/// Returns null if the uri is not a local file or it can not be
+/// mapped, in which case readers should go through the streams as
+/// usual.
+///
+std::shared_ptr<const mapped_file> map_file( const base::uri &u, size_t &size );
+
+///
+/// @brief Creates an image buffer for pixels stored in the contents
+/// of a file held in memory (mapped, or read through a stream when
+/// the file can not be mapped).
+///
+/// The first scanline of the buffer starts at byte offset of the
+/// contents, the buffer holding them alive. The pixels are bits wide,
+/// with the strides in bytes (the y stride negative for scanlines
+/// stored bottom to top) and endianness as they are stored in the
+/// file, and have to be aligned to the size of the values. The buffer
+/// is read only.
+///
+image_buffer mapped_buffer( const std::shared_ptr<const char> &bytes, size_t offset,
+							int16_t bits, bool isfloat, bool isunsigned, base::endianness e,
+							int64_t x1, int64_t y1, int64_t x2, int64_t y2,
+							int64_t xstride, int64_t ystride );
+
+/// As above, for the contents of a mapped file
+image_buffer mapped_buffer( const std::shared_ptr<const mapped_file> &m, size_t offset,
+							int16_t bits, bool isfloat, bool isunsigned, base::endianness e,
+							int64_t x1, int64_t y1, int64_t x2, int64_t y2,
+							int64_t xstride, int64_t ystride );
+
+////////////////////////////////////////
+
+} // namespace media
+
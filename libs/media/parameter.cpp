@@ -397,6 +397,7 @@ parameter_set initialize_parameters(
 					throw_runtime( "Invalid option '{0}' requested, valid options are:\n{1}",
 								   nv[0], errstr.str() );
 				}
+				ri->second.set_from_string( nv[1] );
 			}
 			else
 				throw_runtime( "Invalid media parameter option '{0}' in '{1}', unable to parse name=value", o, option );
@@ -9,36 +9,25 @@
 
 #if defined(HAVE_LIBPNG)
 # include "file_per_sample_reader.h"
-# include "image_frame.h"
+# include "image.h"
+# include "image_buffer.h"
+# include "prefetch_track.h"
 # include "video_track.h"
 # include "file_sequence.h"
 # include <base/contract.h>
-# include <base/scope_guard.h>
-# include <base/string_util.h>
 # include <base/file_system.h>
-# include <base/env.h>
+# include <functional>
+# include <mutex>
+# ifdef __SSE2__
+#  include <xmmintrin.h>
+#  include <emmintrin.h>
+# endif
 
 #include <png.h>
-#ifndef _WIN32
 #include <setjmp.h>
-#endif
 
 #endif // HAVE_LIBPNG
 
-#include <media/riff/fourcc.h>
-
-namespace
-{
-    // tbd: move this to central place for reader and writer
-    struct chunk
-    {
-        // always have len, type and crc. crc includes type and (data)
-        uint32_t _len;
-        media::fourcc _type;
-        uint32_t _crc;
-        std::vector<uint8_t> data; // TBD: zero copy, subimage read
-    };
-}
 ////////////////////////////////////////
 
 namespace media
@@ -47,198 +36,456 @@ namespace media
 #if defined(HAVE_LIBPNG)
 namespace {
 
-struct StreamHolder
+struct read_options
 {
-    base::istream *stream;
-#ifndef _WIN32
-    sigjmp_buf jmpBuffer;
-#endif
-    ssize_t nread;
-    ssize_t nreq;
+    /// decode to float planes, rather than keeping the 8 or 16 bit
+    /// values (converted each time a plane is retrieved)
+    bool to_float = true;
+    /// frames of a sequence decoded at once, 0 to decode as requested
+    size_t frame_threads = 0;
 };
 
-void mypng_raw_read( png_structp png_ptr, png_bytep data, png_size_t length )
+read_options extractOptions( const parameter_set &parms )
 {
-    StreamHolder *readPtr = static_cast<StreamHolder *>( png_get_io_ptr( png_ptr ) );
-    readPtr->stream->read( (char *)data, length );
-    readPtr->nread = readPtr->stream->gcount();
-    if ( readPtr->nread != ssize_t( length ) )
-    {
-        readPtr->nreq = ssize_t( length );
-#ifndef _WIN32
-        longjmp( readPtr->jmpBuffer, 1 );
-#endif
-    }
+    read_options r;
+
+    auto d = parms.find( "decode" );
+    if ( d != parms.end() && d->second.valid() )
+        r.to_float = d->second.as_string() != "native";
+
+    auto t = parms.find( "frame_threads" );
+    if ( t != parms.end() && t->second.valid() )
+        r.frame_threads = static_cast<size_t>( std::max( int64_t(0), t->second.as_int() ) );
+
+    return r;
 }
 
-class png_read_track : public video_track
-{
-public:
-    png_read_track( int64_t b, int64_t e, file_sequence &&fseq )
-        : video_track( "<image>", std::string(), b, e, sample_rate( 24, 1 ),
-                       media::track_description( media::TRACK_VIDEO ) ),
-          _files( std::move( fseq ) )
-    {}
-    ~png_read_track( void ) override = default;
+////////////////////////////////////////
 
-    image_frame *doRead( int64_t f ) override;
+#ifdef __SSE2__
+// converts 4 pixels, each in the epi32 lanes of a register, into 4
+// values of each plane (dividing to match the scalar conversion)
+inline void store_rgba( __m128i p0, __m128i p1, __m128i p2, __m128i p3, __m128 scale, float *const *dst, size_t x )
+{
+    __m128 r = _mm_div_ps( _mm_cvtepi32_ps( p0 ), scale );
+    __m128 g = _mm_div_ps( _mm_cvtepi32_ps( p1 ), scale );
+    __m128 b = _mm_div_ps( _mm_cvtepi32_ps( p2 ), scale );
+    __m128 a = _mm_div_ps( _mm_cvtepi32_ps( p3 ), scale );
+    _MM_TRANSPOSE4_PS( r, g, b, a );
+    _mm_storeu_ps( dst[0] + x, r );
+    _mm_storeu_ps( dst[1] + x, g );
+    _mm_storeu_ps( dst[2] + x, b );
+    _mm_storeu_ps( dst[3] + x, a );
+}
 
-    void doWrite( int64_t, const image_frame & )
+// grey or RGBA rows, returns the number of pixels done
+size_t convert_row_sse( const uint8_t *row, int bits, int chans, float *const *dst, size_t w )
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t x = 0;
+    if ( bits == 8 )
     {
-        throw_logic( "reader asked to write a frame" );
+        const __m128 scale = _mm_set1_ps( 255.0F );
+        if ( chans == 1 )
+        {
+            for ( ; x + 16 <= w; x += 16 )
+            {
+                __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( row + x ) );
+                __m128i lo = _mm_unpacklo_epi8( v, zero );
+                __m128i hi = _mm_unpackhi_epi8( v, zero );
+                _mm_storeu_ps( dst[0] + x, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( lo, zero ) ), scale ) );
+                _mm_storeu_ps( dst[0] + x + 4, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( lo, zero ) ), scale ) );
+                _mm_storeu_ps( dst[0] + x + 8, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( hi, zero ) ), scale ) );
+                _mm_storeu_ps( dst[0] + x + 12, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( hi, zero ) ), scale ) );
+            }
+        }
+        else
+        {
+            for ( ; x + 4 <= w; x += 4 )
+            {
+                __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( row + x * 4 ) );
+                __m128i lo = _mm_unpacklo_epi8( v, zero );
+                __m128i hi = _mm_unpackhi_epi8( v, zero );
+                store_rgba( _mm_unpacklo_epi16( lo, zero ), _mm_unpackhi_epi16( lo, zero ),
+                            _mm_unpacklo_epi16( hi, zero ), _mm_unpackhi_epi16( hi, zero ),
+                            scale, dst, x );
+            }
+        }
+        return x;
     }
 
-    void doWrite( int64_t, const std::vector< std::shared_ptr<image_frame> > & )
+    // 16 bit values are big endian
+    const __m128 scale = _mm_set1_ps( 65535.0F );
+    auto load = [&]( const uint8_t *p )
     {
-        throw_logic( "reader asked to write a frame" );
+        __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) );
+        return _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+    };
+    if ( chans == 1 )
+    {
+        for ( ; x + 8 <= w; x += 8 )
+        {
+            __m128i v = load( row + x * 2 );
+            _mm_storeu_ps( dst[0] + x, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( v, zero ) ), scale ) );
+            _mm_storeu_ps( dst[0] + x + 4, _mm_div_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( v, zero ) ), scale ) );
+        }
     }
+    else
+    {
+        for ( ; x + 4 <= w; x += 4 )
+        {
+            __m128i v0 = load( row + x * 8 );
+            __m128i v1 = load( row + x * 8 + 16 );
+            store_rgba( _mm_unpacklo_epi16( v0, zero ), _mm_unpackhi_epi16( v0, zero ),
+                        _mm_unpacklo_epi16( v1, zero ), _mm_unpackhi_epi16( v1, zero ),
+                        scale, dst, x );
+        }
+    }
+    return x;
+}
+#endif
 
-private:
-    file_sequence _files;
-};
-
-image_frame *
-png_read_track::doRead( int64_t f )
+/// converts a decoded (interleaved) row into a float plane per
+/// channel, as image_buffer::get_scanline would
+void convert_row( const uint8_t *row, int bits, int chans, float *const *dst, size_t w )
 {
-    std::unique_ptr<image_frame> ret;
-
-    base::uri u = _files.get_frame( f );
-    std::string p = u.full_path();
-    auto fs = base::file_system::get( u );
-    base::istream stream = fs->open_read( u );
-    StreamHolder sh;
-    sh.stream = &stream;
-
-    png_byte header[8];
-    stream.read( (char *)header, 8 );
+    size_t x = 0;
+#ifdef __SSE2__
+    if ( chans == 1 || chans == 4 )
+        x = convert_row_sse( row, bits, chans, dst, w );
+#endif
+    const size_t n = static_cast<size_t>( chans );
+    if ( bits == 16 )
+    {
+        for ( ; x < w; ++x )
+        {
+            for ( size_t c = 0; c < n; ++c )
+            {
+                const uint8_t *v = row + ( x * n + c ) * 2;
+                dst[c][x] = static_cast<float>( uint16_t( ( v[0] << 8 ) | v[1] ) ) / 65535.0F;
+            }
+        }
+    }
+    else
+    {
+        for ( ; x < w; ++x )
+        {
+            for ( size_t c = 0; c < n; ++c )
+                dst[c][x] = static_cast<float>( row[x * n + c] ) / 255.0F;
+        }
+    }
+}
 
-    if (png_sig_cmp(header, 0, 8))
-        throw_runtime( "error: {0} is not a PNG.\n", p );
+////////////////////////////////////////
 
-    png_structp png_ptr = png_create_read_struct( PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr );
-    if (!png_ptr)
-        throw_runtime( "error: png_create_read_struct returned 0" );
-    on_scope_exit
+/// An open PNG file, header read and set up to decode rows of 8 or
+/// 16 bit gray, gray + alpha, RGB or RGBA values.
+class png_file
+{
+public:
+    png_file( const std::shared_ptr<base::file_system> &fs, const base::uri &u )
+        : _uri( u ), _stream( fs->open_read( u ) )
     {
-        png_destroy_read_struct( &png_ptr, nullptr, nullptr );
-    };
-
-#ifndef _WIN32
-    if ( setjmp( sh.jmpBuffer )  )
-        throw_runtime( "error: unable to read requested bytes {0} from stream, got {1}", sh.nreq, sh.nread );
-#endif
+        png_byte header[8];
+        _stream.read( reinterpret_cast<char *>( header ), 8 );
+        if ( _stream.gcount() != 8 || png_sig_cmp( header, 0, 8 ) )
+            throw_runtime( "{0} is not a PNG", u );
+
+        _png = png_create_read_struct( PNG_LIBPNG_VER_STRING, this, &png_file::error, &png_file::warning );
+        if ( ! _png )
+            throw_runtime( "png_create_read_struct failed" );
+        _info = png_create_info_struct( _png );
+        if ( ! _info )
+        {
+            png_destroy_read_struct( &_png, nullptr, nullptr );
+            throw_runtime( "png_create_info_struct failed" );
+        }
+
+        if ( setjmp( png_jmpbuf( _png ) ) )
+        {
+            png_destroy_read_struct( &_png, &_info, nullptr );
+            throw_runtime( "Unable to read PNG header of {0}: {1}", _uri, _message );
+        }
+
+        png_set_read_fn( _png, this, &png_file::read );
+        // the first 8 bytes are already read
+        png_set_sig_bytes( _png, 8 );
+        png_read_info( _png, _info );
+
+        int colorType = png_get_color_type( _png, _info );
+        if ( colorType == PNG_COLOR_TYPE_PALETTE )
+            png_set_palette_to_rgb( _png );
+        if ( colorType == PNG_COLOR_TYPE_GRAY && png_get_bit_depth( _png, _info ) < 8 )
+            png_set_expand_gray_1_2_4_to_8( _png );
+        if ( png_get_valid( _png, _info, PNG_INFO_tRNS ) )
+            png_set_tRNS_to_alpha( _png );
+        _passes = png_set_interlace_handling( _png );
+        png_read_update_info( _png, _info );
+
+        _width = png_get_image_width( _png, _info );
+        _height = png_get_image_height( _png, _info );
+        _bits = png_get_bit_depth( _png, _info );
+        _chans = png_get_channels( _png, _info );
+        _rowbytes = png_get_rowbytes( _png, _info );
+        if ( _chans < 1 || _chans > 4 || ( _bits != 8 && _bits != 16 ) )
+            throw_runtime( "PNG layout not supported ({0} channels of {1} bits)", _chans, _bits );
+    }
 
-    // create png info struct
-    png_infop info_ptr = png_create_info_struct( png_ptr );
-    if ( !info_ptr )
-        throw_runtime( "error: png_create_info_struct returned 0" );
+    ~png_file( void )
+    {
+        if ( _png )
+            png_destroy_read_struct( &_png, &_info, nullptr );
+    }
+    png_file( const png_file & ) = delete;
+    png_file &operator=( const png_file & ) = delete;
 
-    // create png info struct
-    png_infop end_info = png_create_info_struct(png_ptr);
-    if (!end_info)
-        throw_runtime( "error: png_create_info_struct returned 0" );
+    uint32_t width( void ) const { return _width; }
+    uint32_t height( void ) const { return _height; }
+    int bits( void ) const { return _bits; }
+    int channels( void ) const { return _chans; }
 
-    // the code in this if statement gets called if libpng encounters an error
-    if ( setjmp( png_jmpbuf( png_ptr ) ) )
-        throw_runtime( "error from libpng" );
+    /// decodes the whole image into rows
+    void read_image( png_bytep *rows )
+    {
+        if ( setjmp( png_jmpbuf( _png ) ) )
+            throw_runtime( "Unable to decode PNG {0}: {1}", _uri, _message );
+        png_read_image( _png, rows );
+    }
 
-    // init png reading
-    png_set_read_fn( png_ptr, &sh, mypng_raw_read );
-//  png_init_io( png_ptr, fp );
+    /// decodes the image a row at a time (unless interlaced), calling
+    /// f with each row as it is done
+    void read_rows( const std::function<void( uint32_t, const uint8_t * )> &f )
+    {
+        std::vector<uint8_t> buf( _rowbytes * ( _passes > 1 ? _height : 1 ) );
+        std::vector<png_bytep> rows;
+        if ( _passes > 1 )
+        {
+            for ( uint32_t y = 0; y < _height; ++y )
+                rows.push_back( buf.data() + y * _rowbytes );
+            read_image( rows.data() );
+            for ( uint32_t y = 0; y < _height; ++y )
+                f( y, rows[y] );
+            return;
+        }
+
+        if ( setjmp( png_jmpbuf( _png ) ) )
+            throw_runtime( "Unable to decode PNG {0}: {1}", _uri, _message );
+        for ( uint32_t y = 0; y < _height; ++y )
+        {
+            png_read_row( _png, buf.data(), nullptr );
+            f( y, buf.data() );
+        }
+    }
 
-    // let libpng know you already read the first 8 bytes
-    png_set_sig_bytes( png_ptr, 8 );
+private:
+    static void read( png_structp png, png_bytep data, png_size_t length )
+    {
+        png_file *self = static_cast<png_file *>( png_get_io_ptr( png ) );
+        self->_stream.read( reinterpret_cast<char *>( data ), static_cast<std::streamsize>( length ) );
+        if ( self->_stream.gcount() != static_cast<std::streamsize>( length ) )
+            png_error( png, "unexpected end of file" );
+    }
 
-    // read all the info up to the image data
-    png_read_info( png_ptr, info_ptr );
+    static void error( png_structp png, png_const_charp msg )
+    {
+        png_file *self = static_cast<png_file *>( png_get_error_ptr( png ) );
+        self->_message = msg;
+        png_longjmp( png, 1 );
+    }
 
-    // variables to pass to get info
-    int bit_depth, color_type;
-    png_uint_32 temp_width, temp_height;
+    static void warning( png_structp, png_const_charp )
+    {
+    }
 
-    // get info about png
-    if ( png_get_IHDR( png_ptr, info_ptr, &temp_width, &temp_height, &bit_depth, &color_type, nullptr, nullptr, nullptr) == 0 )
-        throw_runtime( "error getting PNG header" );
+    base::uri _uri;
+    base::istream _stream;
+    png_structp _png = nullptr;
+    png_infop _info = nullptr;
+    std::string _message;
+    uint32_t _width = 0;
+    uint32_t _height = 0;
+    int _bits = 8;
+    int _chans = 0;
+    int _passes = 1;
+    size_t _rowbytes = 0;
+};
 
-    double fgama = 1.0;
-    if ( png_get_gAMA( png_ptr, info_ptr, &fgama ) == 0 )
-        fgama = 2.4;
+////////////////////////////////////////
 
-    if ( color_type == PNG_COLOR_TYPE_PALETTE )
+/// The channels of a PNG file, a plane each, decoded the first time a
+/// plane is needed: straight into float planes as each row is done,
+/// or into the 8 / 16 bit values as stored.
+class png_image : public image
+{
+public:
+    png_image( const std::shared_ptr<base::file_system> &fs, const base::uri &u, const png_file &hdr, bool toFloat )
+        : _fs( fs ), _uri( u ), _to_float( toFloat )
     {
-        png_set_palette_to_rgb( png_ptr );
-        png_set_tRNS_to_alpha( png_ptr );
+        _width = hdr.width();
+        _height = hdr.height();
+        _bits = hdr.bits();
+        _chans = hdr.channels();
+        set_area( area_rect::from_points( 0, 0, int64_t( _width ) - 1, int64_t( _height ) - 1 ) );
+
+        const char *rgbNames[] = { "R", "G", "B", "A" };
+        const char *greyNames[] = { "Y", "A" };
+        plane_layout pl;
+        if ( _to_float )
+        {
+            pl._bits = 32;
+            pl._floating = true;
+            pl._unsigned = false;
+        }
+        else
+        {
+            pl._bits = static_cast<int8_t>( _bits );
+            pl._floating = false;
+            pl._unsigned = true;
+            // png is always in network (BIG endian) order
+            pl._endian = _bits == 16 ? base::endianness::BIG : base::endianness::NATIVE;
+        }
+        for ( int c = 0; c < _chans; ++c )
+            register_plane( _chans < 3 ? greyNames[c] : rgbNames[c], pl, 0.0 );
     }
 
-    if ( color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8 )
-        png_set_expand_gray_1_2_4_to_8( png_ptr );
+    /// decodes the pixels now rather than when first needed
+    void load( void ) const
+    {
+        stored( 0 );
+    }
 
-    if ( color_type == PNG_COLOR_TYPE_GRAY_ALPHA )
-        png_set_tRNS_to_alpha( png_ptr );
+protected:
+    bool storage_interleaved( void ) const override
+    {
+        return false;
+    }
 
-    // Update the png info struct.
-    png_read_update_info(png_ptr, info_ptr);
-    if ( png_get_IHDR( png_ptr, info_ptr, &temp_width, &temp_height, &bit_depth, &color_type, nullptr, nullptr, nullptr) == 0 )
-        throw_runtime( "error getting PNG header" );
+    void fill_plane( size_t plane, image_buffer &buffer ) override
+    {
+        copy_buffer( stored( plane ), buffer );
+    }
 
-    // Check the info to make sure we can use it.
-//  if ( bit_depth != 8 )
-//      throw_runtime( "only 8 bit PNG images supported" );
+    void fill_image( image_buffer &buffer ) override
+    {
+        for ( size_t p = 0; p != size(); ++p )
+            copy_to_interleaved( stored( p ), buffer, p );
+    }
 
-    ret.reset( new image_frame( 0, 0, temp_width - 1, temp_height - 1 ) );
+    image_buffer compute_direct_plane( size_t plane ) const override
+    {
+        return stored( plane );
+    }
 
-    int c = 0;
-    switch ( color_type )
+private:
+    const image_buffer &stored( size_t plane ) const
     {
-        case PNG_COLOR_TYPE_GRAY: c = 1; break;
-        case PNG_COLOR_TYPE_GRAY_ALPHA: c = 2; break;
-        case PNG_COLOR_TYPE_RGB: c = 3; break;
-        case PNG_COLOR_TYPE_RGB_ALPHA: c = 4; break;
-        default: throw_runtime( "PNG color type not supported ({0})", color_type );
+        std::lock_guard<std::mutex> lk( _mutex );
+        if ( _planes.empty() )
+        {
+            if ( _to_float )
+                decode_float();
+            else
+                decode_native();
+        }
+        return _planes.at( plane );
     }
 
-    image_buffer imgbuf;
-    int offbits = 8;
-    if ( bit_depth > 8 )
+    void decode_float( void ) const
     {
-        offbits = 16;
-        // png is always in network (BIG endian) order...
-        imgbuf = image_buffer::simple_interleaved<uint16_t>( temp_width, temp_height, c,
-                                                             base::endianness::BIG );
+        png_file pf( _fs, _uri );
+        std::vector<image_buffer> planes;
+        for ( int c = 0; c < _chans; ++c )
+            planes.push_back( image_buffer::simple_buffer<float>( 0, 0, int64_t( _width ) - 1, int64_t( _height ) - 1 ) );
+
+        std::vector<float *> lines( static_cast<size_t>( _chans ) );
+        pf.read_rows( [&]( uint32_t y, const uint8_t *row )
+        {
+            for ( size_t c = 0; c != lines.size(); ++c )
+                lines[c] = static_cast<float *>( planes[c].row( y ) );
+            convert_row( row, _bits, _chans, lines.data(), _width );
+        } );
+        _planes = std::move( planes );
     }
-    else
-        imgbuf = image_buffer::simple_interleaved<uint8_t>( temp_width, temp_height, c );
 
-    const char *chanNames[] = { "R", "G", "B", "A" };
-    if ( color_type == PNG_COLOR_TYPE_GRAY )
+    void decode_native( void ) const
     {
-        ret->add_channel( "R", image_buffer( imgbuf, offbits*0 ) );
-        ret->add_channel( "A", image_buffer( imgbuf, offbits*1 ) );
+        png_file pf( _fs, _uri );
+        image_buffer imgbuf;
+        if ( _bits == 16 )
+            imgbuf = image_buffer::simple_interleaved<uint16_t>( _width, _height, _chans, base::endianness::BIG );
+        else
+            imgbuf = image_buffer::simple_interleaved<uint8_t>( _width, _height, _chans );
+
+        std::vector<png_bytep> rows( _height );
+        for ( uint32_t y = 0; y < _height; ++y )
+            rows[y] = static_cast<png_bytep>( imgbuf.row( static_cast<int64_t>( y ) ) );
+        pf.read_image( rows.data() );
+
+        std::vector<image_buffer> planes;
+        for ( int c = 0; c < _chans; ++c )
+            planes.emplace_back( imgbuf, _bits * c );
+        _planes = std::move( planes );
     }
-    else
+
+    std::shared_ptr<base::file_system> _fs;
+    base::uri _uri;
+    bool _to_float = true;
+    uint32_t _width = 0;
+    uint32_t _height = 0;
+    int _bits = 8;
+    int _chans = 0;
+    mutable std::mutex _mutex;
+    mutable std::vector<image_buffer> _planes;
+};
+
+////////////////////////////////////////
+
+class png_frame : public frame
+{
+public:
+    png_frame( const std::shared_ptr<base::file_system> &fs, const base::uri &u, int64_t num, bool toFloat, bool eager )
+        : frame( num )
     {
-        precondition( size_t(c) <= (sizeof(chanNames)/sizeof(const char *)), "valid channel count" );
-        for ( int x = 0; x < c; ++x )
-            ret->add_channel( chanNames[x], image_buffer( imgbuf, offbits*x ) );
+        // unless eager, only the header, the pixels are decoded when
+        // needed
+        png_file hdr( fs, u );
+        auto img = std::make_shared<png_image>( fs, u, hdr, toFloat );
+        if ( eager )
+            img->load();
+        layer &l = register_layer( std::string() );
+        l.add_view( std::string() ).store( img );
     }
+};
 
-    // Row size in bytes.
-    png_size_t rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+////////////////////////////////////////
 
-    std::vector<png_bytep> row_pointers;
-    row_pointers.resize( temp_height, nullptr );
+class png_read_track : public video_track
+{
+public:
+    png_read_track( int64_t b, int64_t e, file_sequence &&fseq, bool toFloat, bool eager )
+        : video_track( "<image>", std::string(), b, e, sample_rate( 24, 1 ),
+                       media::track_description( media::TRACK_VIDEO ) ),
+          _files( std::move( fseq ) ), _to_float( toFloat ), _eager( eager )
+    {}
+    ~png_read_track( void ) override = default;
 
-    if ( png_size_t( imgbuf.ystride_bytes() ) < rowbytes )
-        throw_runtime( "PNG unexpected number of bytes for row({0}), expect {1}", rowbytes, imgbuf.ystride_bytes() );
+    frame *doRead( int64_t f ) override
+    {
+        return new png_frame( base::file_system::get( _files.uri() ), _files.get_frame( f ), f, _to_float, _eager );
+    }
 
-    for ( png_uint_32 i = 0; i < temp_height; ++i )
-        row_pointers[i] = static_cast<uint8_t *>( imgbuf.row( static_cast<int64_t>( i ) ) );
+    void doWrite( int64_t, const frame & ) override
+    {
+        throw_logic( "reader asked to write a frame" );
+    }
 
-    // read the png into image_data through row_pointers
-    png_read_image( png_ptr, row_pointers.data() );
+private:
+    file_sequence _files;
+    bool _to_float;
+    bool _eager;
+};
 
-    return ret.release();
-}
+////////////////////////////////////////
 
 class PNG_reader : public file_per_sample_reader
 {
@@ -250,22 +497,51 @@ public:
         _extensions.emplace_back( "png" );
         std::vector<uint8_t> magic{0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a};
         _magics.emplace_back( std::move( magic ) );
+
+        _parms.push_back(
+            media::parameter_definition(
+                "decode",
+                std::vector<std::string>{ "float", "native" },
+                "float" ) );
+        _parms.back().help( "How the pixels are decoded:\n"
+                            " float - straight to float planes, as each row is done\n"
+                            " native - as the 8 or 16 bit values stored, converted when retrieved\n"
+                            );
+        _parms.push_back( media::parameter_definition( "frame_threads", int64_t(0), int64_t(64), int64_t(0) ) );
+        _parms.back().help( "Number of frames of a sequence decoded at once, ahead of\n"
+                            "the one requested (0 decodes each frame when requested)\n" );
     }
     ~PNG_reader( void ) override = default;
 
-    container create( const base::uri &u, const metadata &params ) override;
+    container create( const base::uri &u, const parameter_set &params ) override;
 };
 
 container
-PNG_reader::create( const base::uri &u, const metadata &params )
+PNG_reader::create( const base::uri &u, const parameter_set &params )
 {
     container result;
+    read_options opts = extractOptions( params );
 
     int64_t start, last;
     file_sequence fseq( u );
     auto fs = scan_samples( start, last, fseq );
 
-    result.add_track( std::make_shared<png_read_track>( start, last, std::move( fseq ) ) );
+    // frames read ahead on the pool are decoded as they are read, so
+    // the pool need not copy them
+    const bool ahead = opts.frame_threads > 0;
+    auto vt = std::make_shared<png_read_track>( start, last, std::move( fseq ), opts.to_float, ahead );
+    if ( ahead )
+    {
+        prefetch_options po;
+        po.window = opts.frame_threads;
+        po.threads = opts.frame_threads;
+        po.decode = false;
+        result.add_track( std::make_shared<prefetch_track>( vt, po ) );
+    }
+    else
+        result.add_track( vt );
+    result.set_parameters( params );
+
     return result;
 }
 
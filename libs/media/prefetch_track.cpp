@@ -0,0 +1,205 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "prefetch_track.h"
+#include "preloaded_image.h"
+#include <base/contract.h>
+
+////////////////////////////////////////
+
+namespace media
+{
+
+////////////////////////////////////////
+
+prefetch_track::prefetch_track( std::shared_ptr<video_track> src, const prefetch_options &opts )
+	: video_track( src->name(), src->view(), src->begin(), src->end(), src->rate(), src->desc() ),
+	  _src( std::move( src ) ), _opts( opts )
+{
+	if ( _opts.window > 0 && _opts.threads > 0 )
+		_pool.reset( new base::thread_pool( _opts.threads ) );
+}
+
+////////////////////////////////////////
+
+prefetch_track::~prefetch_track( void )
+{
+	cancel();
+	// joins the workers (dropping anything still queued) before the
+	// rest of the members go away
+	_pool.reset();
+}
+
+////////////////////////////////////////
+
+void prefetch_track::cancel( void )
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	drop_ahead();
+}
+
+////////////////////////////////////////
+
+size_t prefetch_track::ready( void ) const
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	size_t ret = 0;
+	for ( auto &s: _ahead )
+		ret += s.second->done ? 1 : 0;
+	return ret;
+}
+
+////////////////////////////////////////
+
+size_t prefetch_track::bytes_ahead( void ) const
+{
+	std::lock_guard<std::mutex> lk( _mutex );
+	return _bytes;
+}
+
+////////////////////////////////////////
+
+frame *prefetch_track::doRead( int64_t f )
+{
+	std::unique_lock<std::mutex> lk( _mutex );
+	auto i = _ahead.find( f );
+	if ( i == _ahead.end() )
+	{
+		// first read or a seek, anything read ahead is for the wrong
+		// frames
+		drop_ahead();
+		lk.unlock();
+
+		size_t bytes = 0;
+		std::unique_ptr<frame> ret = load( f, false, bytes );
+		if ( ! rate().valid() )
+			update_rate( _src->rate() );
+
+		lk.lock();
+		if ( _frame_bytes == 0 )
+			_frame_bytes = bytes;
+		_next = _last_queued = f + 1;
+		schedule();
+		return ret.release();
+	}
+
+	// frames skipped over (strided reads) will not be asked for, so
+	// drop them rather than holding on to them (and their bytes)
+	for ( auto j = _ahead.begin(); j != i; j = _ahead.erase( j ) )
+		_bytes -= std::min( _bytes, j->second->bytes );
+
+	std::shared_ptr<slot> s = i->second;
+	_cond.wait( lk, [&]() { return s->done; } );
+	_ahead.erase( f );
+	_bytes -= std::min( _bytes, s->bytes );
+	_next = f + 1;
+	schedule();
+	lk.unlock();
+
+	if ( s->error )
+		std::rethrow_exception( s->error );
+	return s->frm.release();
+}
+
+////////////////////////////////////////
+
+void prefetch_track::doWrite( int64_t , const frame & )
+{
+	throw_logic( "prefetching track asked to write a frame" );
+}
+
+////////////////////////////////////////
+
+std::unique_ptr<frame> prefetch_track::load( int64_t f, bool decode, size_t &bytes )
+{
+	// the source frame is given to us as a shared pointer, so rebuild
+	// the layers in a frame we can hand out, sharing the images (or
+	// preloaded copies of them)
+	std::shared_ptr<frame> src = _src->at( f );
+	if ( ! src )
+		throw_runtime( "Unable to read frame {0}", f );
+
+	bytes = 0;
+	std::unique_ptr<frame> ret = copy_frame( *src,
+		[&]( const layer &, const media::view &, const std::shared_ptr<image> &img ) -> std::shared_ptr<image>
+		{
+			bytes += preloaded_image::decoded_size( *img );
+			if ( decode && ! img->interleaved() )
+				return std::make_shared<preloaded_image>( img );
+			return img;
+		} );
+	return ret;
+}
+
+////////////////////////////////////////
+
+void prefetch_track::drop_ahead( void )
+{
+	// anything still decoding sees the generation change and throws
+	// away the result
+	++_generation;
+	_ahead.clear();
+	_bytes = 0;
+	_last_queued = _next;
+}
+
+////////////////////////////////////////
+
+void prefetch_track::schedule( void )
+{
+	if ( ! _pool )
+		return;
+
+	const int64_t last = std::min( _src->end(), _next + static_cast<int64_t>( _opts.window ) - 1 );
+	for ( ; _last_queued <= last; ++_last_queued )
+	{
+		size_t est = _opts.decode ? _frame_bytes : 0;
+		if ( _opts.memory_limit > 0 && _bytes + est > _opts.memory_limit )
+			break;
+
+		int64_t f = _last_queued;
+		auto s = std::make_shared<slot>();
+		s->bytes = est;
+		_bytes += est;
+		_ahead[f] = s;
+
+		uint64_t gen = _generation;
+		_pool->queue( [this, f, gen, s]()
+		{
+			std::unique_ptr<frame> frm;
+			std::exception_ptr err;
+			size_t bytes = 0;
+			try
+			{
+				frm = load( f, _opts.decode, bytes );
+			}
+			catch ( ... )
+			{
+				err = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lk( _mutex );
+			// dropped by a seek or skipped over
+			auto cur = _ahead.find( f );
+			if ( gen != _generation || cur == _ahead.end() || cur->second != s )
+				return;
+			if ( _opts.decode )
+			{
+				_bytes = _bytes - std::min( _bytes, s->bytes ) + bytes;
+				s->bytes = bytes;
+			}
+			s->frm = std::move( frm );
+			s->error = err;
+			s->done = true;
+			_cond.notify_all();
+		} );
+	}
+}
+
+////////////////////////////////////////
+
+} // media
@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include "video_track.h"
+#include <base/thread_pool.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+////////////////////////////////////////
+
+namespace media
+{
+
+struct prefetch_options
+{
+	/// number of frames after the current one to keep decoding
+	size_t window = 4;
+	/// number of background threads reading frames
+	size_t threads = 2;
+	/// upper bound on the bytes of decoded pixels held by frames read
+	/// ahead (but not yet requested), 0 for no limit
+	size_t memory_limit = 0;
+	/// when true, the pixels of the images are decoded in the
+	/// background, otherwise only the frames are opened (headers
+	/// parsed)
+	bool decode = true;
+};
+
+///
+/// @brief Class prefetch_track wraps a video track, reading the
+/// frames following the last one requested on a pool of background
+/// threads.
+///
+/// While the caller processes frame N, frames N + 1 to N + window are
+/// read (and decoded). Requesting a frame that is not read ahead is
+/// considered a seek, and drops the frames read ahead; requesting one
+/// further ahead than the next drops the frames skipped over. The source
+/// track must support reading different frames from multiple threads
+/// at once, which all the file per frame readers do.
+///
+class prefetch_track : public video_track
+{
+public:
+	prefetch_track( std::shared_ptr<video_track> src, const prefetch_options &opts = prefetch_options() );
+	~prefetch_track( void ) override;
+
+	const std::shared_ptr<video_track> &source( void ) const { return _src; }
+	const prefetch_options &options( void ) const { return _opts; }
+
+	/// drops all frames read ahead, done automatically upon a seek
+	void cancel( void );
+
+	/// number of frames read ahead and done decoding
+	size_t ready( void ) const;
+	/// bytes of decoded pixels (estimated while decoding) held by the
+	/// frames read ahead
+	size_t bytes_ahead( void ) const;
+
+protected:
+	frame *doRead( int64_t f ) override;
+	void doWrite( int64_t f, const frame &frm ) override;
+
+private:
+	struct slot
+	{
+		bool done = false;
+		size_t bytes = 0;
+		std::unique_ptr<frame> frm;
+		std::exception_ptr error;
+	};
+
+	std::unique_ptr<frame> load( int64_t f, bool decode, size_t &bytes );
+	void drop_ahead( void );
+	void schedule( void );
+
+	std::shared_ptr<video_track> _src;
+	prefetch_options _opts;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _cond;
+	std::map<int64_t, std::shared_ptr<slot>> _ahead;
+	uint64_t _generation = 0;
+	int64_t _next = 0;
+	int64_t _last_queued = 0;
+	size_t _bytes = 0;
+	size_t _frame_bytes = 0;
+
+	// last, so the workers are joined before anything they touch is
+	// destroyed
+	std::unique_ptr<base::thread_pool> _pool;
+};
+
+////////////////////////////////////////
+
+} // namespace media
@@ -0,0 +1,217 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include "preloaded_image.h"
+#include <base/contract.h>
+#include <cstring>
+
+////////////////////////////////////////
+
+namespace
+{
+
+size_t plane_bytes( const media::area_rect &a, const media::plane_layout &pl )
+{
+	size_t w = static_cast<size_t>( a.width() ) >> pl._xsubsample_shift;
+	size_t h = static_cast<size_t>( a.height() ) >> pl._ysubsample_shift;
+	return w * h * ( static_cast<size_t>( pl._bits + 7 ) / 8 );
+}
+
+} // empty namespace
+
+////////////////////////////////////////
+
+namespace media
+{
+
+////////////////////////////////////////
+
+preloaded_image::preloaded_image( const std::shared_ptr<image> &src )
+	: _src( src )
+{
+	precondition( _src, "preloading a null image" );
+	copy_description( *_src );
+
+	const area_rect &a = active_area();
+	_planes.reserve( size() );
+	for ( size_t p = 0, nP = size(); p != nP; ++p )
+	{
+		plane_layout pl = layout( p );
+		_planes.push_back( image_buffer::full_plane( a.x1(), a.y1(), a.x2(), a.y2(),
+													 pl._bits, pl._xsubsample_shift, pl._ysubsample_shift,
+													 pl._floating, pl._unsigned ) );
+		_src->retrieve( p, _planes.back() );
+		_bytes += plane_bytes( a, pl );
+	}
+}
+
+////////////////////////////////////////
+
+preloaded_image::preloaded_image( const area_rect &area, std::vector<std::string> names, std::vector<image_buffer> planes )
+	: image( area ), _planes( std::move( planes ) )
+{
+	precondition( names.size() == _planes.size(), "mismatch in plane names ({0}) and planes ({1})", names.size(), _planes.size() );
+	for ( size_t p = 0; p != _planes.size(); ++p )
+	{
+		const image_buffer &b = _planes[p];
+		if ( b.x1() != area.x1() || b.y1() != area.y1() || b.x2() != area.x2() || b.y2() != area.y2() )
+			throw_runtime( "Plane {0} does not cover the area of the image", names[p] );
+
+		plane_layout pl;
+		pl._endian = b.endianness();
+		pl._bits = static_cast<int8_t>( b.bits() );
+		pl._floating = b.is_floating();
+		pl._unsigned = ! b.is_floating();
+		register_plane( std::move( names[p] ), pl, 0.0 );
+		_bytes += plane_bytes( area, pl );
+	}
+}
+
+////////////////////////////////////////
+
+preloaded_image::~preloaded_image( void )
+{
+}
+
+////////////////////////////////////////
+
+size_t preloaded_image::decoded_size( const image &img )
+{
+	size_t ret = 0;
+	for ( size_t p = 0, nP = img.size(); p != nP; ++p )
+		ret += plane_bytes( img.active_area(), img.layout( p ) );
+	return ret;
+}
+
+////////////////////////////////////////
+
+bool preloaded_image::storage_interleaved( void ) const
+{
+	return false;
+}
+
+////////////////////////////////////////
+
+void preloaded_image::fill_plane( size_t plane, image_buffer &buffer )
+{
+	// not a straight copy, let the source reader sort it out
+	if ( ! copy_stored( _planes.at( plane ), plane, buffer ) )
+		source_or_throw().retrieve( plane, buffer );
+}
+
+////////////////////////////////////////
+
+void preloaded_image::fill_image( image_buffer &buffer )
+{
+	source_or_throw().retrieve( buffer );
+}
+
+////////////////////////////////////////
+
+void preloaded_image::fill_plane_level( size_t plane, image_buffer &buffer, int lx, int ly )
+{
+	if ( lx == 0 && ly == 0 )
+	{
+		fill_plane( plane, buffer );
+		return;
+	}
+
+	auto l = _levels.find( std::make_pair( lx, ly ) );
+	if ( l == _levels.end() || ! copy_stored( l->second.at( plane ), plane, buffer ) )
+		source_or_throw().retrieve( plane, buffer, lx, ly );
+}
+
+////////////////////////////////////////
+
+area_rect preloaded_image::compute_level_area( int lx, int ly ) const
+{
+	auto l = _levels.find( std::make_pair( lx, ly ) );
+	if ( l != _levels.end() )
+	{
+		const image_buffer &b = l->second.front();
+		return area_rect::from_points( b.x1(), b.y1(), b.x2(), b.y2() );
+	}
+	if ( ! _src )
+		return image::compute_level_area( lx, ly );
+	return _src->level_area( lx, ly );
+}
+
+////////////////////////////////////////
+
+std::pair<int64_t, int64_t> preloaded_image::compute_preferred_chunk( void ) const
+{
+	if ( ! _src )
+		return image::compute_preferred_chunk();
+	std::pair<int, int> c = _src->preferred_chunk_size();
+	return std::make_pair( static_cast<int64_t>( c.first ), static_cast<int64_t>( c.second ) );
+}
+
+////////////////////////////////////////
+
+image_buffer preloaded_image::compute_direct_plane( size_t plane ) const
+{
+	return _planes.at( plane );
+}
+
+////////////////////////////////////////
+
+void preloaded_image::add_level( int lx, int ly, std::vector<image_buffer> planes )
+{
+	precondition( planes.size() == size(), "level ({0}, {1}) has {2} planes, expected {3}", lx, ly, planes.size(), size() );
+	const image_buffer &f = planes.front();
+	for ( size_t p = 0; p != planes.size(); ++p )
+	{
+		const image_buffer &b = planes[p];
+		if ( b.x1() != f.x1() || b.y1() != f.y1() || b.x2() != f.x2() || b.y2() != f.y2() )
+			throw_runtime( "Plane {0} of level ({1}, {2}) does not cover the area of the level", plane_name( p ), lx, ly );
+		_bytes += plane_bytes( area_rect::from_points( b.x1(), b.y1(), b.x2(), b.y2() ), layout( p ) );
+	}
+	_levels[std::make_pair( lx, ly )] = std::move( planes );
+}
+
+////////////////////////////////////////
+
+bool preloaded_image::copy_stored( const image_buffer &src, size_t plane, image_buffer &buffer ) const
+{
+	const plane_layout pl = layout( plane );
+	if ( buffer.bits() != src.bits() || buffer.is_floating() != src.is_floating() ||
+		 buffer.endianness() != src.endianness() || ( buffer.bits() % 8 ) != 0 ||
+		 buffer.x1() < src.x1() || buffer.x2() > src.x2() ||
+		 buffer.y1() < src.y1() || buffer.y2() > src.y2() ||
+		 pl._xsubsample_shift != 0 || pl._ysubsample_shift != 0 )
+		return false;
+
+	const size_t pixelBytes = static_cast<size_t>( src.bits() / 8 );
+	const size_t copyBytes = static_cast<size_t>( buffer.width() ) * pixelBytes;
+	const int64_t xs = buffer.xstride_bytes();
+	for ( int64_t y = buffer.y1(); y <= buffer.y2(); ++y )
+	{
+		const char *s = static_cast<const char *>( src.row( y ) ) + static_cast<size_t>( buffer.x1() - src.x1() ) * pixelBytes;
+		char *d = static_cast<char *>( buffer.row( y ) );
+		if ( xs == static_cast<int64_t>( pixelBytes ) )
+			std::memcpy( d, s, copyBytes );
+		else
+		{
+			for ( const char *e = s + copyBytes; s != e; s += pixelBytes, d += xs )
+				std::memcpy( d, s, pixelBytes );
+		}
+	}
+	return true;
+}
+
+////////////////////////////////////////
+
+image &preloaded_image::source_or_throw( void ) const
+{
+	if ( ! _src )
+		throw_runtime( "Unsupported retrieval of image held in memory (format mismatch or area out of bounds)" );
+	return *_src;
+}
+
+////////////////////////////////////////
+
+} // media
@@ -0,0 +1,74 @@
+//
+// Copyright (c) 2017 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#pragma once
+
+#include "image.h"
+#include "image_buffer.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+////////////////////////////////////////
+
+namespace media
+{
+
+///
+/// @brief Class preloaded_image holds all the planes of the active
+/// area of another image, decoded up front.
+///
+/// Retrieving a plane (or a part of it) in the stored format is a
+/// copy, anything else (other resolution levels, conversions,
+/// interleaved reads) is passed to the source image. It can also be
+/// created from planes already in memory (i.e. the result of
+/// processing, to be written), in which case there is no source, and
+/// resolution levels computed from them can be stored along with them
+/// (for writing multi-resolution files).
+///
+class preloaded_image : public image
+{
+public:
+	preloaded_image( const std::shared_ptr<image> &src );
+	/// the planes should all cover area
+	preloaded_image( const area_rect &area, std::vector<std::string> names, std::vector<image_buffer> planes );
+	~preloaded_image( void ) override;
+
+	const std::shared_ptr<image> &source( void ) const { return _src; }
+	size_t bytes( void ) const { return _bytes; }
+
+	/// sets the level mode and count of the levels added with add_level
+	using image::set_levels;
+	/// stores resolution level (lx, ly), a buffer per plane, all
+	/// covering the same area
+	void add_level( int lx, int ly, std::vector<image_buffer> planes );
+
+	/// size in bytes of the decoded planes of img
+	static size_t decoded_size( const image &img );
+
+protected:
+	bool storage_interleaved( void ) const override;
+	void fill_plane( size_t plane, image_buffer &buffer ) override;
+	void fill_image( image_buffer &buffer ) override;
+	void fill_plane_level( size_t plane, image_buffer &buffer, int lx, int ly ) override;
+	area_rect compute_level_area( int lx, int ly ) const override;
+	std::pair<int64_t, int64_t> compute_preferred_chunk( void ) const override;
+	image_buffer compute_direct_plane( size_t plane ) const override;
+
+private:
+	image &source_or_throw( void ) const;
+	bool copy_stored( const image_buffer &src, size_t plane, image_buffer &buffer ) const;
+
+	std::shared_ptr<image> _src;
+	std::vector<image_buffer> _planes;
+	std::map<std::pair<int, int>, std::vector<image_buffer>> _levels;
+	size_t _bytes = 0;
+};
+
+////////////////////////////////////////
+
+} // namespace media
@@ -12,6 +12,7 @@
 #include <base/file_system.h>
 
 #include "exr_reader.h"
+#include "dpx_reader.h"
 #include "png_reader.h"
 #include "tiff_reader.h"
 #include <mutex>
@@ -25,8 +26,9 @@ std::mutex theReaderMutex;
 void initReaders( void )
 {
 	media::register_exr_reader();
-//	media::register_png_reader();
-//	media::register_tiff_reader();
+	media::register_dpx_reader();
+	media::register_png_reader();
+	media::register_tiff_reader();
 }
 
 static std::vector<std::shared_ptr<media::reader>> theReaders;
@@ -9,14 +9,23 @@
 
 #if defined(HAVE_LIBTIFF)
 # include "file_per_sample_reader.h"
-# include "image_frame.h"
+# include "image.h"
+# include "image_buffer.h"
 # include "video_track.h"
 # include "file_sequence.h"
 # include <base/contract.h>
-# include <base/scope_guard.h>
-# include <base/string_util.h>
 # include <base/file_system.h>
-# include <base/env.h>
+# include <base/thread_pool.h>
+# include <base/thread_util.h>
+# include <algorithm>
+# include <atomic>
+# include <condition_variable>
+# include <cstring>
+# include <exception>
+# include <mutex>
+# ifdef __SSE2__
+#  include <emmintrin.h>
+# endif
 
 # include <tiffio.h>
 # include <tiffio.hxx>
@@ -33,263 +42,527 @@ namespace media
 namespace
 {
 
-static void tiff_warning_handler( const char *p, const char *fmt, va_list args )
+static void tiff_warning_handler( const char *, const char *, va_list )
 {
 }
 
-static void tiff_error_handler( const char *p, const char *fmt, va_list args )
+static void tiff_error_handler( const char *, const char *, va_list )
 {
 }
 
-static void tiff_warning_handler_ext( thandle_t sp, const char *p, const char *fmt, va_list args )
+static void tiff_warning_handler_ext( thandle_t, const char *, const char *, va_list )
 {
 }
 
-static void tiff_error_handler_ext( thandle_t sp, const char *p, const char *fmt, va_list args )
+static void tiff_error_handler_ext( thandle_t, const char *, const char *, va_list )
 {
 }
 
-
 ////////////////////////////////////////
 
-class tiff_read_track : public video_track
-{
-public:
-	tiff_read_track( int64_t b, int64_t e, file_sequence &&fseq )
-			: video_track( "<image>", std::string(), b, e, sample_rate( 24, 1 ),
-						   media::track_description( media::TRACK_VIDEO ) ),
-			  _files( std::move( fseq ) )
-	{}
-
-	virtual image_frame *doRead( int64_t f );
+#ifdef __SSE2__
+template <int E> inline __m128i add_values( __m128i a, __m128i b );
+template <> inline __m128i add_values<1>( __m128i a, __m128i b ) { return _mm_add_epi8( a, b ); }
+template <> inline __m128i add_values<2>( __m128i a, __m128i b ) { return _mm_add_epi16( a, b ); }
 
-	virtual void doWrite( int64_t , const image_frame & )
+// steps of K = P, 2P, 4P... bytes while below N: sum is the running
+// sum of the pixels in a register, spread copies the first pixel
+// across it
+template <int E, int K, int N, bool More = ( K < N )>
+struct pixel_steps
+{
+	static inline __m128i sum( __m128i v )
 	{
-		throw_logic( "reader asked to write a frame" );
+		return pixel_steps<E, K * 2, N>::sum( add_values<E>( v, _mm_slli_si128( v, K ) ) );
 	}
-
-	virtual void doWrite( int64_t , const std::vector<std::shared_ptr<image_frame>> & )
+	static inline __m128i spread( __m128i v )
 	{
-		throw_logic( "reader asked to write a frame" );
+		return pixel_steps<E, K * 2, N>::spread( _mm_or_si128( v, _mm_slli_si128( v, K ) ) );
 	}
-
-private:
-	file_sequence _files;
 };
 
-////////////////////////////////////////
+template <int E, int K, int N>
+struct pixel_steps<E, K, N, false>
+{
+	static inline __m128i sum( __m128i v ) { return v; }
+	static inline __m128i spread( __m128i v ) { return v; }
+};
 
-image_frame *
-tiff_read_track::doRead( int64_t f )
+// undoes the differencing of pixels P bytes wide holding E byte
+// values, a register of whole pixels at a time, returns the number
+// of bytes done
+template <int E, int P>
+size_t undo_predictor_sse( uint8_t *row, size_t nbytes )
 {
-	std::unique_ptr<image_frame> ret;
-
-	base::uri u = _files.get_frame( f );
-	std::string p = u.full_path();
-	auto fs = base::file_system::get( u );
-	base::istream stream = fs->open_read( u );
-
-	auto terr = TIFFSetErrorHandler( tiff_error_handler );
-	auto twarn = TIFFSetWarningHandler( tiff_warning_handler );
-	auto terre = TIFFSetErrorHandlerExt( tiff_error_handler_ext );
-	auto twarne = TIFFSetWarningHandlerExt( tiff_warning_handler_ext );
-	on_scope_exit
+	// 3 and 6 byte pixels do 4 or 2 pixels per step
+	constexpr int N = ( P == 3 || P == 6 ) ? 12 : 16;
+	const __m128i lowMask = _mm_srli_si128( _mm_set1_epi32( -1 ), 16 - P );
+	__m128i carry = _mm_setzero_si128();
+	size_t i = 0;
+	for ( ; i + 16 <= nbytes; i += N )
 	{
-		TIFFSetErrorHandler( terr );
-		TIFFSetWarningHandler( twarn );
-		TIFFSetErrorHandlerExt( terre );
-		TIFFSetWarningHandlerExt( twarne );
-	};
-
-	// We're just reading the header, so don't open for mapping
-	TIFF *t = TIFFStreamOpen( p.c_str(), &stream );
-	if ( t )
-	{
-		on_scope_exit{ TIFFClose( t ); };
-		uint16_t bps, sf;
-		float offX, offY;
-		uint32_t sizeY, sizeX;
+		__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( row + i ) );
+		v = add_values<E>( pixel_steps<E, P, N>::sum( v ), carry );
+		if ( N == 16 )
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( row + i ), v );
+		else
+		{
+			_mm_storel_epi64( reinterpret_cast<__m128i *>( row + i ), v );
+			int32_t last = _mm_cvtsi128_si32( _mm_srli_si128( v, 8 ) );
+			std::memcpy( row + i + 8, &last, 4 );
+		}
+		carry = pixel_steps<E, P, N>::spread( _mm_and_si128( _mm_srli_si128( v, N - P ), lowMask ) );
+	}
+	return i;
+}
+#endif
 
-		TIFFGetFieldDefaulted( t, TIFFTAG_BITSPERSAMPLE, &bps );
-		if ( ! TIFFGetField( t, TIFFTAG_SAMPLEFORMAT, &sf ) )
-			sf = SAMPLEFORMAT_VOID;
+template <typename T>
+void undo_predictor_scalar( uint8_t *row, size_t nbytes, size_t done, int spp )
+{
+	T *v = reinterpret_cast<T *>( row );
+	const size_t n = nbytes / sizeof(T);
+	for ( size_t i = std::max( done / sizeof(T), size_t( spp ) ); i < n; ++i )
+		v[i] = static_cast<T>( v[i] + v[i - static_cast<size_t>( spp )] );
+}
 
-		if ( ! TIFFGetField( t, TIFFTAG_XPOSITION, &offX ) )
-			offX = 0.F;
-		if ( ! TIFFGetField( t, TIFFTAG_YPOSITION, &offY ) )
-			offY = 0.F;
-		// Need to multiply offX by resolution.
+/// undoes the horizontal differencing of TIFF predictor 2 on a
+/// decoded row of 8 or 16 bit values
+void undo_predictor( uint8_t *row, size_t nbytes, int spp, int bytes )
+{
+	size_t done = 0;
+#ifdef __SSE2__
+	switch ( spp * bytes + ( bytes == 2 ? 100 : 0 ) )
+	{
+		case 1: done = undo_predictor_sse<1, 1>( row, nbytes ); break;
+		case 2: done = undo_predictor_sse<1, 2>( row, nbytes ); break;
+		case 3: done = undo_predictor_sse<1, 3>( row, nbytes ); break;
+		case 4: done = undo_predictor_sse<1, 4>( row, nbytes ); break;
+		case 8: done = undo_predictor_sse<1, 8>( row, nbytes ); break;
+		case 102: done = undo_predictor_sse<2, 2>( row, nbytes ); break;
+		case 104: done = undo_predictor_sse<2, 4>( row, nbytes ); break;
+		case 106: done = undo_predictor_sse<2, 6>( row, nbytes ); break;
+		case 108: done = undo_predictor_sse<2, 8>( row, nbytes ); break;
+		default: break;
+	}
+#endif
+	if ( bytes == 2 )
+		undo_predictor_scalar<uint16_t>( row, nbytes, done, spp );
+	else
+		undo_predictor_scalar<uint8_t>( row, nbytes, done, spp );
+}
 
-		TIFFGetFieldDefaulted( t, TIFFTAG_IMAGEWIDTH, &sizeX );
-		TIFFGetFieldDefaulted( t, TIFFTAG_IMAGELENGTH, &sizeY );
+template <typename T>
+void deinterleave( const uint8_t *src, int chans, std::vector<image_buffer> &planes, int64_t y, int64_t x1, int64_t n )
+{
+	const T *s = reinterpret_cast<const T *>( src );
+	for ( int c = 0; c < chans; ++c )
+	{
+		T *d = static_cast<T *>( planes[static_cast<size_t>( c )].row( y ) ) + x1;
+		for ( int64_t x = 0; x < n; ++x )
+			d[x] = s[x * chans + c];
+	}
+}
 
-		uint16_t photo = 0;
-		TIFFGetFieldDefaulted( t, TIFFTAG_PHOTOMETRIC, &photo );
+////////////////////////////////////////
 
-		uint16_t samps = 0;
-		if ( PHOTOMETRIC_PALETTE == photo )
+/// A libtiff handle on a file
+class tiff_handle
+{
+public:
+	tiff_handle( const std::shared_ptr<base::file_system> &fs, const base::uri &u )
+	{
+		if ( u.scheme() == "file" )
 		{
-			// color, 3 planes
-			samps = 3;
+			// libtiff maps the file
+			_tif = TIFFOpen( u.full_path().c_str(), "r" );
 		}
 		else
 		{
-			TIFFGetFieldDefaulted( t, TIFFTAG_SAMPLESPERPIXEL, &samps );
+			_stream.reset( new base::istream( fs->open_read( u ) ) );
+			_tif = TIFFStreamOpen( u.full_path().c_str(), _stream.get() );
 		}
+		if ( ! _tif )
+			throw_runtime( "Unable to open TIFF file {0}", u );
+	}
+	~tiff_handle( void )
+	{
+		if ( _tif )
+			TIFFClose( _tif );
+	}
+	tiff_handle( const tiff_handle & ) = delete;
+	tiff_handle &operator=( const tiff_handle & ) = delete;
 
-		if ( sf == SAMPLEFORMAT_COMPLEXINT || sf == SAMPLEFORMAT_COMPLEXIEEEFP )
-			throw_not_yet();
+	TIFF *get( void ) const { return _tif; }
 
-		uint16_t orient = 0;
-		TIFFGetFieldDefaulted( t, TIFFTAG_ORIENTATION, &orient );
-		switch ( orient )
+private:
+	std::unique_ptr<base::istream> _stream;
+	TIFF *_tif = nullptr;
+};
+
+////////////////////////////////////////
+
+/// How the pixels of a TIFF file are split in strips or tiles
+struct tiff_layout
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint16_t bps = 8;
+	uint16_t format = SAMPLEFORMAT_UINT;
+	uint16_t spp = 1;
+	uint16_t planar = PLANARCONFIG_CONTIG;
+	uint16_t predictor = PREDICTOR_NONE;
+	bool tiled = false;
+	/// tile size, or the width and rows per strip
+	uint32_t unit_w = 0;
+	uint32_t unit_h = 0;
+	/// strips or tiles across and down a plane
+	size_t across = 0;
+	size_t down = 0;
+	/// all the strips or tiles, of all the samples when planar
+	size_t units = 0;
+	size_t unit_bytes = 0;
+};
+
+/// Decodes strips or tiles with its own handle on the file (libtiff
+/// handles can not be shared between threads)
+class tiff_worker
+{
+public:
+	tiff_worker( const std::shared_ptr<base::file_system> &fs, const base::uri &u, const tiff_layout &l )
+		: _handle( fs, u ), _uri( u ), _layout( l ), _buffer( l.unit_bytes )
+	{
+		// the differencing is undone here (vectorized) instead of by
+		// libtiff, which has to be told before the first strip / tile
+		if ( l.predictor == PREDICTOR_HORIZONTAL && ( l.bps == 8 || l.bps == 16 ) )
+			_undo_predictor = TIFFSetField( _handle.get(), TIFFTAG_PREDICTOR, int( PREDICTOR_NONE ) ) == 1;
+	}
+
+	void decode( size_t unit, std::vector<image_buffer> &planes )
+	{
+		const tiff_layout &l = _layout;
+		const bool separate = l.planar == PLANARCONFIG_SEPARATE;
+		const size_t perPlane = l.across * l.down;
+		const size_t s = separate ? unit / perPlane : 0;
+		const size_t within = unit % perPlane;
+		const int64_t x1 = static_cast<int64_t>( ( within % l.across ) * l.unit_w );
+		const int64_t y1 = static_cast<int64_t>( ( within / l.across ) * l.unit_h );
+		const int64_t cw = std::min( static_cast<int64_t>( l.unit_w ), static_cast<int64_t>( l.width ) - x1 );
+		const int64_t rows = std::min( static_cast<int64_t>( l.unit_h ), static_cast<int64_t>( l.height ) - y1 );
+		const int chans = separate ? 1 : static_cast<int>( l.spp );
+		const size_t vbytes = l.bps / 8;
+		const size_t rowBytes = static_cast<size_t>( l.unit_w ) * static_cast<size_t>( chans ) * vbytes;
+
+		// strips of a separate plane are stored just like the plane,
+		// so are decoded in place
+		uint8_t *buf = _buffer.data();
+		bool inPlace = false;
+		if ( separate && ! l.tiled )
 		{
-			default:
-				
-				break;
+			image_buffer &p = planes[s];
+			precondition( p.ystride_bytes() == static_cast<int64_t>( rowBytes ), "TIFF plane rows expected to be the scanline size" );
+			buf = static_cast<uint8_t *>( p.row( y1 ) );
+			inPlace = true;
 		}
 
-		uint16_t isP = 0;
-		TIFFGetFieldDefaulted( t, TIFFTAG_PLANARCONFIG, &isP );
+		tmsize_t n;
+		if ( l.tiled )
+			n = TIFFReadEncodedTile( _handle.get(), static_cast<uint32_t>( unit ), buf, static_cast<tmsize_t>( l.unit_bytes ) );
+		else
+			n = TIFFReadEncodedStrip( _handle.get(), static_cast<uint32_t>( unit ), buf, static_cast<tmsize_t>( rowBytes * static_cast<size_t>( rows ) ) );
+		if ( n < 0 )
+			throw_runtime( "Unable to decode {0} {1} of TIFF file {2}", l.tiled ? "tile" : "strip", unit, _uri );
 
-		const char *channames[] = { "R", "G", "B", "A" };
-		int64_t w = static_cast<int64_t>( sizeX );
-		int64_t h = static_cast<int64_t>( sizeY );
-		int64_t x1 = 0, y1 = 0, x2 = w - 1, y2 = h - 1;
-		ret.reset( new image_frame( x1, y1, x2, y2 ) );
-		for ( uint16_t s = 0; s < samps; ++s )
+		for ( int64_t r = 0; r < rows; ++r )
 		{
-			image_buffer imgbuf;
-			switch ( bps )
+			uint8_t *src = buf + static_cast<size_t>( r ) * rowBytes;
+			if ( _undo_predictor )
+				undo_predictor( src, rowBytes, chans, static_cast<int>( vbytes ) );
+			if ( inPlace )
+				continue;
+
+			if ( separate )
 			{
-				case 1:
-					// don't handle 1-bit yet
-					throw_not_yet();
-					break;
-				case 8:
-					if ( sf == SAMPLEFORMAT_INT )
-						imgbuf = image_buffer::simple_buffer<int8_t>( x1, y1, x2, y2 );
-					else
-						imgbuf = image_buffer::simple_buffer<uint8_t>( x1, y1, x2, y2 );
-					break;
-				case 16:
-					if ( sf == SAMPLEFORMAT_INT )
-						imgbuf = image_buffer::simple_buffer<int16_t>( x1, y1, x2, y2 );
-					else
-						imgbuf = image_buffer::simple_buffer<uint16_t>( x1, y1, x2, y2 );
-					break;
-				case 32:
-					if ( sf == SAMPLEFORMAT_UINT )
-						imgbuf = image_buffer::simple_buffer<uint32_t>( x1, y1, x2, y2 );
-					else if ( sf == SAMPLEFORMAT_INT )
-						imgbuf = image_buffer::simple_buffer<int32_t>( x1, y1, x2, y2 );
-					else // void or ieeefp
-						imgbuf = image_buffer::simple_buffer<float>( x1, y1, x2, y2 );
-					break;
-				case 64:
-					if ( sf == SAMPLEFORMAT_UINT )
-						imgbuf = image_buffer::simple_buffer<uint64_t>( x1, y1, x2, y2 );
-					else if ( sf == SAMPLEFORMAT_INT )
-						imgbuf = image_buffer::simple_buffer<int64_t>( x1, y1, x2, y2 );
-					else // void or ieeefp
-						imgbuf = image_buffer::simple_buffer<double>( x1, y1, x2, y2 );
-					break;
-				default:
-					
-					break;
+				uint8_t *d = static_cast<uint8_t *>( planes[s].row( y1 + r ) ) + static_cast<size_t>( x1 ) * vbytes;
+				std::memcpy( d, src, static_cast<size_t>( cw ) * vbytes );
+				continue;
 			}
 
-			if ( s < 4 )
-				ret->add_channel( channames[s], imgbuf );
-			else
-				ret->add_channel( imgbuf );
+			switch ( vbytes )
+			{
+				case 1: deinterleave<uint8_t>( src, chans, planes, y1 + r, x1, cw ); break;
+				case 2: deinterleave<uint16_t>( src, chans, planes, y1 + r, x1, cw ); break;
+				case 4: deinterleave<uint32_t>( src, chans, planes, y1 + r, x1, cw ); break;
+				case 8: deinterleave<uint64_t>( src, chans, planes, y1 + r, x1, cw ); break;
+				default: throw_not_yet();
+			}
 		}
+	}
 
-		if ( TIFFIsTiled( t ) )
-		{
-			uint32_t tileWidth = sizeX, tileLength = sizeY;
-			
-			TIFFGetField( t, TIFFTAG_TILEWIDTH, &tileWidth );
-			TIFFGetField( t, TIFFTAG_TILELENGTH, &tileLength );
+private:
+	tiff_handle _handle;
+	base::uri _uri;
+	const tiff_layout &_layout;
+	std::vector<uint8_t> _buffer;
+	bool _undo_predictor = false;
+};
+
+////////////////////////////////////////
+
+/// The samples of a TIFF file, a plane each, decoded the first time a
+/// plane is needed. Strips or tiles are decoded in parallel, by the
+/// calling thread and the workers of the track's pool (each with its
+/// own handle on the file).
+class tiff_image : public image
+{
+public:
+	tiff_image( const std::shared_ptr<base::file_system> &fs, const base::uri &u, TIFF *t, const std::shared_ptr<base::thread_pool> &pool, size_t poolSize )
+		: _fs( fs ), _uri( u ), _pool( pool ), _pool_size( pool ? poolSize : 0 )
+	{
+		tiff_layout &l = _layout;
+		uint16_t photo = PHOTOMETRIC_MINISBLACK;
+		TIFFGetFieldDefaulted( t, TIFFTAG_IMAGEWIDTH, &l.width );
+		TIFFGetFieldDefaulted( t, TIFFTAG_IMAGELENGTH, &l.height );
+		TIFFGetFieldDefaulted( t, TIFFTAG_BITSPERSAMPLE, &l.bps );
+		if ( ! TIFFGetField( t, TIFFTAG_SAMPLEFORMAT, &l.format ) )
+			l.format = SAMPLEFORMAT_VOID;
+		TIFFGetFieldDefaulted( t, TIFFTAG_SAMPLESPERPIXEL, &l.spp );
+		TIFFGetFieldDefaulted( t, TIFFTAG_PLANARCONFIG, &l.planar );
+		TIFFGetFieldDefaulted( t, TIFFTAG_PHOTOMETRIC, &photo );
+		if ( ! TIFFGetField( t, TIFFTAG_PREDICTOR, &l.predictor ) )
+			l.predictor = PREDICTOR_NONE;
 
+		if ( l.format == SAMPLEFORMAT_COMPLEXINT || l.format == SAMPLEFORMAT_COMPLEXIEEEFP )
 			throw_not_yet();
-			if ( PLANARCONFIG_SEPARATE == isP )
-			{
-			}
-			else
-			{
-			}
+		// palette, CMYK, YCbCr (possibly subsampled), other color
+		// models and 1 bit images are not handled yet
+		if ( photo != PHOTOMETRIC_MINISBLACK && photo != PHOTOMETRIC_MINISWHITE && photo != PHOTOMETRIC_RGB )
+			throw_not_yet();
+		if ( l.bps != 8 && l.bps != 16 && l.bps != 32 && l.bps != 64 )
+			throw_not_yet();
+		// white is zero is inverted after decoding, which only makes
+		// sense for integer samples
+		_invert = photo == PHOTOMETRIC_MINISWHITE;
+		if ( _invert && ( l.format == SAMPLEFORMAT_IEEEFP || ( l.format == SAMPLEFORMAT_VOID && l.bps >= 32 ) ) )
+			throw_not_yet();
+
+		l.tiled = TIFFIsTiled( t ) != 0;
+		if ( l.tiled )
+		{
+			TIFFGetField( t, TIFFTAG_TILEWIDTH, &l.unit_w );
+			TIFFGetField( t, TIFFTAG_TILELENGTH, &l.unit_h );
+			l.units = static_cast<size_t>( TIFFNumberOfTiles( t ) );
+			l.unit_bytes = static_cast<size_t>( TIFFTileSize( t ) );
 		}
 		else
 		{
-			tmsize_t ssize = TIFFScanlineSize( t );
-			if ( PLANARCONFIG_SEPARATE == isP )
+			l.unit_w = l.width;
+			TIFFGetFieldDefaulted( t, TIFFTAG_ROWSPERSTRIP, &l.unit_h );
+			l.unit_h = std::min( l.unit_h, l.height );
+			l.units = static_cast<size_t>( TIFFNumberOfStrips( t ) );
+			l.unit_bytes = static_cast<size_t>( TIFFStripSize( t ) );
+		}
+		if ( l.width == 0 || l.height == 0 || l.unit_w == 0 || l.unit_h == 0 )
+			throw_runtime( "Invalid TIFF image layout in {0}", u );
+		l.across = ( l.width + l.unit_w - 1 ) / l.unit_w;
+		l.down = ( l.height + l.unit_h - 1 ) / l.unit_h;
+		const size_t planes = l.planar == PLANARCONFIG_SEPARATE ? l.spp : 1;
+		if ( l.units != l.across * l.down * planes )
+			throw_runtime( "Unexpected number of TIFF strips / tiles ({0}) in {1}", l.units, u );
+
+		set_area( area_rect::from_points( 0, 0, int64_t( l.width ) - 1, int64_t( l.height ) - 1 ) );
+
+		const bool grey = photo == PHOTOMETRIC_MINISBLACK || photo == PHOTOMETRIC_MINISWHITE;
+		const char *rgbNames[] = { "R", "G", "B", "A" };
+		const char *greyNames[] = { "Y", "A" };
+		plane_layout pl;
+		pl._bits = static_cast<int8_t>( l.bps );
+		// untyped 32 and 64 bit samples are taken as float
+		pl._floating = l.format == SAMPLEFORMAT_IEEEFP || ( l.format == SAMPLEFORMAT_VOID && l.bps >= 32 );
+		pl._unsigned = ! pl._floating && l.format != SAMPLEFORMAT_INT;
+		for ( uint16_t s = 0; s < l.spp; ++s )
+		{
+			std::string name;
+			if ( grey && s < 2 )
+				name = greyNames[s];
+			else if ( ! grey && s < 4 )
+				name = rgbNames[s];
+			else
+				name = "S" + std::to_string( s );
+			register_plane( name, pl, 0.0 );
+		}
+
+		uint16_t orient = ORIENTATION_TOPLEFT;
+		TIFFGetFieldDefaulted( t, TIFFTAG_ORIENTATION, &orient );
+		// read as stored
+		if ( orient != ORIENTATION_TOPLEFT )
+			set_meta( "orientation", meta_uint16_t::make( orient ) );
+	}
+
+protected:
+	bool storage_interleaved( void ) const override
+	{
+		return false;
+	}
+
+	void fill_plane( size_t plane, image_buffer &buffer ) override
+	{
+		copy_buffer( stored( plane ), buffer );
+	}
+
+	void fill_image( image_buffer &buffer ) override
+	{
+		for ( size_t p = 0; p != size(); ++p )
+			copy_to_interleaved( stored( p ), buffer, p );
+	}
+
+	image_buffer compute_direct_plane( size_t plane ) const override
+	{
+		return stored( plane );
+	}
+
+private:
+	const image_buffer &stored( size_t plane ) const
+	{
+		std::lock_guard<std::mutex> lk( _mutex );
+		if ( _planes.empty() )
+			decode();
+		return _planes.at( plane );
+	}
+
+	void decode( void ) const
+	{
+		const tiff_layout &l = _layout;
+		const plane_layout &pl = layout( 0 );
+		std::vector<image_buffer> planes;
+		for ( uint16_t s = 0; s < l.spp; ++s )
+			planes.push_back( image_buffer::full_plane( 0, 0, int64_t( l.width ) - 1, int64_t( l.height ) - 1,
+														pl._bits, 0, 0, pl._floating, pl._unsigned ) );
+
+		std::atomic<size_t> next( 0 );
+		std::mutex doneLock;
+		std::condition_variable doneCond;
+		size_t running = 0;
+		std::exception_ptr err;
+		auto work = [&]( void )
+		{
+			try
 			{
-				// need to read it in order of samples to prevent random access
-				for ( uint16_t s = 0; s < samps; ++s )
+				// a worker that starts after the others took all the
+				// units does not need to open the file
+				if ( next < l.units )
 				{
-					uint8_t *dptr = reinterpret_cast<uint8_t *>( ret->at( s ).data() );
-					precondition( ret->at( s ).ystride_bytes() == ssize, "invalid line stride assumption about scanline size" );
-					for ( uint32_t row = 0; row < sizeY; ++row )
-					{
-						TIFFReadScanline( t, dptr, row, s );
-						dptr += ssize;
-					}
+					tiff_worker w( _fs, _uri, l );
+					for ( size_t u = next++; u < l.units; u = next++ )
+						w.decode( u, planes );
 				}
 			}
-			else
+			catch ( ... )
 			{
-				std::unique_ptr<uint8_t[]> tmpbuf = std::unique_ptr<uint8_t[]>( new uint8_t[TIFFScanlineSize( t )] );
-				for ( uint32_t row = 0; row < sizeY; ++row )
-				{
-					TIFFReadScanline( t, tmpbuf.get(), row );
-					for ( uint16_t s = 0; s < samps; ++s )
-					{
-						image_buffer &ib = ret->at( s );
-						uint8_t *dptr = reinterpret_cast<uint8_t *>( ib.data() );
-						dptr += ib.ystride_bytes() * row;
-						const uint8_t *sptr = tmpbuf.get();
-						switch ( ib.bits() )
-						{
-							case 8:
-								for ( uint32_t x = 0; x < sizeX; ++x )
-									dptr[x] = sptr[x*samps + s];
-								break;
-							case 16:
-							{
-								uint16_t *dst16 = reinterpret_cast<uint16_t *>( dptr );
-								const uint16_t *src16 = reinterpret_cast<const uint16_t *>( sptr );
-								for ( uint32_t x = 0; x < sizeX; ++x )
-									dst16[x] = src16[x*samps + s];
-								break;
-							}
-							case 32:
-							{
-								uint32_t *dst32 = reinterpret_cast<uint32_t *>( dptr );
-								const uint32_t *src32 = reinterpret_cast<const uint32_t *>( sptr );
-								for ( uint32_t x = 0; x < sizeX; ++x )
-									dst32[x] = src32[x*samps + s];
-								break;
-							}
-							case 64:
-							{
-								uint64_t *dst64 = reinterpret_cast<uint64_t *>( dptr );
-								const uint64_t *src64 = reinterpret_cast<const uint64_t *>( sptr );
-								for ( uint32_t x = 0; x < sizeX; ++x )
-									dst64[x] = src64[x*samps + s];
-								break;
-							}
-							default:
-								throw_not_yet();
-						}
-					}
-				}
+				std::lock_guard<std::mutex> lk( doneLock );
+				if ( ! err )
+					err = std::current_exception();
+				next = l.units;
 			}
+		};
+
+		// the calling thread decodes too, so only queue as many as
+		// there are units left for the pool
+		running = std::min( l.units, _pool_size + 1 ) - 1;
+		for ( size_t i = 0, n = running; i < n; ++i )
+		{
+			_pool->queue( [&]( void )
+			{
+				work();
+				std::lock_guard<std::mutex> lk( doneLock );
+				if ( --running == 0 )
+					doneCond.notify_all();
+			} );
+		}
+		work();
+		{
+			// the queued work refers to the locals here
+			std::unique_lock<std::mutex> lk( doneLock );
+			doneCond.wait( lk, [&]( void ) { return running == 0; } );
 		}
+		if ( err )
+			std::rethrow_exception( err );
 
+		if ( _invert )
+			invert( planes[0] );
+		_planes = std::move( planes );
+	}
+
+	// flips the bits of the samples of a white is zero plane, which
+	// is max - v for unsigned and -1 - v for signed samples
+	void invert( image_buffer &p ) const
+	{
+		const size_t rowBytes = static_cast<size_t>( _layout.width ) * ( _layout.bps / 8 );
+		for ( int64_t y = 0; y < static_cast<int64_t>( _layout.height ); ++y )
+		{
+			uint8_t *r = static_cast<uint8_t *>( p.row( y ) );
+			for ( size_t i = 0; i < rowBytes; ++i )
+				r[i] = static_cast<uint8_t>( ~r[i] );
+		}
+	}
+
+	std::shared_ptr<base::file_system> _fs;
+	base::uri _uri;
+	tiff_layout _layout;
+	std::shared_ptr<base::thread_pool> _pool;
+	size_t _pool_size = 0;
+	bool _invert = false;
+	mutable std::mutex _mutex;
+	mutable std::vector<image_buffer> _planes;
+};
+
+////////////////////////////////////////
+
+class tiff_frame : public frame
+{
+public:
+	tiff_frame( const std::shared_ptr<base::file_system> &fs, const base::uri &u, int64_t num, const std::shared_ptr<base::thread_pool> &pool, size_t poolSize )
+		: frame( num )
+	{
+		// only the tags, the workers open their own handles
+		tiff_handle h( fs, u );
+		layer &l = register_layer( std::string() );
+		l.add_view( std::string() ).store( std::make_shared<tiff_image>( fs, u, h.get(), pool, poolSize ) );
+	}
+};
+
+////////////////////////////////////////
+
+class tiff_read_track : public video_track
+{
+public:
+	tiff_read_track( int64_t b, int64_t e, file_sequence &&fseq )
+			: video_track( "<image>", std::string(), b, e, sample_rate( 24, 1 ),
+						   media::track_description( media::TRACK_VIDEO ) ),
+			  _files( std::move( fseq ) )
+	{
+		// shared by the decodes of all the frames, so concurrent
+		// reads (i.e. when prefetching) don't add threads per frame
+		_pool_size = static_cast<size_t>( std::max( base::thread::core_count(), 1L ) ) - 1;
+		if ( _pool_size > 0 )
+			_pool = std::make_shared<base::thread_pool>( _pool_size );
+	}
+
+	frame *doRead( int64_t f ) override
+	{
+		return new tiff_frame( base::file_system::get( _files.uri() ), _files.get_frame( f ), f, _pool, _pool_size );
+	}
+
+	void doWrite( int64_t , const frame & ) override
+	{
+		throw_logic( "reader asked to write a frame" );
 	}
-	return ret.release();
-}
+
+private:
+	file_sequence _files;
+	std::shared_ptr<base::thread_pool> _pool;
+	size_t _pool_size = 0;
+};
 
 ////////////////////////////////////////
 
@@ -314,13 +587,13 @@ public:
 		std::vector<uint8_t> magicMDIBE{0x45, 0x50};
 		_magics.emplace_back( std::move( magicMDIBE ) );
 	}
-	virtual ~TIFFReader( void ) = default;
+	~TIFFReader( void ) override = default;
 
-	virtual container create( const base::uri &u, const metadata &params );
+	container create( const base::uri &u, const parameter_set &params ) override;
 };
 
 container
-TIFFReader::create( const base::uri &u, const metadata & )
+TIFFReader::create( const base::uri &u, const parameter_set &p )
 {
 	container result;
 
@@ -329,6 +602,7 @@ TIFFReader::create( const base::uri &u, const metadata & )
 	auto fs = scan_samples( start, last, fseq );
 
 	result.add_track( std::make_shared<tiff_read_track>( start, last, std::move( fseq ) ) );
+	result.set_parameters( p );
 
 	return result;
 }
@@ -341,9 +615,14 @@ TIFFReader::create( const base::uri &u, const metadata & )
 void register_tiff_reader( void )
 {
 #if defined(HAVE_LIBTIFF)
+	// the handlers are global, so are set once rather than around
+	// each (possibly concurrent) read
+	TIFFSetErrorHandler( tiff_error_handler );
+	TIFFSetWarningHandler( tiff_warning_handler );
+	TIFFSetErrorHandlerExt( tiff_error_handler_ext );
+	TIFFSetWarningHandlerExt( tiff_warning_handler_ext );
 	reader::register_reader( std::make_shared<TIFFReader>() );
 #endif
 }
 
 } // namespace media
-
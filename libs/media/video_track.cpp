@@ -50,6 +50,27 @@ video_track::write( int64_t offset, const sample_rate &, const sample_data &sd )
 ////////////////////////////////////////
 
 
+std::shared_future<void>
+video_track::doFinish( int64_t )
+{
+	std::promise<void> done;
+	done.set_value();
+	return done.get_future().share();
+}
+
+
+////////////////////////////////////////
+
+
+void
+video_track::doFlush( void )
+{
+}
+
+
+////////////////////////////////////////
+
+
 } // media
 
 
@@ -9,6 +9,7 @@
 
 #include "track.h"
 #include "frame.h"
+#include <future>
 
 namespace media
 {
@@ -49,6 +50,22 @@ public:
 			doWrite( f, *frm );
 	}
 
+	/// Writers may finish writing (compressing) a frame in the
+	/// background after store returns. The handle returned becomes
+	/// ready once frame f is completely written, and get() rethrows
+	/// any error writing it.
+	std::shared_future<void> finish_frame( int64_t f )
+	{
+		return doFinish( f );
+	}
+
+	/// waits for every frame stored to be written, rethrowing the
+	/// first error
+	void flush( void )
+	{
+		doFlush();
+	}
+
 	// to add
 	bool interframe_encoded( void ) const;
 //	video_info info( void ) const
@@ -68,6 +85,9 @@ protected:
 
 	virtual void write( int64_t offset, const sample_rate &r, const sample_data &sd );
 	virtual void doWrite( int64_t offset, const frame &sd ) = 0;
+	/// by default, writes are synchronous, so this is always ready
+	virtual std::shared_future<void> doFinish( int64_t f );
+	virtual void doFlush( void );
 
 private:
 };
@@ -11,6 +11,7 @@
 #include <base/string_util.h>
 
 #include "exr_writer.h"
+#include "dpx_writer.h"
 #include <mutex>
 #include <atomic>
 #include <map>
@@ -25,6 +26,7 @@ std::mutex theWriterMutex;
 void initWriters( void )
 {
 	media::register_exr_writer();
+	media::register_dpx_writer();
 }
 
 static std::vector<std::shared_ptr<media::writer>> theWriters;
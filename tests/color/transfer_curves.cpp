@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include <base/contract.h>
+#include <base/unit_test.h>
+#include <base/cmd_line.h>
+#include <color/transfer_kernel.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+////////////////////////////////////////
+
+
+namespace
+{
+
+// odd count so the scalar tail of the lines is also checked
+const size_t kSamples = 100003;
+
+// error relative to the value, for values above 1
+inline double error( double v, double ref )
+{
+	return std::abs( v - ref ) / std::max( std::abs( ref ), 1.0 );
+}
+
+template <color::transfer T>
+void check_kernel( base::unit_test &test, const std::string &name, float lo, float hi, double linBound, double encBound )
+{
+	std::vector<float> in( kSamples );
+	for ( size_t i = 0; i != kSamples; ++i )
+		in[i] = lo + ( hi - lo ) * static_cast<float>( i ) / static_cast<float>( kSamples - 1 );
+
+	std::vector<float> v = in;
+	color::linearize_line<T>( v.data(), v.size() );
+	double linErr = 0.0, switchErr = 0.0;
+	for ( size_t i = 0; i != kSamples; ++i )
+	{
+		double ref = color::transfer_kernel<T>::linearize_exact( in[i] );
+		linErr = std::max( linErr, error( v[i], ref ) );
+		switchErr = std::max( switchErr, error( color::linearize( static_cast<double>( in[i] ), T ), ref ) );
+	}
+
+	v = in;
+	color::encode_line<T>( v.data(), v.size() );
+	double encErr = 0.0;
+	for ( size_t i = 0; i != kSamples; ++i )
+	{
+		double ref = color::transfer_kernel<T>::encode_exact( in[i] );
+		encErr = std::max( encErr, error( v[i], ref ) );
+		switchErr = std::max( switchErr, error( color::encode( static_cast<double>( in[i] ), T ), ref ) );
+	}
+
+	if ( linErr <= linBound )
+		test.success( "{0} linearize error {1}", name, linErr );
+	else
+		test.failure( "{0} linearize error {1} exceeds {2}", name, linErr, linBound );
+	if ( encErr <= encBound )
+		test.success( "{0} encode error {1}", name, encErr );
+	else
+		test.failure( "{0} encode error {1} exceeds {2}", name, encErr, encBound );
+	if ( switchErr == 0.0 )
+		test.success( "{0} reference matches linearize / encode", name );
+	else
+		test.failure( "{0} reference differs from linearize / encode by {1}", name, switchErr );
+}
+
+int safemain( int argc, char *argv[] )
+{
+	base::unit_test test( "transfer_curves" );
+
+	base::cmd_line options( argv[0] );
+	test.setup( options );
+
+	try
+	{
+		options.parse( argc, argv );
+	}
+	catch ( ... )
+	{
+		throw_add( "parsing command line arguments" );
+	}
+
+	test["linear"] = [&]( void )
+	{
+		check_kernel<color::transfer::LINEAR>( test, "linear", -1.F, 2.F, 0.0, 0.0 );
+	};
+
+	test["srgb"] = [&]( void )
+	{
+		check_kernel<color::transfer::GAMMA_sRGB>( test, "srgb", -0.25F, 1.5F, 2e-6, 1e-6 );
+	};
+
+	test["bt709"] = [&]( void )
+	{
+		check_kernel<color::transfer::GAMMA_BT709>( test, "bt709", -0.25F, 1.5F, 2e-6, 1e-6 );
+		check_kernel<color::transfer::GAMMA_BT2020>( test, "bt2020", 0.F, 1.F, 2e-6, 1e-6 );
+	};
+
+	test["gamma_dci"] = [&]( void )
+	{
+		check_kernel<color::transfer::GAMMA_DCI>( test, "gamma_dci", -0.25F, 1.5F, 2e-6, 1e-6 );
+	};
+
+	test["pq"] = [&]( void )
+	{
+		// the denominator of the EOTF cancels near 1, so even the
+		// float version of the reference is only within 6e-5
+		check_kernel<color::transfer::PQ>( test, "pq", 0.F, 1.F, 1e-4, 5e-5 );
+	};
+
+	test["hlg"] = [&]( void )
+	{
+		check_kernel<color::transfer::HLG_OETF>( test, "hlg", -0.25F, 1.F, 2e-6, 1e-6 );
+	};
+
+	test["mid_gray_log"] = [&]( void )
+	{
+		check_kernel<color::transfer::MID_GRAY_LOG>( test, "mid_gray_log", 0.F, 1.F, 2e-6, 1e-6 );
+	};
+
+	test.run( options );
+	test.clean();
+
+	return - static_cast<int>( test.failure_count() );
+}
+
+}
+
+int main( int argc, char *argv[] )
+{
+	try
+	{
+		return safemain( argc, argv );
+	}
+	catch ( const std::exception &e )
+	{
+		base::print_exception( std::cerr, e );
+	}
+	return -1;
+}
@@ -0,0 +1,383 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include <base/contract.h>
+#include <base/unit_test.h>
+#include <base/cmd_line.h>
+#include <media/dpx.h>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+////////////////////////////////////////
+
+
+namespace
+{
+
+using namespace media;
+
+// 8 and 9 cover the SSE bodies exactly and with a tail, 7 is only a
+// tail, 17 runs the bodies more than once
+const size_t kWidths[] = { 7, 8, 9, 17 };
+const int kChans[] = { 1, 3, 4 };
+const base::endianness kEndians[] = { base::endianness::BIG, base::endianness::LITTLE };
+
+inline const char *endian_name( base::endianness e )
+{
+	return e == base::endianness::BIG ? "big" : "little";
+}
+
+inline uint8_t chan_desc( int chans )
+{
+	return chans == 1 ? dpx::DESC_LUMA : ( chans == 3 ? dpx::DESC_RGB : dpx::DESC_RGBA );
+}
+
+////////////////////////////////////////
+
+// scalar reference of the quantization, clamped with NaN as 0
+uint32_t ref_quantize( float v, float maxv )
+{
+	if ( std::isnan( v ) || v <= 0.F )
+		return 0;
+	if ( v >= 1.F )
+		return static_cast<uint32_t>( maxv );
+	return static_cast<uint32_t>( std::lrint( v * maxv ) );
+}
+
+// scalar reference of the 16-bit value unpack_line produces
+uint16_t ref_widen( uint32_t v, int bits )
+{
+	return static_cast<uint16_t>( ( v << ( 16 - bits ) ) | ( v >> ( 2 * bits - 16 ) ) );
+}
+
+// appends a value of 'bytes' bytes in the order of the file
+void put( std::vector<char> &out, uint32_t v, size_t bytes, base::endianness e )
+{
+	for ( size_t i = 0; i != bytes; ++i )
+	{
+		size_t sh = e == base::endianness::BIG ? ( bytes - 1 - i ) * 8 : i * 8;
+		out.push_back( static_cast<char>( ( v >> sh ) & 0xFF ) );
+	}
+}
+
+// scalar reference of a packed line, a datum at a time
+std::vector<char> ref_pack( const dpx::element &el, base::endianness e, const std::vector<std::vector<float>> &planes, size_t width )
+{
+	const size_t nc = planes.size();
+	const size_t n = nc * width;
+	const int bits = el.bit_depth;
+	const float maxv = static_cast<float>( ( 1U << bits ) - 1 );
+	std::vector<uint32_t> q( n );
+	for ( size_t d = 0; d != n; ++d )
+		q[d] = ref_quantize( planes[d % nc][d / nc], maxv );
+
+	std::vector<char> out;
+	if ( bits == 8 )
+	{
+		for ( uint32_t v: q )
+			out.push_back( static_cast<char>( v ) );
+	}
+	else if ( bits == 16 || ( bits == 12 && el.packing != 0 ) )
+	{
+		const int shift = ( bits == 12 && el.packing == 1 ) ? 4 : 0;
+		for ( uint32_t v: q )
+			put( out, v << shift, 2, e );
+	}
+	else if ( el.packing != 0 )
+	{
+		// 10 bit, 3 datums to a word
+		const int shift = el.packing == 1 ? 2 : 0;
+		for ( size_t d = 0; d < n; d += 3 )
+		{
+			uint32_t w = 0;
+			for ( size_t i = 0; i != 3 && d + i < n; ++i )
+				w |= q[d + i] << ( 20 - static_cast<int>( i ) * 10 + shift );
+			put( out, w, 4, e );
+		}
+	}
+	else
+	{
+		// a stream of bits from the top of each word
+		uint32_t w = 0;
+		int used = 0;
+		for ( uint32_t v: q )
+		{
+			for ( int b = bits - 1; b >= 0; --b )
+			{
+				w |= ( ( v >> b ) & 1 ) << ( 31 - used );
+				if ( ++used == 32 )
+				{
+					put( out, w, 4, e );
+					w = 0;
+					used = 0;
+				}
+			}
+		}
+		if ( used > 0 )
+			put( out, w, 4, e );
+	}
+
+	// lines start on a 32-bit word
+	while ( out.size() % 4 )
+		out.push_back( 0 );
+	return out;
+}
+
+std::vector<std::vector<float>> make_planes( int chans, size_t width, std::mt19937 &gen )
+{
+	std::uniform_real_distribution<float> dist( -0.1F, 1.1F );
+	const float special[] = { 0.F, 1.F, -0.25F, 1.25F, std::numeric_limits<float>::quiet_NaN(), 0.5F };
+	std::vector<std::vector<float>> planes( static_cast<size_t>( chans ) );
+	for ( size_t c = 0; c != planes.size(); ++c )
+	{
+		planes[c].resize( width );
+		for ( size_t x = 0; x != width; ++x )
+			planes[c][x] = dist( gen );
+		// rotate the out of range values through the channels
+		planes[c][( c + 1 ) % width] = special[c % 6];
+		planes[c][( c + 4 ) % width] = special[( c + 3 ) % 6];
+	}
+	return planes;
+}
+
+////////////////////////////////////////
+
+// packs random lines and compares to the reference, then unpacks
+// them (when unpack_line handles the depth) and checks the values
+void check_line( base::unit_test &test, int bits, uint16_t packing, std::mt19937 &gen )
+{
+	size_t packErr = 0, unpackErr = 0, count = 0;
+	// the writer always fills words for 10 and 12 bits
+	const bool canPack = packing != 0 || bits == 8 || bits == 16;
+	const bool canUnpack = bits == 10 || bits == 12;
+	for ( base::endianness e: kEndians )
+	{
+		const bool swap = e != base::endianness::NATIVE;
+		for ( int chans: kChans )
+		{
+			dpx::element el;
+			el.desc = chan_desc( chans );
+			el.bit_depth = static_cast<uint8_t>( bits );
+			el.packing = packing;
+
+			for ( size_t width: kWidths )
+			{
+				++count;
+				auto planes = make_planes( chans, width, gen );
+				std::vector<char> ref = ref_pack( el, e, planes, width );
+				if ( ref.size() != dpx::line_bytes( el, static_cast<uint32_t>( width ) ) )
+				{
+					test.failure( "{0} bit packing {1} {2} {3}x{4}: line_bytes {5}, reference {6}", bits, packing, endian_name( e ), width, chans, dpx::line_bytes( el, static_cast<uint32_t>( width ) ), ref.size() );
+					continue;
+				}
+
+				std::vector<char> line = ref;
+				if ( canPack )
+				{
+					std::vector<const float *> pp;
+					for ( auto &p: planes )
+						pp.push_back( p.data() );
+					std::fill( line.begin(), line.end(), char( 0x55 ) );
+					dpx::pack_line( el, swap, line.data(), pp.data(), chans, width );
+					if ( line != ref )
+					{
+						++packErr;
+						test.failure( "{0} bit packing {1} {2} {3}x{4}: packed line differs from reference", bits, packing, endian_name( e ), width, chans );
+					}
+				}
+
+				if ( ! canUnpack )
+					continue;
+
+				std::vector<std::vector<uint16_t>> out( static_cast<size_t>( chans ), std::vector<uint16_t>( width ) );
+				std::vector<uint16_t *> op;
+				for ( auto &p: out )
+					op.push_back( p.data() );
+				dpx::unpack_line( el, swap, ref.data(), op.data(), chans, width );
+				const float maxv = static_cast<float>( ( 1U << bits ) - 1 );
+				for ( size_t c = 0; c != out.size(); ++c )
+				{
+					for ( size_t x = 0; x != width; ++x )
+					{
+						uint16_t exp = ref_widen( ref_quantize( planes[c][x], maxv ), bits );
+						if ( out[c][x] != exp )
+						{
+							++unpackErr;
+							test.failure( "{0} bit packing {1} {2} {3}x{4}: channel {5} pixel {6} unpacked {7}, expected {8}", bits, packing, endian_name( e ), width, chans, c, x, out[c][x], exp );
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if ( canPack && packErr == 0 )
+		test.success( "{0} bit packing {1}: {2} lines packed as the reference", bits, packing, count );
+	if ( canUnpack && unpackErr == 0 )
+		test.success( "{0} bit packing {1}: {2} lines unpacked as the reference", bits, packing, count );
+}
+
+////////////////////////////////////////
+
+void check_header( base::unit_test &test, base::endianness e )
+{
+	dpx::header h;
+	h.endian = e;
+	h.orientation = 2;
+	h.width = 1920;
+	h.height = 1080;
+	h.file_size = 8 * 1024 * 1024;
+	h.file_name = "shot.0001.dpx";
+	h.create_time = "2018:01:02:03:04:05";
+	h.creator = "test";
+	h.project = "project";
+	h.copyright = "copyright";
+	h.input_device = "scanner";
+	h.frame_rate = 24.F;
+	h.timecode = 0x01020304;
+	h.userbits = 0;
+
+	dpx::element a;
+	a.ref_low_data = 95;
+	a.ref_low_quantity = 0.F;
+	a.ref_high_data = 685;
+	a.ref_high_quantity = 2.048F;
+	a.desc = dpx::DESC_RGB;
+	a.xfer = dpx::XFER_PRINTING_DENSITY;
+	a.colorimetric = dpx::XFER_PRINTING_DENSITY;
+	a.bit_depth = 10;
+	a.packing = 1;
+	a.data_offset = static_cast<uint32_t>( dpx::kHeaderSize );
+	a.description = "picture";
+	h.elements.push_back( a );
+
+	dpx::element b;
+	b.desc = dpx::DESC_ALPHA;
+	b.bit_depth = 16;
+	b.packing = 0;
+	b.data_offset = a.data_offset + static_cast<uint32_t>( dpx::line_bytes( a, h.width ) * h.height );
+	b.eol_padding = 4;
+	b.description = "matte";
+	h.elements.push_back( b );
+
+	// unset aspect, left as 0
+	std::vector<char> buf( dpx::kHeaderSize );
+	dpx::write_header( buf.data(), h );
+	dpx::header r = dpx::read_header( buf.data(), buf.size() );
+
+	const char *en = endian_name( e );
+	test.test( r.endian == h.endian, "{0} endian header: endianness", en );
+	test.test( ! r.cineon, "{0} endian header: not cineon", en );
+	test.test( r.image_offset == h.image_offset, "{0} endian header: image offset {1}", en, r.image_offset );
+	test.test( r.file_size == h.file_size, "{0} endian header: file size {1}", en, r.file_size );
+	test.test( r.orientation == h.orientation, "{0} endian header: orientation {1}", en, r.orientation );
+	test.test( r.width == h.width && r.height == h.height, "{0} endian header: size {1}x{2}", en, r.width, r.height );
+	test.test( r.file_name == h.file_name && r.create_time == h.create_time && r.creator == h.creator &&
+			   r.project == h.project && r.copyright == h.copyright && r.input_device == h.input_device,
+			   "{0} endian header: strings", en );
+	test.test( r.aspect_h == h.aspect_h && r.aspect_v == h.aspect_v, "{0} endian header: aspect {1}:{2}", en, r.aspect_h, r.aspect_v );
+	test.test( r.frame_rate == h.frame_rate, "{0} endian header: frame rate {1}", en, r.frame_rate );
+	test.test( r.timecode == h.timecode && r.userbits == h.userbits, "{0} endian header: time code", en );
+
+	bool elemOK = r.elements.size() == h.elements.size();
+	for ( size_t i = 0; elemOK && i != h.elements.size(); ++i )
+	{
+		const dpx::element &x = h.elements[i];
+		const dpx::element &y = r.elements[i];
+		elemOK = x.data_sign == y.data_sign &&
+			x.ref_low_data == y.ref_low_data && x.ref_low_quantity == y.ref_low_quantity &&
+			x.ref_high_data == y.ref_high_data && x.ref_high_quantity == y.ref_high_quantity &&
+			x.desc == y.desc && x.xfer == y.xfer && x.colorimetric == y.colorimetric &&
+			x.bit_depth == y.bit_depth && x.packing == y.packing && x.encoding == y.encoding &&
+			x.data_offset == y.data_offset && x.eol_padding == y.eol_padding &&
+			x.eoi_padding == y.eoi_padding && x.description == y.description;
+	}
+	test.test( elemOK, "{0} endian header: {1} elements", en, r.elements.size() );
+
+	h.aspect_h = 4;
+	h.aspect_v = 3;
+	h.frame_rate = 0.F;
+	dpx::write_header( buf.data(), h );
+	r = dpx::read_header( buf.data(), buf.size() );
+	test.test( r.aspect_h == 4 && r.aspect_v == 3 && r.frame_rate == 0.F, "{0} endian header: aspect {1}:{2} frame rate {3}", en, r.aspect_h, r.aspect_v, r.frame_rate );
+}
+
+int safemain( int argc, char *argv[] )
+{
+	base::unit_test test( "dpx" );
+
+	base::cmd_line options( argv[0] );
+	test.setup( options );
+
+	try
+	{
+		options.parse( argc, argv );
+	}
+	catch ( ... )
+	{
+		throw_add( "parsing command line arguments" );
+	}
+
+	std::mt19937 gen( 42 );
+
+	test["pack_8"] = [&]( void )
+	{
+		check_line( test, 8, 0, gen );
+	};
+
+	test["pack_10"] = [&]( void )
+	{
+		check_line( test, 10, 1, gen );
+		check_line( test, 10, 2, gen );
+	};
+
+	test["pack_12"] = [&]( void )
+	{
+		check_line( test, 12, 1, gen );
+		check_line( test, 12, 2, gen );
+	};
+
+	test["pack_16"] = [&]( void )
+	{
+		check_line( test, 16, 0, gen );
+	};
+
+	test["unpack_filled"] = [&]( void )
+	{
+		check_line( test, 10, 0, gen );
+		check_line( test, 12, 0, gen );
+	};
+
+	test["header"] = [&]( void )
+	{
+		for ( base::endianness e: kEndians )
+			check_header( test, e );
+	};
+
+	test.run( options );
+	test.clean();
+
+	return - static_cast<int>( test.failure_count() );
+}
+
+}
+
+int main( int argc, char *argv[] )
+{
+	try
+	{
+		return safemain( argc, argv );
+	}
+	catch ( const std::exception &e )
+	{
+		base::print_exception( std::cerr, e );
+	}
+	return -1;
+}
@@ -0,0 +1,377 @@
+//
+// Copyright (c) 2018 Kimball Thurston
+// All rights reserved.
+// Copyrights licensed under the MIT License.
+// See the accompanying LICENSE.txt file for terms
+//
+
+#include <base/contract.h>
+#include <base/unit_test.h>
+#include <base/cmd_line.h>
+#include <media/frame_cache.h>
+#include <media/image.h>
+#include <media/image_buffer.h>
+#include <media/layer.h>
+#include <algorithm>
+#include <vector>
+
+
+////////////////////////////////////////
+
+
+namespace
+{
+
+using namespace media;
+
+const std::string kTrack( "file:///shot.#.exr#t/" );
+
+// counts the planes retrieved from the source images
+size_t theFills = 0;
+
+/// A two plane float image, the value of each pixel computed from the
+/// frame, plane and position
+class test_image : public image
+{
+public:
+	explicit test_image( int64_t f )
+		: image( area_rect::from_points( 0, 0, 15, 7 ) ), _frame( f )
+	{
+		plane_layout pl;
+		pl._bits = 32;
+		pl._floating = true;
+		pl._unsigned = false;
+		register_plane( "R", pl, 0.0 );
+		register_plane( "G", pl, 0.0 );
+	}
+
+	static float value( int64_t f, size_t plane, int64_t x, int64_t y )
+	{
+		return static_cast<float>( f * 1000 + static_cast<int64_t>( plane ) * 100 + y * 16 + x );
+	}
+
+protected:
+	bool storage_interleaved( void ) const override
+	{
+		return false;
+	}
+
+	void fill_plane( size_t plane, image_buffer &buffer ) override
+	{
+		++theFills;
+		for ( int64_t y = buffer.y1(); y <= buffer.y2(); ++y )
+		{
+			float *line = static_cast<float *>( buffer.row( y ) );
+			for ( int64_t x = buffer.x1(); x <= buffer.x2(); ++x )
+				line[x - buffer.x1()] = value( _frame, plane, x, y );
+		}
+	}
+
+	void fill_image( image_buffer & ) override
+	{
+		throw_not_yet();
+	}
+
+private:
+	int64_t _frame;
+};
+
+/// Frames 1 - 10 of test images
+class test_track : public video_track
+{
+public:
+	test_track( void )
+		: video_track( "t", std::string(), 1, 10, sample_rate( 24, 1 ), track_description( TRACK_VIDEO ) )
+	{
+	}
+
+protected:
+	frame *doRead( int64_t f ) override
+	{
+		std::unique_ptr<frame> ret( new frame( f ) );
+		layer &l = ret->register_layer( std::string() );
+		l.add_view( std::string() ).store( std::make_shared<test_image>( f ) );
+		return ret.release();
+	}
+
+	void doWrite( int64_t , const frame & ) override
+	{
+		throw_logic( "test track asked to write a frame" );
+	}
+};
+
+frame_cache::key make_key( int64_t f, const std::string &track = kTrack )
+{
+	return frame_cache::key{ track, f, std::string(), std::string() };
+}
+
+std::shared_ptr<image> make_image( int64_t f )
+{
+	return std::make_shared<test_image>( f );
+}
+
+// true if the frames in keep are cached, and the others up to last
+// are not (finding them changes the order of use)
+bool holds( frame_cache &c, const std::vector<int64_t> &keep, int64_t last )
+{
+	bool ret = true;
+	for ( int64_t f = 1; f <= last; ++f )
+	{
+		bool want = std::find( keep.begin(), keep.end(), f ) != keep.end();
+		ret = ret && ( static_cast<bool>( c.find( make_key( f ) ) ) == want );
+	}
+	return ret;
+}
+
+////////////////////////////////////////
+
+void check_eviction_order( base::unit_test &test )
+{
+	frame_cache c( 300 );
+	for ( int64_t f = 1; f <= 3; ++f )
+		c.insert( make_key( f ), make_image( f ), 100 );
+	// makes 1 the most recently used, so 2 and then 3 are the first
+	// to go
+	c.find( make_key( 1 ) );
+	c.insert( make_key( 4 ), make_image( 4 ), 100 );
+	c.insert( make_key( 5 ), make_image( 5 ), 100 );
+	frame_cache::statistics s = c.stats();
+	bool ok = holds( c, { 1, 4, 5 }, 5 );
+	test.test( ok && s.entries == 3 && s.bytes == 300 && s.evictions == 2,
+			   "least recently used evicted first: {0} entries, {1} bytes, {2} evictions", s.entries, s.bytes, s.evictions );
+}
+
+void check_set_budget( base::unit_test &test )
+{
+	frame_cache c( 1000 );
+	for ( int64_t f = 1; f <= 5; ++f )
+		c.insert( make_key( f ), make_image( f ), 100 );
+	c.set_budget( 250 );
+	frame_cache::statistics s = c.stats();
+	bool ok = holds( c, { 4, 5 }, 5 );
+	test.test( ok && s.entries == 2 && s.bytes == 200 && s.budget == 250 && s.evictions == 3,
+			   "set_budget evicts down to the budget: {0} entries, {1} bytes, {2} evictions", s.entries, s.bytes, s.evictions );
+
+	c.set_budget( 0 );
+	s = c.stats();
+	test.test( s.entries == 0 && s.bytes == 0, "a budget of 0 evicts everything: {0} entries, {1} bytes", s.entries, s.bytes );
+}
+
+void check_too_large( base::unit_test &test )
+{
+	frame_cache c( 100 );
+	c.insert( make_key( 1 ), make_image( 1 ), 60 );
+	c.insert( make_key( 2 ), make_image( 2 ), 101 );
+	frame_cache::statistics s = c.stats();
+	bool ok = holds( c, { 1 }, 2 );
+	test.test( ok && s.entries == 1 && s.bytes == 60 && s.evictions == 0,
+			   "entry larger than the budget not kept, nothing evicted for it: {0} entries, {1} bytes, {2} evictions", s.entries, s.bytes, s.evictions );
+
+	// replacing a kept entry with one too large drops it
+	c.insert( make_key( 1 ), make_image( 1 ), 200 );
+	s = c.stats();
+	test.test( s.entries == 0 && s.bytes == 0, "entry replaced by one larger than the budget dropped: {0} entries, {1} bytes", s.entries, s.bytes );
+}
+
+void check_pinning( base::unit_test &test )
+{
+	frame_cache c( 300 );
+	c.pin( kTrack, 1, 3 );
+	for ( int64_t f = 1; f <= 5; ++f )
+		c.insert( make_key( f ), make_image( f ), 100 );
+	frame_cache::statistics s = c.stats();
+	// the pinned frames stay even though they are over budget, the
+	// others are evicted as soon as they are added
+	bool ok = holds( c, { 1, 2, 3 }, 5 );
+	test.test( ok && s.entries == 3 && s.bytes == 300 && s.evictions == 2,
+			   "pinned frames kept: {0} entries, {1} bytes, {2} evictions", s.entries, s.bytes, s.evictions );
+
+	c.set_budget( 100 );
+	s = c.stats();
+	test.test( s.entries == 3 && s.bytes == 300, "pinned frames kept past the budget: {0} entries, {1} bytes", s.entries, s.bytes );
+
+	// other tracks are not pinned by it
+	c.insert( make_key( 2, "other" ), make_image( 2 ), 50 );
+	s = c.stats();
+	test.test( s.entries == 3 && ! c.find( make_key( 2, "other" ) ), "frame of another track not pinned: {0} entries", s.entries );
+
+	// moving the window unpins the frames left behind
+	c.pin( kTrack, 3, 4 );
+	s = c.stats();
+	ok = holds( c, { 3 }, 5 );
+	test.test( ok && s.entries == 1 && s.bytes == 100, "moving the pinned range evicts the frames left: {0} entries, {1} bytes", s.entries, s.bytes );
+
+	c.unpin( kTrack );
+	c.set_budget( 0 );
+	s = c.stats();
+	test.test( s.entries == 0 && s.bytes == 0, "unpinned frames evicted: {0} entries, {1} bytes", s.entries, s.bytes );
+}
+
+void check_reinsert( base::unit_test &test )
+{
+	frame_cache c( 1000 );
+	c.insert( make_key( 1 ), make_image( 1 ), 100 );
+	c.insert( make_key( 2 ), make_image( 2 ), 100 );
+	auto img = make_image( 1 );
+	c.insert( make_key( 1 ), img, 300 );
+	frame_cache::statistics s = c.stats();
+	test.test( s.entries == 2 && s.bytes == 400 && c.find( make_key( 1 ) ) == img,
+			   "re-inserting replaces the entry and its bytes: {0} entries, {1} bytes", s.entries, s.bytes );
+
+	c.insert( make_key( 1 ), img, 50 );
+	s = c.stats();
+	test.test( s.entries == 2 && s.bytes == 150, "re-inserting smaller corrects the bytes: {0} entries, {1} bytes", s.entries, s.bytes );
+
+	c.clear();
+	s = c.stats();
+	test.test( s.entries == 0 && s.bytes == 0, "clear: {0} entries, {1} bytes", s.entries, s.bytes );
+}
+
+void check_counters( base::unit_test &test )
+{
+	frame_cache c( 200 );
+	c.find( make_key( 1 ) );
+	c.insert( make_key( 1 ), make_image( 1 ), 100 );
+	c.find( make_key( 1 ) );
+	c.find( make_key( 1 ) );
+	c.find( make_key( 2 ) );
+	c.insert( make_key( 2 ), make_image( 2 ), 100 );
+	c.insert( make_key( 3 ), make_image( 3 ), 100 );
+	frame_cache::statistics s = c.stats();
+	test.test( s.hits == 2 && s.misses == 2 && s.evictions == 1 && s.entries == 2 && s.bytes == 200 && s.budget == 200,
+			   "counters: {0} hits, {1} misses, {2} evictions, {3} entries, {4} bytes, budget {5}",
+			   s.hits, s.misses, s.evictions, s.entries, s.bytes, s.budget );
+}
+
+bool check_frame( video_track &t, int64_t f )
+{
+	std::shared_ptr<frame> frm = t.at( f );
+	std::shared_ptr<image> img = frm->find_image( 0, size_t( 0 ) );
+	bool ret = img && img->size() == 2;
+	for ( size_t p = 0; ret && p != img->size(); ++p )
+	{
+		image_buffer b = image_buffer::simple_buffer<float>( 0, 0, 15, 7 );
+		img->retrieve( p, b );
+		for ( int64_t y = 0; y <= 7; ++y )
+		{
+			const float *line = static_cast<const float *>( b.row( y ) );
+			for ( int64_t x = 0; x <= 15; ++x )
+				ret = ret && line[x] == test_image::value( f, p, x, y );
+		}
+	}
+	return ret;
+}
+
+void check_cached_track( base::unit_test &test )
+{
+	// two 16 x 8 float planes a frame
+	const size_t frameBytes = 16 * 8 * 4 * 2;
+	frame_cache c( frameBytes * 3 );
+	auto src = std::make_shared<test_track>();
+	cached_track t( src, base::uri( std::string( "file:///shot.%23.exr" ) ), c );
+	test.test( t.begin() == 1 && t.end() == 10 && ! t.cache_key().empty(), "cached track: frames {0} - {1}, key {2}", t.begin(), t.end(), t.cache_key() );
+
+	theFills = 0;
+	bool ok = true;
+	for ( int64_t f = 1; f <= 3; ++f )
+		ok = ok && check_frame( t, f );
+	const size_t firstFills = theFills;
+	for ( int64_t f = 1; f <= 3; ++f )
+		ok = ok && check_frame( t, f );
+	frame_cache::statistics s = c.stats();
+	test.test( ok && firstFills == 6 && theFills == 6 && s.hits == 3 && s.entries == 3 && s.bytes == frameBytes * 3,
+			   "cached track: decoded once ({0} fills), then {1} hits, {2} entries, {3} bytes", theFills, s.hits, s.entries, s.bytes );
+
+	// the pinned frames survive reading past the budget
+	t.pin( 1, 2 );
+	for ( int64_t f = 4; f <= 6; ++f )
+		ok = ok && check_frame( t, f );
+	s = c.stats();
+	test.test( ok && s.entries == 3 && static_cast<bool>( c.find( frame_cache::key{ t.cache_key(), 1, std::string(), std::string() } ) ) &&
+			   static_cast<bool>( c.find( frame_cache::key{ t.cache_key(), 2, std::string(), std::string() } ) ) &&
+			   static_cast<bool>( c.find( frame_cache::key{ t.cache_key(), 6, std::string(), std::string() } ) ),
+			   "cached track: pinned frames kept, {0} entries, {1} evictions", s.entries, s.evictions );
+
+	const size_t before = theFills;
+	ok = check_frame( t, 1 ) && check_frame( t, 2 );
+	test.test( ok && theFills == before, "cached track: pinned frames read from the cache ({0} fills)", theFills - before );
+
+	t.unpin();
+	for ( int64_t f = 7; f <= 9; ++f )
+		ok = ok && check_frame( t, f );
+	s = c.stats();
+	test.test( ok && s.entries == 3 && ! c.find( frame_cache::key{ t.cache_key(), 1, std::string(), std::string() } ),
+			   "cached track: unpinned frames evicted, {0} entries, {1} evictions", s.entries, s.evictions );
+}
+
+int safemain( int argc, char *argv[] )
+{
+	base::unit_test test( "frame_cache" );
+
+	base::cmd_line options( argv[0] );
+	test.setup( options );
+
+	try
+	{
+		options.parse( argc, argv );
+	}
+	catch ( ... )
+	{
+		throw_add( "parsing command line arguments" );
+	}
+
+	test["eviction_order"] = [&]( void )
+	{
+		check_eviction_order( test );
+	};
+
+	test["set_budget"] = [&]( void )
+	{
+		check_set_budget( test );
+	};
+
+	test["too_large"] = [&]( void )
+	{
+		check_too_large( test );
+	};
+
+	test["pinning"] = [&]( void )
+	{
+		check_pinning( test );
+	};
+
+	test["reinsert"] = [&]( void )
+	{
+		check_reinsert( test );
+	};
+
+	test["counters"] = [&]( void )
+	{
+		check_counters( test );
+	};
+
+	test["cached_track"] = [&]( void )
+	{
+		check_cached_track( test );
+	};
+
+	test.run( options );
+	test.clean();
+
+	return - static_cast<int>( test.failure_count() );
+}
+
+}
+
+int main( int argc, char *argv[] )
+{
+	try
+	{
+		return safemain( argc, argv );
+	}
+	catch ( const std::exception &e )
+	{
+		base::print_exception( std::cerr, e );
+	}
+	return -1;
+}